@@ -0,0 +1,65 @@
+# oglc_bake_textures(<resource library> [SRGB] [PREMULTIPLIED] [NO_MIPS]
+#                    [QOI] [FORMAT rgba8|bc1|bc3|bc7]
+#                    [QUALITY fast|normal|high] [FILTER box|kaiser|lanczos]
+#                    <images>...)
+#
+# Adds images to a cmrc resource library as KTX2 textures baked by
+# oglc-texbake at build time, with their mip chains, so they upload
+# without decoding. FORMAT picks block compression, RGBA8 by default,
+# and QUALITY how hard the encoder tries. FILTER picks the mip filter,
+# PREMULTIPLIED says the colours are already multiplied by alpha. Each
+# lands at the root as <name>.ktx2. QOI bakes to <name>.qoi instead:
+# lossless and without mips, decoded at load time but much faster than
+# PNG. With OGLC_BAKE_TEXTURES off the images are added as they are
+# instead, for the runtime decoder.
+function(oglc_bake_textures rc)
+  cmake_parse_arguments(
+    ARG "SRGB;PREMULTIPLIED;NO_MIPS;QOI" "FORMAT;QUALITY;FILTER" "" ${ARGN}
+  )
+  if(NOT OGLC_BAKE_TEXTURES)
+    cmrc_add_resources(${rc} ${ARG_UNPARSED_ARGUMENTS})
+    return()
+  endif()
+
+  set(flags)
+  if(ARG_SRGB)
+    list(APPEND flags --srgb)
+  endif()
+  if(ARG_PREMULTIPLIED)
+    list(APPEND flags --premultiplied)
+  endif()
+  if(ARG_NO_MIPS)
+    list(APPEND flags --no-mips)
+  endif()
+  if(ARG_FORMAT)
+    list(APPEND flags --format ${ARG_FORMAT})
+  endif()
+  if(ARG_QUALITY)
+    list(APPEND flags --quality ${ARG_QUALITY})
+  endif()
+  if(ARG_FILTER)
+    list(APPEND flags --filter ${ARG_FILTER})
+  endif()
+
+  set(ext ktx2)
+  if(ARG_QOI)
+    set(ext qoi)
+  endif()
+
+  set(dir "${CMAKE_CURRENT_BINARY_DIR}/baked")
+  set(baked)
+  foreach(image IN LISTS ARG_UNPARSED_ARGUMENTS)
+    get_filename_component(input "${image}" ABSOLUTE)
+    get_filename_component(name "${image}" NAME_WE)
+    add_custom_command(
+      OUTPUT "${dir}/${name}.${ext}"
+      COMMAND "${CMAKE_COMMAND}" -E make_directory "${dir}"
+      COMMAND oglc-texbake "${input}" "${dir}/${name}.${ext}" ${flags}
+      DEPENDS oglc-texbake "${input}"
+      COMMENT "Baking ${image}"
+      VERBATIM
+    )
+    list(APPEND baked "${dir}/${name}.${ext}")
+  endforeach()
+  cmrc_add_resources(${rc} WHENCE "${dir}" ${baked})
+endfunction()
@@ -0,0 +1,113 @@
+#ifndef OGLC_APP_HPP_INCLUDED
+#define OGLC_APP_HPP_INCLUDED
+
+#include "oglc/bench.hpp"
+#include "oglc/context.hpp"
+#include "oglc/debug.hpp"
+#include "oglc/gltrace.hpp"
+#include "oglc/gpuprof.hpp"
+#include "oglc/pacing.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/recorder.hpp"
+#include "oglc/startup.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+
+namespace oglc {
+  // Set OGLC_TRACE to a path to get a chrome://tracing file of what the
+  // CPU profiler, and the active GPU profiler if there is one, recorded.
+  // runLoop() does this when it's done; examples with a loop of their own
+  // call it at the end.
+  inline void writeTraceFromEnv() {
+    const char* path = std::getenv("OGLC_TRACE");
+    if (!path)
+      return;
+    TraceWriter trace;
+    CpuProfiler::instance().exportTo(trace);
+    if (GpuProfiler* gpu = GpuProfiler::active())
+      gpu->exportTo(trace, CpuProfiler::instance().threadId());
+    trace.writeFile(path);
+  }
+
+  // The examples' main loop: run one frame, present, pump events. With
+  // --bench the loop is uncapped and ends after the benchmark, printing
+  // its report. With --record every frame is also captured to disk, and
+  // --frames N stops after N frames, saving the last with --capture. The
+  // first present closes the startup timeline, printed with --startup.
+  // With --on-demand a frame is only drawn after Context::requestRedraw()
+  // or input, otherwise the loop sleeps in the event queue; --frames then
+  // counts wakeups too, so headless runs still end. --fps, --vsync and
+  // --jit go through FramePacer. OGLC_TRACE, see writeTraceFromEnv().
+  template <class F>
+  void runLoop(Context& ctx, const AppOptions& opts, F&& frame) {
+    FramePacer pacer(opts, ctx);
+    Bench bench(opts, ctx);
+    if (bench.active())
+      ctx.swapInterval(0);
+    Recording recording(opts, ctx);
+
+    std::optional<StartupPhase> first_frame;
+    first_frame.emplace("first frame");
+    uint64_t drawn = 0, idle = 0, idle_ns = 0, loop_start = monotonicNanos();
+    for (uint64_t n = 1; !ctx.shouldClose(); n++) {
+      if (opts.onDemand && !ctx.consumeRedraw()) {
+        OGLC_ZONE("idle");
+        uint64_t start = monotonicNanos();
+        ctx.waitEvents(0.1);
+        idle_ns += monotonicNanos() - start;
+        idle++;
+        if (n == opts.frames)
+          break;
+        continue;
+      }
+      // a just-in-time frame wants the input as of now
+      if (pacer.beginFrame())
+        ctx.pollEvents();
+      drawn++;
+      frame();
+      recording.capture(ctx);
+      bool last = n == opts.frames;
+      if (last && !opts.capturePath.empty())
+        readFramebuffer(ctx.width(), ctx.height()).writePpm(opts.capturePath);
+      pacer.beforeSwap();
+      {
+        OGLC_ZONE("swap");
+        ctx.swap();
+      }
+      pacer.endFrame();
+      if (first_frame) {
+        first_frame.reset();
+        StartupTimeline::instance().firstFrame();
+        if (opts.startupReport)
+          StartupTimeline::instance().print();
+      }
+      if (DebugLog::enabled())
+        DebugLog::instance().endFrame();
+      if (GlTracer::active())
+        GlTracer::instance().endFrame();
+      OGLC_FRAME_MARK();
+      ctx.pollEvents();
+
+      if (last || (bench.active() && !bench.frameDone()))
+        break;
+    }
+    recording.finish();
+    if (opts.onDemand) {
+      double total = double(monotonicNanos() - loop_start);
+      std::cerr << "on-demand: " << drawn << " frames drawn, " << idle
+                << " idle wakeups (" << std::fixed << std::setprecision(1)
+                << 100.0 * idle_ns / total << "% of the time idle)\n"
+                << std::defaultfloat;
+    }
+    if (DebugLog::enabled())
+      DebugLog::instance().printSummary();
+    GlTracer::instance().stop();
+    if (bench.active())
+      bench.report();
+    writeTraceFromEnv();
+  }
+}  // namespace oglc
+#endif
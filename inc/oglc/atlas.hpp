@@ -0,0 +1,366 @@
+#ifndef OGLC_ATLAS_HPP_INCLUDED
+#define OGLC_ATLAS_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "oglc/debug.hpp"
+#include "oglc/linalg.hpp"
+
+namespace oglc {
+  // Packs rectangles into a fixed size page with MaxRects: the free space
+  // is kept as every maximal free rectangle, overlapping, and each insert
+  // takes the one it fits best by its shorter leftover side. Removing a
+  // rectangle rebuilds the free list from the ones left, which costs a
+  // pass over them but keeps every maximal free rectangle on offer.
+  class RectPacker {
+  public:
+    struct Rect {
+      int x      = 0;
+      int y      = 0;
+      int width  = 0;
+      int height = 0;
+
+      int right() const { return x + width; }
+      int bottom() const { return y + height; }
+      bool contains(const Rect& o) const {
+        return o.x >= x && o.y >= y && o.right() <= right() &&
+          o.bottom() <= bottom();
+      }
+      bool overlaps(const Rect& o) const {
+        return o.x < right() && x < o.right() && o.y < bottom() &&
+          y < o.bottom();
+      }
+      bool operator==(const Rect&) const = default;
+    };
+
+    RectPacker(int width, int height) : m_width(width), m_height(height) {
+      if (width <= 0 || height <= 0)
+        throw std::invalid_argument("a packer needs a positive size");
+      clear();
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    bool empty() const { return m_used == 0; }
+    // Share of the page in use, 0 to 1.
+    double occupancy() const {
+      return double(m_used) / (double(m_width) * double(m_height));
+    }
+
+    void clear() {
+      m_free.assign(1, {0, 0, m_width, m_height});
+      m_live.clear();
+      m_used = 0;
+    }
+
+    std::optional<Rect> insert(int width, int height) {
+      if (width <= 0 || height <= 0)
+        return std::nullopt;
+      const Rect* best = nullptr;
+      int best_short = std::numeric_limits<int>::max();
+      int best_long  = std::numeric_limits<int>::max();
+      for (const Rect& f : m_free) {
+        if (f.width < width || f.height < height)
+          continue;
+        int dw = f.width - width, dh = f.height - height;
+        int s = std::min(dw, dh), l = std::max(dw, dh);
+        if (s < best_short || (s == best_short && l < best_long)) {
+          best       = &f;
+          best_short = s;
+          best_long  = l;
+        }
+      }
+      if (!best)
+        return std::nullopt;
+
+      Rect placed {best->x, best->y, width, height};
+      cut(placed);
+      m_live.push_back(placed);
+      m_used += int64_t(width) * height;
+      return placed;
+    }
+
+    // Frees a rectangle insert() returned. The free list is rebuilt from
+    // the rectangles still placed, so it is maximal again, as if those
+    // had been the only ones ever inserted.
+    void remove(const Rect& r) {
+      auto it = std::find(m_live.begin(), m_live.end(), r);
+      if (it == m_live.end())
+        return;
+      *it = m_live.back();
+      m_live.pop_back();
+      m_used -= int64_t(r.width) * r.height;
+      m_free.assign(1, {0, 0, m_width, m_height});
+      for (const Rect& l : m_live)
+        cut(l);
+    }
+
+  private:
+    // Every free rectangle the placed one cuts into splits into the up to
+    // four maximal ones around it.
+    void cut(const Rect& placed) {
+      std::vector<Rect> split;
+      for (size_t i = 0; i < m_free.size();) {
+        Rect f = m_free[i];
+        if (!f.overlaps(placed)) {
+          i++;
+          continue;
+        }
+        m_free[i] = m_free.back();
+        m_free.pop_back();
+        if (placed.x > f.x)
+          split.push_back({f.x, f.y, placed.x - f.x, f.height});
+        if (placed.right() < f.right())
+          split.push_back(
+            {placed.right(), f.y, f.right() - placed.right(), f.height});
+        if (placed.y > f.y)
+          split.push_back({f.x, f.y, f.width, placed.y - f.y});
+        if (placed.bottom() < f.bottom())
+          split.push_back(
+            {f.x, placed.bottom(), f.width, f.bottom() - placed.bottom()});
+      }
+      m_free.insert(m_free.end(), split.begin(), split.end());
+      prune();
+    }
+
+    // drops free rectangles inside others
+    void prune() {
+      for (size_t i = 0; i < m_free.size(); i++) {
+        for (size_t j = i + 1; j < m_free.size();) {
+          if (m_free[i].contains(m_free[j])) {
+            m_free[j] = m_free.back();
+            m_free.pop_back();
+          }
+          else if (m_free[j].contains(m_free[i])) {
+            m_free[i] = m_free[j];
+            m_free[j] = m_free.back();
+            m_free.pop_back();
+            j = i + 1;
+          }
+          else {
+            j++;
+          }
+        }
+      }
+    }
+
+    int m_width;
+    int m_height;
+    int64_t m_used = 0;
+    std::vector<Rect> m_free;
+    std::vector<Rect> m_live;  // placed, for rebuilding m_free
+  };
+
+  struct AtlasOptions {
+    int pageSize = 2048;
+    // Texels around each image repeating its edges, so bilinear filtering
+    // doesn't pull in the neighbours. 1 is enough without mips.
+    int gutter           = 2;
+    int maxPages         = 8;
+    gl::GLenum minFilter = gl::GL_LINEAR;
+    gl::GLenum magFilter = gl::GL_LINEAR;
+    std::string label;  // for GL debug output, pages get numbered
+  };
+
+  // Where an image landed in an atlas.
+  struct AtlasRegion {
+    int page   = 0;
+    int x      = 0;  // texels, gutter excluded
+    int y      = 0;
+    int width  = 0;
+    int height = 0;
+    vec4 uv {};  // u0, v0, u1, v1
+
+    // Texture coordinates in the image to texture coordinates in the
+    // page, for meshes made for a texture of their own.
+    vec2 remap(vec2 t) const {
+      return {
+        uv[0] + t[0] * (uv[2] - uv[0]), uv[1] + t[1] * (uv[3] - uv[1])};
+    }
+  };
+
+  // Many small RGBA8 images in a few large textures, so draws using any
+  // of them can share one binding. Images are added and removed at any
+  // time; each goes to the first page with room, and a new page is made
+  // when none has, up to maxPages. Rows go to the pages in the order
+  // given, like a texture of their own, so v runs the same way.
+  //
+  // GL thread only. Call release() while the context is alive.
+  class TextureAtlas {
+  public:
+    using Id = uint32_t;
+
+    explicit TextureAtlas(AtlasOptions options = {}) :
+      m_options(std::move(options)) {
+      if (m_options.pageSize <= 0 || m_options.gutter < 0)
+        throw std::invalid_argument("bad atlas page size or gutter");
+    }
+    TextureAtlas(const TextureAtlas&)            = delete;
+    TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+    // Copies width x height RGBA8 pixels in. Nothing if no page has room
+    // and there can't be another; remove() something and try again. An
+    // image that wouldn't fit an empty page with its gutter throws.
+    std::optional<Id> add(
+      std::span<const uint8_t> rgba, int width, int height) {
+      if (
+        width <= 0 || height <= 0 ||
+        rgba.size() != size_t(width) * size_t(height) * 4)
+        throw std::invalid_argument("image size doesn't match its pixels");
+      const int g = m_options.gutter;
+      if (
+        width > m_options.pageSize - g * 2 ||
+        height > m_options.pageSize - g * 2)
+        throw std::invalid_argument("image too large for an atlas page");
+      std::optional<RectPacker::Rect> slot;
+      size_t page = 0;
+      for (; page < m_pages.size() && !slot; page++)
+        slot = m_pages[page].packer.insert(width + g * 2, height + g * 2);
+      if (slot) {
+        page--;
+      }
+      else if (int(m_pages.size()) < m_options.maxPages) {
+        addPage();
+        slot = m_pages[page].packer.insert(width + g * 2, height + g * 2);
+      }
+      if (!slot)
+        return std::nullopt;
+
+      upload(m_pages[page].texture, *slot, rgba, width, height);
+      const float size = float(m_options.pageSize);
+      AtlasRegion r;
+      r.page   = int(page);
+      r.x      = slot->x + g;
+      r.y      = slot->y + g;
+      r.width  = width;
+      r.height = height;
+      r.uv     = {
+        float(r.x) / size, float(r.y) / size, float(r.x + width) / size,
+        float(r.y + height) / size};
+      Id id = m_next++;
+      m_entries.emplace(id, entry {r, *slot});
+      return id;
+    }
+
+    // The space is reused by later images; what was drawn there stays
+    // until then.
+    void remove(Id id) {
+      auto it = m_entries.find(id);
+      if (it == m_entries.end())
+        return;
+      m_pages[size_t(it->second.region.page)].packer.remove(it->second.slot);
+      m_entries.erase(it);
+    }
+
+    bool contains(Id id) const { return m_entries.count(id) != 0; }
+    const AtlasRegion& region(Id id) const {
+      auto it = m_entries.find(id);
+      if (it == m_entries.end())
+        throw std::out_of_range("no such atlas entry");
+      return it->second.region;
+    }
+
+    size_t size() const { return m_entries.size(); }
+    size_t pageCount() const { return m_pages.size(); }
+    gl::GLuint texture(int page) const {
+      return m_pages.at(size_t(page)).texture;
+    }
+    double occupancy(int page) const {
+      return m_pages.at(size_t(page)).packer.occupancy();
+    }
+
+    void release() {
+      for (auto& p : m_pages)
+        gl::glDeleteTextures(1, &p.texture);
+      m_pages.clear();
+      m_entries.clear();
+    }
+
+  private:
+    struct page {
+      gl::GLuint texture;
+      RectPacker packer;
+    };
+
+    struct entry {
+      AtlasRegion region;
+      RectPacker::Rect slot;  // gutter included
+    };
+
+    void addPage() {
+      using namespace gl;
+      const int size = m_options.pageSize;
+      GLuint texture = 0;
+      GLint bound    = 0;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+      glGenTextures(1, &texture);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(
+        GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_options.minFilter);
+      glTexParameteri(
+        GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_options.magFilter);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+      glTexImage2D(
+        GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+        nullptr);
+      glBindTexture(GL_TEXTURE_2D, GLuint(bound));
+      if (!m_options.label.empty()) {
+        labelObject(
+          GL_TEXTURE, texture,
+          m_options.label + " page " + std::to_string(m_pages.size()));
+      }
+      m_pages.push_back({texture, RectPacker(size, size)});
+    }
+
+    // The image with its edges repeated into the gutter, in one upload.
+    void upload(
+      gl::GLuint texture, const RectPacker::Rect& slot,
+      std::span<const uint8_t> rgba, int width, int height) {
+      using namespace gl;
+      const int g = m_options.gutter;
+      m_scratch.resize(size_t(slot.width) * size_t(slot.height) * 4);
+      for (int y = 0; y < slot.height; y++) {
+        int sy             = std::clamp(y - g, 0, height - 1);
+        const uint8_t* src = rgba.data() + size_t(sy) * width * 4;
+        uint8_t* dst       = m_scratch.data() + size_t(y) * slot.width * 4;
+        for (int x = 0; x < g; x++) {
+          std::memcpy(dst + x * 4, src, 4);
+          std::memcpy(dst + (g + width + x) * 4, src + (width - 1) * 4, 4);
+        }
+        std::memcpy(dst + g * 4, src, size_t(width) * 4);
+      }
+      GLint bound = 0;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glTexSubImage2D(
+        GL_TEXTURE_2D, 0, slot.x, slot.y, slot.width, slot.height, GL_RGBA,
+        GL_UNSIGNED_BYTE, m_scratch.data());
+      glBindTexture(GL_TEXTURE_2D, GLuint(bound));
+    }
+
+    AtlasOptions m_options;
+    std::vector<page> m_pages;
+    std::unordered_map<Id, entry> m_entries;
+    Id m_next = 1;
+    std::vector<uint8_t> m_scratch;  // one padded image
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,663 @@
+#ifndef OGLC_BCN_HPP_INCLUDED
+#define OGLC_BCN_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "oglc/workers.hpp"
+
+namespace oglc {
+  // S3TC and BPTC block compression, 4x4 texels a block.
+  enum class BlockFormat : uint8_t {
+    bc1,  // RGB and 1-bit alpha, 8 bytes a block
+    bc3,  // RGB and smooth alpha, 16 bytes
+    bc7,  // RGBA at much better quality, 16 bytes
+  };
+
+  // How hard the encoder tries.
+  enum class BlockQuality : uint8_t {
+    fast,    // bounding box endpoints
+    normal,  // principal axis endpoints, refined once
+    high,    // refined until it stops helping, best of every start
+  };
+
+  inline size_t blockBytes(BlockFormat f) {
+    return f == BlockFormat::bc1 ? 8 : 16;
+  }
+
+  inline size_t compressedBytes(BlockFormat f, int width, int height) {
+    return size_t((width + 3) / 4) * size_t((height + 3) / 4) * blockBytes(f);
+  }
+
+  namespace details {
+    // A block's texels, RGBA, in rows.
+    using block_texels = std::array<uint8_t, 64>;
+
+    struct rgba_f {
+      float c[4] = {};
+    };
+
+    // Nearest palette entry for each texel by squared RGBA distance, and
+    // the error summed over the texels in mask. Channels that shouldn't
+    // count have to be zeroed in both. Ties go to the lower index.
+    inline uint32_t nearest(
+      const uint8_t* texels, const uint8_t* palette, int n, uint8_t* idx,
+      uint16_t mask = 0xFFFF) {
+#ifdef __SSE2__
+      const __m128i zero = _mm_setzero_si128();
+      __m128i px[8];  // two texels each, as 16-bit
+      for (int i = 0; i < 4; i++) {
+        __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + i * 16));
+        px[i * 2]     = _mm_unpacklo_epi8(v, zero);
+        px[i * 2 + 1] = _mm_unpackhi_epi8(v, zero);
+      }
+      __m128i best[4], best_idx[4];
+      for (int g = 0; g < 4; g++) {
+        best[g]     = _mm_set1_epi32(INT32_MAX);
+        best_idx[g] = zero;
+      }
+      for (int j = 0; j < n; j++) {
+        uint32_t entry;
+        std::memcpy(&entry, palette + j * 4, 4);
+        __m128i pal   = _mm_unpacklo_epi8(_mm_set1_epi32(int(entry)), zero);
+        __m128i index = _mm_set1_epi32(j);
+        for (int g = 0; g < 4; g++) {
+          __m128i d0 = _mm_sub_epi16(px[g * 2], pal);
+          __m128i d1 = _mm_sub_epi16(px[g * 2 + 1], pal);
+          // r²+g², b²+a² per texel, then the pairs summed
+          __m128 s0 = _mm_castsi128_ps(_mm_madd_epi16(d0, d0));
+          __m128 s1 = _mm_castsi128_ps(_mm_madd_epi16(d1, d1));
+          __m128i dist = _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1))));
+          __m128i closer = _mm_cmplt_epi32(dist, best[g]);
+          best[g]        = _mm_or_si128(
+            _mm_and_si128(closer, dist), _mm_andnot_si128(closer, best[g]));
+          best_idx[g] = _mm_or_si128(
+            _mm_and_si128(closer, index),
+            _mm_andnot_si128(closer, best_idx[g]));
+        }
+      }
+      alignas(16) uint32_t dist[16], which[16];
+      for (int g = 0; g < 4; g++) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(dist + g * 4), best[g]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(which + g * 4), best_idx[g]);
+      }
+      uint32_t total = 0;
+      for (int i = 0; i < 16; i++) {
+        idx[i] = uint8_t(which[i]);
+        total += mask >> i & 1 ? dist[i] : 0;
+      }
+      return total;
+#else
+      uint32_t total = 0;
+      for (int i = 0; i < 16; i++) {
+        uint32_t best = UINT32_MAX;
+        for (int j = 0; j < n; j++) {
+          uint32_t d = 0;
+          for (int c = 0; c < 4; c++) {
+            int e = int(texels[i * 4 + c]) - int(palette[j * 4 + c]);
+            d += uint32_t(e * e);
+          }
+          if (d < best) {
+            best   = d;
+            idx[i] = uint8_t(j);
+          }
+        }
+        total += mask >> i & 1 ? best : 0;
+      }
+      return total;
+#endif
+    }
+
+    // Per-channel minimum and maximum over the block.
+    inline void bounds(const uint8_t* texels, uint8_t* lo, uint8_t* hi) {
+#ifdef __SSE2__
+      auto row = [&](int i) {
+        return _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(texels + i * 16));
+      };
+      __m128i mn = _mm_min_epu8(
+        _mm_min_epu8(row(0), row(1)), _mm_min_epu8(row(2), row(3)));
+      __m128i mx = _mm_max_epu8(
+        _mm_max_epu8(row(0), row(1)), _mm_max_epu8(row(2), row(3)));
+      mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+      mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+      mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+      mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+      uint32_t l = uint32_t(_mm_cvtsi128_si32(mn));
+      uint32_t h = uint32_t(_mm_cvtsi128_si32(mx));
+      std::memcpy(lo, &l, 4);
+      std::memcpy(hi, &h, 4);
+#else
+      for (int c = 0; c < 4; c++) {
+        lo[c] = hi[c] = texels[c];
+        for (int i = 1; i < 16; i++) {
+          lo[c] = std::min(lo[c], texels[i * 4 + c]);
+          hi[c] = std::max(hi[c], texels[i * 4 + c]);
+        }
+      }
+#endif
+    }
+
+    // Endpoints along the principal axis of the texels in mask, over the
+    // first `channels` channels.
+    inline void principalEndpoints(
+      const uint8_t* texels, uint16_t mask, int channels, rgba_f& lo,
+      rgba_f& hi) {
+      float mean[4] = {}, count = 0;
+      for (int i = 0; i < 16; i++) {
+        if (!(mask >> i & 1))
+          continue;
+        for (int c = 0; c < channels; c++)
+          mean[c] += texels[i * 4 + c];
+        count++;
+      }
+      for (int c = 0; c < channels; c++)
+        mean[c] /= count;
+
+      float cov[4][4] = {};
+      for (int i = 0; i < 16; i++) {
+        if (!(mask >> i & 1))
+          continue;
+        float d[4];
+        for (int c = 0; c < channels; c++)
+          d[c] = texels[i * 4 + c] - mean[c];
+        for (int a = 0; a < channels; a++)
+          for (int b = 0; b < channels; b++)
+            cov[a][b] += d[a] * d[b];
+      }
+
+      // power iteration, started on the channel that varies most
+      float axis[4] = {};
+      int widest    = 0;
+      for (int c = 1; c < channels; c++)
+        widest = cov[c][c] > cov[widest][widest] ? c : widest;
+      axis[widest] = 1;
+      for (int iter = 0; iter < 8; iter++) {
+        float next[4] = {}, len = 0;
+        for (int a = 0; a < channels; a++) {
+          for (int b = 0; b < channels; b++)
+            next[a] += cov[a][b] * axis[b];
+          len += next[a] * next[a];
+        }
+        if (len < 1e-12f)
+          break;
+        len = 1 / std::sqrt(len);
+        for (int c = 0; c < channels; c++)
+          axis[c] = next[c] * len;
+      }
+
+      float tmin = 1e9f, tmax = -1e9f;
+      for (int i = 0; i < 16; i++) {
+        if (!(mask >> i & 1))
+          continue;
+        float t = 0;
+        for (int c = 0; c < channels; c++)
+          t += (texels[i * 4 + c] - mean[c]) * axis[c];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+      }
+      lo = hi = {};
+      for (int c = 0; c < channels; c++) {
+        lo.c[c] = std::clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+        hi.c[c] = std::clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+      }
+    }
+
+    // Least-squares endpoints for the texels in mask, given each one's
+    // weight towards hi. False if the system is degenerate.
+    inline bool fitEndpoints(
+      const uint8_t* texels, uint16_t mask, const float* weight, int channels,
+      rgba_f& lo, rgba_f& hi) {
+      float aa = 0, ab = 0, bb = 0, ax[4] = {}, bx[4] = {};
+      for (int i = 0; i < 16; i++) {
+        if (!(mask >> i & 1))
+          continue;
+        float b = weight[i], a = 1 - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; c++) {
+          ax[c] += a * texels[i * 4 + c];
+          bx[c] += b * texels[i * 4 + c];
+        }
+      }
+      float det = aa * bb - ab * ab;
+      if (std::fabs(det) < 1e-6f)
+        return false;
+      for (int c = 0; c < channels; c++) {
+        lo.c[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+        hi.c[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+      }
+      return true;
+    }
+
+    inline int refinements(BlockQuality q) {
+      return q == BlockQuality::fast ? 0 : q == BlockQuality::normal ? 1 : 4;
+    }
+
+    // BC1 ------------------------------------------------------------
+
+    struct bc1_block {
+      uint16_t c0, c1;
+      uint8_t idx[16];
+      uint32_t error = UINT32_MAX;
+    };
+
+    inline uint16_t to565(const rgba_f& v) {
+      auto q = [](float x, int max) {
+        return uint16_t(std::clamp(int(x * max / 255.0f + 0.5f), 0, max));
+      };
+      return uint16_t(q(v.c[0], 31) << 11 | q(v.c[1], 63) << 5 | q(v.c[2], 31));
+    }
+
+    inline void from565(uint16_t c, uint8_t* out) {
+      uint8_t r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+      out[0]    = uint8_t(r << 3 | r >> 2);
+      out[1]    = uint8_t(g << 2 | g >> 4);
+      out[2]    = uint8_t(b << 3 | b >> 2);
+      out[3]    = 0;
+    }
+
+    // Scores a pair of endpoints. opaque are the texels to fit, with alpha
+    // zeroed; transparent ones (in three-colour mode) are fixed to 3.
+    inline void bc1Try(
+      const uint8_t* opaque, uint16_t transparent, uint16_t c0, uint16_t c1,
+      bc1_block& best) {
+      bool three = transparent != 0;
+      // the mode is in the order of the endpoints
+      if (three ? c0 > c1 : c0 < c1)
+        std::swap(c0, c1);
+      // interpolated the way Mesa decodes, rounding down
+      uint8_t pal[16];
+      from565(c0, pal);
+      from565(c1, pal + 4);
+      for (int c = 0; c < 3; c++) {
+        if (three) {
+          pal[8 + c] = uint8_t((pal[c] + pal[4 + c]) / 2);
+        }
+        else {
+          pal[8 + c]  = uint8_t((2 * pal[c] + pal[4 + c]) / 3);
+          pal[12 + c] = uint8_t((pal[c] + 2 * pal[4 + c]) / 3);
+        }
+      }
+      pal[11] = pal[15] = 0;
+
+      bc1_block b {c0, c1, {}};
+      // equal endpoints read as three-colour mode, only c0 is safe
+      int n   = three ? 3 : c0 == c1 ? 1 : 4;
+      b.error = nearest(opaque, pal, n, b.idx, uint16_t(~transparent));
+      for (int i = 0; i < 16; i++) {
+        if (transparent >> i & 1)
+          b.idx[i] = 3;
+      }
+      if (b.error < best.error)
+        best = b;
+    }
+
+    inline void encodeBC1(
+      const block_texels& texels, BlockQuality q, bool punch_through,
+      uint8_t* out) {
+      block_texels opaque  = texels;
+      uint16_t transparent = 0;
+      for (int i = 0; i < 16; i++) {
+        if (punch_through && texels[i * 4 + 3] < 128)
+          transparent |= uint16_t(1 << i);
+        opaque[i * 4 + 3] = 0;
+      }
+      bc1_block best;
+      if (transparent == 0xFFFF) {
+        bc1Try(opaque.data(), transparent, 0, 0xFFFF, best);
+      }
+      else {
+        uint16_t fit = uint16_t(~transparent);
+        // the fit ignores transparent texels: stand in for them with an
+        // opaque one so they don't widen the bounding box
+        block_texels fitted = opaque;
+        int first           = std::countr_zero(fit);
+        for (int i = 0; i < 16; i++) {
+          if (transparent >> i & 1)
+            std::memcpy(&fitted[i * 4], &opaque[first * 4], 4);
+        }
+
+        // each start is refined on its own, the best result wins
+        bool three  = transparent != 0;
+        auto search = [&](const rgba_f& l, const rgba_f& h) {
+          bc1_block b;
+          bc1Try(opaque.data(), transparent, to565(h), to565(l), b);
+          for (int iter = 0; iter < refinements(q); iter++) {
+            // weights towards c1
+            const float four_colour[4]  = {0, 1, 1 / 3.0f, 2 / 3.0f};
+            const float three_colour[4] = {0, 1, 0.5f, 0};
+            float weight[16];
+            for (int i = 0; i < 16; i++)
+              weight[i] = (three ? three_colour : four_colour)[b.idx[i]];
+            rgba_f fl, fh;
+            if (!fitEndpoints(opaque.data(), fit, weight, 3, fl, fh))
+              break;
+            uint32_t before = b.error;
+            bc1Try(opaque.data(), transparent, to565(fl), to565(fh), b);
+            if (b.error >= before)
+              break;
+          }
+          if (b.error < best.error)
+            best = b;
+        };
+
+        if (q != BlockQuality::normal) {
+          uint8_t lo[4], hi[4];
+          bounds(fitted.data(), lo, hi);
+          rgba_f l, h;
+          for (int c = 0; c < 3; c++) {
+            float inset = (hi[c] - lo[c]) / 16.0f;
+            l.c[c]      = lo[c] + inset;
+            h.c[c]      = hi[c] - inset;
+          }
+          search(l, h);
+        }
+        if (q != BlockQuality::fast) {
+          rgba_f l, h;
+          principalEndpoints(opaque.data(), fit, 3, l, h);
+          search(l, h);
+        }
+      }
+
+      uint32_t bits = 0;
+      for (int i = 0; i < 16; i++)
+        bits |= uint32_t(best.idx[i]) << (i * 2);
+      std::memcpy(out, &best.c0, 2);
+      std::memcpy(out + 2, &best.c1, 2);
+      std::memcpy(out + 4, &bits, 4);
+    }
+
+    // BC3's alpha block -------------------------------------------------
+
+    inline uint32_t alphaTry(
+      const uint8_t* alpha, uint8_t a0, uint8_t a1, uint8_t* idx) {
+      uint8_t pal[32] = {};
+      uint8_t values[8];
+      values[0] = a0;
+      values[1] = a1;
+      if (a0 > a1) {
+        for (int i = 1; i < 7; i++)
+          values[i + 1] = uint8_t(((7 - i) * a0 + i * a1 + 3) / 7);
+      }
+      else {
+        for (int i = 1; i < 5; i++)
+          values[i + 1] = uint8_t(((5 - i) * a0 + i * a1 + 2) / 5);
+        values[6] = 0;
+        values[7] = 255;
+      }
+      for (int i = 0; i < 8; i++)
+        pal[i * 4 + 3] = values[i];
+      return nearest(alpha, pal, 8, idx);
+    }
+
+    inline void encodeAlpha(
+      const block_texels& texels, BlockQuality q, uint8_t* out) {
+      block_texels alpha {};
+      uint8_t lo = 255, hi = 0, inner_lo = 255, inner_hi = 0;
+      for (int i = 0; i < 16; i++) {
+        uint8_t a        = texels[i * 4 + 3];
+        alpha[i * 4 + 3] = a;
+        lo               = std::min(lo, a);
+        hi               = std::max(hi, a);
+        if (a != 0 && a != 255) {
+          inner_lo = std::min(inner_lo, a);
+          inner_hi = std::max(inner_hi, a);
+        }
+      }
+      uint8_t a0 = hi, a1 = lo, idx[16];
+      uint32_t error = alphaTry(alpha.data(), a0, a1, idx);
+      // the six-value mode has 0 and 255 for free, which suits blocks
+      // with cut-outs
+      if (q != BlockQuality::fast && inner_lo <= inner_hi) {
+        uint8_t other[16];
+        uint32_t e = alphaTry(alpha.data(), inner_lo, inner_hi, other);
+        if (e < error) {
+          error = e;
+          a0    = inner_lo;
+          a1    = inner_hi;
+          std::memcpy(idx, other, sizeof(idx));
+        }
+      }
+
+      uint64_t bits = 0;
+      for (int i = 0; i < 16; i++)
+        bits |= uint64_t(idx[i]) << (i * 3);
+      out[0] = a0;
+      out[1] = a1;
+      for (int i = 0; i < 6; i++)
+        out[2 + i] = uint8_t(bits >> (i * 8));
+    }
+
+    // BC7, mode 6 only: one subset, RGBA endpoints of 7 bits and a shared
+    // low bit each, 16 interpolation steps. That covers most content well
+    // and keeps the search small.
+
+    inline constexpr uint8_t bc7_weights[16] = {
+      0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64,
+    };
+
+    struct bc7_endpoint {
+      uint8_t q[4];  // 7 bits
+      uint8_t p;     // the shared low bit
+      uint8_t value(int c) const { return uint8_t(q[c] << 1 | p); }
+    };
+
+    struct bc7_block {
+      bc7_endpoint e[2];
+      uint8_t idx[16];
+      uint32_t error = UINT32_MAX;
+    };
+
+    inline bc7_endpoint quantize7(const rgba_f& v, int p) {
+      bc7_endpoint e {{}, uint8_t(p)};
+      for (int c = 0; c < 4; c++)
+        e.q[c] = uint8_t(std::clamp(int((v.c[c] - p) / 2 + 0.5f), 0, 127));
+      return e;
+    }
+
+    // the low bit that loses the least
+    inline bc7_endpoint quantize7(const rgba_f& v) {
+      bc7_endpoint best {};
+      float best_err = 1e30f;
+      for (int p = 0; p < 2; p++) {
+        bc7_endpoint e = quantize7(v, p);
+        float err      = 0;
+        for (int c = 0; c < 4; c++) {
+          float d = e.value(c) - v.c[c];
+          err += d * d;
+        }
+        if (err < best_err) {
+          best_err = err;
+          best     = e;
+        }
+      }
+      return best;
+    }
+
+    inline void bc7Try(
+      const uint8_t* texels, bc7_endpoint e0, bc7_endpoint e1,
+      bc7_block& best) {
+      uint8_t pal[64];
+      for (int i = 0; i < 16; i++) {
+        int w = bc7_weights[i];
+        for (int c = 0; c < 4; c++)
+          pal[i * 4 + c] =
+            uint8_t(((64 - w) * e0.value(c) + w * e1.value(c) + 32) >> 6);
+      }
+      bc7_block b {{e0, e1}, {}};
+      b.error = nearest(texels, pal, 16, b.idx);
+      if (b.error < best.error)
+        best = b;
+    }
+
+    // Tries every pairing of low bits for the endpoints given.
+    inline void bc7TryBits(
+      const uint8_t* texels, const rgba_f& lo, const rgba_f& hi,
+      bool exhaustive, bc7_block& best) {
+      if (!exhaustive) {
+        bc7Try(texels, quantize7(lo), quantize7(hi), best);
+        return;
+      }
+      for (int p0 = 0; p0 < 2; p0++)
+        for (int p1 = 0; p1 < 2; p1++)
+          bc7Try(texels, quantize7(lo, p0), quantize7(hi, p1), best);
+    }
+
+    class bit_writer {
+    public:
+      explicit bit_writer(uint8_t* out) : m_out(out) {
+        std::memset(out, 0, 16);
+      }
+
+      void put(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, m_pos++) {
+          if (value >> i & 1)
+            m_out[m_pos / 8] |= uint8_t(1 << (m_pos % 8));
+        }
+      }
+
+    private:
+      uint8_t* m_out;
+      int m_pos = 0;
+    };
+
+    inline void encodeBC7(
+      const block_texels& texels, BlockQuality q, uint8_t* out) {
+      bool high = q == BlockQuality::high;
+      bc7_block best;
+      auto search = [&](const rgba_f& l, const rgba_f& h) {
+        bc7_block b;
+        bc7TryBits(texels.data(), l, h, high, b);
+        for (int iter = 0; iter < refinements(q); iter++) {
+          float weight[16];
+          for (int i = 0; i < 16; i++)
+            weight[i] = bc7_weights[b.idx[i]] / 64.0f;
+          rgba_f fl, fh;
+          if (!fitEndpoints(texels.data(), 0xFFFF, weight, 4, fl, fh))
+            break;
+          uint32_t before = b.error;
+          bc7TryBits(texels.data(), fl, fh, high, b);
+          if (b.error >= before)
+            break;
+        }
+        if (b.error < best.error)
+          best = b;
+      };
+
+      if (q != BlockQuality::normal) {
+        uint8_t lo[4], hi[4];
+        bounds(texels.data(), lo, hi);
+        rgba_f l, h;
+        for (int c = 0; c < 4; c++) {
+          l.c[c] = lo[c];
+          h.c[c] = hi[c];
+        }
+        search(l, h);
+      }
+      if (q != BlockQuality::fast) {
+        rgba_f l, h;
+        principalEndpoints(texels.data(), 0xFFFF, 4, l, h);
+        search(l, h);
+      }
+
+      // the first texel's index has an implied top bit of 0
+      if (best.idx[0] >= 8) {
+        std::swap(best.e[0], best.e[1]);
+        for (auto& i : best.idx)
+          i = uint8_t(15 - i);
+      }
+      bit_writer bits(out);
+      bits.put(1 << 6, 7);  // mode 6
+      for (int c = 0; c < 4; c++) {
+        bits.put(best.e[0].q[c], 7);
+        bits.put(best.e[1].q[c], 7);
+      }
+      bits.put(best.e[0].p, 1);
+      bits.put(best.e[1].p, 1);
+      bits.put(best.idx[0], 3);
+      for (int i = 1; i < 16; i++)
+        bits.put(best.idx[i], 4);
+    }
+
+    // The block at (bx, by), with texels past the edge repeating the last
+    // row and column.
+    inline block_texels loadBlock(
+      std::span<const uint8_t> rgba, int width, int height, int bx, int by) {
+      block_texels b;
+      for (int y = 0; y < 4; y++) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+          int sx = std::min(bx * 4 + x, width - 1);
+          std::memcpy(
+            &b[(y * 4 + x) * 4], &rgba[(size_t(sy) * width + sx) * 4], 4);
+        }
+      }
+      return b;
+    }
+  }  // namespace details
+
+  // Compresses one block of RGBA texels, in rows, to blockBytes(f).
+  inline void encodeBlock(
+    BlockFormat f, BlockQuality q, const details::block_texels& texels,
+    uint8_t* out) {
+    switch (f) {
+      case BlockFormat::bc1:
+        details::encodeBC1(texels, q, true, out);
+        break;
+      case BlockFormat::bc3:
+        details::encodeAlpha(texels, q, out);
+        details::encodeBC1(texels, q, false, out + 8);
+        break;
+      case BlockFormat::bc7:
+        details::encodeBC7(texels, q, out);
+        break;
+    }
+  }
+
+  // Compresses RGBA8 pixels, rows in the order they go to the GL, into
+  // out, which takes compressedBytes(f, width, height). Sizes that aren't
+  // a multiple of 4 are fine. With a pool, rows of blocks are spread over
+  // it and the calling thread.
+  inline void compressImage(
+    std::span<const uint8_t> rgba, int width, int height, BlockFormat f,
+    BlockQuality q, std::span<uint8_t> out, WorkerPool* pool = nullptr) {
+    if (rgba.size() < size_t(width) * size_t(height) * 4)
+      throw std::invalid_argument("compressImage: not enough pixels");
+    if (out.size() < compressedBytes(f, width, height))
+      throw std::invalid_argument("compressImage: output is too small");
+    int blocks_x = (width + 3) / 4, rows = (height + 3) / 4;
+    size_t stride = blocks_x * blockBytes(f);
+    auto row      = [&](size_t by) {
+      uint8_t* dst = out.data() + by * stride;
+      for (int bx = 0; bx < blocks_x; bx++) {
+        encodeBlock(
+          f, q, details::loadBlock(rgba, width, height, bx, int(by)),
+          dst + bx * blockBytes(f));
+      }
+    };
+    if (pool) {
+      pool->parallelFor(size_t(rows), row);
+    }
+    else {
+      for (int by = 0; by < rows; by++)
+        row(size_t(by));
+    }
+  }
+}  // namespace oglc
+#endif
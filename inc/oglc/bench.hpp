@@ -0,0 +1,216 @@
+#ifndef OGLC_BENCH_HPP_INCLUDED
+#define OGLC_BENCH_HPP_INCLUDED
+
+#include <glbinding/AbstractFunction.h>
+#include <glbinding/CallbackMask.h>
+#include <glbinding/FunctionCall.h>
+#include <glbinding/glbinding.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "oglc/context.hpp"
+#include "oglc/snapshot.hpp"
+#include "oglc/startup.hpp"
+#include "oglc/trace.hpp"
+
+namespace oglc {
+  // Frame time samples, summarised as mean and percentiles.
+  class FrameStats {
+  public:
+    void reserve(size_t n) { m_samples.reserve(n); }
+    void record(uint64_t ns) {
+      m_samples.push_back(ns);
+      m_sorted = false;
+    }
+
+    size_t count() const { return m_samples.size(); }
+
+    double meanMs() const {
+      if (m_samples.empty())
+        return 0.0;
+      double sum = 0.0;
+      for (auto s : m_samples)
+        sum += s;
+      return sum / m_samples.size() / 1e6;
+    }
+
+    // Nearest-rank percentile, p in [0, 100].
+    double percentileMs(double p) {
+      if (m_samples.empty())
+        return 0.0;
+      if (!m_sorted) {
+        std::sort(m_samples.begin(), m_samples.end());
+        m_sorted = true;
+      }
+      size_t rank = size_t(std::ceil(p / 100.0 * m_samples.size()));
+      return m_samples[std::clamp<size_t>(rank, 1, m_samples.size()) - 1] /
+        1e6;
+    }
+
+  private:
+    std::vector<uint64_t> m_samples;
+    bool m_sorted = false;
+  };
+
+  // Counts draw calls and state changes through glbinding's after-call
+  // callback. Callbacks cost a lot more than the calls themselves, so only
+  // turn this on while counting, never while timing.
+  class GlCallCounter {
+  public:
+    struct counts {
+      uint64_t calls         = 0;
+      uint64_t draws         = 0;
+      uint64_t state_changes = 0;
+    };
+
+    void enable() {
+      glbinding::setAfterCallback(
+        [this](const glbinding::FunctionCall& call) { count(*call.function); });
+      glbinding::setCallbackMask(glbinding::CallbackMask::After);
+    }
+    void disable() {
+      glbinding::setCallbackMask(glbinding::CallbackMask::None);
+      glbinding::setAfterCallback(nullptr);
+    }
+
+    const counts& totals() const { return m_counts; }
+    void reset() { m_counts = {}; }
+
+  private:
+    enum class kind : uint8_t { other, draw, state };
+
+    static kind classify(std::string_view name) {
+      auto starts = [&](std::string_view p) { return name.starts_with(p); };
+      if (starts("glDraw") || starts("glMultiDraw"))
+        return kind::draw;
+      for (auto p : {
+             "glBind", "glUseProgram", "glActiveTexture", "glEnable",
+             "glDisable", "glBlend", "glDepth", "glStencil", "glCullFace",
+             "glFrontFace", "glPolygon", "glViewport", "glScissor",
+             "glColorMask", "glClearColor", "glPixelStore", "glUniform",
+             "glTexParameter", "glSamplerParameter", "glVertexAttribPointer",
+             "glVertexAttribIPointer", "glVertexAttribDivisor",
+           }) {
+        if (starts(p))
+          return kind::state;
+      }
+      return kind::other;
+    }
+
+    void count(const glbinding::AbstractFunction& fn) {
+      auto it = m_kinds.find(&fn);
+      if (it == m_kinds.end())
+        it = m_kinds.emplace(&fn, classify(fn.name())).first;
+
+      m_counts.calls++;
+      switch (it->second) {
+        case kind::draw:
+          m_counts.draws++;
+          break;
+        case kind::state:
+          m_counts.state_changes++;
+          break;
+        default:
+          break;
+      }
+    }
+
+    counts m_counts;
+    std::unordered_map<const glbinding::AbstractFunction*, kind> m_kinds;
+  };
+
+  // Drives `--bench N`: a few warm-up frames, N timed frames with no GL
+  // callbacks installed, then a short counted run for draw and state-change
+  // numbers. Frame time is the interval between successive frameDone()
+  // calls, i.e. present to present.
+  class Bench {
+  public:
+    Bench(const AppOptions& opts, const Context& ctx) :
+      m_opts(opts),
+      m_ctx(ctx),
+      m_warmup(std::min<uint64_t>(opts.benchFrames, 30)),
+      m_counted(std::min<uint64_t>(opts.benchFrames, 16)) {
+      m_times.reserve(opts.benchFrames);
+    }
+
+    bool active() const { return m_opts.benchFrames > 0; }
+
+    // Call once per frame, right after the swap. Returns false when the
+    // run is complete.
+    bool frameDone() {
+      uint64_t now       = monotonicNanos();
+      uint64_t n         = m_frame++;
+      uint64_t end_timed = m_warmup + m_opts.benchFrames;
+
+      if (n >= m_warmup && n < end_timed)
+        m_times.record(now - m_last);
+      if (n + 1 == end_timed)
+        m_counter.enable();
+      if (n + 1 == end_timed + m_counted) {
+        m_counter.disable();
+        m_last = now;
+        return false;
+      }
+      m_last = now;
+      return true;
+    }
+
+    // Writes the JSON report to --bench-out, or stdout.
+    void report() {
+      std::ofstream file;
+      if (!m_opts.benchOut.empty()) {
+        file.open(m_opts.benchOut);
+        if (!file)
+          throw std::runtime_error("Failed to open " + m_opts.benchOut);
+      }
+      std::ostream& out = m_opts.benchOut.empty() ? std::cout : file;
+
+      auto& c        = m_counter.totals();
+      double counted = double(std::max<uint64_t>(m_counted, 1));
+      double mean    = m_times.meanMs();
+      out << "{\n"
+          << "  \"target\": ";
+      writeJsonString(out, m_opts.target);
+      out << ",\n"
+          << "  \"backend\": \"" << (m_ctx.headless() ? "headless" : "window")
+          << "\",\n"
+          << "  \"renderer\": ";
+      writeJsonString(out, m_ctx.renderer());
+      out << ",\n"
+          << "  \"width\": " << m_ctx.width() << ",\n"
+          << "  \"height\": " << m_ctx.height() << ",\n"
+          << "  \"frames\": " << m_times.count() << ",\n"
+          << "  \"mean_ms\": " << mean << ",\n"
+          << "  \"p50_ms\": " << m_times.percentileMs(50) << ",\n"
+          << "  \"p99_ms\": " << m_times.percentileMs(99) << ",\n"
+          << "  \"p999_ms\": " << m_times.percentileMs(99.9) << ",\n"
+          << "  \"max_ms\": " << m_times.percentileMs(100) << ",\n"
+          << "  \"fps\": " << (mean > 0 ? 1000.0 / mean : 0.0) << ",\n"
+          << "  \"time_to_first_frame_ms\": "
+          << StartupTimeline::instance().timeToFirstFrame() / 1e6 << ",\n"
+          << "  \"gl_calls_per_frame\": " << c.calls / counted << ",\n"
+          << "  \"draws_per_frame\": " << c.draws / counted << ",\n"
+          << "  \"state_changes_per_frame\": " << c.state_changes / counted
+          << "\n}\n";
+    }
+
+  private:
+    const AppOptions& m_opts;
+    const Context& m_ctx;
+    uint64_t m_warmup;
+    uint64_t m_counted;
+    uint64_t m_frame = 0;
+    uint64_t m_last  = 0;
+    FrameStats m_times;
+    GlCallCounter m_counter;
+  };
+}  // namespace oglc
+#endif
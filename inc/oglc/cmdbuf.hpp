@@ -0,0 +1,358 @@
+#ifndef OGLC_CMDBUF_HPP_INCLUDED
+#define OGLC_CMDBUF_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace oglc {
+  class CommandBuffer;
+  class CommandQueue;
+
+  // Recorded commands. Any thread can record into its own CommandBuffer,
+  // only the GL thread may replay one.
+  enum class CommandOp : uint8_t {
+    viewport,
+    clearColor,
+    clear,
+    useProgram,
+    activeTexture,
+    bindTexture,
+    bindVertexArray,
+    bindBuffer,
+    uniform1i,
+    uniform1f,
+    uniform4f,
+    uniformMatrix4fv,
+    drawArrays,
+    drawElements,
+    drawElementsInstanced,
+  };
+
+  namespace details {
+    struct command_header {
+      CommandOp op;
+      uint8_t _pad;
+      uint16_t size;  // payload size in bytes
+    };
+
+    struct cmd_viewport {
+      gl::GLint x, y;
+      gl::GLsizei w, h;
+    };
+    struct cmd_color {
+      gl::GLfloat r, g, b, a;
+    };
+    struct cmd_target_name {
+      gl::GLenum target;
+      gl::GLuint name;
+    };
+    struct cmd_uniform1i {
+      gl::GLint loc, v;
+    };
+    struct cmd_uniform1f {
+      gl::GLint loc;
+      gl::GLfloat v;
+    };
+    struct cmd_uniform4f {
+      gl::GLint loc;
+      gl::GLfloat v[4];
+    };
+    struct cmd_uniform_mat4 {
+      gl::GLint loc;
+      gl::GLfloat v[16];
+    };
+    struct cmd_draw_arrays {
+      gl::GLenum mode;
+      gl::GLint first;
+      gl::GLsizei count;
+    };
+    struct cmd_draw_elements {
+      gl::GLenum mode;
+      gl::GLsizei count;
+      gl::GLenum type;
+      uintptr_t offset;
+      gl::GLsizei instances;
+    };
+  }  // namespace details
+
+  // Linear buffer of compact commands. Storage is reused between frames,
+  // so after warm-up recording doesn't allocate.
+  class CommandBuffer {
+    friend class ::oglc::CommandQueue;
+
+  public:
+    // Counters from the last replay.
+    struct stats {
+      size_t commands = 0;
+      size_t draws    = 0;
+      size_t skipped  = 0;  // redundant binds filtered out
+    };
+
+    CommandBuffer() = default;
+    explicit CommandBuffer(size_t reserve) { m_data.reserve(reserve); }
+    // not copyable
+    CommandBuffer(const CommandBuffer&)            = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+    // movable
+    CommandBuffer(CommandBuffer&&)            = default;
+    CommandBuffer& operator=(CommandBuffer&&) = default;
+
+    void viewport(gl::GLint x, gl::GLint y, gl::GLsizei w, gl::GLsizei h) {
+      push(CommandOp::viewport, details::cmd_viewport {x, y, w, h});
+    }
+    void clearColor(
+      gl::GLfloat r, gl::GLfloat g, gl::GLfloat b, gl::GLfloat a) {
+      push(CommandOp::clearColor, details::cmd_color {r, g, b, a});
+    }
+    void clear(gl::ClearBufferMask mask) {
+      push(CommandOp::clear, mask);
+    }
+    void useProgram(gl::GLuint program) {
+      push(CommandOp::useProgram, program);
+    }
+    void activeTexture(gl::GLenum unit) {
+      push(CommandOp::activeTexture, unit);
+    }
+    void bindTexture(gl::GLenum target, gl::GLuint tex) {
+      push(CommandOp::bindTexture, details::cmd_target_name {target, tex});
+    }
+    void bindVertexArray(gl::GLuint vao) {
+      push(CommandOp::bindVertexArray, vao);
+    }
+    void bindBuffer(gl::GLenum target, gl::GLuint buf) {
+      push(CommandOp::bindBuffer, details::cmd_target_name {target, buf});
+    }
+    void uniform(gl::GLint loc, gl::GLint v) {
+      push(CommandOp::uniform1i, details::cmd_uniform1i {loc, v});
+    }
+    void uniform(gl::GLint loc, gl::GLfloat v) {
+      push(CommandOp::uniform1f, details::cmd_uniform1f {loc, v});
+    }
+    void uniform(
+      gl::GLint loc, gl::GLfloat x, gl::GLfloat y, gl::GLfloat z,
+      gl::GLfloat w) {
+      push(CommandOp::uniform4f, details::cmd_uniform4f {loc, {x, y, z, w}});
+    }
+    void uniformMatrix4(gl::GLint loc, const gl::GLfloat* m) {
+      details::cmd_uniform_mat4 cmd {loc, {}};
+      std::memcpy(cmd.v, m, sizeof(cmd.v));
+      push(CommandOp::uniformMatrix4fv, cmd);
+    }
+    void drawArrays(gl::GLenum mode, gl::GLint first, gl::GLsizei count) {
+      push(
+        CommandOp::drawArrays, details::cmd_draw_arrays {mode, first, count});
+    }
+    void drawElements(
+      gl::GLenum mode, gl::GLsizei count, gl::GLenum type,
+      uintptr_t offset = 0) {
+      push(
+        CommandOp::drawElements,
+        details::cmd_draw_elements {mode, count, type, offset, 1});
+    }
+    void drawElementsInstanced(
+      gl::GLenum mode, gl::GLsizei count, gl::GLenum type, uintptr_t offset,
+      gl::GLsizei instances) {
+      push(
+        CommandOp::drawElementsInstanced,
+        details::cmd_draw_elements {mode, count, type, offset, instances});
+    }
+
+    // Forget all commands but keep the storage.
+    void reset() { m_data.clear(); }
+    bool empty() const { return m_data.empty(); }
+    size_t size() const { return m_data.size(); }
+
+    // Executes every command against the current context. Must be called
+    // on the GL thread.
+    stats replay() const {
+      replay_state state;
+      replay(state);
+      return state.counters;
+    }
+
+  private:
+    // Bind cache used to drop redundant state changes while replaying.
+    // It only lives for one replay pass since other code may touch GL
+    // state in between.
+    struct replay_state {
+      gl::GLuint program = ~0u;
+      gl::GLuint vao     = ~0u;
+      gl::GLuint array   = ~0u;
+      gl::GLuint element = ~0u;
+      gl::GLenum unit    = static_cast<gl::GLenum>(~0u);
+      stats counters;
+    };
+
+    template <class T>
+    void push(CommandOp op, const T& payload) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      static_assert(sizeof(T) <= UINT16_MAX);
+      // keep every header 4-byte aligned, payloads are memcpy'd out
+      constexpr size_t padded = (sizeof(T) + 3) & ~size_t(3);
+      details::command_header hdr {op, 0, uint16_t(padded)};
+
+      size_t at = m_data.size();
+      m_data.resize(at + sizeof(hdr) + padded);
+      std::memcpy(m_data.data() + at, &hdr, sizeof(hdr));
+      std::memcpy(m_data.data() + at + sizeof(hdr), &payload, sizeof(T));
+    }
+
+    template <class T>
+    static T read(const std::byte* p) {
+      T res;
+      std::memcpy(&res, p, sizeof(T));
+      return res;
+    }
+
+    void replay(replay_state& st) const {
+      using namespace gl;
+      using namespace details;
+      const std::byte* p   = m_data.data();
+      const std::byte* end = p + m_data.size();
+
+      while (p < end) {
+        auto hdr = read<command_header>(p);
+        p += sizeof(hdr);
+        st.counters.commands++;
+
+        switch (hdr.op) {
+          case CommandOp::viewport: {
+            auto c = read<cmd_viewport>(p);
+            glViewport(c.x, c.y, c.w, c.h);
+          } break;
+          case CommandOp::clearColor: {
+            auto c = read<cmd_color>(p);
+            glClearColor(c.r, c.g, c.b, c.a);
+          } break;
+          case CommandOp::clear: {
+            glClear(read<ClearBufferMask>(p));
+          } break;
+          case CommandOp::useProgram: {
+            auto prog = read<GLuint>(p);
+            if (prog == st.program) {
+              st.counters.skipped++;
+              break;
+            }
+            glUseProgram(st.program = prog);
+          } break;
+          case CommandOp::activeTexture: {
+            auto unit = read<gl::GLenum>(p);
+            if (unit == st.unit) {
+              st.counters.skipped++;
+              break;
+            }
+            glActiveTexture(st.unit = unit);
+          } break;
+          case CommandOp::bindTexture: {
+            auto c = read<cmd_target_name>(p);
+            glBindTexture(c.target, c.name);
+          } break;
+          case CommandOp::bindVertexArray: {
+            auto vao = read<GLuint>(p);
+            if (vao == st.vao) {
+              st.counters.skipped++;
+              break;
+            }
+            glBindVertexArray(st.vao = vao);
+            // element buffer binding belongs to the VAO
+            st.element = ~0u;
+          } break;
+          case CommandOp::bindBuffer: {
+            auto c      = read<cmd_target_name>(p);
+            GLuint* cur = c.target == GL_ARRAY_BUFFER ? &st.array
+              : c.target == GL_ELEMENT_ARRAY_BUFFER   ? &st.element
+                                                      : nullptr;
+            if (cur && *cur == c.name) {
+              st.counters.skipped++;
+              break;
+            }
+            glBindBuffer(c.target, c.name);
+            if (cur)
+              *cur = c.name;
+          } break;
+          case CommandOp::uniform1i: {
+            auto c = read<cmd_uniform1i>(p);
+            glUniform1i(c.loc, c.v);
+          } break;
+          case CommandOp::uniform1f: {
+            auto c = read<cmd_uniform1f>(p);
+            glUniform1f(c.loc, c.v);
+          } break;
+          case CommandOp::uniform4f: {
+            auto c = read<cmd_uniform4f>(p);
+            glUniform4f(c.loc, c.v[0], c.v[1], c.v[2], c.v[3]);
+          } break;
+          case CommandOp::uniformMatrix4fv: {
+            auto c = read<cmd_uniform_mat4>(p);
+            glUniformMatrix4fv(c.loc, 1, GL_FALSE, c.v);
+          } break;
+          case CommandOp::drawArrays: {
+            auto c = read<cmd_draw_arrays>(p);
+            glDrawArrays(c.mode, c.first, c.count);
+            st.counters.draws++;
+          } break;
+          case CommandOp::drawElements: {
+            auto c = read<cmd_draw_elements>(p);
+            glDrawElements(
+              c.mode, c.count, c.type, reinterpret_cast<const void*>(c.offset));
+            st.counters.draws++;
+          } break;
+          case CommandOp::drawElementsInstanced: {
+            auto c = read<cmd_draw_elements>(p);
+            glDrawElementsInstanced(
+              c.mode, c.count, c.type, reinterpret_cast<const void*>(c.offset),
+              c.instances);
+            st.counters.draws++;
+          } break;
+          default:
+            throw std::logic_error("Invalid command in command buffer");
+        }
+        p += hdr.size;
+      }
+    }
+
+    std::vector<std::byte> m_data;
+  };
+
+  // One CommandBuffer per recording thread. Buffers are replayed in index
+  // order, so give each worker a fixed slot and the output is deterministic.
+  class CommandQueue {
+  public:
+    explicit CommandQueue(size_t slots, size_t reserve = 4096) {
+      m_buffers.reserve(slots);
+      for (size_t i = 0; i < slots; i++)
+        m_buffers.emplace_back(reserve);
+    }
+
+    size_t slots() const { return m_buffers.size(); }
+    CommandBuffer& operator[](size_t n) { return m_buffers[n]; }
+
+    // Replays every slot in one pass on the GL thread, then resets them
+    // for the next frame.
+    CommandBuffer::stats submit() {
+      CommandBuffer::replay_state state;
+      for (auto& buf : m_buffers) {
+        buf.replay(state);
+        buf.reset();
+      }
+      m_last = state.counters;
+      return m_last;
+    }
+
+    const CommandBuffer::stats& lastStats() const { return m_last; }
+
+  private:
+    std::vector<CommandBuffer> m_buffers;
+    CommandBuffer::stats m_last;
+  };
+}  // namespace oglc
+#endif
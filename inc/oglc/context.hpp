@@ -0,0 +1,548 @@
+#ifndef OGLC_CONTEXT_HPP_INCLUDED
+#define OGLC_CONTEXT_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+#include <glbinding/glbinding.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#ifdef OGLC_HAS_EGL
+  // keep Xlib's macros out of everything that includes us
+  #define EGL_NO_X11
+  #include <EGL/egl.h>
+  #include <EGL/eglext.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "oglc/debug.hpp"
+#include "oglc/gltrace.hpp"
+#include "oglc/startup.hpp"
+
+namespace oglc {
+  enum class Backend {
+    window,    // GLFW window, the default
+    headless,  // EGL pbuffer/surfaceless context, drawing into an FBO
+  };
+
+  enum class Vsync {
+    off,
+    on,
+    adaptive,  // tear rather than stall when a frame is late, if supported
+  };
+
+  // Command line options shared by all the examples.
+  struct AppOptions {
+    Backend backend      = Backend::window;
+    int width            = 800;
+    int height           = 600;
+    uint64_t benchFrames = 0;      // 0 = not benchmarking
+    uint64_t frames      = 0;      // 0 = run until closed
+    double fixedDt       = 0.0;    // > 0 = seconds per frame for time()
+    double fpsCap        = 0.0;    // 0 = uncapped
+    Vsync vsync          = Vsync::on;
+    bool floating        = false;  // keep the window above others
+    bool glDebug         = false;  // debug context with KHR_debug output
+    bool glStats         = false;  // per-function GL call counts and times
+    bool startupReport   = false;  // print the startup timeline
+    bool overlapStartup  = false;  // load assets while the context is made
+    bool onDemand        = false;  // only redraw when something changed
+    bool justInTime      = false;  // start frames just before the present
+    std::string benchOut;          // empty = stdout
+    std::string recordPath;        // empty = not recording
+    std::string capturePath;       // last frame as PPM, needs --frames
+    std::string glTrace;           // binary GL call trace, empty = none
+    std::string target;            // name of the executable, for reports
+
+    static void usage(std::ostream& out, std::string_view argv0) {
+      out << "usage: " << argv0 << " [options]\n"
+          << "  --headless          render offscreen through EGL, no window\n"
+          << "  --size WxH          framebuffer size (default 800x600)\n"
+          << "  --bench N           render N frames uncapped, report as JSON\n"
+          << "  --bench-out FILE    write the bench report to FILE\n"
+          << "  --record FILE       record every frame, .y4m or raw RGBA\n"
+          << "  --frames N          exit after N frames\n"
+          << "  --fixed-dt SECONDS  fixed clock step per frame\n"
+          << "  --capture FILE      save the last frame (PPM), with --frames\n"
+          << "  --gl-debug          debug context, log KHR_debug messages\n"
+          << "  --gl-stats          count and time GL calls per function\n"
+          << "  --gl-trace FILE     write every GL call to a binary trace\n"
+          << "  --startup           print the startup timeline\n"
+          << "  --overlap-startup   load assets during context creation\n"
+          << "  --on-demand         redraw only after input or a resize\n"
+          << "  --fps N             cap the frame rate at N\n"
+          << "  --vsync MODE        on (default), off or adaptive\n"
+          << "  --jit               sample input just before the present\n";
+    }
+
+    static AppOptions fromArgs(int argc, char** argv) {
+      AppOptions opts;
+      std::string_view argv0 = argc > 0 ? argv[0] : "app";
+      opts.target = std::string(argv0.substr(argv0.find_last_of("/\\") + 1));
+
+      for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto value           = [&]() -> std::string_view {
+          if (i + 1 >= argc)
+            throw std::invalid_argument(std::string(arg) + " needs a value");
+          return argv[++i];
+        };
+
+        if (arg == "--headless") {
+          opts.backend = Backend::headless;
+        }
+        else if (arg == "--size") {
+          std::string v(value());
+          if (std::sscanf(v.c_str(), "%dx%d", &opts.width, &opts.height) != 2)
+            throw std::invalid_argument("--size expects WxH");
+        }
+        else if (arg == "--bench") {
+          opts.benchFrames = std::stoull(std::string(value()));
+        }
+        else if (arg == "--bench-out") {
+          opts.benchOut = value();
+        }
+        else if (arg == "--record") {
+          opts.recordPath = value();
+        }
+        else if (arg == "--frames") {
+          opts.frames = std::stoull(std::string(value()));
+        }
+        else if (arg == "--fixed-dt") {
+          opts.fixedDt = std::stod(std::string(value()));
+        }
+        else if (arg == "--capture") {
+          opts.capturePath = value();
+        }
+        else if (arg == "--gl-debug") {
+          opts.glDebug = true;
+        }
+        else if (arg == "--gl-stats") {
+          opts.glStats = true;
+        }
+        else if (arg == "--gl-trace") {
+          opts.glTrace = value();
+        }
+        else if (arg == "--startup") {
+          opts.startupReport = true;
+        }
+        else if (arg == "--overlap-startup") {
+          opts.overlapStartup = true;
+        }
+        else if (arg == "--on-demand") {
+          opts.onDemand = true;
+        }
+        else if (arg == "--fps") {
+          opts.fpsCap = std::stod(std::string(value()));
+        }
+        else if (arg == "--vsync") {
+          std::string_view v = value();
+          if (v == "on")
+            opts.vsync = Vsync::on;
+          else if (v == "off")
+            opts.vsync = Vsync::off;
+          else if (v == "adaptive")
+            opts.vsync = Vsync::adaptive;
+          else
+            throw std::invalid_argument("--vsync expects on, off or adaptive");
+        }
+        else if (arg == "--jit") {
+          opts.justInTime = true;
+        }
+        else if (arg == "--help" || arg == "-h") {
+          usage(std::cout, argv0);
+          std::exit(0);
+        }
+        else {
+          usage(std::cerr, argv0);
+          throw std::invalid_argument("Unknown option " + std::string(arg));
+        }
+      }
+      // the bench counts calls through the same glbinding callbacks, and
+      // timing every call would skew its numbers anyway
+      if (opts.benchFrames > 0 && (opts.glStats || !opts.glTrace.empty()))
+        throw std::invalid_argument("--gl-stats/--gl-trace and --bench clash");
+      // a benchmark wants every frame drawn
+      if (opts.benchFrames > 0 && opts.onDemand)
+        throw std::invalid_argument("--on-demand and --bench clash");
+      // and uncapped
+      if (opts.benchFrames > 0 && (opts.fpsCap > 0 || opts.justInTime))
+        throw std::invalid_argument("--fps/--jit and --bench clash");
+      return opts;
+    }
+  };
+
+  // Owns the GL context and whatever presents it. The window backend wraps
+  // a GLFW window. The headless backend makes an EGL context (surfaceless
+  // if the platform allows, pbuffer otherwise) and renders into an FBO
+  // that stays bound as the default framebuffer, so examples don't have to
+  // care which one they got.
+  class Context {
+  public:
+    Context(const AppOptions& opts, const char* title) :
+      m_backend(opts.backend),
+      m_width(opts.width),
+      m_height(opts.height),
+      m_floating(opts.floating),
+      m_fixedDt(opts.fixedDt),
+      m_debug(opts.glDebug),
+      m_start(std::chrono::steady_clock::now()) {
+      OGLC_STARTUP_PHASE("context");
+      if (m_backend == Backend::headless)
+        initHeadless();
+      else
+        initWindow(title);
+      // after our own setup, so a trace only holds the example's calls
+      if (opts.glStats || !opts.glTrace.empty())
+        GlTracer::instance().start(opts.glTrace);
+    }
+    // not copyable or movable, GLFW callbacks point back at us
+    Context(const Context&)            = delete;
+    Context& operator=(const Context&) = delete;
+
+    ~Context() {
+      if (m_backend == Backend::headless) {
+#ifdef OGLC_HAS_EGL
+        if (m_display != EGL_NO_DISPLAY) {
+          eglMakeCurrent(m_display, m_surface, m_surface, m_context);
+          gl::glDeleteFramebuffers(1, &m_fbo);
+          gl::glDeleteRenderbuffers(2, m_rbos.data());
+          for (auto& f : m_fences)
+            if (f)
+              gl::glDeleteSync(f);
+          eglMakeCurrent(
+            m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+          if (m_surface != EGL_NO_SURFACE)
+            eglDestroySurface(m_display, m_surface);
+          eglDestroyContext(m_display, m_context);
+          eglTerminate(m_display);
+        }
+#endif
+      }
+      else {
+        glfwTerminate();
+      }
+    }
+
+    Backend backend() const { return m_backend; }
+    bool headless() const { return m_backend == Backend::headless; }
+    // nullptr on the headless backend
+    GLFWwindow* window() const { return m_window; }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // Seconds since the context was created, or frames presented times
+    // the step with --fixed-dt. Safe from any thread.
+    double time() const {
+      if (m_fixedDt > 0.0)
+        return double(m_presented.load()) * m_fixedDt;
+      return std::chrono::duration<double>(
+               std::chrono::steady_clock::now() - m_start)
+        .count();
+    }
+
+    // Moves the context between threads: release on one, then make
+    // current on the other.
+    void makeCurrent() {
+#ifdef OGLC_HAS_EGL
+      if (headless())
+        eglMakeCurrent(m_display, m_surface, m_surface, m_context);
+#endif
+      if (!headless())
+        glfwMakeContextCurrent(m_window);
+      glbinding::useContext(0);
+    }
+    void releaseCurrent() {
+#ifdef OGLC_HAS_EGL
+      if (headless())
+        eglMakeCurrent(
+          m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+      if (!headless())
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    // Presents the frame. Headless there is nothing to present, but we
+    // still keep at most two frames in flight like a swapchain would, so
+    // frame times mean the same thing on both backends.
+    void swap() {
+      m_presented++;
+      if (!headless()) {
+        glfwSwapBuffers(m_window);
+        return;
+      }
+      auto& fence = m_fences[m_frame++ % m_fences.size()];
+      if (fence) {
+        gl::glClientWaitSync(fence, gl::GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        gl::glDeleteSync(fence);
+      }
+      fence =
+        gl::glFenceSync(gl::GL_SYNC_GPU_COMMANDS_COMPLETE, gl::GL_NONE_BIT);
+      gl::glFlush();
+    }
+
+    void pollEvents() {
+      if (!headless())
+        glfwPollEvents();
+    }
+    // Headless there are no events, so this just sleeps.
+    void waitEvents(double timeout) {
+      if (!headless())
+        glfwWaitEventsTimeout(timeout);
+      else
+        std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+    }
+
+    // Window backend only, headless never waits for vsync.
+    void swapInterval(int interval) {
+      if (!headless())
+        glfwSwapInterval(interval);
+    }
+    // Of the monitor the window is on (or the primary one), 0 if unknown
+    // or headless.
+    int refreshRate() const {
+      if (headless())
+        return 0;
+      GLFWmonitor* monitor = glfwGetWindowMonitor(m_window);
+      if (!monitor)
+        monitor = glfwGetPrimaryMonitor();
+      const GLFWvidmode* mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+      return mode ? mode->refreshRate : 0;
+    }
+
+    bool shouldClose() const {
+      return m_close || (!headless() && glfwWindowShouldClose(m_window));
+    }
+    // Safe from any thread.
+    void requestClose() {
+      m_close = true;
+      if (!headless())
+        glfwSetWindowShouldClose(m_window, true);
+    }
+
+    // Asks for another frame with --on-demand: input, resizes and exposes
+    // do this by themselves, animations have to call it every frame they
+    // change something. Safe from any thread.
+    void requestRedraw() {
+      m_dirty = true;
+      if (!headless())
+        glfwPostEmptyEvent();
+    }
+    // Whether a frame was asked for since the last call.
+    bool consumeRedraw() { return m_dirty.exchange(false); }
+
+    // Called with the new framebuffer size, on the thread pumping events.
+    void onResize(std::function<void(int, int)> fn) {
+      m_resize = std::move(fn);
+    }
+
+    // GL_RENDERER of the current context.
+    std::string renderer() const {
+      auto str = gl::glGetString(gl::GL_RENDERER);
+      return str ? reinterpret_cast<const char*>(str) : "unknown";
+    }
+
+  private:
+    void initWindow(const char* title) {
+      {
+        OGLC_STARTUP_PHASE("glfwInit");
+        if (!glfwInit())
+          throw std::runtime_error("GLFW failed to initialize");
+      }
+      // Setup an OpenGL 3.3 Core context
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+      glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+      glfwWindowHint(GLFW_FLOATING, m_floating ? GLFW_TRUE : GLFW_FALSE);
+      glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, m_debug);
+      {
+        OGLC_STARTUP_PHASE("create window");
+        m_window =
+          glfwCreateWindow(width(), height(), title, nullptr, nullptr);
+        if (m_window == nullptr) {
+          glfwTerminate();
+          throw std::runtime_error("GLFW failed to create window");
+        }
+        glfwMakeContextCurrent(m_window);
+      }
+      glfwSetWindowUserPointer(m_window, this);
+      glfwSetFramebufferSizeCallback(
+        m_window, [](GLFWwindow* win, int width, int height) {
+          auto self = static_cast<Context*>(glfwGetWindowUserPointer(win));
+          self->m_width  = width;
+          self->m_height = height;
+          self->m_dirty  = true;
+          if (self->m_resize)
+            self->m_resize(width, height);
+        });
+      // anything the user does may change the next frame
+      glfwSetWindowRefreshCallback(m_window, &Context::markDirty);
+      glfwSetKeyCallback(m_window, [](GLFWwindow* win, int, int, int, int) {
+        markDirty(win);
+      });
+      glfwSetMouseButtonCallback(m_window, [](GLFWwindow* win, int, int, int) {
+        markDirty(win);
+      });
+      glfwSetCursorPosCallback(m_window, [](GLFWwindow* win, double, double) {
+        markDirty(win);
+      });
+      glfwSetScrollCallback(m_window, [](GLFWwindow* win, double, double) {
+        markDirty(win);
+      });
+
+      {
+        OGLC_STARTUP_PHASE("glbinding init");
+        glbinding::initialize(glfwGetProcAddress, false);
+      }
+      if (m_debug)
+        DebugLog::instance().install();
+    }
+
+    static void markDirty(GLFWwindow* win) {
+      static_cast<Context*>(glfwGetWindowUserPointer(win))->m_dirty = true;
+    }
+
+    void initHeadless() {
+#ifdef OGLC_HAS_EGL
+      {
+        OGLC_STARTUP_PHASE("eglInitialize");
+        // prefer Mesa's surfaceless platform, it needs no display server
+        auto get_platform_display =
+          reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display) {
+          m_display = get_platform_display(
+            EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (m_display == EGL_NO_DISPLAY)
+          m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (
+          m_display == EGL_NO_DISPLAY ||
+          !eglInitialize(m_display, nullptr, nullptr))
+          throw std::runtime_error("EGL failed to initialize");
+        if (!eglBindAPI(EGL_OPENGL_API))
+          throw std::runtime_error("EGL has no desktop OpenGL");
+      }
+
+      EGLint config_attrs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,  //
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,  //
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8,   //
+        EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,  //
+        EGL_NONE,
+      };
+      EGLConfig config;
+      EGLint count = 0;
+      auto choose  = [&] {
+        return eglChooseConfig(m_display, config_attrs, &config, 1, &count) &&
+          count > 0;
+      };
+      if (!choose()) {
+        // no pbuffer configs, take anything and go surfaceless
+        config_attrs[1] = 0;
+        if (!choose())
+          throw std::runtime_error("EGL has no usable config");
+      }
+
+      // Setup an OpenGL 3.3 Core context
+      const EGLint context_attrs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_DEBUG, m_debug ? EGL_TRUE : EGL_FALSE,
+        EGL_NONE,
+      };
+      {
+        OGLC_STARTUP_PHASE("create context");
+        m_context =
+          eglCreateContext(m_display, config, EGL_NO_CONTEXT, context_attrs);
+        if (m_context == EGL_NO_CONTEXT)
+          throw std::runtime_error("EGL failed to create a 3.3 core context");
+
+        const EGLint pbuffer_attrs[] = {
+          EGL_WIDTH, width(), EGL_HEIGHT, height(), EGL_NONE};
+        m_surface = eglCreatePbufferSurface(m_display, config, pbuffer_attrs);
+        if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context))
+          throw std::runtime_error("EGL failed to make the context current");
+      }
+
+      {
+        OGLC_STARTUP_PHASE("glbinding init");
+        glbinding::initialize(
+          [](const char* name) {
+            return reinterpret_cast<glbinding::ProcAddress>(
+              eglGetProcAddress(name));
+          },
+          false);
+      }
+      if (m_debug)
+        DebugLog::instance().install();
+      initFramebuffer();
+#else
+      throw std::runtime_error("Built without EGL, --headless is unavailable");
+#endif
+    }
+
+    // Offscreen render target standing in for the default framebuffer.
+    void initFramebuffer() {
+      using namespace gl;
+      OGLC_STARTUP_PHASE("framebuffer");
+      glGenRenderbuffers(2, m_rbos.data());
+      glBindRenderbuffer(GL_RENDERBUFFER, m_rbos[0]);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width(), height());
+      glBindRenderbuffer(GL_RENDERBUFFER, m_rbos[1]);
+      glRenderbufferStorage(
+        GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width(), height());
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+      glGenFramebuffers(1, &m_fbo);
+      glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+      glFramebufferRenderbuffer(
+        GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_rbos[0]);
+      glFramebufferRenderbuffer(
+        GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+        m_rbos[1]);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Offscreen framebuffer is incomplete");
+      glViewport(0, 0, width(), height());
+    }
+
+    Backend m_backend;
+    std::atomic<int> m_width;
+    std::atomic<int> m_height;
+    bool m_floating;
+    double m_fixedDt;
+    bool m_debug;
+    std::atomic<uint64_t> m_presented {0};
+    std::chrono::steady_clock::time_point m_start;
+    std::atomic<bool> m_close {false};
+    std::atomic<bool> m_dirty {true};
+    std::function<void(int, int)> m_resize;
+
+    GLFWwindow* m_window = nullptr;
+#ifdef OGLC_HAS_EGL
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLContext m_context = EGL_NO_CONTEXT;
+    EGLSurface m_surface = EGL_NO_SURFACE;
+#endif
+    gl::GLuint m_fbo = 0;
+    std::array<gl::GLuint, 2> m_rbos {};
+    std::array<gl::GLsync, 2> m_fences {};
+    uint64_t m_frame = 0;
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,253 @@
+#ifndef OGLC_DEBUG_HPP_INCLUDED
+#define OGLC_DEBUG_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+#include "oglc/profiler.hpp"
+
+namespace oglc {
+  namespace details {
+    struct debug_message {
+      gl::GLenum source;
+      gl::GLenum type;
+      gl::GLenum severity;
+      gl::GLuint id;
+      char text[240];
+    };
+
+    // Bounded multi-producer, single-consumer queue. Drivers may call the
+    // debug callback from their own threads, so pushes race each other;
+    // each slot carries a sequence number saying whose turn it is. When
+    // full, messages are dropped rather than blocking the driver.
+    class debug_queue {
+    public:
+      static constexpr size_t capacity = 1024;
+
+      debug_queue() : m_slots(new slot[capacity]) {
+        for (size_t i = 0; i < capacity; i++)
+          m_slots[i].seq.store(i, std::memory_order_relaxed);
+      }
+
+      bool push(const debug_message& msg) {
+        uint64_t pos = m_head.load(std::memory_order_relaxed);
+        while (true) {
+          slot& s      = m_slots[pos & (capacity - 1)];
+          uint64_t seq = s.seq.load(std::memory_order_acquire);
+          if (seq == pos) {
+            if (m_head.compare_exchange_weak(
+                  pos, pos + 1, std::memory_order_relaxed)) {
+              s.msg = msg;
+              s.seq.store(pos + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if (seq < pos) {
+            return false;
+          }
+          else {
+            pos = m_head.load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      template <class F>
+      void drain(F&& fn) {
+        while (true) {
+          slot& s = m_slots[m_tail & (capacity - 1)];
+          if (s.seq.load(std::memory_order_acquire) != m_tail + 1)
+            return;
+          fn(s.msg);
+          s.seq.store(m_tail + capacity, std::memory_order_release);
+          m_tail++;
+        }
+      }
+
+    private:
+      struct slot {
+        std::atomic<uint64_t> seq;
+        debug_message msg;
+      };
+
+      std::unique_ptr<slot[]> m_slots;
+      alignas(64) std::atomic<uint64_t> m_head {0};
+      alignas(64) uint64_t m_tail = 0;
+    };
+  }  // namespace details
+
+  // KHR_debug output. Messages from the driver go into a lock-free queue
+  // and are printed on the GL thread at the end of each frame; performance
+  // warnings (Mesa reports shader recompiles and stalls this way) are
+  // counted per frame and show up as a counter in the profiler.
+  class DebugLog {
+  public:
+    static DebugLog& instance() {
+      static DebugLog log;
+      return log;
+    }
+
+    // Installs the callback on the current context, if it is a debug
+    // context with KHR_debug. Returns whether it did.
+    bool install() {
+      using namespace gl;
+      if (!supported()) {
+        std::cerr << "GL debug output unavailable, not a debug context\n";
+        return false;
+      }
+      glEnable(GL_DEBUG_OUTPUT);
+      glDebugMessageCallback(&DebugLog::callback, this);
+      // notifications are mostly our own debug groups echoing back
+      glDebugMessageControl(
+        GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0,
+        nullptr, GL_FALSE);
+      s_enabled = true;
+      return true;
+    }
+
+    // Whether labels and debug groups should be sent at all.
+    static bool enabled() { return s_enabled; }
+
+    // GL thread, once per frame. Prints what came in and returns the
+    // number of performance warnings since the last call.
+    uint64_t endFrame(std::ostream& out = std::cerr) {
+      m_queue.drain([&](const details::debug_message& msg) {
+        out << "GL " << typeName(msg.type) << " ("
+            << severityName(msg.severity) << ", " << msg.id
+            << "): " << msg.text << "\n";
+      });
+      uint64_t perf = m_framePerf.exchange(0, std::memory_order_relaxed);
+      m_totalPerf += perf;
+      OGLC_COUNTER("gl perf warnings", perf);
+      return perf;
+    }
+
+    uint64_t performanceWarnings() const { return m_totalPerf; }
+    uint64_t dropped() const { return m_dropped.load(); }
+
+    void printSummary(std::ostream& out = std::cerr) const {
+      out << "GL debug: " << m_totalPerf << " performance warnings, "
+          << dropped() << " messages dropped\n";
+    }
+
+  private:
+    DebugLog() = default;
+
+    static bool supported() {
+      using namespace gl;
+      GLint flags = 0;
+      glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+      if ((flags & GLint(GL_CONTEXT_FLAG_DEBUG_BIT)) == 0)
+        return false;
+
+      GLint major = 0, minor = 0;
+      glGetIntegerv(GL_MAJOR_VERSION, &major);
+      glGetIntegerv(GL_MINOR_VERSION, &minor);
+      if (major > 4 || (major == 4 && minor >= 3))
+        return true;
+      GLint count = 0;
+      glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+      for (GLint i = 0; i < count; i++) {
+        auto ext = reinterpret_cast<const char*>(
+          glGetStringi(GL_EXTENSIONS, GLuint(i)));
+        if (ext && std::string_view(ext) == "GL_KHR_debug")
+          return true;
+      }
+      return false;
+    }
+
+    // Any thread the driver likes.
+    static void callback(
+      gl::GLenum source, gl::GLenum type, gl::GLuint id, gl::GLenum severity,
+      gl::GLsizei length, const gl::GLchar* message, const void* user) {
+      auto self = static_cast<DebugLog*>(const_cast<void*>(user));
+      if (type == gl::GL_DEBUG_TYPE_PERFORMANCE)
+        self->m_framePerf.fetch_add(1, std::memory_order_relaxed);
+
+      details::debug_message msg {source, type, severity, id, {}};
+      size_t len = length < 0 ? std::strlen(message) : size_t(length);
+      len        = std::min(len, sizeof(msg.text) - 1);
+      std::memcpy(msg.text, message, len);
+      msg.text[len] = '\0';
+      if (!self->m_queue.push(msg))
+        self->m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static const char* typeName(gl::GLenum type) {
+      using namespace gl;
+      switch (type) {
+        case GL_DEBUG_TYPE_ERROR:
+          return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+          return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+          return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY:
+          return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE:
+          return "performance";
+        default:
+          return "other";
+      }
+    }
+    static const char* severityName(gl::GLenum severity) {
+      using namespace gl;
+      switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH:
+          return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM:
+          return "medium";
+        case GL_DEBUG_SEVERITY_LOW:
+          return "low";
+        default:
+          return "info";
+      }
+    }
+
+    inline static bool s_enabled = false;
+
+    details::debug_queue m_queue;
+    std::atomic<uint64_t> m_framePerf {0};
+    std::atomic<uint64_t> m_dropped {0};
+    uint64_t m_totalPerf = 0;
+  };
+
+  // Names a GL object for debuggers and driver messages. Does nothing
+  // unless debug output is on.
+  inline void labelObject(
+    gl::GLenum identifier, gl::GLuint name, std::string_view label) {
+    if (DebugLog::enabled()) {
+      gl::glObjectLabel(
+        identifier, name, gl::GLsizei(label.size()), label.data());
+    }
+  }
+
+  // Scoped debug group, shows up as a region in RenderDoc, apitrace and
+  // friends. Does nothing unless debug output is on.
+  class DebugGroup {
+  public:
+    explicit DebugGroup(const char* name) : m_active(DebugLog::enabled()) {
+      if (m_active)
+        gl::glPushDebugGroup(gl::GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+    }
+    DebugGroup(const DebugGroup&)            = delete;
+    DebugGroup& operator=(const DebugGroup&) = delete;
+    ~DebugGroup() {
+      if (m_active)
+        gl::glPopDebugGroup();
+    }
+
+  private:
+    bool m_active;
+  };
+}  // namespace oglc
+#endif
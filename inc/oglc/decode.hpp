@@ -0,0 +1,144 @@
+#ifndef OGLC_DECODE_HPP_INCLUDED
+#define OGLC_DECODE_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace oglc {
+  // Bump allocator for scratch memory that all dies at once. Freeing is a
+  // no-op; reset() drops everything, and merges what it had into a single
+  // block, so a workload that fits once runs allocation-free afterwards.
+  class ScratchArena {
+  public:
+    static constexpr size_t alignment = 16;
+
+    explicit ScratchArena(size_t block_size = size_t(1) << 20) :
+      m_blockSize(block_size) {}
+    ScratchArena(const ScratchArena&)            = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    void* allocate(size_t size) {
+      size = roundUp(std::max<size_t>(size, 1));
+      if (m_blocks.empty() || m_used + size > m_blocks.back().size)
+        grow(size);
+      block& b = m_blocks.back();
+      m_last   = b.data.get() + m_used;
+      m_used += size;
+      return m_last;
+    }
+
+    // Grows the last allocation in place when it can.
+    void* reallocate(void* p, size_t old_size, size_t new_size) {
+      if (!p)
+        return allocate(new_size);
+      if (p == m_last) {
+        size_t start = size_t(m_last - m_blocks.back().data.get());
+        if (start + roundUp(new_size) <= m_blocks.back().size) {
+          m_used = start + roundUp(new_size);
+          return p;
+        }
+      }
+      void* q = allocate(new_size);
+      std::memcpy(q, p, std::min(old_size, new_size));
+      return q;
+    }
+
+    void reset() {
+      if (m_blocks.size() > 1) {
+        size_t total = 0;
+        for (auto& b : m_blocks)
+          total += b.size;
+        m_blocks.clear();
+        m_blocks.push_back({std::make_unique<std::byte[]>(total), total});
+      }
+      m_used = 0;
+      m_last = nullptr;
+    }
+
+    size_t capacity() const {
+      size_t total = 0;
+      for (auto& b : m_blocks)
+        total += b.size;
+      return total;
+    }
+
+  private:
+    struct block {
+      std::unique_ptr<std::byte[]> data;
+      size_t size;
+    };
+
+    static size_t roundUp(size_t size) {
+      return (size + alignment - 1) / alignment * alignment;
+    }
+
+    void grow(size_t at_least) {
+      size_t size = std::max(m_blockSize, at_least);
+      m_blocks.push_back({std::make_unique<std::byte[]>(size), size});
+      m_used = 0;
+    }
+
+    size_t m_blockSize;
+    std::vector<block> m_blocks;
+    size_t m_used     = 0;
+    std::byte* m_last = nullptr;
+  };
+
+  namespace details {
+    // The arena decodeInto() set up for the decoder running on this
+    // thread, null outside it.
+    inline thread_local ScratchArena* t_arena = nullptr;
+
+    // Allocation hooks for decoders, stb_image's STBI_MALLOC and friends.
+    // Outside decodeInto() they are plain malloc, realloc and free.
+    inline void* decodeMalloc(size_t size) {
+      return t_arena ? t_arena->allocate(size) : std::malloc(size);
+    }
+
+    inline void* decodeRealloc(void* p, size_t old_size, size_t new_size) {
+      if (!t_arena)
+        return std::realloc(p, new_size);
+      return t_arena->reallocate(p, old_size, new_size);
+    }
+
+    inline void decodeFree(void* p) {
+      if (!t_arena)
+        std::free(p);
+    }
+  }  // namespace details
+
+  // Runs decode(), which returns the decoder's output or null on failure,
+  // with the decoder's allocations coming from a per-thread arena, then
+  // copies the output to dst. Returns false if decoding failed.
+  //
+  // dst is written once, front to back, and never read, so it can be a
+  // buffer mapped write-only. It isn't handed to the decoder: stb_image
+  // reads back the rows it has written, PNG unfiltering does for one,
+  // and that is slow or worse on write-combined memory.
+  //
+  // The output pointer is only valid inside, never free it.
+  template <class F>
+  bool decodeInto(std::span<uint8_t> dst, F&& decode) {
+    thread_local ScratchArena arena;
+    details::t_arena = &arena;
+    struct cleanup {
+      ~cleanup() {
+        details::t_arena->reset();
+        details::t_arena = nullptr;
+      }
+    } on_exit;
+
+    auto* out = static_cast<const uint8_t*>(decode());
+    if (!out)
+      return false;
+    std::memcpy(dst.data(), out, dst.size());
+    return true;
+  }
+}  // namespace oglc
+#endif
@@ -0,0 +1,769 @@
+#ifndef OGLC_GLTRACE_HPP_INCLUDED
+#define OGLC_GLTRACE_HPP_INCLUDED
+
+#include <glbinding/AbstractFunction.h>
+#include <glbinding/AbstractValue.h>
+#include <glbinding/CallbackMask.h>
+#include <glbinding/FunctionCall.h>
+#include <glbinding/Value.h>
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/types.h>
+#include <glbinding/glbinding.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "oglc/profiler.hpp"
+
+namespace oglc {
+  // Binary GL call trace, native byte order. After an 8 byte magic the
+  // file is a stream of records, each starting with a one byte tag:
+  //
+  //   'N' u16 id, u16 length, name          first use of a function
+  //   'C' u16 id, u8 argc, argc * value,    one call
+  //       u8 has_return, [value],
+  //       u8 blobs, blobs * (u8 arg, u32 size, bytes)
+  //   'F' u64 frame                         end of a frame
+  //
+  // where a value is u8 kind, u64 bits. Pointer arguments are recorded as
+  // addresses; for uploads and glGen*/glDelete* the memory they point at
+  // is attached as a blob, so a replay has everything it needs. What was
+  // written through a glMapBufferRange mapping goes with glUnmapBuffer.
+  namespace trace {
+    inline constexpr char magic[8] = {'O', 'G', 'L', 'C', 'T', 'R', 'C', '1'};
+
+    enum class kind : uint8_t {
+      unknown,
+      sint,
+      uint,
+      enumeration,
+      bitfield,
+      boolean,
+      real,  // float or double, stored as double
+      pointer,
+    };
+
+    struct value {
+      kind type     = kind::unknown;
+      uint64_t bits = 0;
+
+      int64_t asInt() const { return int64_t(bits); }
+      double asReal() const {
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+      }
+    };
+
+    struct blob {
+      uint8_t arg;  // which argument it belongs to
+      uint32_t size;
+      const char* data;
+    };
+
+    struct call {
+      uint16_t function;
+      uint8_t argc;
+      uint8_t blobs;
+      bool hasReturn;
+      value ret;
+      uint32_t firstArg;
+      uint32_t firstBlob;
+    };
+
+    // A whole trace, loaded and indexed up front so replaying it costs no
+    // parsing. Blobs point into the file contents held here.
+    class Reader {
+    public:
+      explicit Reader(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+          throw std::runtime_error("Failed to open " + path);
+        m_data.assign(
+          std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (
+          m_data.size() < sizeof(magic) ||
+          std::memcmp(m_data.data(), magic, sizeof(magic)) != 0)
+          throw std::runtime_error(path + " is not a GL trace");
+        m_pos = sizeof(magic);
+        while (m_pos < m_data.size())
+          record();
+      }
+
+      const std::vector<std::string>& functions() const { return m_names; }
+      const std::vector<call>& calls() const { return m_calls; }
+      // Index of the first call after each frame.
+      const std::vector<size_t>& frameEnds() const { return m_frameEnds; }
+
+      std::span<const value> args(const call& c) const {
+        return {m_args.data() + c.firstArg, c.argc};
+      }
+      std::span<const blob> blobs(const call& c) const {
+        return {m_blobs.data() + c.firstBlob, c.blobs};
+      }
+
+    private:
+      void record() {
+        switch (get<uint8_t>()) {
+          case 'N': {
+            auto id  = get<uint16_t>();
+            auto len = get<uint16_t>();
+            if (id >= m_names.size())
+              m_names.resize(id + 1);
+            m_names[id].assign(bytes(len), len);
+          } break;
+          case 'C': {
+            call c {};
+            c.function = get<uint16_t>();
+            c.argc     = get<uint8_t>();
+            c.firstArg = uint32_t(m_args.size());
+            for (uint8_t i = 0; i < c.argc; i++)
+              m_args.push_back(getValue());
+            c.hasReturn = get<uint8_t>() != 0;
+            if (c.hasReturn)
+              c.ret = getValue();
+            c.blobs     = get<uint8_t>();
+            c.firstBlob = uint32_t(m_blobs.size());
+            for (uint8_t i = 0; i < c.blobs; i++) {
+              blob b;
+              b.arg  = get<uint8_t>();
+              b.size = get<uint32_t>();
+              b.data = bytes(b.size);
+              m_blobs.push_back(b);
+            }
+            if (c.function >= m_names.size())
+              throw std::runtime_error("GL trace calls an unnamed function");
+            m_calls.push_back(c);
+          } break;
+          case 'F':
+            get<uint64_t>();
+            m_frameEnds.push_back(m_calls.size());
+            break;
+          default:
+            throw std::runtime_error("GL trace is corrupt");
+        }
+      }
+
+      const char* bytes(size_t size) {
+        if (m_data.size() - m_pos < size)
+          throw std::runtime_error("GL trace is truncated");
+        const char* ptr = m_data.data() + m_pos;
+        m_pos += size;
+        return ptr;
+      }
+      template <class T>
+      T get() {
+        T v;
+        std::memcpy(&v, bytes(sizeof(T)), sizeof(T));
+        return v;
+      }
+      value getValue() {
+        value v;
+        v.type = kind(get<uint8_t>());
+        v.bits = get<uint64_t>();
+        return v;
+      }
+
+      std::vector<char> m_data;
+      size_t m_pos = 0;
+      std::vector<std::string> m_names;
+      std::vector<call> m_calls;
+      std::vector<value> m_args;
+      std::vector<blob> m_blobs;
+      std::vector<size_t> m_frameEnds;
+    };
+  }  // namespace trace
+
+  namespace details {
+    template <class T>
+    bool encodeAs(
+      const glbinding::AbstractValue* v, trace::kind k, trace::value& out) {
+      auto typed = dynamic_cast<const glbinding::Value<T>*>(v);
+      if (typed == nullptr)
+        return false;
+      T val = typed->value();
+      out.type = k;
+      if constexpr (std::is_same_v<T, gl::GLboolean>) {
+        out.bits = val == gl::GL_TRUE ? 1 : 0;
+      }
+      else if constexpr (std::is_floating_point_v<T>) {
+        double d = val;
+        std::memcpy(&out.bits, &d, sizeof(d));
+      }
+      else if constexpr (std::is_pointer_v<T>) {
+        out.bits = uint64_t(reinterpret_cast<uintptr_t>(val));
+      }
+      else if constexpr (std::is_signed_v<T>) {
+        out.bits = uint64_t(int64_t(val));
+      }
+      else {
+        out.bits = uint64_t(val);
+      }
+      return true;
+    }
+
+    // glbinding keeps each argument as Value<T> of its declared type, so
+    // try the types GL actually uses. Anything else is kept as unknown and
+    // the call can't be replayed.
+    inline trace::value encodeValue(const glbinding::AbstractValue* v) {
+      using trace::kind;
+      trace::value out;
+      if (v == nullptr)
+        return out;
+      encodeAs<gl::GLenum>(v, kind::enumeration, out) ||
+        encodeAs<gl::GLint>(v, kind::sint, out) ||
+        encodeAs<gl::GLuint>(v, kind::uint, out) ||
+        encodeAs<gl::GLboolean>(v, kind::boolean, out) ||
+        encodeAs<gl::GLfloat>(v, kind::real, out) ||
+        encodeAs<gl::GLdouble>(v, kind::real, out) ||
+        encodeAs<gl::GLsizeiptr>(v, kind::sint, out) ||
+        encodeAs<gl::GLint64>(v, kind::sint, out) ||
+        encodeAs<gl::GLuint64>(v, kind::uint, out) ||
+        encodeAs<gl::ClearBufferMask>(v, kind::bitfield, out) ||
+        encodeAs<gl::MapBufferAccessMask>(v, kind::bitfield, out) ||
+        encodeAs<gl::SyncObjectMask>(v, kind::bitfield, out) ||
+        encodeAs<gl::UnusedMask>(v, kind::bitfield, out) ||
+        encodeAs<const void*>(v, kind::pointer, out) ||
+        encodeAs<void*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLuint*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLuint*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLint*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLint*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLfloat*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLfloat*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLchar*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLchar*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLchar* const*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLubyte*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLsizei*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLsizei*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLenum*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLint64*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLuint64*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLboolean*>(v, kind::pointer, out) ||
+        encodeAs<const gl::GLdouble*>(v, kind::pointer, out) ||
+        encodeAs<gl::GLsync>(v, kind::pointer, out);
+      return out;
+    }
+
+    // What a function's pointer arguments point at, for attaching blobs.
+    enum class payload : uint8_t {
+      none,
+      buffer_data,      // glBufferData(target, size, data, usage)
+      buffer_sub_data,  // glBufferSubData(target, offset, size, data)
+      tex_image_2d,     // glTexImage2D(.., w, h, border, format, type, data)
+      tex_sub_image_2d,
+      tex_image_3d,
+      tex_sub_image_3d,
+      compressed_image,      // glCompressedTexImage2D(.., size, data)
+      compressed_sub_image,  // glCompressedTexSubImage2D(.., size, data)
+      shader_source,  // glShaderSource(shader, count, strings, lengths)
+      uniform_vec,    // glUniformNxv(location, count, value)
+      uniform_mat,    // glUniformMatrixNfv(location, count, transpose, value)
+      names,          // glGen*/glDelete*(n, names)
+      string,         // glGetUniformLocation(program, name) and friends
+      labelled,       // glObjectLabel(.., length, label), glPushDebugGroup
+      pixel_store,    // tracked, for unpack alignment
+      bind_buffer,    // tracked, for unpack buffer bindings
+      map_buffer,     // tracked, glMapBufferRange(target, offset, size, access)
+      unmap_buffer,   // glUnmapBuffer(target), with what the mapping holds
+    };
+
+    inline payload classifyPayload(std::string_view name, uint32_t& width) {
+      auto starts = [&](std::string_view p) { return name.starts_with(p); };
+      width       = 0;
+      if (name == "glBufferData")
+        return payload::buffer_data;
+      if (name == "glBufferSubData")
+        return payload::buffer_sub_data;
+      if (name == "glTexImage2D")
+        return payload::tex_image_2d;
+      if (name == "glTexSubImage2D")
+        return payload::tex_sub_image_2d;
+      if (name == "glTexImage3D")
+        return payload::tex_image_3d;
+      if (name == "glTexSubImage3D")
+        return payload::tex_sub_image_3d;
+      if (name == "glCompressedTexImage2D")
+        return payload::compressed_image;
+      if (name == "glCompressedTexSubImage2D")
+        return payload::compressed_sub_image;
+      if (name == "glShaderSource")
+        return payload::shader_source;
+      if (name == "glGetUniformLocation" || name == "glGetAttribLocation") {
+        width = 1;
+        return payload::string;
+      }
+      if (name == "glBindAttribLocation") {
+        width = 2;
+        return payload::string;
+      }
+      if (name == "glObjectLabel" || name == "glPushDebugGroup")
+        return payload::labelled;
+      if (name == "glPixelStorei")
+        return payload::pixel_store;
+      if (name == "glBindBuffer")
+        return payload::bind_buffer;
+      if (name == "glMapBufferRange")
+        return payload::map_buffer;
+      if (name == "glUnmapBuffer")
+        return payload::unmap_buffer;
+      if (starts("glUniformMatrix") && name.ends_with("fv")) {
+        // glUniformMatrix4fv, non-square ones aren't worth the trouble
+        width = uint32_t(name[15] - '0');
+        width *= width;
+        return name.size() == 18 ? payload::uniform_mat : payload::none;
+      }
+      if (starts("glUniform") && name.ends_with("v") && name.size() >= 12) {
+        width = uint32_t(name[9] - '0');
+        return width >= 1 && width <= 4 ? payload::uniform_vec : payload::none;
+      }
+      for (auto p : {
+             "glGenBuffers", "glGenTextures", "glGenVertexArrays",
+             "glGenFramebuffers", "glGenRenderbuffers", "glGenQueries",
+             "glGenSamplers", "glDeleteBuffers", "glDeleteTextures",
+             "glDeleteVertexArrays", "glDeleteFramebuffers",
+             "glDeleteRenderbuffers", "glDeleteQueries", "glDeleteSamplers",
+           }) {
+        if (name == p)
+          return payload::names;
+      }
+      return payload::none;
+    }
+
+    // Bytes per pixel of client pixel data.
+    inline uint32_t pixelBytes(gl::GLenum format, gl::GLenum type) {
+      using namespace gl;
+      switch (type) {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+          return 2;
+        case GL_UNSIGNED_INT_8_8_8_8:
+        case GL_UNSIGNED_INT_8_8_8_8_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_24_8:
+          return 4;
+        default:
+          break;
+      }
+      uint32_t size = 1;
+      switch (type) {
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+          size = 2;
+          break;
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+          size = 4;
+          break;
+        default:
+          break;
+      }
+      switch (format) {
+        case GL_RG:
+        case GL_RG_INTEGER:
+          return size * 2;
+        case GL_RGB:
+        case GL_BGR:
+        case GL_RGB_INTEGER:
+          return size * 3;
+        case GL_RGBA:
+        case GL_BGRA:
+        case GL_RGBA_INTEGER:
+          return size * 4;
+        default:
+          return size;
+      }
+    }
+  }  // namespace details
+
+  // Opt-in GL instrumentation through glbinding's callbacks: per-function
+  // call counts and times, and optionally a binary trace of every call
+  // (see oglc::trace). Nothing is installed unless start() is called, so
+  // it costs nothing otherwise. Callbacks are global, so only use GL from
+  // one thread at a time while this is on.
+  class GlTracer {
+  public:
+    static GlTracer& instance() {
+      static GlTracer tracer;
+      return tracer;
+    }
+
+    static bool active() { return s_active; }
+
+    // Installs the callbacks. Stats are always kept; with a path, calls
+    // are also written to a trace file.
+    void start(const std::string& trace_path = {}) {
+      using glbinding::CallbackMask;
+      if (!trace_path.empty()) {
+        m_file.open(trace_path, std::ios::binary);
+        if (!m_file)
+          throw std::runtime_error("Failed to open " + trace_path);
+        m_buffer.reserve(buffer_size);
+        put(trace::magic, sizeof(trace::magic));
+      }
+      m_baseTicks = details::readTicks();
+      m_baseNs    = monotonicNanos();
+
+      glbinding::setBeforeCallback([this](const glbinding::FunctionCall& call) {
+        before(call);
+        t_start = details::readTicks();
+      });
+      glbinding::setAfterCallback([this](const glbinding::FunctionCall& call) {
+        after(call, details::readTicks());
+      });
+      auto mask = CallbackMask::Before | CallbackMask::After;
+      if (m_file.is_open())
+        mask = mask | CallbackMask::ParametersAndReturnValue;
+      glbinding::setCallbackMask(mask);
+      s_active = true;
+    }
+
+    // Once per frame, after the swap.
+    void endFrame() {
+      uint64_t calls = 0;
+      for (auto& f : m_functions) {
+        calls += f.frame_calls;
+        f.max_frame_calls = std::max(f.max_frame_calls, f.frame_calls);
+        f.frame_calls     = 0;
+      }
+      OGLC_COUNTER("gl calls", calls);
+      if (m_file.is_open()) {
+        putTag('F');
+        putRaw(m_frames);
+        flushIfFull();
+      }
+      m_frames++;
+    }
+
+    // Removes the callbacks, closes the trace and prints the stats.
+    void stop(std::ostream& out = std::cerr) {
+      if (!s_active)
+        return;
+      glbinding::setCallbackMask(glbinding::CallbackMask::None);
+      glbinding::setBeforeCallback(nullptr);
+      glbinding::setAfterCallback(nullptr);
+      s_active = false;
+      if (m_file.is_open()) {
+        flush();
+        m_file.close();
+      }
+      print(out);
+    }
+
+    // Per-function table, most expensive first.
+    void print(std::ostream& out = std::cerr) const {
+      uint64_t end_ticks = details::readTicks();
+      double ns_per_tick = 1.0;
+      if (end_ticks > m_baseTicks) {
+        ns_per_tick =
+          double(monotonicNanos() - m_baseNs) / double(end_ticks - m_baseTicks);
+      }
+
+      std::vector<const function_stats*> sorted;
+      for (auto& f : m_functions)
+        sorted.push_back(&f);
+      std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+        return a->ticks > b->ticks;
+      });
+
+      double frames = double(std::max<uint64_t>(m_frames, 1));
+      out << "GL calls over " << m_frames << " frames:\n"
+          << "  " << std::setw(28) << std::left << "function" << std::right
+          << std::setw(10) << "calls/fr" << std::setw(8) << "max/fr"
+          << std::setw(12) << "total ms" << std::setw(10) << "ns/call\n";
+      for (auto f : sorted) {
+        double ns = double(f->ticks) * ns_per_tick;
+        out << "  " << std::setw(28) << std::left << f->name << std::right
+            << std::fixed << std::setprecision(2) << std::setw(10)
+            << f->calls / frames << std::setw(8) << f->max_frame_calls
+            << std::setw(12) << ns / 1e6 << std::setw(9)
+            << std::setprecision(0) << ns / double(f->calls) << "\n";
+      }
+    }
+
+  private:
+    struct function_stats {
+      std::string name;
+      uint64_t calls           = 0;
+      uint64_t frame_calls     = 0;
+      uint64_t max_frame_calls = 0;
+      uint64_t ticks           = 0;
+      details::payload payload = details::payload::none;
+      uint32_t payload_width   = 0;  // floats per uniform, or string arg
+      bool named               = false;  // 'N' record written
+    };
+
+    static constexpr size_t buffer_size = size_t(1) << 20;
+
+    GlTracer() = default;
+
+    uint16_t lookup(const glbinding::AbstractFunction* fn) {
+      auto it = m_ids.find(fn);
+      if (it != m_ids.end())
+        return it->second;
+      auto id   = uint16_t(m_functions.size());
+      auto& f   = m_functions.emplace_back();
+      f.name    = fn->name();
+      f.payload = details::classifyPayload(f.name, f.payload_width);
+      m_ids.emplace(fn, id);
+      return id;
+    }
+
+    // The mapping is gone once glUnmapBuffer returns, so its contents
+    // have to be taken here.
+    void before(const glbinding::FunctionCall& call) {
+      if (!m_file.is_open() || call.parameters.empty())
+        return;
+      function_stats& f = m_functions[lookup(call.function)];
+      if (f.payload != details::payload::unmap_buffer)
+        return;
+      m_unmapped.clear();
+      auto target  = details::encodeValue(call.parameters[0].get()).bits;
+      auto mapping = m_mapped.find(m_bound[uint32_t(target)]);
+      if (mapping == m_mapped.end())
+        return;
+      auto bytes = static_cast<const char*>(mapping->second.data);
+      m_unmapped.assign(bytes, bytes + mapping->second.size);
+      m_mapped.erase(mapping);
+    }
+
+    void after(const glbinding::FunctionCall& call, uint64_t end) {
+      uint16_t id       = lookup(call.function);
+      function_stats& f = m_functions[id];
+      f.calls++;
+      f.frame_calls++;
+      f.ticks += end - t_start;
+      track(f, call);
+      if (m_file.is_open())
+        write(f, id, call);
+    }
+
+    // Keeps the state the blob sizes depend on up to date.
+    void track(const function_stats& f, const glbinding::FunctionCall& call) {
+      using details::payload;
+      bool tracked = f.payload == payload::pixel_store ||
+        f.payload == payload::bind_buffer || f.payload == payload::map_buffer;
+      if (!tracked)
+        return;
+      auto arg = [&](size_t i) {
+        return i < call.parameters.size()
+          ? details::encodeValue(call.parameters[i].get())
+          : trace::value {};
+      };
+      if (f.payload == payload::pixel_store) {
+        if (gl::GLenum(arg(0).bits) == gl::GL_UNPACK_ALIGNMENT)
+          m_unpackAlignment = uint32_t(arg(1).bits);
+      }
+      else if (f.payload == payload::bind_buffer) {
+        m_bound[uint32_t(arg(0).bits)] = uint32_t(arg(1).bits);
+      }
+      // only writes need recording, and only while tracing
+      else if (
+        call.returnValue &&
+        (arg(3).bits & uint64_t(gl::GL_MAP_WRITE_BIT)) != 0) {
+        auto data = details::encodeValue(call.returnValue.get()).bits;
+        if (data != 0) {
+          m_mapped[m_bound[uint32_t(arg(0).bits)]] = {
+            reinterpret_cast<const void*>(uintptr_t(data)),
+            size_t(arg(2).bits)};
+        }
+      }
+    }
+
+    void write(
+      function_stats& f, uint16_t id, const glbinding::FunctionCall& call) {
+      if (!f.named) {
+        putTag('N');
+        putRaw(id);
+        putRaw(uint16_t(f.name.size()));
+        put(f.name.data(), f.name.size());
+        f.named = true;
+      }
+
+      m_args.clear();
+      for (auto& p : call.parameters)
+        m_args.push_back(details::encodeValue(p.get()));
+
+      putTag('C');
+      putRaw(id);
+      putRaw(uint8_t(m_args.size()));
+      for (auto& v : m_args)
+        putValue(v);
+      putRaw(uint8_t(call.returnValue != nullptr));
+      if (call.returnValue)
+        putValue(details::encodeValue(call.returnValue.get()));
+
+      m_blobs.clear();
+      collectBlobs(f);
+      putRaw(uint8_t(m_blobs.size()));
+      for (auto& b : m_blobs) {
+        putRaw(b.arg);
+        putRaw(uint32_t(b.size));
+        put(b.data, b.size);
+      }
+      flushIfFull();
+    }
+
+    struct blob {
+      uint8_t arg;
+      const void* data;
+      size_t size;
+    };
+
+    struct mapping {
+      const void* data;
+      size_t size;
+    };
+
+    void collectBlobs(const function_stats& f) {
+      using details::payload;
+      auto ptr = [&](size_t i) -> const void* {
+        if (i >= m_args.size() || m_args[i].type != trace::kind::pointer)
+          return nullptr;
+        return reinterpret_cast<const void*>(uintptr_t(m_args[i].bits));
+      };
+      auto num = [&](size_t i) {
+        return i < m_args.size() ? m_args[i].asInt() : 0;
+      };
+      auto add = [&](size_t i, const void* data, size_t size) {
+        if (data != nullptr && size > 0)
+          m_blobs.push_back({uint8_t(i), data, size});
+      };
+      // rows are padded to the unpack alignment, except the last one
+      auto image = [&](size_t data, int64_t w, int64_t h, int64_t d,
+                       size_t format, size_t type) {
+        if (m_bound[uint32_t(gl::GL_PIXEL_UNPACK_BUFFER)] != 0)
+          return;
+        size_t bpp = details::pixelBytes(
+          gl::GLenum(num(format)), gl::GLenum(num(type)));
+        size_t align = std::max<uint32_t>(m_unpackAlignment, 1);
+        size_t row   = (size_t(w) * bpp + align - 1) / align * align;
+        size_t rows  = size_t(h) * size_t(d);
+        if (rows > 0)
+          add(data, ptr(data), row * (rows - 1) + size_t(w) * bpp);
+      };
+
+      switch (f.payload) {
+        case payload::buffer_data:
+          add(2, ptr(2), size_t(num(1)));
+          break;
+        case payload::buffer_sub_data:
+          add(3, ptr(3), size_t(num(2)));
+          break;
+        case payload::tex_image_2d:
+          image(8, num(3), num(4), 1, 6, 7);
+          break;
+        case payload::tex_sub_image_2d:
+          image(8, num(4), num(5), 1, 6, 7);
+          break;
+        case payload::tex_image_3d:
+          image(9, num(3), num(4), num(5), 7, 8);
+          break;
+        case payload::tex_sub_image_3d:
+          image(10, num(5), num(6), num(7), 8, 9);
+          break;
+        // sized by the caller, no unpack alignment involved
+        case payload::compressed_image:
+          if (m_bound[uint32_t(gl::GL_PIXEL_UNPACK_BUFFER)] == 0)
+            add(7, ptr(7), size_t(num(6)));
+          break;
+        case payload::compressed_sub_image:
+          if (m_bound[uint32_t(gl::GL_PIXEL_UNPACK_BUFFER)] == 0)
+            add(8, ptr(8), size_t(num(7)));
+          break;
+        case payload::shader_source: {
+          auto strings = static_cast<const gl::GLchar* const*>(ptr(2));
+          auto lengths = static_cast<const gl::GLint*>(ptr(3));
+          for (int64_t i = 0; strings && i < num(1); i++) {
+            size_t len = lengths && lengths[i] >= 0 ? size_t(lengths[i])
+                                                    : std::strlen(strings[i]);
+            add(2, strings[i], len);
+          }
+        } break;
+        case payload::uniform_vec:
+          add(2, ptr(2), size_t(num(1)) * f.payload_width * 4);
+          break;
+        case payload::uniform_mat:
+          add(3, ptr(3), size_t(num(1)) * f.payload_width * 4);
+          break;
+        case payload::names:
+          add(1, ptr(1), size_t(num(0)) * sizeof(gl::GLuint));
+          break;
+        // strings keep their terminator, so a replay can pass them as is
+        case payload::string:
+          if (auto str = static_cast<const char*>(ptr(f.payload_width)))
+            add(f.payload_width, str, std::strlen(str) + 1);
+          break;
+        case payload::unmap_buffer:
+          add(0, m_unmapped.data(), m_unmapped.size());
+          break;
+        case payload::labelled:
+          if (auto str = static_cast<const char*>(ptr(3))) {
+            size_t len = num(2) < 0 ? std::strlen(str) + 1 : size_t(num(2));
+            add(3, str, len);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+
+    void putTag(char tag) { putRaw(uint8_t(tag)); }
+    void putValue(const trace::value& v) {
+      putRaw(uint8_t(v.type));
+      putRaw(v.bits);
+    }
+    template <class T>
+    void putRaw(const T& v) {
+      put(&v, sizeof(T));
+    }
+    void put(const void* data, size_t size) {
+      auto bytes = static_cast<const char*>(data);
+      m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+    }
+    void flushIfFull() {
+      if (m_buffer.size() >= buffer_size)
+        flush();
+    }
+    void flush() {
+      m_file.write(m_buffer.data(), std::streamsize(m_buffer.size()));
+      m_buffer.clear();
+    }
+
+    inline static bool s_active = false;
+    inline static thread_local uint64_t t_start = 0;
+
+    std::unordered_map<const glbinding::AbstractFunction*, uint16_t> m_ids;
+    std::vector<function_stats> m_functions;
+    uint64_t m_frames    = 0;
+    uint64_t m_baseTicks = 0;
+    uint64_t m_baseNs    = 0;
+
+    std::ofstream m_file;
+    std::vector<char> m_buffer;
+    std::vector<trace::value> m_args;
+    std::vector<blob> m_blobs;
+    uint32_t m_unpackAlignment = 4;
+    // buffer bound to each target, and the live write mappings by buffer
+    std::unordered_map<uint32_t, uint32_t> m_bound;
+    std::unordered_map<uint32_t, mapping> m_mapped;
+    std::vector<char> m_unmapped;
+  };
+}  // namespace oglc
+#endif
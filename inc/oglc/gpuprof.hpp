@@ -0,0 +1,246 @@
+#ifndef OGLC_GPUPROF_HPP_INCLUDED
+#define OGLC_GPUPROF_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "oglc/debug.hpp"
+#include "oglc/snapshot.hpp"
+#include "oglc/trace.hpp"
+
+// Times the GPU work issued inside the enclosing scope.
+#define OGLC_GPU_ZONE(name) \
+  ::oglc::GpuZone OGLC_CONCAT(_oglc_gpu_zone_, __LINE__)(name)
+
+namespace oglc {
+  class GpuZone;
+
+  // GPU profiler built on GL_TIMESTAMP queries. Zones are bracketed with
+  // two glQueryCounter timestamps rather than GL_TIME_ELAPSED, since
+  // elapsed-time queries can't nest.
+  //
+  // Queries live in a ring of `latency` frames. A frame's results are only
+  // read back when its slot comes round again, by which point the GPU is
+  // long done with it, so the profiler never stalls the pipeline. If a
+  // frame still isn't done, its results are dropped rather than waited on.
+  class GpuProfiler {
+    friend class ::oglc::GpuZone;
+
+  public:
+    explicit GpuProfiler(
+      uint32_t latency = 4, uint32_t max_zones = 256,
+      size_t max_history = 1 << 20) :
+      m_latency(latency), m_maxZones(max_zones), m_maxHistory(max_history) {}
+    // not copyable or movable, zones point back at us
+    GpuProfiler(const GpuProfiler&)            = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+    // GL objects must be released with release() while the context is
+    // still alive, we don't know if it is by now.
+    ~GpuProfiler() {
+      if (s_active == this)
+        s_active = nullptr;
+    }
+
+    // Zones opened by OGLC_GPU_ZONE go to this profiler.
+    void activate() { s_active = this; }
+    static GpuProfiler* active() { return s_active; }
+
+    // Marks the start of a new frame. Collects the results for the frame
+    // that last used this ring slot.
+    void beginFrame() {
+      if (m_queries.empty())
+        init();
+
+      m_frame++;
+      frame_slot& slot = m_slots[m_frame % m_latency];
+      collect(slot);
+      slot.zones.clear();
+      m_current = &slot;
+    }
+
+    // Deletes all query objects. Call before the context goes away.
+    void release() {
+      if (!m_queries.empty())
+        gl::glDeleteQueries(gl::GLsizei(m_queries.size()), m_queries.data());
+      m_queries.clear();
+      m_slots.clear();
+      m_current = nullptr;
+    }
+
+    uint64_t droppedFrames() const { return m_dropped; }
+
+    // Appends all collected zones to a trace. Each zone shows up twice: on
+    // the GPU track when it executed, and on the CPU track it was issued
+    // from.
+    void exportTo(TraceWriter& trace, uint32_t cpu_tid = 0) const {
+      trace.threadName(TraceWriter::gpu_track, "GPU");
+      for (auto& z : m_history) {
+        trace.complete(
+          z.name, TraceWriter::gpu_track, z.gpu_begin, z.gpu_end - z.gpu_begin);
+        trace.complete(z.name, cpu_tid, z.cpu_begin, z.cpu_end - z.cpu_begin);
+      }
+    }
+
+    // Mean GPU time per zone name over the whole run.
+    void print(std::ostream& out = std::cerr) const {
+      out << "GPU zones (" << m_dropped << " frames dropped):\n";
+      for (auto& [name, s] : m_totals) {
+        out << "  " << std::setw(24) << std::left << name << std::right
+            << std::fixed << std::setprecision(4)
+            << (s.count ? s.total / 1e6 / s.count : 0.0) << " ms avg over "
+            << s.count << "\n";
+      }
+    }
+
+  private:
+    struct zone_record {
+      const char* name;
+      uint32_t begin_query;
+      uint32_t end_query;
+      uint64_t cpu_begin;
+      uint64_t cpu_end;
+    };
+    struct frame_slot {
+      std::vector<zone_record> zones;
+      uint32_t first_query = 0;  // this slot owns [first_query, +2*max_zones)
+      uint32_t used        = 0;
+      uint32_t last_query  = 0;  // the one issued last
+    };
+    struct resolved_zone {
+      const char* name;
+      uint64_t gpu_begin, gpu_end;
+      uint64_t cpu_begin, cpu_end;
+    };
+    struct totals {
+      uint64_t total = 0;
+      uint64_t count = 0;
+    };
+
+    void init() {
+      using namespace gl;
+      m_queries.resize(size_t(m_latency) * m_maxZones * 2);
+      glGenQueries(GLsizei(m_queries.size()), m_queries.data());
+      m_slots.resize(m_latency);
+      for (uint32_t i = 0; i < m_latency; i++) {
+        m_slots[i].first_query = i * m_maxZones * 2;
+        m_slots[i].zones.reserve(m_maxZones);
+      }
+      calibrate();
+    }
+
+    // Maps GPU timestamps onto the CPU's steady clock.
+    void calibrate() {
+      gl::GLint64 gpu_now;
+      gl::glGetInteger64v(gl::GL_TIMESTAMP, &gpu_now);
+      m_cpuBase = monotonicNanos();
+      m_gpuBase = uint64_t(gpu_now);
+    }
+
+    void collect(frame_slot& slot) {
+      using namespace gl;
+      slot.used = 0;
+      if (slot.zones.empty())
+        return;
+
+      // queries finish in the order they were issued, so the last one
+      // tells us about all of them; with nested zones that's the outer
+      // zone's end, not the last zone opened
+      GLint available = 0;
+      glGetQueryObjectiv(
+        m_queries[slot.last_query], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        m_dropped++;
+        return;
+      }
+
+      for (auto& z : slot.zones) {
+        // left open across the frame, its end was never issued
+        if (z.cpu_end == 0)
+          continue;
+        GLuint64 t0 = 0, t1 = 0;
+        glGetQueryObjectui64v(m_queries[z.begin_query], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(m_queries[z.end_query], GL_QUERY_RESULT, &t1);
+
+        if (m_history.size() < m_maxHistory) {
+          m_history.push_back(
+            {z.name, t0 - m_gpuBase + m_cpuBase, t1 - m_gpuBase + m_cpuBase,
+             z.cpu_begin, z.cpu_end});
+        }
+        auto& s = m_totals[z.name];
+        s.total += t1 - t0;
+        s.count++;
+      }
+    }
+
+    // Returns the index into zones, or -1 if this frame is out of queries.
+    int32_t open(const char* name) {
+      if (m_current == nullptr || m_current->used + 2 > m_maxZones * 2)
+        return -1;
+      frame_slot& slot = *m_current;
+      uint32_t q       = slot.first_query + slot.used;
+      slot.used += 2;
+      slot.last_query = q;
+      gl::glQueryCounter(m_queries[q], gl::GL_TIMESTAMP);
+      slot.zones.push_back({name, q, q + 1, monotonicNanos(), 0});
+      return int32_t(slot.zones.size() - 1);
+    }
+    // A zone still open when its frame ended is dropped: its slot has
+    // moved on, and collect() skips it for want of an end.
+    void close(uint64_t frame, int32_t index) {
+      if (frame != m_frame || m_current == nullptr)
+        return;
+      zone_record& z = m_current->zones[size_t(index)];
+      gl::glQueryCounter(m_queries[z.end_query], gl::GL_TIMESTAMP);
+      m_current->last_query = z.end_query;
+      z.cpu_end             = monotonicNanos();
+    }
+
+    inline static GpuProfiler* s_active = nullptr;
+
+    uint32_t m_latency;
+    uint32_t m_maxZones;
+    size_t m_maxHistory;
+    uint64_t m_frame   = 0;
+    uint64_t m_dropped = 0;
+    uint64_t m_cpuBase = 0;
+    uint64_t m_gpuBase = 0;
+    std::vector<gl::GLuint> m_queries;
+    std::vector<frame_slot> m_slots;
+    frame_slot* m_current = nullptr;
+    std::vector<resolved_zone> m_history;
+    std::map<std::string_view, totals> m_totals;
+  };
+
+  // Scoped GPU zone, use through OGLC_GPU_ZONE. With debug output on, it
+  // is also a debug group, so zones show up in frame debuggers too.
+  class GpuZone {
+  public:
+    explicit GpuZone(const char* name) :
+      m_group(name),
+      m_prof(GpuProfiler::active()),
+      m_frame(m_prof ? m_prof->m_frame : 0),
+      m_index(m_prof ? m_prof->open(name) : -1) {}
+    GpuZone(const GpuZone&)            = delete;
+    GpuZone& operator=(const GpuZone&) = delete;
+    ~GpuZone() {
+      if (m_index >= 0)
+        m_prof->close(m_frame, m_index);
+    }
+
+  private:
+    DebugGroup m_group;
+    GpuProfiler* m_prof;
+    uint64_t m_frame;  // the profiler's, when opened
+    int32_t m_index;
+  };
+}  // namespace oglc
+#endif
@@ -13,6 +13,9 @@
 #include <memory>
 
 #include "cmrc/cmrc.hpp"
+#include "oglc/debug.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/startup.hpp"
 
 // OGLC: OpenGL Classes
 namespace oglc {
@@ -47,9 +50,16 @@ namespace oglc {
       m_handle = 0;
     }
     
+    // Names the shader in GL debug output.
+    Shader& label(std::string_view name) {
+      labelObject(gl::GL_SHADER, m_handle, name);
+      return *this;
+    }
+    
   private:
     Shader(gl::GLenum type, const char* begin, gl::GLint len) :
       m_handle(gl::glCreateShader(type)) {
+      OGLC_STARTUP_PHASE("shader compile");
       gl::glShaderSource(m_handle, 1, &begin, &len);
       gl::glCompileShader(m_handle);
       
@@ -67,6 +77,7 @@ namespace oglc {
     }
     Shader(gl::GLenum type, const char* cstr) :
       m_handle(gl::glCreateShader(type)) {
+      OGLC_STARTUP_PHASE("shader compile");
       gl::glShaderSource(m_handle, 1, &cstr, nullptr);
       gl::glCompileShader(m_handle);
       
@@ -100,6 +111,7 @@ namespace oglc {
       }
       
       // bind shaders and link
+      OGLC_STARTUP_PHASE("shader link");
       (gl::glAttachShader(m_handle, shaders.m_handle), ...);
       gl::glLinkProgram(m_handle);
       // I'm not sure why this has to be here but it does.
@@ -119,6 +131,12 @@ namespace oglc {
       m_handle = 0;
     }
     
+    // Names the program in GL debug output.
+    ShaderProgram& label(std::string_view name) {
+      labelObject(gl::GL_PROGRAM, m_handle, name);
+      return *this;
+    }
+    
     void use() {
       if (m_handle == 0)
         throw std::logic_error("Handle is not assigned to any shader");
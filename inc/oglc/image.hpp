@@ -0,0 +1,58 @@
+#ifndef OGLC_IMAGE_HPP_INCLUDED
+#define OGLC_IMAGE_HPP_INCLUDED
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace oglc {
+  // 8-bit RGB image, rows top-down. Stored as binary PPM (P6), which is
+  // trivial to read back and opens in most image viewers.
+  struct Image {
+    int width  = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+
+    Image() = default;
+    Image(int w, int h) : width(w), height(h), pixels(size_t(w) * h * 3) {}
+
+    uint8_t* row(int y) { return pixels.data() + size_t(y) * width * 3; }
+    const uint8_t* row(int y) const {
+      return pixels.data() + size_t(y) * width * 3;
+    }
+
+    void writePpm(const std::string& path) const {
+      std::ofstream out(path, std::ios::binary);
+      if (!out)
+        throw std::runtime_error("Failed to open " + path);
+      out << "P6\n" << width << " " << height << "\n255\n";
+      out.write(
+        reinterpret_cast<const char*>(pixels.data()),
+        std::streamsize(pixels.size()));
+    }
+
+    static Image readPpm(const std::string& path) {
+      std::ifstream in(path, std::ios::binary);
+      if (!in)
+        throw std::runtime_error("Failed to open " + path);
+
+      std::string magic;
+      int w = 0, h = 0, maxval = 0;
+      in >> magic >> w >> h >> maxval;
+      in.get();  // the single whitespace before the data
+      if (!in || magic != "P6" || maxval != 255 || w <= 0 || h <= 0)
+        throw std::runtime_error(path + " is not an 8-bit binary PPM");
+
+      Image img(w, h);
+      in.read(
+        reinterpret_cast<char*>(img.pixels.data()),
+        std::streamsize(img.pixels.size()));
+      if (!in)
+        throw std::runtime_error(path + " is truncated");
+      return img;
+    }
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,269 @@
+#ifndef OGLC_KTX_HPP_INCLUDED
+#define OGLC_KTX_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace oglc {
+  // Khronos KTX2 textures, as far as we use them: a single 2D image with
+  // its mip chain, RGBA8 or block compressed, no arrays, cube maps or
+  // supercompression. Enough to ship textures ready to upload, and the
+  // Khronos tools can read them.
+  //
+  // Layout: identifier, header, index, level index, data format
+  // descriptor, then the levels smallest first. All little endian.
+  namespace ktx {
+    inline constexpr uint8_t identifier[12] = {
+      0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n',
+    };
+
+    // KTX2 names formats by their Vulkan number.
+    enum class format : uint32_t {
+      rgba8        = 37,   // VK_FORMAT_R8G8B8A8_UNORM
+      srgb8_alpha8 = 43,   // VK_FORMAT_R8G8B8A8_SRGB
+      bc1          = 133,  // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+      bc1_srgb     = 134,  // VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+      bc3          = 137,  // VK_FORMAT_BC3_UNORM_BLOCK
+      bc3_srgb     = 138,  // VK_FORMAT_BC3_SRGB_BLOCK
+      bc7          = 145,  // VK_FORMAT_BC7_UNORM_BLOCK
+      bc7_srgb     = 146,  // VK_FORMAT_BC7_SRGB_BLOCK
+    };
+
+    inline bool known(uint32_t vk_format) {
+      switch (format(vk_format)) {
+        case format::rgba8:
+        case format::srgb8_alpha8:
+        case format::bc1:
+        case format::bc1_srgb:
+        case format::bc3:
+        case format::bc3_srgb:
+        case format::bc7:
+        case format::bc7_srgb:
+          return true;
+      }
+      return false;
+    }
+
+    inline bool isSrgb(format f) {
+      return f == format::srgb8_alpha8 || f == format::bc1_srgb ||
+        f == format::bc3_srgb || f == format::bc7_srgb;
+    }
+
+    inline bool isCompressed(format f) {
+      return f != format::rgba8 && f != format::srgb8_alpha8;
+    }
+
+    // Texels are stored in blocks, 4x4 when compressed and single ones
+    // otherwise.
+    inline int blockSize(format f) { return isCompressed(f) ? 4 : 1; }
+
+    inline size_t blockBytes(format f) {
+      if (f == format::bc1 || f == format::bc1_srgb)
+        return 8;
+      return isCompressed(f) ? 16 : 4;
+    }
+
+    inline size_t levelBytes(format f, int width, int height) {
+      int b = blockSize(f);
+      return size_t((width + b - 1) / b) * size_t((height + b - 1) / b) *
+        blockBytes(f);
+    }
+
+    struct level {
+      int width;
+      int height;
+      std::span<const uint8_t> data;
+    };
+
+    namespace details {
+      inline constexpr size_t header_size = 80;  // up to the level index
+      inline constexpr size_t level_entry = 24;
+
+      // KHR_DF basic descriptor block.
+      inline std::vector<uint32_t> describe(format f) {
+        struct sample {
+          uint32_t offset, bits, channel, upper;
+        };
+        // alpha isn't sRGB encoded even when the colours are
+        const uint32_t linear_alpha = isSrgb(f) ? 15 | 0x10 : 15;
+
+        uint32_t model = 1;  // RGBSDA
+        std::vector<sample> samples;
+        switch (f) {
+          case format::rgba8:
+          case format::srgb8_alpha8:
+            samples = {
+              {0, 8, 0, 255},
+              {8, 8, 1, 255},
+              {16, 8, 2, 255},
+              {24, 8, linear_alpha, 255},
+            };
+            break;
+          case format::bc1:
+          case format::bc1_srgb:
+            model   = 128;
+            samples = {{0, 64, 1, UINT32_MAX}};  // colour, alpha present
+            break;
+          case format::bc3:
+          case format::bc3_srgb:
+            model   = 130;
+            samples = {{0, 64, 15, UINT32_MAX}, {64, 64, 0, UINT32_MAX}};
+            break;
+          case format::bc7:
+          case format::bc7_srgb:
+            model   = 134;
+            samples = {{0, 128, 0, UINT32_MAX}};
+            break;
+        }
+
+        const uint32_t bt709 = 1;
+        uint32_t transfer    = isSrgb(f) ? 2 : 1;
+        uint32_t dims        = uint32_t(blockSize(f) - 1) * 0x0101;
+        uint32_t block_size  = uint32_t(24 + samples.size() * 16);
+
+        std::vector<uint32_t> dfd = {
+          4 + block_size,        // dfdTotalSize
+          0,                     // Khronos, basic descriptor
+          2 | block_size << 16,  // version 2
+          model | bt709 << 8 | transfer << 16,
+          dims,                     // texel block size - 1
+          uint32_t(blockBytes(f)),  // bytes in plane 0
+          0,
+        };
+        for (auto& s : samples) {
+          dfd.insert(
+            dfd.end(),
+            {s.offset | (s.bits - 1) << 16 | s.channel << 24, 0, 0, s.upper});
+        }
+        return dfd;
+      }
+
+      template <class T>
+      T read(std::span<const uint8_t> blob, size_t offset) {
+        T value;
+        std::memcpy(&value, blob.data() + offset, sizeof(T));
+        return value;
+      }
+
+      template <class T>
+      void write(std::vector<uint8_t>& out, size_t offset, T value) {
+        std::memcpy(out.data() + offset, &value, sizeof(T));
+      }
+    }  // namespace details
+
+    // A KTX2 file in memory, checked and indexed. Levels point into the
+    // blob, which has to outlive this.
+    class Texture {
+    public:
+      explicit Texture(std::span<const uint8_t> blob) {
+        using details::read;
+        if (
+          blob.size() < details::header_size ||
+          std::memcmp(blob.data(), identifier, sizeof(identifier)) != 0)
+          throw std::runtime_error("not a KTX2 file");
+
+        uint32_t vk_format = read<uint32_t>(blob, 12);
+        if (!known(vk_format))
+          throw std::runtime_error(
+            "unsupported KTX2 format " + std::to_string(vk_format));
+        m_format = format(vk_format);
+        m_width  = int(read<uint32_t>(blob, 20));
+        m_height = int(read<uint32_t>(blob, 24));
+        if (
+          m_width <= 0 || m_height <= 0 || read<uint32_t>(blob, 28) != 0 ||
+          read<uint32_t>(blob, 32) > 1 || read<uint32_t>(blob, 36) != 1)
+          throw std::runtime_error("KTX2 file is not a plain 2D texture");
+        if (read<uint32_t>(blob, 44) != 0)
+          throw std::runtime_error("supercompressed KTX2 is not supported");
+
+        // 0 asks the loader to generate the mips
+        size_t count = std::max<uint32_t>(read<uint32_t>(blob, 40), 1);
+        if (details::header_size + count * details::level_entry > blob.size())
+          throw std::runtime_error("KTX2 level index is truncated");
+        int w = m_width, h = m_height;
+        for (size_t i = 0; i < count; i++) {
+          size_t entry  = details::header_size + i * details::level_entry;
+          auto offset   = read<uint64_t>(blob, entry);
+          auto length   = read<uint64_t>(blob, entry + 8);
+          size_t expect = levelBytes(m_format, w, h);
+          // length first, so blob.size() - length can't wrap
+          if (
+            length != expect || length > blob.size() ||
+            offset > blob.size() - length)
+            throw std::runtime_error(
+              "KTX2 level " + std::to_string(i) + " is malformed");
+          m_levels.push_back({w, h, blob.subspan(offset, length)});
+          w = std::max(w / 2, 1);
+          h = std::max(h / 2, 1);
+        }
+      }
+
+      format pixelFormat() const { return m_format; }
+      int width() const { return m_width; }
+      int height() const { return m_height; }
+      // Level 0 is the full size.
+      const std::vector<level>& levels() const { return m_levels; }
+
+    private:
+      format m_format;
+      int m_width;
+      int m_height;
+      std::vector<level> m_levels;
+    };
+
+    // Serialises a texture. levels[0] is the full size and each one after
+    // it half the previous, rounded down. Compressed levels hold whole
+    // blocks, partial ones at the edges included.
+    inline std::vector<uint8_t> write(format f, std::span<const level> levels) {
+      using details::write;
+      if (levels.empty())
+        throw std::invalid_argument("a texture needs at least one level");
+      std::vector<uint32_t> dfd = details::describe(f);
+      size_t dfd_offset =
+        details::header_size + levels.size() * details::level_entry;
+      size_t dfd_bytes = dfd.size() * sizeof(uint32_t);
+      size_t align     = std::lcm(blockBytes(f), size_t(4));
+
+      size_t size = dfd_offset + dfd_bytes;
+      std::vector<size_t> offsets(levels.size());
+      for (size_t i = levels.size(); i-- > 0;) {
+        const level& l = levels[i];
+        if (l.data.size() != levelBytes(f, l.width, l.height))
+          throw std::invalid_argument("level size doesn't match its pixels");
+        size       = (size + align - 1) / align * align;
+        offsets[i] = size;
+        size += l.data.size();
+      }
+
+      std::vector<uint8_t> out(size);
+      std::memcpy(out.data(), identifier, sizeof(identifier));
+      write<uint32_t>(out, 12, uint32_t(f));
+      write<uint32_t>(out, 16, 1);  // typeSize
+      write<uint32_t>(out, 20, uint32_t(levels[0].width));
+      write<uint32_t>(out, 24, uint32_t(levels[0].height));
+      write<uint32_t>(out, 36, 1);  // faceCount
+      write<uint32_t>(out, 40, uint32_t(levels.size()));
+      write<uint32_t>(out, 48, uint32_t(dfd_offset));
+      write<uint32_t>(out, 52, uint32_t(dfd_bytes));
+      for (size_t i = 0; i < levels.size(); i++) {
+        size_t entry = details::header_size + i * details::level_entry;
+        write<uint64_t>(out, entry, offsets[i]);
+        write<uint64_t>(out, entry + 8, levels[i].data.size());
+        write<uint64_t>(out, entry + 16, levels[i].data.size());
+        std::memcpy(
+          out.data() + offsets[i], levels[i].data.data(),
+          levels[i].data.size());
+      }
+      std::memcpy(out.data() + dfd_offset, dfd.data(), dfd_bytes);
+      return out;
+    }
+  }  // namespace ktx
+}  // namespace oglc
+#endif
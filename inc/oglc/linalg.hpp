@@ -1,11 +1,11 @@
 #ifndef OGLC_LINALG_HPP_INCLUDED
 #define OGLC_LINALG_HPP_INCLUDED
-#include <bits/utility.h>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 namespace oglc {
   namespace details {
     template <class T>
@@ -36,30 +36,31 @@ namespace oglc {
     static constexpr size_t count = N;
 
     constexpr T& operator[](size_t n) { return _m_data[n]; }
-    constexpr vec<T, 2> swizzle(size_t x, size_t y) {
+    constexpr const T& operator[](size_t n) const { return _m_data[n]; }
+    constexpr vec<T, 2> swizzle(size_t x, size_t y) const {
       return vec<T, 2> {_m_data[x], _m_data[y]};
     }
-    constexpr vec<T, 3> swizzle(size_t x, size_t y, size_t z) {
+    constexpr vec<T, 3> swizzle(size_t x, size_t y, size_t z) const {
       return vec<T, 3> {_m_data[x], _m_data[y], _m_data[z]};
     }
-    constexpr vec<T, 4> swizzle(size_t x, size_t y, size_t z, size_t w) {
+    constexpr vec<T, 4> swizzle(size_t x, size_t y, size_t z, size_t w) const {
       return vec<T, 4> {_m_data[x], _m_data[y], _m_data[z], _m_data[w]};
     }
 
-    constexpr T x() { return _m_data[0]; }
-    constexpr T y() { return _m_data[1]; }
-    constexpr T z() requires(N >= 3) { return _m_data[2]; }
-    constexpr T w() requires(N >= 4) { return _m_data[3]; }
+    constexpr T x() const { return _m_data[0]; }
+    constexpr T y() const { return _m_data[1]; }
+    constexpr T z() const requires(N >= 3) { return _m_data[2]; }
+    constexpr T w() const requires(N >= 4) { return _m_data[3]; }
 
-    constexpr T r() { return _m_data[0]; }
-    constexpr T g() { return _m_data[1]; }
-    constexpr T b() requires(N >= 3) { return _m_data[2]; }
-    constexpr T a() requires(N >= 4) { return _m_data[3]; }
+    constexpr T r() const { return _m_data[0]; }
+    constexpr T g() const { return _m_data[1]; }
+    constexpr T b() const requires(N >= 3) { return _m_data[2]; }
+    constexpr T a() const requires(N >= 4) { return _m_data[3]; }
 
-    constexpr T s() { return _m_data[0]; }
-    constexpr T t() { return _m_data[1]; }
-    constexpr T p() requires(N >= 3) { return _m_data[2]; }
-    constexpr T q() requires(N >= 4) { return _m_data[3]; }
+    constexpr T s() const { return _m_data[0]; }
+    constexpr T t() const { return _m_data[1]; }
+    constexpr T p() const requires(N >= 3) { return _m_data[2]; }
+    constexpr T q() const requires(N >= 4) { return _m_data[3]; }
 
     T _m_data[N];
   };
@@ -123,8 +124,8 @@ namespace oglc {
   template <class T, size_t N>
   constexpr T dot(const vec<T, N>& a, const vec<T, N>& b) requires(
     !std::is_same_v<T, bool>) {
-    [&a, &b ]<size_t... Is>(std::index_sequence<Is...>)->T {
-      return ((a[Is] + b[Is]) * ...);
+    return [&a, &b ]<size_t... Is>(std::index_sequence<Is...>)->T {
+      return ((a[Is] * b[Is]) + ...);
     }
     (std::make_index_sequence<N> {});
   }
@@ -145,10 +146,18 @@ namespace oglc {
   }
   
   template <class T, size_t N>
-  constexpr vec<T, N> norm(const vec<T, N>& a) requires(std::is_floating_point_v<T>) {
+  constexpr vec<T, N> norm(const vec<T, N>& a) requires(
+    std::is_floating_point_v<T>) {
     return a / length(a);
   }
 
+  template <class T, size_t N>
+  constexpr vec<T, N> lerp(
+    const vec<T, N>& a, const vec<T, N>& b,
+    T t) requires(std::is_floating_point_v<T>) {
+    return a + (b - a) * t;
+  }
+
   template <class T, size_t C, size_t R = C>
   struct mat {
     static_assert(
@@ -162,16 +171,25 @@ namespace oglc {
     static constexpr size_t rows = R;
     
 
-    constexpr vec<T, C>& operator[](size_t n) { return _m_data[n]; }
+    static constexpr mat identity() requires(C == R) {
+      mat m {};
+      for (size_t i = 0; i < C; i++)
+        m[i][i] = T(1);
+      return m;
+    }
+
+    // Column-major, like GL: [n] is the nth column.
+    constexpr vec<T, R>& operator[](size_t n) { return _m_data[n]; }
+    constexpr const vec<T, R>& operator[](size_t n) const { return _m_data[n]; }
 
-    constexpr vec<T, R> row(size_t n) {
-      [ this, n ]<size_t... Is>(std::index_sequence<Is...>) {
-        return vec<T, R> {(_m_data[Is][n])...};
+    constexpr vec<T, C> row(size_t n) const {
+      return [ this, n ]<size_t... Is>(std::index_sequence<Is...>) {
+        return vec<T, C> {(_m_data[Is][n])...};
       }
-      (std::make_index_sequence<R> {});
+      (std::make_index_sequence<C> {});
     }
 
-    vec<T, C> _m_data[R];
+    vec<T, R> _m_data[C];
   };
 
   // Basic matrix operations
@@ -184,7 +202,7 @@ namespace oglc {
     return [&a, &b ]<size_t... Is>(std::index_sequence<Is...>) { \
       return mat<T, C, R> {(a[Is] o b[Is])...};                  \
     }                                                            \
-    (std::make_index_sequence<R> {});                            \
+    (std::make_index_sequence<C> {});                            \
   }
 #define MAT_SCALAR_OP(o)                                          \
   template <class T, size_t C, size_t R>                          \
@@ -192,7 +210,7 @@ namespace oglc {
     return [&a, &b ]<size_t... Is>(std::index_sequence<Is...>) {  \
       return mat<T, C, R> {(a[Is] o b)...};                       \
     }                                                             \
-    (std::make_index_sequence<R> {});                             \
+    (std::make_index_sequence<C> {});                             \
   }
 #define MAT_SCALAR_OP_REVERSE(o)                                  \
   template <class T, size_t C, size_t R>                          \
@@ -214,7 +232,7 @@ namespace oglc {
   MAT_SCALAR_OP_REVERSE(*)
 
   template <class T, size_t C, size_t R>
-  constexpr vec<T, R> operator*(const mat<T, C, R>& a, const vec<T, R>& b) {
+  constexpr vec<T, R> operator*(const mat<T, C, R>& a, const vec<T, C>& b) {
     return [&a, &b ]<size_t... Is>(std::index_sequence<Is...>) {
       return vec<T, R> {dot(a.row(Is), b)...};
     }
@@ -240,6 +258,99 @@ namespace oglc {
 #undef MAT_SCALAR_OP
 #undef MAT_SCALAR_OP_REVERSE
 
+  template <class T>
+  constexpr mat<T, 4> translation(const vec<T, 3>& v) {
+    auto m = mat<T, 4>::identity();
+    m[3]   = vec<T, 4> {v[0], v[1], v[2], T(1)};
+    return m;
+  }
+
+  // Quaternions
+  // ===========
+
+  // Unit quaternions for rotations, (x, y, z) is the vector part.
+  template <class T>
+  struct quaternion {
+    static_assert(
+      std::is_floating_point_v<T>,
+      "Only floating-point quaternions are allowed");
+
+    using value_type = T;
+
+    static constexpr quaternion identity() { return {0, 0, 0, 1}; }
+    static quaternion fromAxisAngle(const vec<T, 3>& axis, T angle) {
+      vec<T, 3> v = norm(axis) * std::sin(angle / 2);
+      return {v[0], v[1], v[2], std::cos(angle / 2)};
+    }
+
+    constexpr T& operator[](size_t n) { return _m_data[n]; }
+    constexpr const T& operator[](size_t n) const { return _m_data[n]; }
+
+    T _m_data[4];
+  };
+
+  // Composition: a * b rotates by b, then by a.
+  template <class T>
+  constexpr quaternion<T> operator*(
+    const quaternion<T>& a, const quaternion<T>& b) {
+    return {
+      a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1],
+      a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0],
+      a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3],
+      a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2],
+    };
+  }
+
+  template <class T>
+  constexpr T dot(const quaternion<T>& a, const quaternion<T>& b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+  }
+
+  template <class T>
+  quaternion<T> norm(const quaternion<T>& q) {
+    T l = std::sqrt(dot(q, q));
+    return {q[0] / l, q[1] / l, q[2] / l, q[3] / l};
+  }
+
+  // Interpolates along the shorter arc. Falls back to a normalised lerp
+  // when the two are close enough for that to be indistinguishable, which
+  // also keeps sin(theta) away from 0.
+  template <class T>
+  quaternion<T> slerp(const quaternion<T>& a, quaternion<T> b, T t) {
+    T cos_theta = dot(a, b);
+    if (cos_theta < 0) {
+      b         = {-b[0], -b[1], -b[2], -b[3]};
+      cos_theta = -cos_theta;
+    }
+    T wa = 1 - t, wb = t;
+    if (cos_theta < T(0.9995)) {
+      T theta     = std::acos(cos_theta);
+      T sin_theta = std::sin(theta);
+      wa = std::sin((1 - t) * theta) / sin_theta;
+      wb = std::sin(t * theta) / sin_theta;
+    }
+    quaternion<T> r {
+      wa * a[0] + wb * b[0],
+      wa * a[1] + wb * b[1],
+      wa * a[2] + wb * b[2],
+      wa * a[3] + wb * b[3],
+    };
+    return norm(r);
+  }
+
+  template <class T>
+  constexpr mat<T, 4> rotation(const quaternion<T>& q) {
+    T xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+    T xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+    T wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+    return mat<T, 4> {
+      vec<T, 4> {1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0},
+      vec<T, 4> {2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0},
+      vec<T, 4> {2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0},
+      vec<T, 4> {0, 0, 0, 1},
+    };
+  }
+
   // Typedefs to match GLSL
   // ======================
 
@@ -273,6 +384,9 @@ namespace oglc {
   using mat3 = mat3x3;
   using mat4 = mat4x4;
 
+  using quat  = quaternion<float>;
+  using dquat = quaternion<double>;
+
 #undef VEC_DEF
 #undef MAT_DEF
 }  // namespace oglc
@@ -0,0 +1,336 @@
+#ifndef OGLC_MIPMAP_HPP_INCLUDED
+#define OGLC_MIPMAP_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "oglc/pixels.hpp"
+#include "oglc/workers.hpp"
+
+namespace oglc {
+  // Levels in a full mip chain, down to 1x1.
+  inline int mipLevels(int width, int height) {
+    return std::bit_width(unsigned(std::max(width, height)));
+  }
+
+  inline int mipSize(int size, int level) { return std::max(size >> level, 1); }
+
+  // RGBA8 bytes of the first levels of a chain, back to back.
+  inline size_t mipChainBytes(int width, int height, int levels) {
+    size_t bytes = 0;
+    for (int i = 0; i < levels; i++)
+      bytes += size_t(mipSize(width, i)) * size_t(mipSize(height, i)) * 4;
+    return bytes;
+  }
+
+  enum class MipFilter : uint8_t {
+    box,      // area average, soft
+    kaiser,   // Kaiser windowed sinc, sharp with little ringing
+    lanczos,  // Lanczos 3, sharpest, rings a little at hard edges
+  };
+
+  struct MipOptions {
+    MipFilter filter = MipFilter::box;
+    // The colours are sRGB encoded; they are filtered in linear space.
+    bool srgb = false;
+    // The colours are already multiplied by alpha, before any sRGB
+    // encoding, the way an sRGB framebuffer blends. Otherwise they are
+    // weighted by alpha while filtering, so the colour of transparent
+    // texels doesn't bleed into the rest.
+    bool premultiplied = false;
+  };
+
+  namespace details {
+    // One RGBA texel of floats.
+#ifdef __SSE2__
+    struct float4 {
+      __m128 v;
+
+      static float4 zero() { return {_mm_setzero_ps()}; }
+      static float4 splat(float s) { return {_mm_set1_ps(s)}; }
+      static float4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+      void store(float* p) const { _mm_storeu_ps(p, v); }
+      float4 operator+(float4 o) const { return {_mm_add_ps(v, o.v)}; }
+      float4 operator*(float4 o) const { return {_mm_mul_ps(v, o.v)}; }
+    };
+#else
+    struct float4 {
+      float v[4];
+
+      static float4 zero() { return {}; }
+      static float4 splat(float s) { return {{s, s, s, s}}; }
+      static float4 load(const float* p) {
+        float4 r;
+        std::memcpy(r.v, p, sizeof(r.v));
+        return r;
+      }
+      void store(float* p) const { std::memcpy(p, v, sizeof(v)); }
+      float4 operator+(float4 o) const {
+        return {{v[0] + o.v[0], v[1] + o.v[1], v[2] + o.v[2], v[3] + o.v[3]}};
+      }
+      float4 operator*(float4 o) const {
+        return {{v[0] * o.v[0], v[1] * o.v[1], v[2] * o.v[2], v[3] * o.v[3]}};
+      }
+    };
+#endif
+
+    inline float sinc(float x) {
+      x *= std::numbers::pi_v<float>;
+      return std::abs(x) < 1e-5f ? 1.0f : std::sin(x) / x;
+    }
+
+    // Modified Bessel function of the first kind, order 0.
+    inline float bessel0(float x) {
+      float sum = 1, term = 1;
+      for (int k = 1; k < 16; k++) {
+        float f = x / float(2 * k);
+        term *= f * f;
+        sum += term;
+      }
+      return sum;
+    }
+
+    inline float filterRadius(MipFilter f) {
+      return f == MipFilter::box ? 0.5f : 3.0f;
+    }
+
+    // The kernel at t output texels from the centre.
+    inline float filterWeight(MipFilter f, float t) {
+      const float r = filterRadius(f);
+      if (std::abs(t) >= r)
+        return 0;
+      switch (f) {
+        case MipFilter::box:
+          return 1;
+        case MipFilter::kaiser: {
+          const float alpha = 4;
+          float q           = t / r;
+          return sinc(t) * bessel0(alpha * std::sqrt(1 - q * q)) /
+            bessel0(alpha);
+        }
+        case MipFilter::lanczos:
+          return sinc(t) * sinc(t / r);
+      }
+      return 0;
+    }
+
+    // A separable pass from src texels down to dst along one axis: the
+    // same number of taps for every output, padded with zero weights,
+    // reading source texels clamped to the edge.
+    struct filter_taps {
+      int count = 0;
+      std::vector<int> index;
+      std::vector<float> weight;
+    };
+
+    inline filter_taps filterTaps(MipFilter f, int src, int dst) {
+      const float scale  = float(src) / float(dst);
+      const float radius = filterRadius(f) * scale;
+      const int span     = int(std::ceil(radius * 2)) + 1;
+
+      std::vector<int> first(dst);
+      std::vector<float> weights(size_t(dst) * span);
+      filter_taps taps;
+      for (int o = 0; o < dst; o++) {
+        float centre = (float(o) + 0.5f) * scale;
+        first[o]     = int(std::floor(centre - radius));
+        float* w     = &weights[size_t(o) * span];
+        float sum    = 0;
+        for (int k = 0; k < span; k++) {
+          float i = float(first[o] + k);
+          // a box covers texels partially, the rest are point sampled
+          w[k] = f == MipFilter::box
+            ? std::max(
+                std::min(i + 1, centre + radius) -
+                  std::max(i, centre - radius),
+                0.0f)
+            : filterWeight(f, (i + 0.5f - centre) / scale);
+          sum += w[k];
+        }
+        for (int k = 0; k < span; k++)
+          w[k] /= sum;
+        // zero weights at the far end don't need to be read
+        int used = span;
+        while (used > 1 && w[used - 1] == 0)
+          used--;
+        taps.count = std::max(taps.count, used);
+      }
+
+      taps.index.resize(size_t(dst) * taps.count);
+      taps.weight.resize(size_t(dst) * taps.count);
+      for (int o = 0; o < dst; o++) {
+        for (int k = 0; k < taps.count; k++) {
+          size_t t       = size_t(o) * taps.count + k;
+          taps.index[t]  = std::clamp(first[o] + k, 0, src - 1);
+          taps.weight[t] = weights[size_t(o) * span + k];
+        }
+      }
+      return taps;
+    }
+
+    // RGBA8 to linear, premultiplied floats.
+    inline void linearise(
+      const uint8_t* src, int width, float* dst, const MipOptions& o) {
+      const auto& srgb = srgbTable();
+      for (int x = 0; x < width; x++, src += 4, dst += 4) {
+        float a = src[3] * (1 / 255.0f);
+        float m = o.premultiplied ? 1 : a;
+        for (int c = 0; c < 3; c++)
+          dst[c] = (o.srgb ? srgb[src[c]] : src[c] * (1 / 255.0f)) * m;
+        dst[3] = a;
+      }
+    }
+
+    // Back from linearise(), clamping what the sharper filters overshoot.
+    // The clamped floats go to next, when the next level is filtered from
+    // this one.
+    inline void encode(
+      float* acc, int width, uint8_t* dst, float* next, const MipOptions& o) {
+      for (int x = 0; x < width; x++) {
+        float* p   = acc + size_t(x) * 4;
+        uint8_t* q = dst + size_t(x) * 4;
+        float a    = std::clamp(p[3], 0.0f, 1.0f);
+        p[3]       = a;
+        for (int c = 0; c < 3; c++) {
+          float v = std::clamp(p[c], 0.0f, a);
+          p[c]    = v;
+          if (!o.premultiplied)
+            v = a > 0 ? v / a : 0;
+          q[c] = o.srgb ? linearToSrgb(v) : uint8_t(v * 255.0f + 0.5f);
+        }
+        q[3] = uint8_t(a * 255.0f + 0.5f);
+      }
+      if (next)
+        std::memcpy(next, acc, size_t(width) * 4 * sizeof(float));
+    }
+
+    // Filters one level into the next, in bands of rows spread over the
+    // pool. row(y, scratch) returns source row y as linear floats, using
+    // scratch if it has to convert.
+    template <class Row>
+    void resample(
+      Row&& row, int sw, int sh, int dw, int dh, uint8_t* dst, float* next,
+      const MipOptions& o, WorkerPool* pool) {
+      const filter_taps h = filterTaps(o.filter, sw, dw);
+      const filter_taps v = filterTaps(o.filter, sh, dh);
+      const int band      = 32;
+      const size_t stride = size_t(dw) * 4;
+
+      auto work = [&](size_t b) {
+        thread_local std::vector<float> scratch, rows, acc;
+        int y0 = int(b) * band, y1 = std::min(y0 + band, dh);
+        int lo = v.index[size_t(y0) * v.count];
+        int hi = v.index[size_t(y1) * v.count - 1];
+        scratch.resize(size_t(sw) * 4);
+        rows.resize(size_t(hi - lo + 1) * stride);
+        acc.resize(stride);
+
+        // horizontally, every source row the band reads
+        for (int sy = lo; sy <= hi; sy++) {
+          const float* src = row(sy, scratch.data());
+          float* out       = &rows[size_t(sy - lo) * stride];
+          for (int x = 0; x < dw; x++) {
+            const int* index    = &h.index[size_t(x) * h.count];
+            const float* weight = &h.weight[size_t(x) * h.count];
+            float4 sum          = float4::zero();
+            for (int k = 0; k < h.count; k++) {
+              sum = sum +
+                float4::splat(weight[k]) * float4::load(src + index[k] * 4);
+            }
+            sum.store(out + size_t(x) * 4);
+          }
+        }
+        // then down the columns, a whole row at a time
+        for (int y = y0; y < y1; y++) {
+          std::fill(acc.begin(), acc.end(), 0.0f);
+          for (int k = 0; k < v.count; k++) {
+            size_t t = size_t(y) * v.count + k;
+            if (v.weight[t] == 0)
+              continue;
+            float4 w         = float4::splat(v.weight[t]);
+            const float* src = &rows[size_t(v.index[t] - lo) * stride];
+            for (size_t i = 0; i < stride; i += 4)
+              (float4::load(&acc[i]) + w * float4::load(src + i))
+                .store(&acc[i]);
+          }
+          encode(
+            acc.data(), dw, dst + size_t(y) * stride,
+            next ? next + size_t(y) * stride : nullptr, o);
+        }
+      };
+
+      size_t bands = size_t(dh + band - 1) / band;
+      if (pool) {
+        pool->parallelFor(bands, work);
+      }
+      else {
+        for (size_t b = 0; b < bands; b++)
+          work(b);
+      }
+    }
+  }  // namespace details
+
+  // The next mip level of RGBA8 pixels, half the size rounded down.
+  inline void downsample(
+    std::span<const uint8_t> src, int width, int height, std::span<uint8_t> dst,
+    const MipOptions& options = {}, WorkerPool* pool = nullptr) {
+    int dw = mipSize(width, 1), dh = mipSize(height, 1);
+    if (
+      src.size() < size_t(width) * size_t(height) * 4 ||
+      dst.size() < size_t(dw) * size_t(dh) * 4)
+      throw std::invalid_argument("downsample: buffer is too small");
+    auto row = [&](int y, float* scratch) {
+      details::linearise(
+        &src[size_t(y) * width * 4], width, scratch, options);
+      return static_cast<const float*>(scratch);
+    };
+    details::resample(
+      row, width, height, dw, dh, dst.data(), nullptr, options, pool);
+  }
+
+  // Fills in a mip chain: chain holds the first levels back to back, see
+  // mipChainBytes(), with level 0 already in place. Each level is filtered
+  // from the one before, kept as floats in between so the error doesn't
+  // add up. Bands of rows go to the pool, if there is one, and the calling
+  // thread.
+  inline void generateMips(
+    std::span<uint8_t> chain, int width, int height, int levels,
+    const MipOptions& options = {}, WorkerPool* pool = nullptr) {
+    if (chain.size() < mipChainBytes(width, height, levels))
+      throw std::invalid_argument("generateMips: chain is too small");
+    std::vector<float> prev, next;
+    uint8_t* src = chain.data();
+    for (int i = 1; i < levels; i++) {
+      int sw = mipSize(width, i - 1), sh = mipSize(height, i - 1);
+      int dw = mipSize(width, i), dh = mipSize(height, i);
+      uint8_t* dst = src + size_t(sw) * sh * 4;
+      next.resize(i + 1 < levels ? size_t(dw) * dh * 4 : 0);
+
+      auto row = [&](int y, float* scratch) {
+        if (i > 1)
+          return static_cast<const float*>(&prev[size_t(y) * sw * 4]);
+        details::linearise(src + size_t(y) * sw * 4, sw, scratch, options);
+        return static_cast<const float*>(scratch);
+      };
+      details::resample(
+        row, sw, sh, dw, dh, dst, next.empty() ? nullptr : next.data(),
+        options, pool);
+      std::swap(prev, next);
+      src = dst;
+    }
+  }
+}  // namespace oglc
+#endif
@@ -0,0 +1,157 @@
+#ifndef OGLC_PACING_HPP_INCLUDED
+#define OGLC_PACING_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "oglc/context.hpp"
+#include "oglc/profiler.hpp"
+
+namespace oglc {
+  namespace details {
+    inline void cpuRelax() {
+#ifdef __SSE2__
+      _mm_pause();
+#else
+      std::this_thread::yield();
+#endif
+    }
+
+    // How long a 1 ms sleep really takes on this machine, as a running
+    // mean and deviation. Sleeping stops once the deadline is closer than
+    // mean + deviation, the rest is spun.
+    class SleepEstimator {
+    public:
+      uint64_t margin() const { return uint64_t(m_mean + std::sqrt(m_var)); }
+
+      void record(uint64_t slept) {
+        // a plain average at first, then a moving one: timer resolution
+        // can change under us
+        if (m_count < 64)
+          m_count++;
+        double alpha = 1.0 / m_count;
+        double delta = double(slept) - m_mean;
+        m_mean += alpha * delta;
+        m_var = (1.0 - alpha) * (m_var + alpha * delta * delta);
+      }
+
+    private:
+      double m_mean  = 2e6;  // pessimistic until measured
+      double m_var   = 0.0;
+      double m_count = 0.0;
+    };
+  }  // namespace details
+
+  // Waits until deadline (monotonicNanos() time) with sub-millisecond
+  // precision: OS sleeps while that can't overshoot, then spins.
+  inline void sleepUntil(uint64_t deadline) {
+    thread_local details::SleepEstimator estimator;
+    uint64_t now = monotonicNanos();
+    while (now < deadline && deadline - now > estimator.margin()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      uint64_t woke = monotonicNanos();
+      estimator.record(woke - now);
+      now = woke;
+    }
+    while (monotonicNanos() < deadline)
+      details::cpuRelax();
+  }
+
+  // Frame pacing for a render loop: sets the swap interval from --vsync
+  // and caps the frame rate with --fps. With --jit the frame's work is
+  // pushed as late as possible, so input is sampled just before the
+  // predicted present instead of right after the previous one. Call
+  // beginFrame() before sampling input, beforeSwap() once the frame is
+  // recorded and endFrame() after the swap returns.
+  class FramePacer {
+  public:
+    FramePacer(const AppOptions& opts, Context& ctx) :
+      m_jit(opts.justInTime) {
+      int interval = opts.vsync == Vsync::off ? 0 : 1;
+      // late frames tear instead of waiting a whole extra refresh
+      if (
+        opts.vsync == Vsync::adaptive && !ctx.headless() &&
+        (glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+         glfwExtensionSupported("WGL_EXT_swap_control_tear")))
+        interval = -1;
+      ctx.swapInterval(interval);
+
+      if (opts.fpsCap > 0)
+        m_period = uint64_t(1e9 / opts.fpsCap);
+      else if (interval != 0 && ctx.refreshRate() > 0)
+        m_period = uint64_t(1e9 / ctx.refreshRate());
+      // vsync alone already paces, only --fps has to wait
+      m_cap = opts.fpsCap > 0;
+    }
+
+    // Whether frames get spaced out by us at all.
+    bool active() const { return m_period > 0 && (m_cap || m_jit); }
+
+    // Returns true if it waited, in which case input should be sampled
+    // again.
+    bool beginFrame() {
+      bool waited = false;
+      if (m_jit && m_next > 0) {
+        // start as late as the slowest recent frame allows
+        uint64_t work = *std::max_element(m_work.begin(), m_work.end());
+        uint64_t wake = m_next - std::min(m_next, work + work / 4);
+        if (wake > monotonicNanos()) {
+          OGLC_ZONE("pacing");
+          sleepUntil(wake);
+          waited = true;
+        }
+      }
+      m_begin = monotonicNanos();
+      return waited;
+    }
+
+    void beforeSwap() {
+      uint64_t now = monotonicNanos();
+      // CPU side only: with vsync the swap blocks, and counting that as
+      // work would make us start earlier and earlier. The first frame
+      // pays for lazy driver setup, it says nothing about the next ones.
+      if (m_frame++ > 0)
+        m_work[m_frame % m_work.size()] = now - m_begin;
+      // --jit with --fps: the frame was quicker than predicted, hold it
+      // back so the rate stays capped
+      if (m_jit && m_cap && now < m_next) {
+        OGLC_ZONE("pacing");
+        sleepUntil(m_next);
+      }
+    }
+
+    void endFrame() {
+      if (m_period == 0)
+        return;
+      uint64_t now = monotonicNanos();
+      if (m_jit || !m_cap) {
+        // the swap returned at (or was held until) the present, so the
+        // next one is a period away
+        m_next = now + m_period;
+        return;
+      }
+      // fell too far behind: restart the schedule rather than burst
+      m_next = m_next + m_period < now ? now : m_next + m_period;
+      OGLC_ZONE("pacing");
+      sleepUntil(m_next);
+    }
+
+  private:
+    bool m_jit;
+    bool m_cap        = false;
+    uint64_t m_period = 0;  // ns, 0 = unknown
+    uint64_t m_next   = 0;  // when the next frame should present
+    uint64_t m_begin  = 0;
+    uint64_t m_frame  = 0;
+    std::array<uint64_t, 32> m_work {};  // recent frame CPU times
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,220 @@
+#ifndef OGLC_PIXELS_HPP_INCLUDED
+#define OGLC_PIXELS_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+namespace oglc {
+  // Conversions between the 8-bit layouts decoders produce: 1 to 4
+  // channels, grey, grey and alpha, RGB and RGBA, tightly packed. SSE2
+  // where it helps, with scalar versions for the rest and the tails.
+  namespace details {
+    // c * a / 255, rounded, exactly
+    inline uint8_t mulAlpha(uint32_t c, uint32_t a) {
+      uint32_t t = c * a + 128;
+      return uint8_t((t + (t >> 8)) >> 8);
+    }
+
+    inline float srgbToLinear(float c) {
+      return c <= 0.04045f ? c / 12.92f
+                           : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline const std::array<float, 256>& srgbTable() {
+      static const auto table = [] {
+        std::array<float, 256> t;
+        for (int i = 0; i < 256; i++)
+          t[i] = srgbToLinear(i / 255.0f);
+        return t;
+      }();
+      return table;
+    }
+
+    // Rounded in encoded space without calling pow: a coarse table gets
+    // within a code or two, then the linear values halfway between codes
+    // settle it.
+    inline uint8_t linearToSrgb(float c) {
+      static const auto tables = [] {
+        struct {
+          std::array<float, 256> edges;  // last one is past 1
+          std::array<uint8_t, 4097> start;
+        } t;
+        for (int i = 0; i < 256; i++)
+          t.edges[i] = i < 255 ? srgbToLinear((i + 0.5f) / 255.0f) : 2.0f;
+        uint8_t code = 0;
+        for (int i = 0; i <= 4096; i++) {
+          while (t.edges[code] <= i / 4096.0f)
+            code++;
+          t.start[i] = code;
+        }
+        return t;
+      }();
+      c            = std::clamp(c, 0.0f, 1.0f);
+      uint8_t code = tables.start[int(c * 4096)];
+      while (tables.edges[code] <= c)
+        code++;
+      return code;
+    }
+
+#ifdef __SSE2__
+    // The same, on 16-bit lanes
+    inline __m128i mulAlpha(__m128i c, __m128i a) {
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+      return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    // Multiplies 16 bytes of grey and alpha or RGBA pixels by their
+    // alpha, in 16-bit lanes. AlphaLanes shuffles each pixel's alpha to
+    // all its lanes, keep marks the alpha lanes, which stay as they are.
+    template <int AlphaLanes>
+    inline __m128i premultiply16(__m128i x, __m128i keep) {
+      const __m128i zero = _mm_setzero_si128();
+      __m128i half[2]    = {
+        _mm_unpacklo_epi8(x, zero), _mm_unpackhi_epi8(x, zero)};
+      __m128i out[2];
+      for (int i = 0; i < 2; i++) {
+        __m128i a = _mm_shufflehi_epi16(
+          _mm_shufflelo_epi16(half[i], AlphaLanes), AlphaLanes);
+        // alpha times 255 over 255 is alpha again
+        a = _mm_or_si128(
+          _mm_andnot_si128(keep, a), _mm_and_si128(keep, _mm_set1_epi16(255)));
+        out[i] = mulAlpha(half[i], a);
+      }
+      return _mm_packus_epi16(out[0], out[1]);
+    }
+#endif
+  }  // namespace details
+
+  // Expands pixels of 1 to 4 channels to RGBA8 the way stb_image does:
+  // grey to all three colours, opaque where there is no alpha. dst holds
+  // as many pixels as src.
+  inline void expandToRgba(
+    std::span<const uint8_t> src, int channels, std::span<uint8_t> dst) {
+    if (
+      channels < 1 || channels > 4 ||
+      src.size() / size_t(channels) != dst.size() / 4 ||
+      src.size() % size_t(channels) != 0 || dst.size() % 4 != 0)
+      throw std::invalid_argument("pixel counts don't match");
+    const size_t count = dst.size() / 4;
+    if (count == 0)
+      return;
+    const uint8_t* in  = src.data();
+    uint8_t* out       = dst.data();
+    size_t i           = 0;
+    switch (channels) {
+      case 1: {
+#ifdef __SSE2__
+        const __m128i opaque = _mm_set1_epi32(int(0xff000000));
+        for (; i + 16 <= count; i += 16) {
+          __m128i g  = _mm_loadu_si128((const __m128i*)(in + i));
+          __m128i lo = _mm_unpacklo_epi8(g, g), hi = _mm_unpackhi_epi8(g, g);
+          __m128i px[4] = {
+            _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+            _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi)};
+          for (int k = 0; k < 4; k++) {
+            _mm_storeu_si128(
+              (__m128i*)(out + i * 4 + k * 16), _mm_or_si128(px[k], opaque));
+          }
+        }
+#endif
+        for (; i < count; i++) {
+          out[i * 4] = out[i * 4 + 1] = out[i * 4 + 2] = in[i];
+          out[i * 4 + 3]                               = 255;
+        }
+      } break;
+      case 2: {
+#ifdef __SSE2__
+        // g, g, a, a to g, g, g, a
+        const __m128i keep  = _mm_set1_epi32(int(0xff00ffff));
+        const __m128i first = _mm_set1_epi32(0xff);
+        auto spread         = [&](__m128i ga) {
+          return _mm_or_si128(
+            _mm_and_si128(ga, keep),
+            _mm_slli_epi32(_mm_and_si128(ga, first), 16));
+        };
+        for (; i + 8 <= count; i += 8) {
+          __m128i x = _mm_loadu_si128((const __m128i*)(in + i * 2));
+          _mm_storeu_si128(
+            (__m128i*)(out + i * 4), spread(_mm_unpacklo_epi8(x, x)));
+          _mm_storeu_si128(
+            (__m128i*)(out + i * 4 + 16), spread(_mm_unpackhi_epi8(x, x)));
+        }
+#endif
+        for (; i < count; i++) {
+          out[i * 4] = out[i * 4 + 1] = out[i * 4 + 2] = in[i * 2];
+          out[i * 4 + 3]                               = in[i * 2 + 1];
+        }
+      } break;
+      case 3:
+        // a word at a time, reading one byte past each pixel but the last;
+        // SSE2 has no byte shuffle to do better
+        for (; i + 1 < count; i++) {
+          uint32_t px;
+          std::memcpy(&px, in + i * 3, 4);
+          px |= 0xffu << 24;
+          std::memcpy(out + i * 4, &px, 4);
+        }
+        for (; i < count; i++) {
+          std::memcpy(out + i * 4, in + i * 3, 3);
+          out[i * 4 + 3] = 255;
+        }
+        break;
+      case 4:
+        std::memcpy(out, in, dst.size());
+        break;
+    }
+  }
+
+  // Multiplies the colours of grey and alpha or RGBA pixels by their
+  // alpha, in place. Without alpha there is nothing to do. sRGB colours
+  // are multiplied in linear light and encoded again, the way an sRGB
+  // framebuffer blends; scaling the encoded values would darken them.
+  inline void premultiplyAlpha(
+    std::span<uint8_t> pixels, int channels, bool srgb = false) {
+    if (channels != 2 && channels != 4)
+      return;
+    uint8_t* p = pixels.data();
+    size_t n   = pixels.size() / size_t(channels) * size_t(channels);
+    size_t i   = 0;
+    if (srgb) {
+      const auto& linear = details::srgbTable();
+      for (; i < n; i += size_t(channels)) {
+        float a = p[i + size_t(channels) - 1] * (1 / 255.0f);
+        for (int c = 0; c < channels - 1; c++) {
+          uint8_t& v = p[i + size_t(c)];
+          v          = details::linearToSrgb(linear[v] * a);
+        }
+      }
+      return;
+    }
+#ifdef __SSE2__
+    const __m128i keep = channels == 4
+      ? _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0)
+      : _mm_set_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+    for (; i + 16 <= n; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+      x         = channels == 4
+                ? details::premultiply16<_MM_SHUFFLE(3, 3, 3, 3)>(x, keep)
+                : details::premultiply16<_MM_SHUFFLE(3, 3, 1, 1)>(x, keep);
+      _mm_storeu_si128((__m128i*)(p + i), x);
+    }
+#endif
+    for (; i < n; i += size_t(channels)) {
+      uint8_t a = p[i + size_t(channels) - 1];
+      for (int c = 0; c < channels - 1; c++)
+        p[i + size_t(c)] = details::mulAlpha(p[i + size_t(c)], a);
+    }
+  }
+}  // namespace oglc
+
+#endif
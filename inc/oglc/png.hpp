@@ -0,0 +1,864 @@
+#ifndef OGLC_PNG_HPP_INCLUDED
+#define OGLC_PNG_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+namespace oglc {
+  // A fast path for the PNGs textures usually are, 8 bits a channel and
+  // not interlaced, decoded to RGBA8 or to the channels they hold exactly
+  // as stb_image does with that many channels requested. The zlib stream
+  // is inflated through lookup tables that yield two literals at once
+  // where they fit, and rows are unfiltered with SSE2 a pixel (Avg,
+  // Paeth) or 16 bytes (Sub, Up) at a time.
+  //
+  // Anything else, and anything malformed, is left to stb: decode()
+  // returns false and the caller falls back. Like stb, checksums aren't
+  // verified.
+  namespace png {
+    namespace details {
+      inline uint32_t be32(const uint8_t* p) {
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 |
+          uint32_t(p[2]) << 8 | p[3];
+      }
+
+      // Canonical Huffman decoding, with a table for codes up to fast_bits
+      // long indexed by the next bits of input. Entries are the code
+      // length in bits 0-4, 0 when the code is longer, and what it decodes
+      // to from bit 16: a symbol, or for literals 1 or 2 bytes with their
+      // count in bits 5-6. Filling the table costs about as much as
+      // decoding a few thousand symbols, so short streams can build it
+      // with fewer bits than MaxBits.
+      template <int MaxBits>
+      struct huffman {
+        static constexpr int max_bits    = MaxBits;
+        static constexpr int max_symbols = 288;
+
+        int fast_bits = MaxBits;
+        uint32_t mask = (1u << MaxBits) - 1;
+        std::array<uint32_t, size_t(1) << MaxBits> fast;
+        uint16_t count[16];
+        uint16_t symbol[max_symbols];
+
+        bool build(const uint8_t* lengths, int n, int bits = MaxBits) {
+          // four counts a length, a run of one length would otherwise
+          // wait on its own increments
+          uint16_t counts[4][16] = {};
+          for (int i = 0; i < n; i++)
+            counts[i & 3][lengths[i]]++;
+          for (int len = 0; len < 16; len++) {
+            count[len] = uint16_t(
+              counts[0][len] + counts[1][len] + counts[2][len] +
+              counts[3][len]);
+          }
+          count[0] = 0;
+          int left = 1;
+          for (int len = 1; len < 16; len++) {
+            left = left * 2 - count[len];
+            if (left < 0)
+              return false;  // over-subscribed
+          }
+
+          uint16_t offset[16], next[16];
+          offset[1] = 0;
+          for (int len = 1; len < 15; len++)
+            offset[len + 1] = uint16_t(offset[len] + count[len]);
+          uint32_t code = 0;
+          for (int len = 1; len < 16; len++) {
+            code      = (code + count[len - 1]) << 1;
+            next[len] = uint16_t(code);
+          }
+
+          fast_bits = bits;
+          mask      = (1u << bits) - 1;
+          // a complete code writes every entry, those of longer codes
+          // included, so only an incomplete one needs clearing
+          if (left != 0)
+            std::fill_n(fast.begin(), mask + 1, 0);
+          for (int s = 0; s < n; s++) {
+            int len = lengths[s];
+            if (len == 0)
+              continue;
+            symbol[offset[len]++] = uint16_t(s);
+            uint32_t c            = next[len]++;
+            if (len > fast_bits) {
+              fast[reverse(c >> (len - fast_bits), fast_bits)] = 0;
+              continue;
+            }
+            uint32_t reversed = reverse(c, len);
+            uint32_t e        = uint32_t(len) | uint32_t(s) << 16;
+            if (s < 256)
+              e |= 1u << 5;  // a literal, if this is that table
+            for (uint32_t i = reversed; i <= mask; i += 1u << len)
+              fast[i] = e;
+          }
+          return true;
+        }
+
+        // The low len bits of c, back to front: codes are packed from
+        // their top bit, the table is indexed from the bottom.
+        static uint32_t reverse(uint32_t c, int len) {
+          c = (c & 0x5555) << 1 | (c >> 1 & 0x5555);
+          c = (c & 0x3333) << 2 | (c >> 2 & 0x3333);
+          c = (c & 0x0F0F) << 4 | (c >> 4 & 0x0F0F);
+          c = (c & 0x00FF) << 8 | (c >> 8 & 0x00FF);
+          return c >> (16 - len);
+        }
+
+        // Literal/length tables: a second literal that fits in the rest of
+        // the bits joins the first.
+        void pairLiterals() {
+          auto single = fast;
+          for (uint32_t i = 0; i <= mask; i++) {
+            uint32_t e = single[i], len = e & 31, s = e >> 16;
+            if (len == 0 || s >= 256)
+              continue;
+            uint32_t e2 = single[i >> len], len2 = e2 & 31;
+            if (len2 != 0 && len + len2 <= fast_bits && (e2 >> 16) < 256)
+              fast[i] = (len + len2) | 2u << 5 | s << 16 | (e2 >> 16) << 24;
+          }
+        }
+
+        // Codes past the table, a bit at a time. -1 for none.
+        int slow(uint64_t bits, int& len) const {
+          int code = 0, first = 0, index = 0;
+          for (int l = 1; l < 16; l++) {
+            code |= int(bits & 1);
+            bits >>= 1;
+            if (code - first < count[l]) {
+              len = l;
+              return symbol[index + code - first];
+            }
+            index += count[l];
+            first = (first + count[l]) << 1;
+            code <<= 1;
+          }
+          return -1;
+        }
+      };
+
+      using litlen_table = huffman<11>;
+      using dist_table   = huffman<10>;
+
+      inline constexpr uint16_t length_base[29] = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+      };
+      inline constexpr uint8_t length_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+      };
+      inline constexpr uint16_t dist_base[30] = {
+        1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577,
+      };
+      inline constexpr uint8_t dist_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+      };
+
+      struct fixed_tables {
+        litlen_table lit;
+        dist_table dist;
+      };
+
+      inline const fixed_tables& fixedTables() {
+        static const fixed_tables tables = [] {
+          fixed_tables t;
+          uint8_t lengths[288];
+          std::memset(lengths, 8, 144);
+          std::memset(lengths + 144, 9, 112);
+          std::memset(lengths + 256, 7, 24);
+          std::memset(lengths + 280, 8, 8);
+          t.lit.build(lengths, 288);
+          t.lit.pairLiterals();
+          std::memset(lengths, 5, 30);
+          t.dist.build(lengths, 30);
+          return t;
+        }();
+        return tables;
+      }
+
+      // Raw DEFLATE into a buffer of known size, which must have 16 bytes
+      // of slack past it for copies that overshoot. Input is read 8 bytes
+      // at a time into a 64-bit bit buffer; past the end it reads zeros,
+      // and fails if it used them.
+      class inflater {
+      public:
+        inflater(std::span<const uint8_t> in) :
+          m_in(in.data()), m_end(in.data() + in.size()) {}
+
+        bool run(uint8_t* out, size_t size) {
+          m_out    = out;
+          m_cursor = out;
+          m_limit  = out + size;
+          for (bool last = false; !last;) {
+            refill();
+            last      = take(1);
+            auto type = take(2);
+            bool ok   = false;
+            if (type == 0) {
+              ok = stored();
+            }
+            else if (type == 1) {
+              auto& fixed = fixedTables();
+              ok          = codes(fixed.lit, fixed.dist);
+            }
+            else if (type == 2) {
+              ok = dynamic() && codes(m_lit, m_dist);
+            }
+            if (!ok || overrun())
+              return false;
+          }
+          return m_cursor == m_limit;
+        }
+
+      private:
+        // output left, in bytes, below which a block counts as short
+        static constexpr size_t small_block = 16 * 1024;
+
+        void refill() {
+          if (m_end - m_in >= 8) {
+            uint64_t v;
+            std::memcpy(&v, m_in, 8);
+            m_bits |= v << m_count;
+            m_in += (63 - m_count) >> 3;
+            m_count |= 56;
+            return;
+          }
+          while (m_count <= 56) {
+            uint64_t b = 0;
+            if (m_in < m_end)
+              b = *m_in++;
+            else
+              m_padding++;
+            m_bits |= b << m_count;
+            m_count += 8;
+          }
+        }
+
+        uint32_t take(int n) {
+          uint32_t v = uint32_t(m_bits & ((uint64_t(1) << n) - 1));
+          m_bits >>= n;
+          m_count -= n;
+          return v;
+        }
+
+        bool overrun() const { return size_t(m_count) < m_padding * 8; }
+
+        template <class Table>
+        int decode(const Table& t) {
+          uint32_t e = t.fast[m_bits & t.mask];
+          int len    = int(e & 31);
+          int s      = len ? int(e >> 16) : t.slow(m_bits, len);
+          if (s >= 0)
+            take(len);
+          return s;
+        }
+
+        bool stored() {
+          take(m_count & 7);
+          // hand back what the bit buffer read ahead
+          size_t buffered = size_t(m_count) / 8;
+          if (buffered < m_padding)
+            return false;
+          m_in -= buffered - m_padding;
+          m_bits    = 0;
+          m_count   = 0;
+          m_padding = 0;
+          if (m_end - m_in < 4)
+            return false;
+          uint32_t len  = uint32_t(m_in[0]) | uint32_t(m_in[1]) << 8;
+          uint32_t nlen = uint32_t(m_in[2]) | uint32_t(m_in[3]) << 8;
+          m_in += 4;
+          if (
+            (len ^ 0xFFFF) != nlen || size_t(m_end - m_in) < len ||
+            size_t(m_limit - m_cursor) < len)
+            return false;
+          std::memcpy(m_cursor, m_in, len);
+          m_cursor += len;
+          m_in += len;
+          return true;
+        }
+
+        bool dynamic() {
+          static constexpr uint8_t order[19] = {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+          };
+          refill();
+          int nlit = int(take(5)) + 257, ndist = int(take(5)) + 1;
+          int ncode = int(take(4)) + 4;
+          if (nlit > 286 || ndist > 30)
+            return false;
+          uint8_t code_lengths[19] = {};
+          for (int i = 0; i < ncode; i++) {
+            refill();
+            code_lengths[order[i]] = uint8_t(take(3));
+          }
+          huffman<7> codes;
+          if (!codes.build(code_lengths, 19))
+            return false;
+
+          uint8_t lengths[286 + 30];
+          for (int n = 0; n < nlit + ndist;) {
+            refill();
+            int s = decode(codes);
+            if (s < 0)
+              return false;
+            if (s < 16) {
+              lengths[n++] = uint8_t(s);
+              continue;
+            }
+            int repeat = 0;
+            uint8_t value = 0;
+            if (s == 16) {
+              if (n == 0)
+                return false;
+              value  = lengths[n - 1];
+              repeat = 3 + int(take(2));
+            }
+            else if (s == 17) {
+              repeat = 3 + int(take(3));
+            }
+            else {
+              repeat = 11 + int(take(7));
+            }
+            if (n + repeat > nlit + ndist)
+              return false;
+            std::memset(lengths + n, value, size_t(repeat));
+            n += repeat;
+          }
+          if (overrun() || lengths[256] == 0)
+            return false;
+          // a short block gets small tables, without pairs: filling the
+          // full ones would take longer than decoding it
+          bool small    = size_t(m_limit - m_cursor) < small_block;
+          int lit_bits  = small ? 9 : litlen_table::max_bits;
+          int dist_bits = small ? 8 : dist_table::max_bits;
+          if (
+            !m_lit.build(lengths, nlit, lit_bits) ||
+            !m_dist.build(lengths + nlit, ndist, dist_bits))
+            return false;
+          if (!small)
+            m_lit.pairLiterals();
+          return true;
+        }
+
+        // The block's symbols until its end code. Up to 48 bits are used
+        // per match, so one refill covers it.
+        bool codes(const litlen_table& lit, const dist_table& dist) {
+          uint8_t* out         = m_cursor;
+          uint8_t* const limit = m_limit;
+          const uint32_t mask  = lit.mask;
+          for (;;) {
+            if (m_count < 48)
+              refill();
+            uint32_t e = lit.fast[m_bits & mask];
+            if (uint32_t n = e >> 5 & 3) {
+              if (size_t(limit - out) < n)
+                return false;
+              take(int(e & 31));
+              out[0] = uint8_t(e >> 16);
+              out[1] = uint8_t(e >> 24);
+              out += n;
+              continue;
+            }
+            int s = decode(lit);
+            if (s < 0)
+              return false;
+            if (s < 256) {
+              // a literal code too long for the table
+              if (out == limit)
+                return false;
+              *out++ = uint8_t(s);
+              continue;
+            }
+            if (s == 256)
+              break;
+            s -= 257;
+            if (s >= 29)
+              return false;
+            size_t len = length_base[s] + take(length_extra[s]);
+            int d      = decode(dist);
+            if (d < 0 || d >= 30)
+              return false;
+            size_t distance = dist_base[d] + take(dist_extra[d]);
+            if (
+              distance > size_t(out - m_out) || len > size_t(limit - out))
+              return false;
+
+            const uint8_t* from = out - distance;
+            if (distance >= 8) {
+              // 8 bytes at a time, each read is behind what was written
+              for (size_t i = 0; i < len; i += 8)
+                std::memcpy(out + i, from + i, 8);
+            }
+            else if (distance == 1) {
+              std::memset(out, from[0], len);
+            }
+            else {
+              for (size_t i = 0; i < len; i++)
+                out[i] = from[i];
+            }
+            out += len;
+          }
+          m_cursor = out;
+          return true;
+        }
+
+        const uint8_t* m_in;
+        const uint8_t* m_end;
+        uint64_t m_bits  = 0;
+        int m_count      = 0;
+        size_t m_padding = 0;  // zero bytes read past the end
+
+        uint8_t* m_out    = nullptr;
+        uint8_t* m_cursor = nullptr;
+        uint8_t* m_limit  = nullptr;
+        litlen_table m_lit;
+        dist_table m_dist;
+      };
+
+      inline uint8_t paeth(int a, int b, int c) {
+        int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b),
+            pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc)
+          return uint8_t(a);
+        return uint8_t(pb <= pc ? b : c);
+      }
+
+      // Any pixel size, a byte at a time. The first bpp bytes have no
+      // left neighbour.
+      inline void unfilterScalar(
+        int filter, const uint8_t* src, const uint8_t* up, uint8_t* out,
+        size_t n, size_t bpp) {
+        switch (filter) {
+          case 1:
+            for (size_t i = 0; i < n; i++)
+              out[i] = uint8_t(src[i] + (i >= bpp ? out[i - bpp] : 0));
+            break;
+          case 2:
+            for (size_t i = 0; i < n; i++)
+              out[i] = uint8_t(src[i] + up[i]);
+            break;
+          case 3:
+            for (size_t i = 0; i < n; i++) {
+              int left = i >= bpp ? out[i - bpp] : 0;
+              out[i]   = uint8_t(src[i] + ((left + up[i]) >> 1));
+            }
+            break;
+          case 4:
+            for (size_t i = 0; i < n; i++) {
+              int left = i >= bpp ? out[i - bpp] : 0;
+              int diag = i >= bpp ? up[i - bpp] : 0;
+              out[i]   = uint8_t(src[i] + paeth(left, up[i], diag));
+            }
+            break;
+          default:
+            std::memcpy(out, src, n);
+            break;
+        }
+      }
+
+#ifdef __SSE2__
+      // After libpng's SSE2 filters: Sub, Avg and Paeth depend on the
+      // pixel to the left, so they go a pixel at a time, all its channels
+      // at once.
+      template <size_t Bpp>
+      __m128i loadPixel(const uint8_t* p) {
+        uint32_t v = 0;
+        std::memcpy(&v, p, Bpp);
+        return _mm_cvtsi32_si128(int(v));
+      }
+
+      template <size_t Bpp>
+      void storePixel(uint8_t* p, __m128i v) {
+        uint32_t x = uint32_t(_mm_cvtsi128_si32(v));
+        std::memcpy(p, &x, Bpp);
+      }
+
+      inline __m128i abs16(__m128i x) {
+        return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+      }
+
+      inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+      }
+
+      template <size_t Bpp>
+      void unfilterSimd(
+        int filter, const uint8_t* src, const uint8_t* up, uint8_t* out,
+        size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i           = 0;
+        switch (filter) {
+          case 1: {
+            __m128i a = zero;
+            if constexpr (Bpp == 4) {
+              // a prefix sum over the 4 pixels in 16 bytes, plus the last
+              // one of the previous 16
+              for (; i + 16 <= n; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+                x         = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+                x         = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+                x         = _mm_add_epi8(x, a);
+                _mm_storeu_si128((__m128i*)(out + i), x);
+                a = _mm_shuffle_epi32(x, 0xFF);
+              }
+            }
+            for (; i < n; i += Bpp) {
+              a = _mm_add_epi8(a, loadPixel<Bpp>(src + i));
+              storePixel<Bpp>(out + i, a);
+            }
+          } break;
+          case 2:
+            for (; i + 16 <= n; i += 16) {
+              __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+              __m128i b = _mm_loadu_si128((const __m128i*)(up + i));
+              _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi8(x, b));
+            }
+            for (; i < n; i++)
+              out[i] = uint8_t(src[i] + up[i]);
+            break;
+          case 3: {
+            const __m128i one = _mm_set1_epi8(1);
+            __m128i a         = zero;
+            for (; i < n; i += Bpp) {
+              __m128i b = loadPixel<Bpp>(up + i);
+              // _mm_avg_epu8 rounds up, the filter rounds down
+              __m128i avg = _mm_sub_epi8(
+                _mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+              a = _mm_add_epi8(loadPixel<Bpp>(src + i), avg);
+              storePixel<Bpp>(out + i, a);
+            }
+          } break;
+          case 4: {
+            // in 16-bit lanes, where the differences fit
+            __m128i a = zero, c = zero;
+            for (; i < n; i += Bpp) {
+              __m128i b = _mm_unpacklo_epi8(loadPixel<Bpp>(up + i), zero);
+              __m128i x = _mm_unpacklo_epi8(loadPixel<Bpp>(src + i), zero);
+              __m128i pa = _mm_sub_epi16(b, c);  // p - a
+              __m128i pb = _mm_sub_epi16(a, c);  // p - b
+              __m128i pc = _mm_add_epi16(pa, pb);
+              pa         = abs16(pa);
+              pb         = abs16(pb);
+              pc         = abs16(pc);
+              __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+              __m128i nearest  = select(
+                _mm_cmpeq_epi16(smallest, pa), a,
+                select(_mm_cmpeq_epi16(smallest, pb), b, c));
+              // the high bytes stay zero, no carries cross lanes
+              a = _mm_add_epi8(x, nearest);
+              storePixel<Bpp>(out + i, _mm_packus_epi16(a, a));
+              c = b;
+            }
+          } break;
+          default:
+            std::memcpy(out, src, n);
+            break;
+        }
+      }
+#endif
+
+      // One row, from its filtered bytes and the unfiltered row above,
+      // zeros for the first.
+      inline void unfilter(
+        int filter, const uint8_t* src, const uint8_t* up, uint8_t* out,
+        size_t n, size_t bpp) {
+#ifdef __SSE2__
+        if (bpp == 4)
+          return unfilterSimd<4>(filter, src, up, out, n);
+        if (bpp == 3)
+          return unfilterSimd<3>(filter, src, up, out, n);
+#endif
+        unfilterScalar(filter, src, up, out, n, bpp);
+      }
+
+      struct image_info {
+        uint32_t width  = 0;
+        uint32_t height = 0;
+        uint8_t colour  = 0;
+        int channels    = 0;
+        uint32_t palette[256];  // RGBA, in memory order
+        int palette_size = 0;
+        bool keyed       = false;  // tRNS on grey or RGB
+        uint8_t key[3]   = {};
+      };
+
+      // Rows to RGBA8, or to grey and alpha or RGB where those were asked
+      // for, the way stb expands them. Palette indices past the palette
+      // are left to stb.
+      inline bool expand(
+        const image_info& img, const uint8_t* src, uint8_t* out,
+        int channels) {
+        const uint32_t w = img.width;
+        if (channels == 2) {
+          for (uint32_t x = 0; x < w; x++, out += 2) {
+            out[0] = src[x];
+            out[1] = img.keyed && src[x] == img.key[0] ? 0 : 255;
+          }
+          return true;
+        }
+        if (channels == 3) {
+          for (uint32_t x = 0; x < w; x++, out += 3) {
+            if (src[x] >= img.palette_size)
+              return false;
+            std::memcpy(out, &img.palette[src[x]], 3);
+          }
+          return true;
+        }
+        switch (img.colour) {
+          case 0:
+            for (uint32_t x = 0; x < w; x++, out += 4) {
+              uint8_t g = src[x];
+              out[0] = out[1] = out[2] = g;
+              out[3] = img.keyed && g == img.key[0] ? 0 : 255;
+            }
+            break;
+          case 2:
+            for (uint32_t x = 0; x < w; x++, src += 3, out += 4) {
+              out[0] = src[0];
+              out[1] = src[1];
+              out[2] = src[2];
+              out[3] = img.keyed && src[0] == img.key[0] &&
+                  src[1] == img.key[1] && src[2] == img.key[2]
+                ? 0
+                : 255;
+            }
+            break;
+          case 3: {
+            // four texels to a store
+            const uint32_t size = uint32_t(img.palette_size);
+            const uint32_t* pal = img.palette;
+            uint32_t x          = 0;
+            for (; x + 4 <= w; x += 4, out += 16) {
+              const uint8_t* i = src + x;
+              if (
+                (i[0] >= size) | (i[1] >= size) | (i[2] >= size) |
+                (i[3] >= size))
+                return false;
+              uint32_t four[4] = {pal[i[0]], pal[i[1]], pal[i[2]], pal[i[3]]};
+              std::memcpy(out, four, 16);
+            }
+            for (; x < w; x++, out += 4) {
+              if (src[x] >= size)
+                return false;
+              std::memcpy(out, &pal[src[x]], 4);
+            }
+          } break;
+          case 4:
+            for (uint32_t x = 0; x < w; x++, src += 2, out += 4) {
+              out[0] = out[1] = out[2] = src[0];
+              out[3] = src[1];
+            }
+            break;
+        }
+        return true;
+      }
+
+      inline int channels(uint8_t colour) {
+        switch (colour) {
+          case 0:
+          case 3:
+            return 1;
+          case 2:
+            return 3;
+          case 4:
+            return 2;
+          case 6:
+            return 4;
+        }
+        return 0;
+      }
+    }  // namespace details
+
+    inline constexpr uint8_t signature[8] = {
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+    };
+
+    // Channels in the file, as stbi_info() reports them except that a
+    // tRNS colour key counts as alpha: 1 to 4, 0 if it isn't a PNG.
+    inline int channelsOf(std::span<const uint8_t> file) {
+      using details::be32;
+      const uint8_t* p   = file.data();
+      const uint8_t* end = p + file.size();
+      if (
+        file.size() < 8 + 25 || std::memcmp(p, signature, 8) != 0 ||
+        std::memcmp(p + 12, "IHDR", 4) != 0)
+        return 0;
+      uint8_t colour = p[25];
+      int channels   = colour == 3 ? 3 : details::channels(colour);
+      if (channels == 0)
+        return 0;
+      for (p += 33; end - p >= 12 && (channels & 1);) {
+        uint32_t len = be32(p);
+        if (
+          std::memcmp(p + 4, "IDAT", 4) == 0 ||
+          len > uint32_t(end - p - 12))
+          break;
+        if (std::memcmp(p + 4, "tRNS", 4) == 0)
+          return channels + 1;
+        p += 12 + len;
+      }
+      return channels;
+    }
+
+    // Decodes to dst, which has to be exactly width * height * channels
+    // bytes: RGBA, or the channels channelsOf() reports. False when the
+    // file isn't one this takes, dst may have been written to by then.
+    inline bool decode(
+      std::span<const uint8_t> file, std::span<uint8_t> dst,
+      int channels = 4) {
+      using details::be32;
+      const uint8_t* p   = file.data();
+      const uint8_t* end = p + file.size();
+      if (
+        file.size() < 8 + 25 || std::memcmp(p, signature, 8) != 0 ||
+        be32(p + 8) != 13 || std::memcmp(p + 12, "IHDR", 4) != 0)
+        return false;
+
+      details::image_info img;
+      img.width    = be32(p + 16);
+      img.height   = be32(p + 20);
+      img.colour   = p[25];
+      img.channels = details::channels(img.colour);
+      // 8 bits, no interlacing, within stb's limits
+      if (
+        p[24] != 8 || img.channels == 0 || p[26] != 0 || p[27] != 0 ||
+        p[28] != 0 || img.width == 0 || img.height == 0 ||
+        img.width > (1u << 24) || img.height > (1u << 24) ||
+        (1u << 30) / img.width / 4 < img.height ||
+        dst.size() != size_t(img.width) * img.height * size_t(channels))
+        return false;
+      // straight from the unfiltered rows, or expanded from them
+      const bool direct = channels == img.channels && img.colour != 3;
+      if (
+        !direct && channels != 4 && !(img.colour == 3 && channels == 3) &&
+        !(img.colour == 0 && channels == 2))
+        return false;
+
+      // the zlib stream, joined up if it spans several IDATs
+      thread_local std::vector<uint8_t> joined;
+      std::span<const uint8_t> zlib;
+      int idats = 0;
+      bool seen_trns = false;
+      for (p += 33;;) {
+        if (end - p < 12)
+          return false;
+        uint32_t len = be32(p);
+        if (len > uint32_t(end - p - 12))
+          return false;
+        const uint8_t* type = p + 4;
+        const uint8_t* data = p + 8;
+        p += 12 + len;
+        if (std::memcmp(type, "IDAT", 4) == 0) {
+          if (img.colour == 3 && img.palette_size == 0)
+            return false;
+          if (idats++ == 0) {
+            zlib = {data, len};
+          }
+          else {
+            if (idats == 2)
+              joined.assign(zlib.begin(), zlib.end());
+            joined.insert(joined.end(), data, data + len);
+            zlib = joined;
+          }
+        }
+        else if (std::memcmp(type, "IEND", 4) == 0) {
+          break;
+        }
+        else if (idats > 0) {
+          // stb is strict about what follows the data
+          if (!(type[0] & 0x20) || std::memcmp(type, "tRNS", 4) == 0)
+            return false;
+        }
+        else if (std::memcmp(type, "PLTE", 4) == 0) {
+          if (len % 3 != 0 || len > 768 || len == 0 || seen_trns)
+            return false;
+          img.palette_size = int(len / 3);
+          for (int i = 0; i < img.palette_size; i++) {
+            uint8_t rgba[4] = {data[i * 3], data[i * 3 + 1], data[i * 3 + 2],
+                               255};
+            std::memcpy(&img.palette[i], rgba, 4);
+          }
+        }
+        else if (std::memcmp(type, "tRNS", 4) == 0) {
+          if (seen_trns)
+            return false;
+          seen_trns = true;
+          if (img.colour == 3) {
+            if (img.palette_size == 0 || int(len) > img.palette_size)
+              return false;
+            for (uint32_t i = 0; i < len; i++)
+              reinterpret_cast<uint8_t*>(&img.palette[i])[3] = data[i];
+          }
+          else if (img.colour == 0 || img.colour == 2) {
+            if (len != uint32_t(img.channels) * 2)
+              return false;
+            // stb keeps the low byte of each 16-bit sample
+            img.keyed = true;
+            for (int k = 0; k < img.channels; k++)
+              img.key[k] = data[k * 2 + 1];
+          }
+          else {
+            return false;
+          }
+        }
+        else if (!(type[0] & 0x20) || std::memcmp(type, "CgBI", 4) == 0) {
+          return false;  // unknown critical chunks, Apple's variant
+        }
+      }
+      if (idats == 0 || zlib.size() < 2)
+        return false;
+
+      // zlib header: deflate, no preset dictionary
+      if (
+        (zlib[0] & 15) != 8 || (zlib[0] * 256 + zlib[1]) % 31 != 0 ||
+        (zlib[1] & 0x20))
+        return false;
+      const size_t row = size_t(img.width) * size_t(img.channels);
+      const size_t raw = (row + 1) * img.height;
+      thread_local std::vector<uint8_t> inflated, rows;
+      inflated.resize(raw + 16);
+      details::inflater inflate(zlib.subspan(2));
+      if (!inflate.run(inflated.data(), raw))
+        return false;
+
+      // unfiltering reads the row above and the texels to the left, so
+      // it goes through two rows of scratch: dst may be write-only mapped
+      // memory, each finished row is written to it once
+      const size_t bpp = size_t(img.channels);
+      rows.assign(row * 3 + 16, 0);
+      const uint8_t* up = rows.data() + row * 2;  // zeros
+      uint8_t* current  = rows.data();
+      uint8_t* previous = rows.data() + row;
+      const uint8_t* src = inflated.data();
+      for (uint32_t y = 0; y < img.height; y++, src += row + 1) {
+        if (src[0] > 4)
+          return false;
+        uint8_t* out = dst.data() + size_t(y) * img.width * size_t(channels);
+        details::unfilter(src[0], src + 1, up, current, row, bpp);
+        if (direct)
+          std::memcpy(out, current, row);
+        else if (!details::expand(img, current, out, channels))
+          return false;
+        up = current;
+        std::swap(current, previous);
+      }
+      return true;
+    }
+  }  // namespace png
+}  // namespace oglc
+#endif
@@ -0,0 +1,246 @@
+#ifndef OGLC_PROFILER_HPP_INCLUDED
+#define OGLC_PROFILER_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define OGLC_HAS_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+  #include <intrin.h>
+  #define OGLC_HAS_TSC 1
+#endif
+
+#include "oglc/snapshot.hpp"
+#include "oglc/trace.hpp"
+
+// CPU instrumentation. Everything here compiles to nothing unless the
+// build defines OGLC_ENABLE_PROFILER (the OGLC_ENABLE_PROFILER CMake
+// option).
+#ifdef OGLC_ENABLE_PROFILER
+  // Times the enclosing scope.
+  #define OGLC_ZONE(name) \
+    ::oglc::CpuZone OGLC_CONCAT(_oglc_zone_, __LINE__)(name)
+  // Records a named value, shown as a graph in the trace.
+  #define OGLC_COUNTER(name, value) \
+    ::oglc::CpuProfiler::counter(name, int64_t(value))
+  // Marks the end of a frame on the calling thread, and drains the rings.
+  #define OGLC_FRAME_MARK() ::oglc::CpuProfiler::frameMark()
+  // Names the calling thread's track in the trace.
+  #define OGLC_THREAD_NAME(name) \
+    ::oglc::CpuProfiler::instance().setThreadName(name)
+#else
+  #define OGLC_ZONE(name)
+  #define OGLC_COUNTER(name, value) ((void) 0)
+  #define OGLC_FRAME_MARK() ((void) 0)
+  #define OGLC_THREAD_NAME(name) ((void) 0)
+#endif
+
+namespace oglc {
+  class CpuProfiler;
+
+  namespace details {
+    // Cheapest monotonic tick we can get: the TSC on x86 (invariant on
+    // anything recent), steady_clock nanoseconds otherwise.
+    inline uint64_t readTicks() {
+#ifdef OGLC_HAS_TSC
+      return __rdtsc();
+#else
+      return monotonicNanos();
+#endif
+    }
+
+    enum class profile_kind : uint32_t { zone, counter, frame };
+
+    struct profile_event {
+      const char* name;
+      uint64_t start;
+      uint64_t end;  // or the value for counters
+      profile_kind kind;
+    };
+
+    // Single-producer, single-consumer ring. The owning thread pushes, the
+    // collector drains. Pushing never blocks; when the collector falls
+    // behind, new events are dropped and counted.
+    class profile_ring {
+    public:
+      static constexpr size_t capacity = size_t(1) << 16;
+
+      explicit profile_ring(uint32_t tid) :
+        m_events(new profile_event[capacity]), m_tid(tid) {}
+
+      void push(const profile_event& e) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= capacity) {
+          m_dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        m_events[head & (capacity - 1)] = e;
+        m_head.store(head + 1, std::memory_order_release);
+      }
+
+      template <class F>
+      void drain(F&& fn) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; tail++)
+          fn(m_events[tail & (capacity - 1)]);
+        m_tail.store(tail, std::memory_order_release);
+      }
+
+      uint32_t tid() const { return m_tid; }
+      uint64_t dropped() const { return m_dropped.load(); }
+
+      std::string name;
+
+    private:
+      std::unique_ptr<profile_event[]> m_events;
+      uint32_t m_tid;
+      alignas(64) std::atomic<uint64_t> m_head {0};
+      alignas(64) std::atomic<uint64_t> m_tail {0};
+      std::atomic<uint64_t> m_dropped {0};
+    };
+  }  // namespace details
+
+  // Process-wide CPU profiler. Each thread records into its own ring with
+  // no locking; collect() moves events out of the rings and should be
+  // called regularly (e.g. once per frame) from one thread.
+  class CpuProfiler {
+  public:
+    static CpuProfiler& instance() {
+      static CpuProfiler prof;
+      return prof;
+    }
+
+    // The calling thread's ring, created on first use.
+    details::profile_ring& ring() {
+      thread_local details::profile_ring* t_ring = nullptr;
+      if (t_ring == nullptr) {
+        std::lock_guard lock(m_mutex);
+        auto& r = m_rings.emplace_back(
+          std::make_unique<details::profile_ring>(uint32_t(m_rings.size())));
+        t_ring  = r.get();
+      }
+      return *t_ring;
+    }
+
+    // Track ID of the calling thread, for lining up other events with it.
+    uint32_t threadId() { return ring().tid(); }
+
+    void setThreadName(const char* name) {
+      auto& r = ring();
+      std::lock_guard lock(m_mutex);
+      r.name = name;
+    }
+
+    static void counter(const char* name, int64_t value) {
+      uint64_t t = details::readTicks();
+      instance().ring().push(
+        {name, t, uint64_t(value), details::profile_kind::counter});
+    }
+    static void frameMark() {
+      uint64_t t = details::readTicks();
+      instance().ring().push({"frame", t, t, details::profile_kind::frame});
+      instance().collect();
+    }
+
+    // Drains every thread's ring into the profiler's own storage.
+    void collect() {
+      std::lock_guard lock(m_mutex);
+      for (auto& r : m_rings) {
+        r->drain([&](const details::profile_event& e) {
+          if (m_events.size() < m_maxEvents)
+            m_events.push_back({e, r->tid()});
+        });
+      }
+    }
+
+    uint64_t dropped() {
+      std::lock_guard lock(m_mutex);
+      uint64_t res = 0;
+      for (auto& r : m_rings)
+        res += r->dropped();
+      return res;
+    }
+
+    // Collects, then appends everything recorded so far to a trace.
+    void exportTo(TraceWriter& trace) {
+      collect();
+      std::lock_guard lock(m_mutex);
+
+      // calibrate ticks against the steady clock over the whole run
+      uint64_t end_ticks = details::readTicks();
+      uint64_t end_ns    = monotonicNanos();
+      double scale       = 1.0;
+      if (end_ticks > m_baseTicks)
+        scale = double(end_ns - m_baseNs) / double(end_ticks - m_baseTicks);
+      auto to_ns = [&](uint64_t ticks) {
+        return m_baseNs + uint64_t(double(ticks - m_baseTicks) * scale);
+      };
+
+      for (auto& r : m_rings) {
+        trace.threadName(
+          r->tid(), r->name.empty() ? "thread " + std::to_string(r->tid())
+                                    : r->name);
+      }
+      for (auto& [e, tid] : m_events) {
+        switch (e.kind) {
+          case details::profile_kind::zone:
+            trace.complete(
+              e.name, tid, to_ns(e.start), to_ns(e.end) - to_ns(e.start));
+            break;
+          case details::profile_kind::counter:
+            trace.counter(e.name, tid, to_ns(e.start), double(int64_t(e.end)));
+            break;
+          case details::profile_kind::frame:
+            trace.instant(e.name, tid, to_ns(e.start));
+            break;
+        }
+      }
+    }
+
+  private:
+    CpuProfiler() :
+      m_baseTicks(details::readTicks()), m_baseNs(monotonicNanos()) {}
+
+    struct stored_event {
+      details::profile_event event;
+      uint32_t tid;
+    };
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<details::profile_ring>> m_rings;
+    std::vector<stored_event> m_events;
+    size_t m_maxEvents = size_t(1) << 22;
+    uint64_t m_baseTicks;
+    uint64_t m_baseNs;
+  };
+
+  // Scoped CPU zone, use through OGLC_ZONE. Costs two tick reads and one
+  // ring push.
+  class CpuZone {
+  public:
+    explicit CpuZone(const char* name) :
+      m_ring(CpuProfiler::instance().ring()),
+      m_name(name),
+      m_start(details::readTicks()) {}
+    CpuZone(const CpuZone&)            = delete;
+    CpuZone& operator=(const CpuZone&) = delete;
+    ~CpuZone() {
+      m_ring.push(
+        {m_name, m_start, details::readTicks(), details::profile_kind::zone});
+    }
+
+  private:
+    details::profile_ring& m_ring;
+    const char* m_name;
+    uint64_t m_start;
+  };
+}  // namespace oglc
+#endif
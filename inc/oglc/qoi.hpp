@@ -0,0 +1,302 @@
+#ifndef OGLC_QOI_HPP_INCLUDED
+#define OGLC_QOI_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace oglc {
+  // The "Quite OK Image" format: lossless, one pass each way, and simple
+  // enough to decode several times faster than PNG. Pixels are coded
+  // against the previous one, as a run, an index into the 64 most recently
+  // hashed colours, a small difference, or verbatim. A good fit for
+  // textures embedded in the binary that would otherwise be PNGs.
+  //
+  // Layout: "qoif", width and height big endian, channels (3 or 4) and
+  // colour space (0 sRGB, 1 linear), the chunks, then 7 zeros and a 1.
+  // Images are encoded from RGBA8, and decoded to RGBA8 or to RGB8,
+  // dropping the alpha; channels says whether it was worth keeping.
+  namespace qoi {
+    inline constexpr uint8_t magic[4] = {'q', 'o', 'i', 'f'};
+
+    namespace details {
+      inline constexpr size_t header_size  = 14;
+      inline constexpr size_t padding_size = 8;
+      // Beyond this the reference decoder gives up, and so do we.
+      inline constexpr uint64_t max_pixels = 400'000'000;
+
+      inline constexpr uint8_t op_index = 0x00;  // 2 bit tags
+      inline constexpr uint8_t op_diff  = 0x40;
+      inline constexpr uint8_t op_luma  = 0x80;
+      inline constexpr uint8_t op_run   = 0xc0;
+      inline constexpr uint8_t op_rgb   = 0xfe;  // 8 bit tags
+      inline constexpr uint8_t op_rgba  = 0xff;
+
+      // Pixels are handled as RGBA bytes loaded into a word, red lowest.
+      inline uint32_t load(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+      }
+
+      inline uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+        return r | g << 8 | b << 16 | a << 24;
+      }
+
+      // (r * 3 + g * 5 + b * 7 + a * 11) % 64 in one multiply: spread the
+      // channels 16 bits apart, and the products that land in the top byte
+      // are exactly the weighted sum.
+      inline uint32_t hash(uint32_t px) {
+        uint64_t v = px;
+        v          = (v & 0xff00ff00) << 24 | (v & 0x00ff00ff);
+        return uint32_t(
+          (v * (uint64_t(3) << 56 | uint64_t(5) << 24 | uint64_t(7) << 40 |
+                uint64_t(11) << 8)) >>
+          56 & 63);
+      }
+
+      inline uint32_t be32(const uint8_t* p) {
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 |
+          uint32_t(p[2]) << 8 | p[3];
+      }
+
+      inline void putBe32(std::vector<uint8_t>& out, uint32_t v) {
+        out.insert(
+          out.end(), {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8),
+                      uint8_t(v)});
+      }
+    }  // namespace details
+
+    struct Header {
+      int width;
+      int height;
+      int channels;  // 3 if every pixel is opaque, else 4
+      bool srgb;
+    };
+
+    inline bool isQoi(std::span<const uint8_t> file) {
+      return file.size() >= details::header_size &&
+        std::memcmp(file.data(), magic, sizeof(magic)) == 0;
+    }
+
+    // Throws if file isn't a QOI image we can decode.
+    inline Header readHeader(std::span<const uint8_t> file) {
+      if (!isQoi(file))
+        throw std::runtime_error("not a QOI file");
+      uint32_t w = details::be32(&file[4]), h = details::be32(&file[8]);
+      Header header {int(w), int(h), file[12], file[13] == 0};
+      if (
+        w == 0 || h == 0 || uint64_t(w) * h > details::max_pixels ||
+        (header.channels != 3 && header.channels != 4) || file[13] > 1)
+        throw std::runtime_error("QOI header is malformed");
+      return header;
+    }
+
+    // Decodes into RGBA8 or RGB8 a run of pixels at a time, so the output
+    // can be written in pieces as buffers come free; the whole encoded
+    // image has to stay alive meanwhile. Truncated or corrupt data throws,
+    // at the latest when the pixels run out before the image is complete.
+    // The output is only ever written, once.
+    class Decoder {
+    public:
+      explicit Decoder(std::span<const uint8_t> file) :
+        m_header(readHeader(file)),
+        m_in(file.data() + details::header_size),
+        m_end(file.data() + file.size()),
+        m_left(uint64_t(m_header.width) * uint64_t(m_header.height)) {
+        if (file.size() < details::header_size + details::padding_size)
+          throw std::runtime_error("QOI data is truncated");
+        // chunks are at most 5 bytes, so stopping this far short of the
+        // end lets the loop read without checking each byte
+        m_end -= details::padding_size;
+      }
+
+      const Header& header() const { return m_header; }
+      // Pixels not decoded yet.
+      uint64_t remaining() const { return m_left; }
+
+      // Decodes the next dst.size() / channels pixels, or as many as are
+      // left, and returns how many. channels is 3 or 4.
+      size_t read(std::span<uint8_t> dst, int channels = 4) {
+        if (channels == 3)
+          return readAs<3>(dst);
+        if (channels == 4)
+          return readAs<4>(dst);
+        throw std::invalid_argument("QOI decodes to 3 or 4 channels");
+      }
+
+    private:
+      template <size_t Channels>
+      size_t readAs(std::span<uint8_t> dst) {
+        using namespace details;
+        size_t count =
+          size_t(std::min<uint64_t>(dst.size() / Channels, m_left));
+        uint8_t* out = dst.data();
+        uint8_t* end = out + count * Channels;
+        const uint8_t* in = m_in;
+        uint32_t px       = m_px;
+
+        // a run can straddle calls
+        for (; m_run > 0 && out < end; m_run--, out += Channels)
+          std::memcpy(out, &px, Channels);
+
+        while (out < end) {
+          if (in >= m_end)
+            throw std::runtime_error("QOI data is truncated");
+          uint8_t b = *in++;
+          if (b < op_diff) {
+            px = m_index[b];
+          }
+          else if (b < op_luma) {
+            uint32_t r  = (px + (b >> 4 & 3) - 2) & 0xff;
+            uint32_t g  = ((px >> 8) + (b >> 2 & 3) - 2) & 0xff;
+            uint32_t bl = ((px >> 16) + (b & 3) - 2) & 0xff;
+            px          = pack(r, g, bl, px >> 24);
+          }
+          else if (b < op_run) {
+            uint8_t b2  = *in++;
+            int dg      = (b & 0x3f) - 32;
+            uint32_t r  = (px + dg - 8 + (b2 >> 4)) & 0xff;
+            uint32_t g  = ((px >> 8) + dg) & 0xff;
+            uint32_t bl = ((px >> 16) + dg - 8 + (b2 & 0x0f)) & 0xff;
+            px          = pack(r, g, bl, px >> 24);
+          }
+          else if (b == op_rgb) {
+            px = pack(in[0], in[1], in[2], px >> 24);
+            in += 3;
+          }
+          else if (b == op_rgba) {
+            px = load(in);
+            in += 4;
+          }
+          else {
+            // b & 0x3f repeats after this one; those that don't fit are
+            // written by the next call
+            size_t room = size_t(end - out) / Channels - 1;
+            size_t fit  = std::min<size_t>(b & 0x3f, room);
+            m_run       = uint32_t((b & 0x3f) - fit);
+            m_index[hash(px)] = px;
+            for (size_t i = 0; i <= fit; i++, out += Channels)
+              std::memcpy(out, &px, Channels);
+            continue;
+          }
+          m_index[hash(px)] = px;
+          std::memcpy(out, &px, Channels);
+          out += Channels;
+        }
+        m_in = in;
+        m_px = px;
+        m_left -= count;
+        return count;
+      }
+
+      Header m_header;
+      const uint8_t* m_in;
+      const uint8_t* m_end;  // where the padding starts
+      uint64_t m_left;
+      uint32_t m_px  = details::pack(0, 0, 0, 255);
+      uint32_t m_run = 0;  // repeats of m_px still owed
+      uint32_t m_index[64] {};
+    };
+
+    // Decodes a whole image into dst, which has to be exactly its size
+    // with that many channels: 4, or 3 for RGB.
+    inline void decode(
+      std::span<const uint8_t> file, std::span<uint8_t> dst,
+      int channels = 4) {
+      Decoder decoder(file);
+      const Header& h = decoder.header();
+      if (dst.size() != size_t(h.width) * size_t(h.height) * size_t(channels))
+        throw std::invalid_argument("QOI image doesn't fit the destination");
+      decoder.read(dst, channels);
+    }
+
+    // Encodes width x height RGBA8 pixels. The header says 3 channels if
+    // they are all opaque.
+    inline std::vector<uint8_t> encode(
+      std::span<const uint8_t> rgba, int width, int height, bool srgb) {
+      using namespace details;
+      size_t pixels = size_t(width) * size_t(height);
+      if (
+        width <= 0 || height <= 0 || pixels > max_pixels ||
+        rgba.size() != pixels * 4)
+        throw std::invalid_argument("QOI image size doesn't match its pixels");
+
+      bool opaque = true;
+      for (size_t i = 3; i < rgba.size() && opaque; i += 4)
+        opaque = rgba[i] == 255;
+
+      std::vector<uint8_t> out;
+      out.reserve(header_size + pixels + padding_size);
+      out.insert(out.end(), std::begin(magic), std::end(magic));
+      putBe32(out, uint32_t(width));
+      putBe32(out, uint32_t(height));
+      out.push_back(opaque ? 3 : 4);
+      out.push_back(srgb ? 0 : 1);
+
+      uint32_t index[64] {};
+      uint32_t prev = pack(0, 0, 0, 255);
+      int run       = 0;
+      for (size_t i = 0; i < pixels; i++) {
+        uint32_t px = load(&rgba[i * 4]);
+        if (px == prev) {
+          // runs of 63 and 64 would collide with the 8 bit tags
+          if (++run == 62 || i + 1 == pixels) {
+            out.push_back(uint8_t(op_run | (run - 1)));
+            run = 0;
+          }
+          continue;
+        }
+        if (run > 0) {
+          out.push_back(uint8_t(op_run | (run - 1)));
+          run = 0;
+        }
+
+        uint32_t slot = hash(px);
+        if (index[slot] == px) {
+          out.push_back(uint8_t(op_index | slot));
+        }
+        else if ((px >> 24) == (prev >> 24)) {
+          index[slot] = px;
+          // channel differences, wrapping
+          auto delta  = [&](int shift) {
+            return int8_t(uint8_t((px >> shift) - (prev >> shift)));
+          };
+          int dr = delta(0), dg = delta(8), db = delta(16);
+          int dr_dg = dr - dg, db_dg = db - dg;
+          if (
+            dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+            out.push_back(
+              uint8_t(op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+          }
+          else if (
+            dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 &&
+            db_dg < 8) {
+            out.push_back(uint8_t(op_luma | (dg + 32)));
+            out.push_back(uint8_t((dr_dg + 8) << 4 | (db_dg + 8)));
+          }
+          else {
+            out.insert(
+              out.end(),
+              {op_rgb, uint8_t(px), uint8_t(px >> 8), uint8_t(px >> 16)});
+          }
+        }
+        else {
+          index[slot] = px;
+          out.insert(
+            out.end(), {op_rgba, uint8_t(px), uint8_t(px >> 8),
+                        uint8_t(px >> 16), uint8_t(px >> 24)});
+        }
+        prev = px;
+      }
+      out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+      return out;
+    }
+  }  // namespace qoi
+}  // namespace oglc
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef OGLC_READBACK_HPP_INCLUDED
+#define OGLC_READBACK_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "oglc/image.hpp"
+#include "oglc/profiler.hpp"
+
+namespace oglc {
+  // One captured frame, straight out of a mapped pixel buffer. RGBA8,
+  // rows bottom-up as GL reads them. Only valid inside the callback.
+  struct FrameView {
+    const uint8_t* data;
+    int width;
+    int height;
+    size_t stride;  // bytes per row
+    uint64_t frame;
+  };
+
+  // Reads the bound read framebuffer straight away, flipped top-down.
+  // Waits for the GPU to finish, so keep it to one-off captures; the ring
+  // below is for every frame.
+  inline Image readFramebuffer(int width, int height) {
+    using namespace gl;
+    std::vector<uint8_t> rgba(size_t(width) * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+    Image img(width, height);
+    for (int y = 0; y < height; y++) {
+      const uint8_t* src = rgba.data() + size_t(height - 1 - y) * width * 4;
+      uint8_t* dst       = img.row(y);
+      for (int x = 0; x < width; x++) {
+        dst[x * 3 + 0] = src[x * 4 + 0];
+        dst[x * 3 + 1] = src[x * 4 + 1];
+        dst[x * 3 + 2] = src[x * 4 + 2];
+      }
+    }
+    return img;
+  }
+
+  // Captures the framebuffer every frame without stalling the pipeline.
+  //
+  // Frame N is read into pixel pack buffer N % K with a fence behind it.
+  // Buffers are only mapped once their fence has signalled, oldest first,
+  // which is normally K - 1 frames later. The mapped memory goes straight
+  // to the consumer on its own thread, no copies, and is unmapped on the
+  // GL thread once the consumer is done with it.
+  //
+  // If a buffer comes round again before the GPU or the consumer is done
+  // with it, capture() waits for it rather than dropping the frame, and
+  // counts a stall. A slow consumer therefore slows rendering down, so
+  // keep the callback short or hand the work to a pool.
+  class ReadbackRing {
+  public:
+    using consumer_type = std::function<void(const FrameView&)>;
+
+    explicit ReadbackRing(consumer_type fn, uint32_t slots = 3) :
+      m_consumer(std::move(fn)), m_slots(slots) {
+      m_thread = std::thread([this] { consumerMain(); });
+    }
+    // not copyable or movable, the consumer thread points back at us
+    ReadbackRing(const ReadbackRing&)            = delete;
+    ReadbackRing& operator=(const ReadbackRing&) = delete;
+    // GL objects must be released with release() while the context is
+    // still alive, we don't know if it is by now.
+    ~ReadbackRing() { stopConsumer(); }
+
+    // Queues a read of the bound read framebuffer. Call after drawing and
+    // before the swap.
+    void capture(int width, int height) {
+      using namespace gl;
+      OGLC_ZONE("readback");
+      if (m_slots.front().pbo == 0)
+        init();
+      poll();
+
+      slot& s = m_slots[m_next % m_slots.size()];
+      if (s.state != slot_state::idle) {
+        m_stalls++;
+        OGLC_ZONE("readback stall");
+        if (s.state == slot_state::pending) {
+          glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+          map(s);
+        }
+        waitConsumed(s);
+        unmap(s);
+      }
+
+      size_t stride = size_t(width) * 4;
+      size_t bytes  = stride * size_t(height);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+      if (bytes != s.bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        s.bytes = bytes;
+      }
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      s.fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+      s.width  = width;
+      s.height = height;
+      s.stride = stride;
+      s.frame  = m_next++;
+      s.state  = slot_state::pending;
+    }
+
+    // Maps whatever is ready and unmaps whatever the consumer is done
+    // with, without blocking. capture() already does this, call it on
+    // frames that aren't captured.
+    void poll() {
+      for (size_t i = 0; i < m_slots.size(); i++) {
+        slot& s = m_slots[(m_next + i) % m_slots.size()];
+        if (s.state == slot_state::mapped && s.consumed.load())
+          unmap(s);
+      }
+      // map in frame order, so the consumer sees frames in order
+      for (size_t i = 0; i < m_slots.size(); i++) {
+        slot& s = m_slots[(m_next + i) % m_slots.size()];
+        if (s.state != slot_state::pending)
+          continue;
+        using namespace gl;
+        auto res = glClientWaitSync(s.fence, GL_NONE_BIT, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+          break;
+        map(s);
+      }
+    }
+
+    // Waits until every captured frame has been consumed.
+    void flush() {
+      for (size_t i = 0; i < m_slots.size(); i++) {
+        slot& s = m_slots[(m_next + i) % m_slots.size()];
+        if (s.state == slot_state::pending) {
+          gl::glClientWaitSync(
+            s.fence, gl::GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+          map(s);
+        }
+      }
+      for (auto& s : m_slots) {
+        if (s.state == slot_state::mapped) {
+          waitConsumed(s);
+          unmap(s);
+        }
+      }
+    }
+
+    // Flushes, then deletes all GL objects. Call before the context goes
+    // away.
+    void release() {
+      if (m_slots.front().pbo == 0)
+        return;
+      flush();
+      for (auto& s : m_slots) {
+        gl::glDeleteBuffers(1, &s.pbo);
+        s.pbo   = 0;
+        s.bytes = 0;
+      }
+    }
+
+    uint64_t captured() const { return m_next; }
+    // Times capture() had to wait on the GPU or the consumer.
+    uint64_t stalls() const { return m_stalls; }
+
+  private:
+    enum class slot_state { idle, pending, mapped };
+
+    struct slot {
+      gl::GLuint pbo      = 0;
+      gl::GLsync fence    = nullptr;
+      size_t bytes        = 0;
+      int width           = 0;
+      int height          = 0;
+      size_t stride       = 0;
+      uint64_t frame      = 0;
+      slot_state state    = slot_state::idle;
+      const uint8_t* data = nullptr;
+      std::atomic<bool> consumed {false};
+    };
+
+    void init() {
+      for (auto& s : m_slots)
+        gl::glGenBuffers(1, &s.pbo);
+    }
+
+    // GL thread: maps a signalled buffer and hands it to the consumer.
+    void map(slot& s) {
+      using namespace gl;
+      glDeleteSync(s.fence);
+      s.fence = nullptr;
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+      s.data = static_cast<const uint8_t*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s.bytes, GL_MAP_READ_BIT));
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      s.state = slot_state::mapped;
+      s.consumed.store(false);
+      {
+        std::lock_guard lock(m_mutex);
+        m_queue.push_back(&s);
+      }
+      m_cv.notify_one();
+    }
+
+    void unmap(slot& s) {
+      using namespace gl;
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      s.data  = nullptr;
+      s.state = slot_state::idle;
+    }
+
+    void waitConsumed(slot& s) {
+      std::unique_lock lock(m_mutex);
+      m_doneCv.wait(lock, [&] { return s.consumed.load(); });
+    }
+
+    void consumerMain() {
+      OGLC_THREAD_NAME("readback");
+      while (true) {
+        slot* s;
+        {
+          std::unique_lock lock(m_mutex);
+          m_cv.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+          if (m_queue.empty())
+            return;
+          s = m_queue.front();
+          m_queue.pop_front();
+        }
+        if (s->data != nullptr) {
+          OGLC_ZONE("readback consume");
+          m_consumer({s->data, s->width, s->height, s->stride, s->frame});
+        }
+        {
+          std::lock_guard lock(m_mutex);
+          s->consumed.store(true);
+        }
+        m_doneCv.notify_all();
+      }
+    }
+
+    void stopConsumer() {
+      if (!m_thread.joinable())
+        return;
+      {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      m_thread.join();
+    }
+
+    consumer_type m_consumer;
+    std::vector<slot> m_slots;
+    uint64_t m_next   = 0;
+    uint64_t m_stalls = 0;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_doneCv;
+    std::deque<slot*> m_queue;
+    bool m_stop = false;
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,488 @@
+#ifndef OGLC_RECORDER_HPP_INCLUDED
+#define OGLC_RECORDER_HPP_INCLUDED
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __has_include(<unistd.h>)
+  #include <fcntl.h>
+  #include <unistd.h>
+  #define OGLC_HAS_POSIX_IO 1
+#endif
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "oglc/context.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/readback.hpp"
+#include "oglc/workers.hpp"
+
+namespace oglc {
+  namespace details {
+    // Heap block with a fixed alignment, as O_DIRECT wants.
+    struct aligned_deleter {
+      std::align_val_t align;
+      void operator()(uint8_t* p) const { ::operator delete[](p, align); }
+    };
+    using aligned_bytes = std::unique_ptr<uint8_t[], aligned_deleter>;
+
+    inline aligned_bytes allocAligned(size_t size, size_t align) {
+      auto a = std::align_val_t(align);
+      return aligned_bytes(new (a) uint8_t[size], aligned_deleter {a});
+    }
+
+    // Sequential writer that only issues large, block-aligned writes, so
+    // it can bypass the page cache with O_DIRECT where there is one. The
+    // unaligned tail goes out with O_DIRECT turned off when closing.
+    class direct_file {
+    public:
+      static constexpr size_t alignment  = 4096;
+      static constexpr size_t chunk_size = size_t(8) << 20;
+
+      explicit direct_file(const std::string& path) :
+        m_chunk(allocAligned(chunk_size, alignment)) {
+#ifdef OGLC_HAS_POSIX_IO
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  #ifdef O_DIRECT
+        m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        // tmpfs and friends refuse O_DIRECT, fall back to buffered
+        if (m_fd < 0)
+  #endif
+          m_fd = ::open(path.c_str(), flags, 0644);
+        if (m_fd < 0)
+          throw std::runtime_error("Failed to open " + path);
+#else
+        m_file = std::fopen(path.c_str(), "wb");
+        if (!m_file)
+          throw std::runtime_error("Failed to open " + path);
+#endif
+      }
+      direct_file(const direct_file&)            = delete;
+      direct_file& operator=(const direct_file&) = delete;
+      ~direct_file() { close(); }
+
+      void write(const void* data, size_t size) {
+        auto src = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+          size_t n = std::min(size, chunk_size - m_used);
+          std::memcpy(m_chunk.get() + m_used, src, n);
+          m_used += n;
+          src += n;
+          size -= n;
+          if (m_used == chunk_size)
+            flushChunk(chunk_size);
+        }
+      }
+
+      void close() {
+#ifdef OGLC_HAS_POSIX_IO
+        if (m_fd < 0)
+          return;
+  #ifdef O_DIRECT
+        ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+  #endif
+        flushChunk(m_used);
+        ::close(m_fd);
+        m_fd = -1;
+#else
+        if (!m_file)
+          return;
+        flushChunk(m_used);
+        std::fclose(m_file);
+        m_file = nullptr;
+#endif
+      }
+
+    private:
+      void flushChunk(size_t size) {
+        const uint8_t* p = m_chunk.get();
+        while (size > 0) {
+#ifdef OGLC_HAS_POSIX_IO
+          ptrdiff_t n = ::write(m_fd, p, size);
+#else
+          ptrdiff_t n = ptrdiff_t(std::fwrite(p, 1, size, m_file));
+          if (n == 0)
+            n = -1;
+#endif
+          if (n < 0)
+            throw std::runtime_error("Write to recording failed");
+          p += n;
+          size -= size_t(n);
+        }
+        m_used = 0;
+      }
+
+      aligned_bytes m_chunk;
+      size_t m_used = 0;
+#ifdef OGLC_HAS_POSIX_IO
+      int m_fd = -1;
+#else
+      std::FILE* m_file = nullptr;
+#endif
+    };
+
+    // BT.601 limited range, 8 bit fixed point.
+    inline uint8_t rgbToY(int r, int g, int b) {
+      return uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+    inline uint8_t rgbToU(int r, int g, int b) {
+      return uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+    inline uint8_t rgbToV(int r, int g, int b) {
+      return uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+#ifdef __SSE2__
+    // Splits 8 RGBA pixels into 16-bit R, G and B lanes.
+    inline void unpackRgb8(
+      const uint8_t* src, __m128i& r, __m128i& g, __m128i& b) {
+      auto in      = reinterpret_cast<const __m128i*>(src);
+      __m128i lo   = _mm_loadu_si128(in);
+      __m128i hi   = _mm_loadu_si128(in + 1);
+      __m128i mask = _mm_set1_epi32(0xFF);
+      r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+      g = _mm_packs_epi32(
+        _mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+        _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+      b = _mm_packs_epi32(
+        _mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+        _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+    }
+
+    // rgbToY on 8 lanes. The weighted sum tops out at 56228, which fits
+    // an unsigned 16-bit lane, hence the logical shift.
+    inline __m128i lumaX8(__m128i r, __m128i g, __m128i b) {
+      __m128i y = _mm_add_epi16(
+        _mm_add_epi16(
+          _mm_mullo_epi16(r, _mm_set1_epi16(66)),
+          _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+        _mm_add_epi16(
+          _mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+      return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+    }
+
+    // Sums horizontal pairs of two rows' lanes: 8 + 8 lanes in, 4 out
+    // (as 32-bit).
+    inline __m128i quadSum(__m128i row0, __m128i row1) {
+      return _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+    }
+
+    inline __m128i chromaX8(
+      __m128i r, __m128i g, __m128i b, int16_t kr, int16_t kg, int16_t kb) {
+      __m128i c = _mm_add_epi16(
+        _mm_add_epi16(
+          _mm_mullo_epi16(r, _mm_set1_epi16(kr)),
+          _mm_mullo_epi16(g, _mm_set1_epi16(kg))),
+        _mm_add_epi16(
+          _mm_mullo_epi16(b, _mm_set1_epi16(kb)), _mm_set1_epi16(128)));
+      return _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+    }
+#endif
+
+    // Converts two RGBA rows into two Y rows and one row each of U and V,
+    // averaging 2x2 blocks for chroma. Returns how many pixels it did, the
+    // caller finishes the rest.
+    inline int rgbaToYuv420Simd(
+      const uint8_t* row0, const uint8_t* row1, uint8_t* y0, uint8_t* y1,
+      uint8_t* u, uint8_t* v, int width) {
+      int x = 0;
+#ifdef __SSE2__
+      const __m128i two = _mm_set1_epi16(2);
+      for (; x + 16 <= width; x += 16) {
+        __m128i r[4], g[4], b[4];
+        unpackRgb8(row0 + x * 4, r[0], g[0], b[0]);
+        unpackRgb8(row0 + x * 4 + 32, r[1], g[1], b[1]);
+        unpackRgb8(row1 + x * 4, r[2], g[2], b[2]);
+        unpackRgb8(row1 + x * 4 + 32, r[3], g[3], b[3]);
+
+        _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(y0 + x),
+          _mm_packus_epi16(
+            lumaX8(r[0], g[0], b[0]), lumaX8(r[1], g[1], b[1])));
+        _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(y1 + x),
+          _mm_packus_epi16(
+            lumaX8(r[2], g[2], b[2]), lumaX8(r[3], g[3], b[3])));
+
+        // rounded 2x2 averages, 8 of them
+        auto avg = [&](__m128i* c) {
+          __m128i sum = _mm_packs_epi32(
+            quadSum(c[0], c[2]), quadSum(c[1], c[3]));
+          return _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        };
+        __m128i ra = avg(r), ga = avg(g), ba = avg(b);
+        _mm_storel_epi64(
+          reinterpret_cast<__m128i*>(u + x / 2),
+          _mm_packus_epi16(chromaX8(ra, ga, ba, -38, -74, 112), ra));
+        _mm_storel_epi64(
+          reinterpret_cast<__m128i*>(v + x / 2),
+          _mm_packus_epi16(chromaX8(ra, ga, ba, 112, -94, -18), ra));
+      }
+#endif
+      return x;
+    }
+
+    // Scalar version, also handles odd widths by repeating the last column.
+    inline void rgbaToYuv420Scalar(
+      const uint8_t* row0, const uint8_t* row1, uint8_t* y0, uint8_t* y1,
+      uint8_t* u, uint8_t* v, int x, int width) {
+      for (; x < width; x += 2) {
+        int x1   = std::min(x + 1, width - 1);
+        auto px0 = row0 + x * 4, px1 = row0 + x1 * 4;
+        auto px2 = row1 + x * 4, px3 = row1 + x1 * 4;
+        y0[x]    = rgbToY(px0[0], px0[1], px0[2]);
+        y1[x]    = rgbToY(px2[0], px2[1], px2[2]);
+        if (x1 != x) {
+          y0[x1] = rgbToY(px1[0], px1[1], px1[2]);
+          y1[x1] = rgbToY(px3[0], px3[1], px3[2]);
+        }
+        int r = (px0[0] + px1[0] + px2[0] + px3[0] + 2) >> 2;
+        int g = (px0[1] + px1[1] + px2[1] + px3[1] + 2) >> 2;
+        int b = (px0[2] + px1[2] + px2[2] + px3[2] + 2) >> 2;
+        u[x / 2] = rgbToU(r, g, b);
+        v[x / 2] = rgbToV(r, g, b);
+      }
+    }
+  }  // namespace details
+
+  // Streams frames to disk as Y4M (YUV 4:2:0) or as raw, headerless RGBA.
+  //
+  // consume() converts a frame into one of a fixed set of buffers, used
+  // in turn, splitting the rows across a team of threads of its own, and
+  // queues it for the writer thread. Nothing is allocated per frame: the
+  // threads are started once and the queue is two counters. When every
+  // buffer is waiting
+  // on the disk, consume() blocks. Fed from a ReadbackRing, that holds
+  // back the ring, which in turn holds back rendering, so memory stays
+  // bounded and no frame is dropped.
+  class VideoRecorder {
+  public:
+    enum class Format { y4m, rgba };
+
+    VideoRecorder(
+      const std::string& path, Format format, int width, int height,
+      int fps = 60, size_t buffers = 3) :
+      m_file(path),
+      m_format(format),
+      m_width(width),
+      m_height(height) {
+      size_t frame_bytes = size_t(width) * height * 4;
+      if (format == Format::y4m) {
+        size_t chroma = size_t((width + 1) / 2) * ((height + 1) / 2);
+        frame_bytes   = size_t(width) * height + chroma * 2;
+
+        char header[128];
+        int n = std::snprintf(
+          header, sizeof(header),
+          "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+          width, height, fps);
+        m_file.write(header, size_t(n));
+      }
+      m_frameBytes = frame_bytes;
+      m_buffers.reserve(buffers);
+      for (size_t i = 0; i < buffers; i++) {
+        m_buffers.push_back(
+          details::allocAligned(frame_bytes, details::direct_file::alignment));
+      }
+      m_writer = std::thread([this] { writerMain(); });
+    }
+    // not copyable or movable, the writer thread points back at us
+    VideoRecorder(const VideoRecorder&)            = delete;
+    VideoRecorder& operator=(const VideoRecorder&) = delete;
+    ~VideoRecorder() { finish(); }
+
+    // Converts and queues one frame. Frames of the wrong size are skipped,
+    // a stream can't change size halfway.
+    void consume(const FrameView& frame) {
+      if (frame.width != m_width || frame.height != m_height) {
+        m_skipped++;
+        return;
+      }
+
+      // the buffers are used in turn, wait for the next to be written out
+      {
+        OGLC_ZONE("recorder wait");
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(
+          lock, [&] { return m_queued - m_written < m_buffers.size(); });
+      }
+      uint8_t* buf = m_buffers[m_queued % m_buffers.size()].get();
+      {
+        OGLC_ZONE("recorder convert");
+        if (m_format == Format::y4m)
+          convertYuv(frame, buf);
+        else
+          convertRgba(frame, buf);
+      }
+      {
+        std::lock_guard lock(m_mutex);
+        m_queued++;
+      }
+      m_cv.notify_all();
+      m_frames++;
+    }
+
+    // Writes out everything queued and closes the file.
+    void finish() {
+      if (!m_writer.joinable())
+        return;
+      {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      m_writer.join();
+      m_file.close();
+    }
+
+    uint64_t frames() const { return m_frames; }
+    uint64_t skipped() const { return m_skipped; }
+
+  private:
+    // Row pairs per band, enough bands to keep the team busy.
+    size_t bandCount(size_t rows) const {
+      return std::min(rows, (m_team.size() + 1) * 4);
+    }
+
+    void convertYuv(const FrameView& frame, uint8_t* buf) {
+      int w = m_width, h = m_height;
+      int cw = (w + 1) / 2, ch = (h + 1) / 2;
+      uint8_t* y_plane = buf;
+      uint8_t* u_plane = y_plane + size_t(w) * h;
+      uint8_t* v_plane = u_plane + size_t(cw) * ch;
+
+      // GL rows are bottom-up, video is top-down
+      auto src_row = [&](int row) {
+        return frame.data + size_t(h - 1 - row) * frame.stride;
+      };
+      size_t bands = bandCount(size_t(ch));
+      m_team.run(bands, [&](size_t band) {
+        int begin = int(band * ch / bands), end = int((band + 1) * ch / bands);
+        for (int cy = begin; cy < end; cy++) {
+          int r0 = cy * 2, r1 = std::min(r0 + 1, h - 1);
+          uint8_t* y0 = y_plane + size_t(r0) * w;
+          uint8_t* y1 = y_plane + size_t(r1) * w;
+          uint8_t* u  = u_plane + size_t(cy) * cw;
+          uint8_t* v  = v_plane + size_t(cy) * cw;
+          int x = details::rgbaToYuv420Simd(
+            src_row(r0), src_row(r1), y0, y1, u, v, w);
+          details::rgbaToYuv420Scalar(
+            src_row(r0), src_row(r1), y0, y1, u, v, x, w);
+        }
+      });
+    }
+
+    void convertRgba(const FrameView& frame, uint8_t* buf) {
+      size_t row_bytes = size_t(m_width) * 4;
+      size_t bands     = bandCount(size_t(m_height));
+      m_team.run(bands, [&](size_t band) {
+        size_t begin = band * m_height / bands;
+        size_t end   = (band + 1) * m_height / bands;
+        for (size_t row = begin; row < end; row++) {
+          std::memcpy(
+            buf + row * row_bytes,
+            frame.data + (m_height - 1 - row) * frame.stride, row_bytes);
+        }
+      });
+    }
+
+    void writerMain() {
+      OGLC_THREAD_NAME("recorder");
+      static constexpr char frame_tag[] = "FRAME\n";
+      while (true) {
+        uint8_t* buf;
+        {
+          std::unique_lock lock(m_mutex);
+          m_cv.wait(lock, [&] { return m_stop || m_written < m_queued; });
+          if (m_written == m_queued)
+            return;
+          buf = m_buffers[m_written % m_buffers.size()].get();
+        }
+        {
+          OGLC_ZONE("recorder write");
+          if (m_format == Format::y4m)
+            m_file.write(frame_tag, sizeof(frame_tag) - 1);
+          m_file.write(buf, m_frameBytes);
+        }
+        {
+          std::lock_guard lock(m_mutex);
+          m_written++;
+        }
+        m_cv.notify_all();
+      }
+    }
+
+    details::direct_file m_file;
+    WorkerTeam m_team;
+    Format m_format;
+    int m_width;
+    int m_height;
+    size_t m_frameBytes = 0;
+    uint64_t m_frames   = 0;
+    uint64_t m_skipped  = 0;
+
+    // frame n goes to buffer n % size, written once the writer gets to it
+    std::vector<details::aligned_bytes> m_buffers;
+    uint64_t m_queued  = 0;
+    uint64_t m_written = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::thread m_writer;
+  };
+
+  // Drives `--record FILE` for the examples: readback ring and recorder.
+  // .y4m files get YUV, anything else raw RGBA. Does nothing unless
+  // recording was asked for.
+  class Recording {
+  public:
+    Recording(const AppOptions& opts, const Context& ctx) {
+      if (opts.recordPath.empty())
+        return;
+      auto& path  = opts.recordPath;
+      auto format = path.ends_with(".y4m") ? VideoRecorder::Format::y4m
+                                           : VideoRecorder::Format::rgba;
+      m_recorder  = std::make_unique<VideoRecorder>(
+        path, format, ctx.width(), ctx.height());
+      m_ring = std::make_unique<ReadbackRing>(
+        [rec = m_recorder.get()](const FrameView& f) { rec->consume(f); });
+    }
+
+    bool active() const { return m_ring != nullptr; }
+
+    // GL thread, after drawing and before the swap.
+    void capture(const Context& ctx) {
+      if (m_ring)
+        m_ring->capture(ctx.width(), ctx.height());
+    }
+
+    // GL thread, while the context is still current.
+    void finish() {
+      if (!m_ring)
+        return;
+      m_ring->release();
+      m_recorder->finish();
+      std::cerr << "recorded " << m_recorder->frames() << " frames ("
+                << m_recorder->skipped() << " skipped, " << m_ring->stalls()
+                << " readback stalls)\n";
+      m_ring.reset();
+    }
+
+  private:
+    std::unique_ptr<VideoRecorder> m_recorder;
+    std::unique_ptr<ReadbackRing> m_ring;
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,90 @@
+#ifndef OGLC_SNAPSHOT_HPP_INCLUDED
+#define OGLC_SNAPSHOT_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+namespace oglc {
+  // Lock-free triple buffer for handing snapshots from one producer thread
+  // to one consumer thread. The producer never waits for the consumer and
+  // the consumer always sees the newest complete snapshot, so neither side
+  // can fall more than one snapshot behind the other.
+  template <class T>
+  class TripleBuffer {
+  public:
+    TripleBuffer() = default;
+    explicit TripleBuffer(const T& init) : m_slots {init, init, init} {}
+    // not copyable or movable, both threads hold a reference
+    TripleBuffer(const TripleBuffer&)            = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Producer side: fill in the back slot, then publish it.
+    T& back() { return m_slots[m_back]; }
+    void publish() {
+      uint8_t prev =
+        m_middle.exchange(m_back | fresh_bit, std::memory_order_acq_rel);
+      m_back = prev & index_mask;
+    }
+
+    // Consumer side: picks up the latest published snapshot if there is a
+    // new one. Returns whether front() changed.
+    bool update() {
+      if ((m_middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+        return false;
+      m_front =
+        m_middle.exchange(m_front, std::memory_order_acq_rel) & index_mask;
+      return true;
+    }
+    const T& front() const { return m_slots[m_front]; }
+
+  private:
+    static constexpr uint8_t index_mask = 0x3;
+    static constexpr uint8_t fresh_bit  = 0x4;
+
+    // separate cache lines so the two threads don't fight over them
+    alignas(64) T m_slots[3] {};
+    alignas(64) std::atomic<uint8_t> m_middle {1};
+    alignas(64) uint8_t m_back  = 0;
+    alignas(64) uint8_t m_front = 2;
+  };
+
+  // Monotonic timestamp in nanoseconds, for stamping snapshots.
+  inline uint64_t monotonicNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+  // Running min/mean/max of a latency in nanoseconds. Single-threaded,
+  // keep one per thread that measures.
+  class LatencyStats {
+  public:
+    void record(uint64_t ns) {
+      m_count++;
+      m_sum += ns;
+      m_min = std::min(m_min, ns);
+      m_max = std::max(m_max, ns);
+    }
+
+    uint64_t count() const { return m_count; }
+    double meanMs() const { return m_count ? m_sum / 1e6 / m_count : 0.0; }
+    double minMs() const { return m_count ? m_min / 1e6 : 0.0; }
+    double maxMs() const { return m_max / 1e6; }
+
+    void print(std::string_view name, std::ostream& out = std::cerr) const {
+      out << name << ": " << m_count << " samples, min " << minMs()
+          << " ms, mean " << meanMs() << " ms, max " << maxMs() << " ms\n";
+    }
+
+  private:
+    uint64_t m_count = 0;
+    uint64_t m_sum   = 0;
+    uint64_t m_min   = UINT64_MAX;
+    uint64_t m_max   = 0;
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,159 @@
+#ifndef OGLC_STARTUP_HPP_INCLUDED
+#define OGLC_STARTUP_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "oglc/profiler.hpp"
+#include "oglc/snapshot.hpp"
+
+// Times the enclosing scope as a startup phase, and as a CPU zone.
+#define OGLC_STARTUP_PHASE(name)                                   \
+  ::oglc::StartupPhase OGLC_CONCAT(_oglc_startup_, __LINE__)(name); \
+  OGLC_ZONE(name)
+
+namespace oglc {
+  namespace details {
+    // Taken during static initialisation, as close to process start as
+    // we can portably get.
+    inline const uint64_t startup_origin = monotonicNanos();
+    inline const std::thread::id startup_thread = std::this_thread::get_id();
+  }  // namespace details
+
+  // Where the time goes between process start and the first presented
+  // frame. Phases can come from any thread and nest; once the first frame
+  // is in, the timeline closes and later phases are ignored, so code that
+  // also runs mid-session (shader compiles) can stay instrumented.
+  class StartupTimeline {
+  public:
+    struct phase {
+      const char* name;
+      uint64_t start;  // ns since process start
+      uint64_t end;
+      uint32_t thread;  // 0 is the main thread
+      uint32_t depth;
+    };
+
+    static StartupTimeline& instance() {
+      static StartupTimeline timeline;
+      return timeline;
+    }
+
+    bool done() const { return m_done.load(std::memory_order_acquire); }
+
+    void record(const phase& p) {
+      std::lock_guard lock(m_mutex);
+      if (!done())
+        m_phases.push_back(p);
+    }
+
+    // Call once the first frame has been presented.
+    void firstFrame() {
+      std::lock_guard lock(m_mutex);
+      if (done())
+        return;
+      m_firstFrame = monotonicNanos() - details::startup_origin;
+      m_done.store(true, std::memory_order_release);
+    }
+
+    // Nanoseconds from process start to the first presented frame, 0
+    // before there was one.
+    uint64_t timeToFirstFrame() const { return done() ? m_firstFrame : 0; }
+
+    void print(std::ostream& out = std::cerr) const {
+      std::lock_guard lock(m_mutex);
+      std::vector<phase> sorted = m_phases;
+      std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+        return a.start < b.start;
+      });
+      out << "startup (ms since process start):\n"
+          << "     start  duration  thread\n"
+          << std::fixed << std::setprecision(2);
+      for (auto& p : sorted) {
+        out << std::setw(10) << p.start / 1e6 << std::setw(10)
+            << (p.end - p.start) / 1e6 << std::setw(8) << p.thread << "  "
+            << std::string(p.depth * 2, ' ') << p.name << "\n";
+      }
+      if (done())
+        out << "time to first frame: " << m_firstFrame / 1e6 << " ms\n";
+      out << std::defaultfloat;
+    }
+
+    static uint32_t threadIndex() {
+      static std::atomic<uint32_t> next {1};
+      if (std::this_thread::get_id() == details::startup_thread)
+        return 0;
+      thread_local uint32_t index = next++;
+      return index;
+    }
+
+  private:
+    StartupTimeline() = default;
+
+    mutable std::mutex m_mutex;
+    std::vector<phase> m_phases;
+    std::atomic<bool> m_done {false};
+    uint64_t m_firstFrame = 0;
+  };
+
+  // Scoped startup phase, use through OGLC_STARTUP_PHASE. Costs nothing
+  // worth mentioning once startup is over.
+  class StartupPhase {
+  public:
+    explicit StartupPhase(const char* name) :
+      m_name(name), m_active(!StartupTimeline::instance().done()) {
+      if (m_active) {
+        m_start = monotonicNanos();
+        t_depth++;
+      }
+    }
+    StartupPhase(const StartupPhase&)            = delete;
+    StartupPhase& operator=(const StartupPhase&) = delete;
+    ~StartupPhase() {
+      if (!m_active)
+        return;
+      t_depth--;
+      StartupTimeline::instance().record({
+        m_name,
+        m_start - details::startup_origin,
+        monotonicNanos() - details::startup_origin,
+        StartupTimeline::threadIndex(),
+        t_depth,
+      });
+    }
+
+  private:
+    inline static thread_local uint32_t t_depth = 0;
+
+    const char* m_name;
+    bool m_active;
+    uint64_t m_start = 0;
+  };
+
+  // Runs fn as a startup phase. With overlap it starts right away on its
+  // own thread, so asset loading can proceed while the context is being
+  // created. Otherwise it runs on the caller when the result is first
+  // asked for, which is the plain serial startup.
+  template <class F>
+  auto startupTask(bool overlap, const char* name, F&& fn)
+    -> std::future<std::invoke_result_t<F>> {
+    auto policy = overlap ? std::launch::async : std::launch::deferred;
+    return std::async(policy, [overlap, name, fn = std::forward<F>(fn)] {
+      if (overlap)
+        OGLC_THREAD_NAME("startup");
+      OGLC_STARTUP_PHASE(name);
+      return fn();
+    });
+  }
+}  // namespace oglc
+#endif
@@ -0,0 +1,304 @@
+#ifndef OGLC_TEXARRAY_HPP_INCLUDED
+#define OGLC_TEXARRAY_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "oglc/debug.hpp"
+#include "oglc/profiler.hpp"
+
+namespace oglc {
+  struct TextureArrayOptions {
+    int width  = 64;
+    int height = 64;
+    int layers = 256;
+    bool srgb  = false;
+    gl::GLenum wrap      = gl::GL_CLAMP_TO_EDGE;
+    gl::GLenum minFilter = gl::GL_NEAREST;
+    gl::GLenum magFilter = gl::GL_NEAREST;
+    std::string label;  // for GL debug output
+  };
+
+  // Many same-sized RGBA8 images, skins say, as the layers of one
+  // GL_TEXTURE_2D_ARRAY, so everything drawn with them needs one binding.
+  // Images are looked up by a key of the caller's choosing and get a
+  // layer while they are in use; when the layers run out the least
+  // recently used image is evicted, though never one used since
+  // beginFrame(), as this frame's draws may still need it.
+  //
+  // A crowd then is one instanced draw: pass each instance's layer as an
+  // integer attribute with glVertexAttribIPointer and a divisor of 1, and
+  // sample with texture(sampler2DArray, vec3(uv, layer)); 05-skins does.
+  //
+  // insert() copies the pixels straight into a mapped staging buffer;
+  // flush() unmaps and uploads them.
+  //
+  // GL thread only. Call release() while the context is alive.
+  class TextureArrayPool {
+  public:
+    using Key = uint64_t;
+
+    explicit TextureArrayPool(TextureArrayOptions options = {}) :
+      m_options(std::move(options)) {
+      using namespace gl;
+      const TextureArrayOptions& o = m_options;
+      GLint max_layers             = 0;
+      glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+      if (o.width <= 0 || o.height <= 0 || o.layers <= 0)
+        throw std::invalid_argument("a texture array needs a positive size");
+      if (o.layers > max_layers)
+        throw std::invalid_argument("more layers than the driver allows");
+
+      GLint bound = 0;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+      glGenTextures(1, &m_texture);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, o.wrap);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, o.wrap);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, o.minFilter);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, o.magFilter);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+      glTexImage3D(
+        GL_TEXTURE_2D_ARRAY, 0, o.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, o.width,
+        o.height, o.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, GLuint(bound));
+      if (!o.label.empty())
+        labelObject(GL_TEXTURE, m_texture, o.label);
+
+      // layer 0 handed out first
+      for (int i = o.layers - 1; i >= 0; i--)
+        m_free.push_back(i);
+    }
+    TextureArrayPool(const TextureArrayPool&)            = delete;
+    TextureArrayPool& operator=(const TextureArrayPool&) = delete;
+
+    gl::GLuint texture() const { return m_texture; }
+    int capacity() const { return m_options.layers; }
+    size_t size() const { return m_entries.size(); }
+    // Images that lost their layer to another, since the start.
+    uint64_t evictions() const { return m_evictions; }
+    size_t layerBytes() const {
+      return size_t(m_options.width) * size_t(m_options.height) * 4;
+    }
+
+    // Starts a frame: what the last one used can be evicted again.
+    void beginFrame() { m_frame++; }
+
+    // The image's layer, if it has one, counting it as used this frame.
+    std::optional<int> find(Key key) {
+      auto it = m_entries.find(key);
+      if (it == m_entries.end())
+        return std::nullopt;
+      touch(it->second);
+      return it->second.layer;
+    }
+
+    // Gives the image a layer, or replaces its pixels if it has one, and
+    // queues their upload. Nothing if every layer is in use this frame.
+    std::optional<int> insert(Key key, std::span<const uint8_t> rgba) {
+      if (rgba.size() != layerBytes())
+        throw std::invalid_argument("image doesn't match the array's layers");
+      auto it = m_entries.find(key);
+      if (it == m_entries.end()) {
+        std::optional<int> layer = take();
+        if (!layer)
+          return std::nullopt;
+        m_order.push_front(key);
+        it = m_entries.emplace(key, entry {*layer, m_order.begin(), 0}).first;
+      }
+      touch(it->second);
+      stage(it->second.layer, rgba);
+      return it->second.layer;
+    }
+
+    // Frees the image's layer. Its pixels stay until the layer is reused.
+    void evict(Key key) {
+      auto it = m_entries.find(key);
+      if (it == m_entries.end())
+        return;
+      m_order.erase(it->second.pos);
+      m_free.push_back(it->second.layer);
+      m_entries.erase(it);
+    }
+
+    // Uploads what insert() queued, before anything is drawn with it.
+    // Layers queued one after the other in the same staging buffer go
+    // in one glTexSubImage3D. Returns how many calls that took.
+    size_t flush() {
+      using namespace gl;
+      if (m_pending.empty())
+        return 0;
+      OGLC_ZONE("upload texture layers");
+      const TextureArrayOptions& o = m_options;
+      const size_t bytes           = layerBytes();
+      for (size_t i = 0; i < m_mapped; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_chunks[i].pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      }
+      std::vector<std::pair<int, staged>> order(
+        m_pending.begin(), m_pending.end());
+      std::sort(order.begin(), order.end(), [](auto& a, auto& b) {
+        return a.first < b.first;
+      });
+
+      GLint bound = 0;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      // a run is consecutive layers staged back to back
+      auto next = [&](size_t i, size_t n) {
+        const staged &a = order[i].second, &b = order[i + n].second;
+        return order[i + n].first == order[i].first + int(n) &&
+          b.chunk == a.chunk && b.offset == a.offset + n * bytes;
+      };
+      size_t calls = 0;
+      for (size_t i = 0, run = 1; i < order.size(); i += run, calls++) {
+        for (run = 1; i + run < order.size() && next(i, run); run++) {}
+        const staged& first = order[i].second;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_chunks[first.chunk].pbo);
+        glTexSubImage3D(
+          GL_TEXTURE_2D_ARRAY, 0, 0, 0, order[i].first, o.width, o.height,
+          GLsizei(run), GL_RGBA, GL_UNSIGNED_BYTE,
+          reinterpret_cast<const void*>(first.offset));
+      }
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, GLuint(bound));
+      m_pending.clear();
+      m_mapped = 0;
+      return calls;
+    }
+
+    void release() {
+      gl::glDeleteTextures(1, &m_texture);
+      for (chunk& c : m_chunks)
+        gl::glDeleteBuffers(1, &c.pbo);
+      m_texture = 0;
+      m_chunks.clear();
+      m_mapped = 0;
+      m_entries.clear();
+      m_order.clear();
+      m_pending.clear();
+    }
+
+  private:
+    // A staging buffer, mapped from the first layer written to it until
+    // flush().
+    struct chunk {
+      gl::GLuint pbo  = 0;
+      uint8_t* mapped = nullptr;
+      size_t used     = 0;
+    };
+
+    struct staged {
+      size_t chunk;
+      size_t offset;
+    };
+
+    struct entry {
+      int layer;
+      std::list<Key>::iterator pos;  // in m_order
+      uint64_t frame;                // last used
+    };
+
+    // most recently used to the front
+    void touch(entry& e) {
+      m_order.splice(m_order.begin(), m_order, e.pos);
+      e.frame = m_frame;
+    }
+
+    std::optional<int> take() {
+      if (!m_free.empty()) {
+        int layer = m_free.back();
+        m_free.pop_back();
+        return layer;
+      }
+      // the least recently used can go unless it was used this frame, in
+      // which case everything was
+      if (m_order.empty())
+        return std::nullopt;
+      auto victim = m_entries.find(m_order.back());
+      if (victim->second.frame == m_frame)
+        return std::nullopt;
+      int layer = victim->second.layer;
+      m_order.pop_back();
+      m_entries.erase(victim);
+      m_evictions++;
+      return layer;
+    }
+
+    // Straight into a mapped staging buffer. A layer queued twice is
+    // uploaded once, with the later pixels.
+    void stage(int layer, std::span<const uint8_t> rgba) {
+      auto it = m_pending.find(layer);
+      if (it == m_pending.end()) {
+        if (m_mapped == 0 || m_chunks[m_mapped - 1].used == chunkBytes())
+          map();
+        chunk& c = m_chunks[m_mapped - 1];
+        it = m_pending.emplace(layer, staged {m_mapped - 1, c.used}).first;
+        c.used += rgba.size();
+      }
+      const staged& at = it->second;
+      std::memcpy(
+        m_chunks[at.chunk].mapped + at.offset, rgba.data(), rgba.size());
+    }
+
+    // Up to 4 MiB of whole layers, or one if they're bigger.
+    size_t chunkBytes() const {
+      size_t layers = std::clamp<size_t>(
+        (size_t(4) << 20) / layerBytes(), 1, size_t(m_options.layers));
+      return layers * layerBytes();
+    }
+
+    // Maps the next staging buffer, making one if it's the first time
+    // this many were needed. A fresh store every time, so a buffer whose
+    // last upload is still in flight doesn't stall the map.
+    void map() {
+      using namespace gl;
+      if (m_mapped == m_chunks.size()) {
+        m_chunks.emplace_back();
+        glGenBuffers(1, &m_chunks.back().pbo);
+      }
+      chunk& c = m_chunks[m_mapped];
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, c.pbo);
+      glBufferData(
+        GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(chunkBytes()), nullptr,
+        GL_STREAM_DRAW);
+      c.mapped = static_cast<uint8_t*>(glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(chunkBytes()),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      if (!c.mapped)
+        throw std::runtime_error("failed to map a staging buffer");
+      c.used = 0;
+      m_mapped++;
+    }
+
+    TextureArrayOptions m_options;
+    gl::GLuint m_texture = 0;
+    uint64_t m_frame     = 1;
+    uint64_t m_evictions = 0;
+    std::unordered_map<Key, entry> m_entries;
+    std::list<Key> m_order;
+    std::vector<int> m_free;
+    // layer to where its pixels are staged, until flush()
+    std::unordered_map<int, staged> m_pending;
+    std::vector<chunk> m_chunks;
+    size_t m_mapped = 0;  // of m_chunks, from the front
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,816 @@
+#ifndef OGLC_TEXLOADER_HPP_INCLUDED
+#define OGLC_TEXLOADER_HPP_INCLUDED
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "oglc/bcn.hpp"
+#include "oglc/debug.hpp"
+#include "oglc/gpuprof.hpp"
+#include "oglc/ktx.hpp"
+#include "oglc/mipmap.hpp"
+#include "oglc/pixels.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/workers.hpp"
+
+namespace oglc {
+  struct TextureSize {
+    int width    = 0;
+    int height   = 0;
+    int channels = 4;  // grey, grey and alpha, RGB or RGBA
+
+    // 8 bits a channel, tightly packed
+    size_t bytes() const {
+      return size_t(width) * size_t(height) * size_t(channels);
+    }
+  };
+
+  // How the loader gets pixels out of an encoded image, in two steps so
+  // they can be decoded straight into a mapped staging buffer: probe()
+  // reads the size and channel count from the header, decode() then
+  // writes rows of that many 8-bit channels, tightly packed, in the order
+  // they go to glTexImage2D, to dst, which is exactly size.bytes() long.
+  // dst may be mapped write-only: write it, never read it back. Both
+  // throw on failure and run on workers.
+  struct TextureDecoder {
+    std::function<TextureSize(std::span<const uint8_t> encoded)> probe;
+    std::function<void(std::span<const uint8_t>, std::span<uint8_t> dst)>
+      decode;
+  };
+
+  struct TextureOptions {
+    gl::GLenum wrap      = gl::GL_REPEAT;
+    gl::GLenum minFilter = gl::GL_LINEAR_MIPMAP_LINEAR;
+    gl::GLenum magFilter = gl::GL_LINEAR;
+    bool mipmaps         = true;
+    // The colours are sRGB encoded, and sampled as such. There is no sRGB
+    // format for grey, it is widened to RGBA.
+    bool srgb = false;
+    // Multiply the colours by alpha on a worker before uploading, in
+    // linear light if they are sRGB.
+    bool premultiply = false;
+    // Block compress on a worker before uploading, mips included. Costs
+    // decode time, saves three quarters to seven eighths of the memory.
+    // RGBA8 if the driver doesn't take the format.
+    std::optional<BlockFormat> compress;
+    BlockQuality quality = BlockQuality::normal;
+    // Filter the mips on a worker, to upload with the full size level,
+    // rather than with glGenerateMipmap on the GL thread. Compressed
+    // textures always are, box filtered unless this says otherwise.
+    std::optional<MipOptions> filterMips;
+    std::string label;  // for GL debug output
+  };
+
+  namespace details {
+    enum class texture_state : uint8_t {
+      probing,   // a worker is reading the header
+      probed,    // waiting for a staging buffer
+      decoding,  // a worker is decoding into the mapped buffer
+      decoded,   // waiting for its turn to upload
+      ready,
+      failed,
+    };
+
+    struct texture_job {
+      std::span<const uint8_t> encoded;
+      std::optional<ktx::Texture> baked;  // nothing to decode
+      TextureOptions options;
+      TextureSize size;
+      size_t bytes       = 0;  // to upload, every level
+      size_t cost        = 0;  // against the frame budget
+      gl::GLuint pbo     = 0;
+      uint8_t* mapped    = nullptr;
+      std::vector<uint8_t> memory;  // decoded before there was a context
+      gl::GLuint texture = 0;
+      std::string error;
+      std::atomic<texture_state> state {texture_state::probing};
+    };
+
+    inline gl::GLenum internalFormat(ktx::format f) {
+      switch (f) {
+        case ktx::format::rgba8:
+          return gl::GL_RGBA8;
+        case ktx::format::srgb8_alpha8:
+          return gl::GL_SRGB8_ALPHA8;
+        case ktx::format::bc1:
+          return gl::GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case ktx::format::bc1_srgb:
+          return gl::GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+        case ktx::format::bc3:
+          return gl::GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case ktx::format::bc3_srgb:
+          return gl::GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case ktx::format::bc7:
+          return gl::GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case ktx::format::bc7_srgb:
+          return gl::GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+      }
+      return gl::GL_RGBA8;
+    }
+
+    // The block formats the driver takes. S3TC and its sRGB variants are
+    // extensions even on recent drivers, BPTC is core from 4.2.
+    struct block_support {
+      bool s3tc      = false;
+      bool s3tc_srgb = false;
+      bool bptc      = false;
+
+      // GL thread, with a context
+      static block_support query() {
+        using namespace gl;
+        block_support s;
+        GLint major = 0, minor = 0, count = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        s.bptc = major > 4 || (major == 4 && minor >= 2);
+        for (GLint i = 0; i < count; i++) {
+          auto ext = reinterpret_cast<const char*>(
+            glGetStringi(GL_EXTENSIONS, GLuint(i)));
+          std::string_view name = ext ? ext : "";
+          s.s3tc |= name == "GL_EXT_texture_compression_s3tc";
+          s.s3tc_srgb |= name == "GL_EXT_texture_sRGB" ||
+            name == "GL_EXT_texture_compression_s3tc_srgb";
+          s.bptc |= name == "GL_ARB_texture_compression_bptc";
+        }
+        return s;
+      }
+
+      // The extension the format needs and the driver lacks, if any.
+      const char* missing(ktx::format f) const {
+        constexpr const char* s3tc_ext = "GL_EXT_texture_compression_s3tc";
+        switch (f) {
+          case ktx::format::bc1:
+          case ktx::format::bc3:
+            return s3tc ? nullptr : s3tc_ext;
+          case ktx::format::bc1_srgb:
+          case ktx::format::bc3_srgb:
+            if (!s3tc)
+              return s3tc_ext;
+            return s3tc_srgb ? nullptr : "GL_EXT_texture_sRGB";
+          case ktx::format::bc7:
+          case ktx::format::bc7_srgb:
+            return bptc ? nullptr : "GL_ARB_texture_compression_bptc";
+          default:
+            return nullptr;
+        }
+      }
+    };
+
+    inline ktx::format blockFormat(BlockFormat f, bool srgb) {
+      switch (f) {
+        case BlockFormat::bc1:
+          return srgb ? ktx::format::bc1_srgb : ktx::format::bc1;
+        case BlockFormat::bc3:
+          return srgb ? ktx::format::bc3_srgb : ktx::format::bc3;
+        case BlockFormat::bc7:
+          return srgb ? ktx::format::bc7_srgb : ktx::format::bc7;
+      }
+      return ktx::format::bc7;
+    }
+
+    // Formats for 8-bit channels; grey is swizzled back to grey when it
+    // is sampled.
+    inline gl::GLenum pixelFormat(int channels) {
+      switch (channels) {
+        case 1:
+          return gl::GL_RED;
+        case 2:
+          return gl::GL_RG;
+        case 3:
+          return gl::GL_RGB;
+      }
+      return gl::GL_RGBA;
+    }
+
+    inline gl::GLenum internalFormat(int channels, bool srgb) {
+      switch (channels) {
+        case 1:
+          return gl::GL_R8;
+        case 2:
+          return gl::GL_RG8;
+        case 3:
+          return srgb ? gl::GL_SRGB8 : gl::GL_RGB8;
+      }
+      return srgb ? gl::GL_SRGB8_ALPHA8 : gl::GL_RGBA8;
+    }
+
+    // The widest GL_UNPACK_ALIGNMENT rows of this many bytes meet, so
+    // tightly packed rows are read as they are.
+    inline int unpackAlignment(size_t row) {
+      return row % 8 == 0 ? 8 : row % 4 == 0 ? 4 : row % 2 == 0 ? 2 : 1;
+    }
+
+    // Levels the loader uploads itself, and their bytes in the staging
+    // buffer, back to back.
+    inline int levelCount(const TextureOptions& o, TextureSize size) {
+      bool cpu = o.compress || o.filterMips;
+      return cpu && o.mipmaps ? mipLevels(size.width, size.height) : 1;
+    }
+
+    // Channels as uploaded: the CPU mip filter and block compressor work
+    // on RGBA, and so does sRGB grey.
+    inline int uploadChannels(const TextureOptions& o, TextureSize size) {
+      bool rgba = o.compress || o.filterMips || (o.srgb && size.channels < 3);
+      return rgba ? 4 : size.channels;
+    }
+
+    // Whether a worker has more to do than decode into the staging buffer.
+    inline bool converts(const TextureOptions& o, TextureSize size) {
+      return uploadChannels(o, size) != size.channels ||
+        levelCount(o, size) > 1 || (o.premultiply && size.channels % 2 == 0);
+    }
+
+    // What an upload counts against the frame budget. glGenerateMipmap
+    // runs on the GL thread too: it reads about 4/3 of the base level to
+    // write the third below it, so that is charged on top of the bytes.
+    inline size_t uploadCost(size_t bytes, bool gpu_mips) {
+      return gpu_mips ? bytes / 3 * 8 : bytes;
+    }
+
+    inline size_t stagingBytes(const TextureOptions& o, TextureSize size) {
+      if (!o.compress) {
+        size_t rgba =
+          mipChainBytes(size.width, size.height, levelCount(o, size));
+        return rgba / 4 * size_t(uploadChannels(o, size));
+      }
+      size_t bytes = 0;
+      for (int i = 0; i < levelCount(o, size); i++) {
+        bytes += compressedBytes(
+          *o.compress, mipSize(size.width, i), mipSize(size.height, i));
+      }
+      return bytes;
+    }
+
+    // The job's bytes and cost, from its options and probed size.
+    inline void measure(texture_job& job) {
+      const TextureOptions& o = job.options;
+      job.bytes               = stagingBytes(o, job.size);
+      job.cost                = uploadCost(
+        job.bytes, o.mipmaps && levelCount(o, job.size) == 1);
+    }
+  }  // namespace details
+
+  // A texture that may still be loading. Until it is ready, id() is the
+  // loader's placeholder, so it can be bound and drawn with right away.
+  class TextureHandle {
+  public:
+    TextureHandle() = default;
+
+    bool ready() const { return state() == details::texture_state::ready; }
+    bool failed() const { return state() == details::texture_state::failed; }
+    // Why it failed, empty otherwise.
+    const std::string& error() const {
+      static const std::string none;
+      return failed() ? m_job->error : none;
+    }
+
+    gl::GLuint id() const {
+      if (ready())
+        return m_job->texture;
+      return m_placeholder ? *m_placeholder : 0;
+    }
+    // 0 until the header was read.
+    int width() const { return probed() ? m_job->size.width : 0; }
+    int height() const { return probed() ? m_job->size.height : 0; }
+
+  private:
+    friend class TextureLoader;
+
+    TextureHandle(
+      std::shared_ptr<details::texture_job> job,
+      std::shared_ptr<const gl::GLuint> placeholder) :
+      m_job(std::move(job)), m_placeholder(std::move(placeholder)) {}
+
+    details::texture_state state() const {
+      return m_job ? m_job->state.load(std::memory_order_acquire)
+                   : details::texture_state::failed;
+    }
+    bool probed() const {
+      auto s = state();
+      return s != details::texture_state::probing &&
+        s != details::texture_state::failed;
+    }
+
+    std::shared_ptr<details::texture_job> m_job;
+    // made by the loader once it has a context
+    std::shared_ptr<const gl::GLuint> m_placeholder;
+  };
+
+  // Loads textures without hitching the frame.
+  //
+  // A worker reads each image's header, then update() maps a pixel unpack
+  // buffer of the right size and a worker decodes the image straight into
+  // it, so the pixels are never copied and the GL thread never touches
+  // them. Decoded buffers are uploaded by update() in load order. Each
+  // call maps and uploads at most frameBudget bytes each, a texture bigger
+  // than the budget goes through on its own. One whose mips are generated
+  // on the GL thread counts as 8/3 of its bytes. Buffers in flight are
+  // capped at stagingLimit bytes, the rest wait for one. Baked textures
+  // skip all of that and queue for upload right away. Textures with their
+  // mips filtered or compressed on the CPU are decoded to worker memory
+  // instead, and go to the staging buffer level by level from there.
+  //
+  // Loading can start before the context exists, to overlap with its
+  // creation: until useContext(), update() or finish() is first called,
+  // images are decoded to worker memory as soon as they are probed,
+  // without a staging limit, and uploaded from there. Ones to compress
+  // wait, the driver might not take the blocks.
+  //
+  // Block formats are checked against the driver's extensions: compress
+  // falls back to RGBA8 without them, a baked texture in such a format
+  // fails.
+  //
+  // load() and update() are GL thread only, or the thread that is going
+  // to make the context; call update() once a frame.
+  class TextureLoader {
+  public:
+    explicit TextureLoader(
+      TextureDecoder decoder, size_t frame_budget = size_t(4) << 20,
+      size_t staging_limit = size_t(32) << 20) :
+      m_decoder(std::move(decoder)),
+      m_frameBudget(frame_budget),
+      m_stagingLimit(staging_limit) {}
+    // not copyable or movable, jobs on the pool point back at us
+    TextureLoader(const TextureLoader&)            = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+    // GL objects must be released with release() while the context is
+    // still alive, we don't know if it is by now.
+    ~TextureLoader() { m_pool.waitIdle(); }
+
+    // Starts loading an encoded image, which has to stay alive until the
+    // texture is ready or failed.
+    TextureHandle load(
+      std::span<const uint8_t> encoded, TextureOptions options = {}) {
+      auto job     = std::make_shared<details::texture_job>();
+      job->encoded = encoded;
+      job->options = std::move(options);
+      m_pending++;
+      m_queued.push_back(job);
+      submitProbes();
+      return TextureHandle(job, m_placeholder);
+    }
+
+    // Starts loading a KTX2 texture baked by oglc-texbake. It is uploaded
+    // from the blob as it is, mips included, which has to stay alive
+    // until the texture is ready. Throws if the blob can't be used.
+    TextureHandle loadBaked(
+      std::span<const uint8_t> blob, TextureOptions options = {}) {
+      auto job = std::make_shared<details::texture_job>();
+      job->baked.emplace(blob);
+      job->size    = {job->baked->width(), job->baked->height()};
+      job->options = std::move(options);
+      for (auto& l : job->baked->levels())
+        job->bytes += l.data.size();
+      job->cost = details::uploadCost(
+        job->bytes,
+        job->options.mipmaps && job->baked->levels().size() == 1 &&
+          !ktx::isCompressed(job->baked->pixelFormat()));
+      job->state.store(state::decoded, std::memory_order_release);
+      m_pending++;
+      m_uploads.push_back(job);
+      return TextureHandle(job, m_placeholder);
+    }
+
+    // GL thread, once the context is current: from here on images are
+    // decoded into staging buffers, and handles have a placeholder.
+    void useContext() {
+      if (*m_placeholder == 0) {
+        initPlaceholder();
+        m_blocks = details::block_support::query();
+      }
+      m_context.store(true, std::memory_order_release);
+    }
+
+    // GL thread, once a frame: uploads what is ready to go within the
+    // budget, then stages what was probed since.
+    void update() { pump(m_frameBudget); }
+
+    // Blocks until every texture loaded so far is ready or failed,
+    // ignoring the budget. For startup and fixed-length runs.
+    void finish() {
+      OGLC_ZONE("finish textures");
+      while (m_pending > 0) {
+        pump(SIZE_MAX);
+        if (m_pending > 0)
+          m_pool.waitIdle();
+      }
+    }
+
+    // Textures not ready or failed yet.
+    size_t pending() const { return m_pending; }
+    uint64_t uploadedBytes() const { return m_uploaded; }
+
+    // Finishes what is in flight, then deletes the placeholder, every
+    // texture this made and the staging buffers. Call before the context
+    // goes away.
+    void release() {
+      finish();
+      for (auto name : m_textures)
+        gl::glDeleteTextures(1, &name);
+      m_textures.clear();
+      if (!m_pbos.empty())
+        gl::glDeleteBuffers(gl::GLsizei(m_pbos.size()), m_pbos.data());
+      m_pbos.clear();
+      if (*m_placeholder != 0)
+        gl::glDeleteTextures(1, m_placeholder.get());
+      *m_placeholder = 0;
+    }
+
+  private:
+    using job_ptr = std::shared_ptr<details::texture_job>;
+    using state   = details::texture_state;
+
+    // worker
+    void probe(const job_ptr& job) {
+      OGLC_ZONE("probe texture");
+      try {
+        job->size = m_decoder.probe(job->encoded);
+        if (job->size.width <= 0 || job->size.height <= 0)
+          throw std::runtime_error("image has no pixels");
+        details::measure(*job);
+      }
+      catch (const std::exception& e) {
+        job->error = e.what();
+        finished(job, state::failed);
+        m_unstaged--;
+        return;
+      }
+      // nothing to map a buffer with yet; whether the driver takes the
+      // blocks isn't known before then either
+      bool early = !m_context.load(std::memory_order_acquire);
+      if (early && !job->options.compress) {
+        m_unstaged--;
+        job->memory.resize(job->bytes);
+        job->state.store(state::decoding, std::memory_order_release);
+        decode(job, job->memory);
+        return;
+      }
+      job->state.store(state::probed, std::memory_order_release);
+      std::lock_guard lock(m_mutex);
+      m_probed.push_back(job);
+    }
+
+    // worker; a failure is handed over too, the buffer has to be unmapped
+    // on the GL thread
+    void decode(const job_ptr& job, std::span<uint8_t> out) {
+      OGLC_ZONE("decode texture");
+      try {
+        if (details::converts(job->options, job->size))
+          convert(*job, out);
+        else
+          m_decoder.decode(job->encoded, out);
+      }
+      catch (const std::exception& e) {
+        job->error = e.what();
+      }
+      std::lock_guard lock(m_mutex);
+      m_decoded.push_back(job);
+    }
+
+    // worker; premultiplied, widened to RGBA and the mips filtered in
+    // worker memory, reading back from a mapped buffer can be very slow.
+    // Filtering and compressing spread over the pool too, whichever
+    // workers aren't busy with other textures.
+    void convert(details::texture_job& job, std::span<uint8_t> out) {
+      thread_local std::vector<uint8_t> decoded, chain;
+      const TextureOptions& o = job.options;
+      const TextureSize& size = job.size;
+      int levels              = details::levelCount(o, size);
+      int w = size.width, h = size.height;
+      int channels = details::uploadChannels(o, size);
+      chain.resize(mipChainBytes(w, h, levels) / 4 * size_t(channels));
+      std::span<uint8_t> base(chain.data(), size.bytes());
+      if (channels != size.channels) {
+        decoded.resize(size.bytes());
+        base = decoded;
+      }
+      m_decoder.decode(job.encoded, base);
+      if (o.premultiply)
+        premultiplyAlpha(base, size.channels, o.srgb);
+      if (channels != size.channels)
+        expandToRgba(base, size.channels, {chain.data(), size_t(w) * h * 4});
+      if (levels > 1) {
+        MipOptions filter = o.filterMips.value_or(MipOptions {});
+        filter.srgb |= o.srgb;
+        filter.premultiplied |= o.premultiply;
+        generateMips(chain, w, h, levels, filter, &m_pool);
+      }
+      if (!o.compress) {
+        std::memcpy(out.data(), chain.data(), chain.size());
+        return;
+      }
+
+      const uint8_t* src = chain.data();
+      uint8_t* dst       = out.data();
+      for (int i = 0; i < levels; i++) {
+        int lw = mipSize(w, i), lh = mipSize(h, i);
+        size_t bytes = compressedBytes(*o.compress, lw, lh);
+        compressImage(
+          {src, size_t(lw) * lh * 4}, lw, lh, *o.compress, o.quality,
+          {dst, bytes}, &m_pool);
+        src += size_t(lw) * lh * 4;
+        dst += bytes;
+      }
+    }
+
+    void finished(const job_ptr& job, state s) {
+      job->state.store(s, std::memory_order_release);
+      m_pending--;
+    }
+
+    // Only a few probes go to the pool at a time, so the decodes into
+    // staging buffers don't queue up behind thousands of them.
+    void submitProbes() {
+      size_t window = m_pool.size() * 2;
+      while (!m_queued.empty() && m_unstaged < window) {
+        m_unstaged++;
+        m_pool.submit([this, job = m_queued.front()] { probe(job); });
+        m_queued.pop_front();
+      }
+    }
+
+    void pump(size_t budget) {
+      OGLC_ZONE("texture loader");
+      useContext();
+      {
+        std::lock_guard lock(m_mutex);
+        for (auto& job : m_probed)
+          uncompressed(*job);
+        m_uploads.insert(m_uploads.end(), m_decoded.begin(), m_decoded.end());
+        m_staging.insert(m_staging.end(), m_probed.begin(), m_probed.end());
+        m_decoded.clear();
+        m_probed.clear();
+      }
+      submitProbes();
+
+      size_t spent = 0;
+      while (!m_uploads.empty()) {
+        size_t cost = m_uploads.front()->cost;
+        if (spent > 0 && spent + cost > budget)
+          break;
+        upload(m_uploads.front());
+        m_uploads.pop_front();
+        spent += cost;
+      }
+      // allocating and mapping costs about as much as the upload, so it
+      // gets the same budget
+      spent = 0;
+      while (!m_staging.empty()) {
+        size_t bytes = m_staging.front()->bytes;
+        if (spent > 0 && spent + bytes > budget)
+          break;
+        if (m_staged > 0 && m_staged + bytes > m_stagingLimit)
+          break;
+        stage(m_staging.front());
+        m_staging.pop_front();
+        spent += bytes;
+      }
+    }
+
+    // Block compression the driver can't take falls back to RGBA8, before
+    // the job is staged.
+    void uncompressed(details::texture_job& job) {
+      const TextureOptions& o = job.options;
+      if (
+        !o.compress ||
+        !m_blocks.missing(details::blockFormat(*o.compress, o.srgb)))
+        return;
+      job.options.compress.reset();
+      details::measure(job);
+    }
+
+    void stage(const job_ptr& job) {
+      using namespace gl;
+      size_t bytes = job->bytes;
+      m_unstaged--;
+      if (m_pbos.empty()) {
+        m_pbos.emplace_back();
+        glGenBuffers(1, &m_pbos.back());
+      }
+      job->pbo = m_pbos.back();
+      m_pbos.pop_back();
+
+      // a fresh store every time, so a buffer whose last upload is still
+      // in flight doesn't stall the map
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+      job->mapped = static_cast<uint8_t*>(glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      if (!job->mapped) {
+        m_pbos.push_back(job->pbo);
+        job->pbo   = 0;
+        job->error = "failed to map a staging buffer";
+        finished(job, state::failed);
+        return;
+      }
+      m_staged += bytes;
+      job->state.store(state::decoding, std::memory_order_release);
+      m_pool.submit([this, job] { decode(job, {job->mapped, job->bytes}); });
+    }
+
+    void upload(const job_ptr& job) {
+      using namespace gl;
+      OGLC_ZONE("upload texture");
+      const TextureSize& size = job->size;
+      const TextureOptions& o = job->options;
+      if (job->pbo != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      }
+      if (job->baked) {
+        if (const char* ext = m_blocks.missing(job->baked->pixelFormat()))
+          job->error = std::string("the driver lacks ") + ext;
+      }
+      if (!job->error.empty()) {
+        if (job->pbo != 0) {
+          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+          recycle(job);
+        }
+        job->memory = {};
+        finished(job, state::failed);
+        return;
+      }
+      // offsets into the bound staging buffer, or into worker memory
+      auto pixels = [&](size_t offset) -> const void* {
+        if (job->pbo != 0)
+          return reinterpret_cast<const void*>(offset);
+        return job->memory.data() + offset;
+      };
+
+      GLint bound = 0;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+      glGenTextures(1, &job->texture);
+      glBindTexture(GL_TEXTURE_2D, job->texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, o.wrap);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, o.wrap);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, o.minFilter);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, o.magFilter);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      size_t levels = 1;
+      // compressed textures can't have their mips generated
+      bool compressed = false;
+      std::optional<GpuZone> zone(std::in_place, "glTexImage2D");
+      if (job->baked) {
+        // straight from the blob, the driver takes its own copy
+        ktx::format f = job->baked->pixelFormat();
+        GLenum format = details::internalFormat(f);
+        compressed    = ktx::isCompressed(f);
+        levels        = job->baked->levels().size();
+        for (size_t i = 0; i < levels; i++) {
+          const ktx::level& l = job->baked->levels()[i];
+          if (compressed) {
+            glCompressedTexImage2D(
+              GL_TEXTURE_2D, GLint(i), format, l.width, l.height, 0,
+              GLsizei(l.data.size()), l.data.data());
+          }
+          else {
+            glTexImage2D(
+              GL_TEXTURE_2D, GLint(i), format, l.width, l.height, 0, GL_RGBA,
+              GL_UNSIGNED_BYTE, l.data.data());
+          }
+        }
+      }
+      else if (o.compress) {
+        // the levels sit back to back in the staging buffer
+        GLenum format = details::internalFormat(
+          details::blockFormat(*o.compress, o.srgb));
+        compressed    = true;
+        levels        = size_t(details::levelCount(o, size));
+        size_t offset = 0;
+        for (size_t i = 0; i < levels; i++) {
+          int w = mipSize(size.width, int(i)), h = mipSize(size.height, int(i));
+          size_t bytes = compressedBytes(*o.compress, w, h);
+          glCompressedTexImage2D(
+            GL_TEXTURE_2D, GLint(i), format, w, h, 0, GLsizei(bytes),
+            pixels(offset));
+          offset += bytes;
+        }
+      }
+      else {
+        int channels    = details::uploadChannels(o, size);
+        GLenum internal = details::internalFormat(channels, o.srgb);
+        GLenum format   = details::pixelFormat(channels);
+        levels          = size_t(details::levelCount(o, size));
+        size_t offset   = 0;
+        for (size_t i = 0; i < levels; i++) {
+          int w = mipSize(size.width, int(i)), h = mipSize(size.height, int(i));
+          size_t row = size_t(w) * size_t(channels);
+          glPixelStorei(GL_UNPACK_ALIGNMENT, details::unpackAlignment(row));
+          glTexImage2D(
+            GL_TEXTURE_2D, GLint(i), internal, w, h, 0, format,
+            GL_UNSIGNED_BYTE, pixels(offset));
+          offset += row * size_t(h);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (channels < 3) {
+          // grey, with its alpha in green
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+          glTexParameteri(
+            GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A,
+            channels == 2 ? GL_GREEN : GL_ONE);
+        }
+      }
+      // a partial chain is still complete once capped, a single level
+      // gets the rest generated
+      zone.reset();
+      if (o.mipmaps && levels == 1 && !compressed) {
+        OGLC_GPU_ZONE("glGenerateMipmap");
+        glGenerateMipmap(GL_TEXTURE_2D);
+      }
+      else
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levels - 1));
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glBindTexture(GL_TEXTURE_2D, GLuint(bound));
+      if (!o.label.empty())
+        labelObject(GL_TEXTURE, job->texture, o.label);
+
+      if (job->pbo != 0)
+        recycle(job);
+      job->memory = {};
+      m_uploaded += job->bytes;
+      m_textures.push_back(job->texture);
+      finished(job, state::ready);
+    }
+
+    // the job's staging buffer, once unmapped
+    void recycle(const job_ptr& job) {
+      m_pbos.push_back(job->pbo);
+      job->pbo    = 0;
+      job->mapped = nullptr;
+      m_staged -= job->bytes;
+    }
+
+    // magenta and black, hard to mistake for the real thing
+    void initPlaceholder() {
+      using namespace gl;
+      const uint8_t checker[] = {
+        255, 0, 255, 255, 0,   0, 0,   255,  //
+        0,   0, 0,   255, 255, 0, 255, 255,
+      };
+      GLint bound = 0;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+      glGenTextures(1, m_placeholder.get());
+      glBindTexture(GL_TEXTURE_2D, *m_placeholder);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glTexImage2D(
+        GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+        checker);
+      glBindTexture(GL_TEXTURE_2D, GLuint(bound));
+      labelObject(GL_TEXTURE, *m_placeholder, "texture placeholder");
+    }
+
+    TextureDecoder m_decoder;
+    size_t m_frameBudget;
+    size_t m_stagingLimit;
+
+    // GL thread only
+    std::deque<job_ptr> m_queued;   // not given to the pool yet
+    std::deque<job_ptr> m_staging;  // probed, waiting for a buffer
+    std::deque<job_ptr> m_uploads;  // decoded, waiting for the budget
+    std::vector<gl::GLuint> m_pbos;  // free staging buffers
+    std::vector<gl::GLuint> m_textures;
+    std::shared_ptr<gl::GLuint> m_placeholder =
+      std::make_shared<gl::GLuint>(0);
+    details::block_support m_blocks;
+    size_t m_staged     = 0;
+    uint64_t m_uploaded = 0;
+
+    // handed over by the workers
+    std::mutex m_mutex;
+    std::vector<job_ptr> m_probed;
+    std::vector<job_ptr> m_decoded;
+    std::atomic<size_t> m_pending {0};
+    std::atomic<size_t> m_unstaged {0};  // given to the pool, not staged
+    std::atomic<bool> m_context {false};
+
+    // last, so it is joined before anything its jobs touch goes away
+    WorkerPool m_pool;
+  };
+}  // namespace oglc
+#endif
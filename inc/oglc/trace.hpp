@@ -0,0 +1,148 @@
+#ifndef OGLC_TRACE_HPP_INCLUDED
+#define OGLC_TRACE_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Token pasting helper for macros that declare scoped guards.
+#define OGLC_CONCAT_IMPL(a, b) a##b
+#define OGLC_CONCAT(a, b) OGLC_CONCAT_IMPL(a, b)
+
+namespace oglc {
+  // Writes str as a JSON string, quoted, escaping what JSON requires:
+  // quotes, backslashes and control characters. Names, paths and driver
+  // strings can hold any of them.
+  inline void writeJsonString(std::ostream& out, std::string_view str) {
+    out << '"';
+    for (char c : str) {
+      switch (c) {
+        case '"':
+          out << "\\\"";
+          break;
+        case '\\':
+          out << "\\\\";
+          break;
+        case '\n':
+          out << "\\n";
+          break;
+        case '\r':
+          out << "\\r";
+          break;
+        case '\t':
+          out << "\\t";
+          break;
+        default:
+          if (uint8_t(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", unsigned(c));
+            out << code;
+          }
+          else {
+            out << c;
+          }
+      }
+    }
+    out << '"';
+  }
+
+  // Collects events from the profilers and writes them out in Chrome's
+  // trace_event JSON format (load in chrome://tracing or Perfetto).
+  // Timestamps are steady_clock nanoseconds, so CPU and GPU events line up.
+  class TraceWriter {
+  public:
+    // Timeline IDs. CPU threads use their own small IDs, the GPU gets a
+    // fixed one well out of the way.
+    static constexpr uint32_t gpu_track = 1000;
+
+    struct event {
+      std::string name;
+      uint64_t ts;
+      uint64_t dur;
+      uint32_t tid;
+      char ph;  // 'X' complete, 'i' instant, 'C' counter
+      double value;
+    };
+
+    void complete(
+      std::string_view name, uint32_t tid, uint64_t ts, uint64_t dur) {
+      m_events.push_back({std::string(name), ts, dur, tid, 'X', 0.0});
+    }
+    void instant(std::string_view name, uint32_t tid, uint64_t ts) {
+      m_events.push_back({std::string(name), ts, 0, tid, 'i', 0.0});
+    }
+    void counter(
+      std::string_view name, uint32_t tid, uint64_t ts, double value) {
+      m_events.push_back({std::string(name), ts, 0, tid, 'C', value});
+    }
+    void threadName(uint32_t tid, std::string_view name) {
+      m_threads[tid] = std::string(name);
+    }
+
+    size_t size() const { return m_events.size(); }
+
+    void write(std::ostream& out) const {
+      // Chrome wants microseconds; shift everything to start at zero
+      uint64_t base = UINT64_MAX;
+      for (auto& e : m_events)
+        base = std::min(base, e.ts);
+      if (base == UINT64_MAX)
+        base = 0;
+
+      out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+      bool first = true;
+      auto sep   = [&] {
+        if (!first)
+          out << ",\n";
+        first = false;
+      };
+      for (auto& [tid, name] : m_threads) {
+        sep();
+        out << R"({"ph":"M","pid":1,"tid":)" << tid
+            << R"(,"name":"thread_name","args":{"name":)";
+        writeJsonString(out, name);
+        out << "}}";
+      }
+      out << std::fixed << std::setprecision(3);
+      for (auto& e : m_events) {
+        sep();
+        out << R"({"ph":")" << e.ph << R"(","pid":1,"tid":)" << e.tid
+            << R"(,"ts":)" << (e.ts - base) / 1000.0 << R"(,"name":)";
+        writeJsonString(out, e.name);
+        switch (e.ph) {
+          case 'X':
+            out << R"(,"dur":)" << e.dur / 1000.0;
+            break;
+          case 'i':
+            out << R"(,"s":"t")";
+            break;
+          case 'C':
+            out << R"(,"args":{"value":)" << e.value << "}";
+            break;
+        }
+        out << "}";
+      }
+      out << "\n]}\n";
+    }
+
+    void writeFile(const std::string& path) const {
+      std::ofstream out(path);
+      if (!out)
+        throw std::runtime_error("Failed to open trace file " + path);
+      write(out);
+    }
+
+  private:
+    std::vector<event> m_events;
+    std::map<uint32_t, std::string> m_threads;
+  };
+}  // namespace oglc
+#endif
@@ -0,0 +1,268 @@
+#ifndef OGLC_WORKERS_HPP_INCLUDED
+#define OGLC_WORKERS_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace oglc {
+  // Fixed-size pool of worker threads. Nothing in here touches GL,
+  // so jobs must never call into the context.
+  class WorkerPool {
+  public:
+    using job_type = std::function<void()>;
+
+    // hardware_concurrency() may be 0 when it can't tell
+    explicit WorkerPool(
+      size_t threads = std::max(2u, std::thread::hardware_concurrency()) - 1) {
+      m_threads.reserve(threads);
+      for (size_t i = 0; i < threads; i++) {
+        m_threads.emplace_back([this] { workerMain(); });
+      }
+    }
+    // not copyable or movable, the threads hold a pointer to us
+    WorkerPool(const WorkerPool&)            = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+      {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all();
+      for (auto& t : m_threads)
+        t.join();
+    }
+
+    size_t size() const { return m_threads.size(); }
+
+    // Queues a job to run at some point on any worker.
+    void submit(job_type job) {
+      {
+        std::lock_guard lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+      }
+      m_cv.notify_one();
+    }
+
+    // Runs fn(i) for i in [0, n) across the pool and the calling thread,
+    // returning once every index is done. Safe to call from one of our
+    // own jobs: the caller works through the indices itself and only
+    // waits for helpers that got a worker, those still queued drop out.
+    // If fn throws, on any thread, no index is started after that and
+    // the first exception is rethrown here once fn is no longer running.
+    template <class F>
+    void parallelFor(size_t n, F&& fn) {
+      if (n == 0)
+        return;
+      if (n == 1 || m_threads.empty()) {
+        for (size_t i = 0; i < n; i++)
+          fn(i);
+        return;
+      }
+
+      // outlives the call for helpers that start after it returned
+      struct shared_state {
+        std::atomic<size_t> next {0};
+        size_t running = 0;
+        bool closed    = false;
+        std::exception_ptr error;  // the first fn threw
+        std::mutex mutex;
+        std::condition_variable cv;
+      };
+      auto state = std::make_shared<shared_state>();
+      auto drain = [state, n, &fn] {
+        try {
+          for (size_t i; (i = state->next.fetch_add(1)) < n;)
+            fn(i);
+        }
+        catch (...) {
+          // the rest are skipped, everywhere
+          state->next = n;
+          std::lock_guard lock(state->mutex);
+          if (!state->error)
+            state->error = std::current_exception();
+        }
+      };
+
+      size_t helpers = std::min(n - 1, m_threads.size());
+      for (size_t i = 0; i < helpers; i++) {
+        submit([state, drain] {
+          {
+            std::lock_guard lock(state->mutex);
+            if (state->closed)
+              return;
+            state->running++;
+          }
+          drain();
+          std::lock_guard lock(state->mutex);
+          state->running--;
+          state->cv.notify_all();
+        });
+      }
+      drain();
+
+      // every index has been taken, the helpers still running have the
+      // last of them
+      std::unique_lock lock(state->mutex);
+      state->closed = true;
+      state->cv.wait(lock, [&] { return state->running == 0; });
+      if (state->error)
+        std::rethrow_exception(state->error);
+    }
+
+    // Blocks until the queue is empty and no job is running.
+    void waitIdle() {
+      std::unique_lock lock(m_mutex);
+      m_idleCv.wait(lock, [this] { return m_jobs.empty() && m_busy == 0; });
+    }
+
+  private:
+    void workerMain() {
+      while (true) {
+        job_type job;
+        {
+          std::unique_lock lock(m_mutex);
+          m_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+          if (m_stop && m_jobs.empty())
+            return;
+          job = std::move(m_jobs.front());
+          m_jobs.pop_front();
+          m_busy++;
+        }
+        job();
+        {
+          std::lock_guard lock(m_mutex);
+          m_busy--;
+          if (m_jobs.empty() && m_busy == 0)
+            m_idleCv.notify_all();
+        }
+      }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::deque<job_type> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idleCv;
+    size_t m_busy = 0;
+    bool m_stop   = false;
+  };
+
+  // A fixed team of threads for a parallel loop run every frame. Unlike
+  // WorkerPool::parallelFor, run() allocates nothing: the threads are
+  // started once and woken for each call, and reach fn through a
+  // pointer. One run() at a time, and not from inside fn.
+  class WorkerTeam {
+  public:
+    explicit WorkerTeam(
+      size_t threads = std::max(2u, std::thread::hardware_concurrency()) - 1) {
+      m_threads.reserve(threads);
+      for (size_t i = 0; i < threads; i++)
+        m_threads.emplace_back([this] { memberMain(); });
+    }
+    // not copyable or movable, the threads hold a pointer to us
+    WorkerTeam(const WorkerTeam&)            = delete;
+    WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+    ~WorkerTeam() {
+      {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+      }
+      m_wake.notify_all();
+      for (auto& t : m_threads)
+        t.join();
+    }
+
+    size_t size() const { return m_threads.size(); }
+
+    // Runs fn(i) for i in [0, n) across the team and the calling thread,
+    // returning once every index is done. If fn throws, no index is
+    // started after that and the first exception is rethrown here.
+    template <class F>
+    void run(size_t n, F&& fn) {
+      if (n == 0)
+        return;
+      if (n == 1 || m_threads.empty()) {
+        for (size_t i = 0; i < n; i++)
+          fn(i);
+        return;
+      }
+      using fn_type = std::remove_reference_t<F>;
+      {
+        std::lock_guard lock(m_mutex);
+        m_fn      = const_cast<void*>(static_cast<const void*>(&fn));
+        m_call    = [](void* f, size_t i) { (*static_cast<fn_type*>(f))(i); };
+        m_n       = n;
+        m_next    = 0;
+        m_running = m_threads.size();
+        m_round++;
+      }
+      m_wake.notify_all();
+      work();
+
+      // every member has to have seen this round before the next one
+      std::unique_lock lock(m_mutex);
+      m_done.wait(lock, [this] { return m_running == 0; });
+      if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+
+  private:
+    void work() {
+      try {
+        for (size_t i; (i = m_next.fetch_add(1)) < m_n;)
+          m_call(m_fn, i);
+      }
+      catch (...) {
+        m_next = m_n;
+        std::lock_guard lock(m_mutex);
+        if (!m_error)
+          m_error = std::current_exception();
+      }
+    }
+
+    void memberMain() {
+      uint64_t seen = 0;
+      while (true) {
+        {
+          std::unique_lock lock(m_mutex);
+          m_wake.wait(lock, [&] { return m_stop || m_round != seen; });
+          if (m_stop)
+            return;
+          seen = m_round;
+        }
+        work();
+        std::lock_guard lock(m_mutex);
+        if (--m_running == 0)
+          m_done.notify_one();
+      }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    // this round's loop, set under m_mutex before m_round moves on
+    void* m_fn                    = nullptr;
+    void (*m_call)(void*, size_t) = nullptr;
+    size_t m_n                    = 0;
+    std::atomic<size_t> m_next {0};
+    size_t m_running = 0;
+    uint64_t m_round = 0;
+    std::exception_ptr m_error;  // the first fn threw
+    bool m_stop = false;
+  };
+}  // namespace oglc
+#endif
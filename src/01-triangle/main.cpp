@@ -1,10 +1,11 @@
 #include <glbinding/gl/enum.h>
 #include <glbinding/gl/functions.h>
 #include <numbers>
+#include "oglc/app.hpp"
 #include "oglc/handles.hpp"
+#include "oglc/profiler.hpp"
 #define GLFW_INCLUDE_NONE
 #include <glbinding/gl/gl.h>
-#include <glbinding/glbinding.h>
 #include <GLFW/glfw3.h>
 
 #include <cmrc/cmrc.hpp>
@@ -13,6 +14,7 @@ CMRC_DECLARE(rc);
 #include <iostream>
 #include <array>
 #include <cmath>
+#include <cstdlib>
 
 float vertices[] = {
   -0.5f, -0.5f, 0.0f,
@@ -28,14 +30,13 @@ gl::GLuint indices[] = {
 gl::GLuint vbo, vao, ebo;
 oglc::ShaderProgram shader;
 
-void setup(GLFWwindow* win) {
+void setup(oglc::Context& ctx) {
   using namespace gl;
-  glfwMakeContextCurrent(win);
+  OGLC_STARTUP_PHASE("setup");
   
   // Setup viewport and resize handler
-  glViewport(0, 0, 800, 600);
-  glfwSetFramebufferSizeCallback(win, [](GLFWwindow* win, int width, int height) {
-    glfwMakeContextCurrent(win);
+  glViewport(0, 0, ctx.width(), ctx.height());
+  ctx.onResize([](int width, int height) {
     glViewport(0, 0, width, height);
   });
   
@@ -68,12 +69,18 @@ void setup(GLFWwindow* win) {
   // Setup EBO data
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  
+  // names for GL debug output
+  shader.label("triangle");
+  oglc::labelObject(GL_BUFFER, vbo, "quad vertices");
+  oglc::labelObject(GL_BUFFER, ebo, "quad indices");
+  oglc::labelObject(GL_VERTEX_ARRAY, vao, "quad");
 }
 
-void render(GLFWwindow* win) {
+void render() {
   using namespace gl;
+  OGLC_ZONE("render");
   
-  glfwMakeContextCurrent(win);
   glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT);
   
@@ -86,40 +93,25 @@ void render(GLFWwindow* win) {
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 }
 
-void input(GLFWwindow* win) {
-  if (glfwGetKey(win, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-    glfwSetWindowShouldClose(win, true);
+void input(oglc::Context& ctx) {
+  if (ctx.window() && glfwGetKey(ctx.window(), GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    ctx.requestClose();
   }
 }
 
-int main() {
-  glfwInit();
-  // Setup an OpenGL 3.3 Core context
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  // Create GLFW window
-  GLFWwindow* win = glfwCreateWindow(800, 600, "OpenGL Testing", nullptr, nullptr);
-  if (win == nullptr) {
-    glfwTerminate();
-    std::cerr << "GLFW failed to create window\n";
-    return 1;
-  }
-  glbinding::initialize(glfwGetProcAddress, false);
+int main(int argc, char** argv) {
+  OGLC_THREAD_NAME("main");
+  auto opts = oglc::AppOptions::fromArgs(argc, argv);
+  oglc::Context ctx(opts, "OpenGL Testing");
   
-  setup(win);
+  setup(ctx);
   
   // event loop
-  while (!glfwWindowShouldClose(win)) {
-    input(win);
-    render(win);
-    
-    // swap buffers and poll
-    glfwSwapBuffers(win);
-    glfwPollEvents();
-  }
+  oglc::runLoop(ctx, opts, [&] {
+    input(ctx);
+    render();
+  });
   
   shader.~ShaderProgram();
-  glfwTerminate();
   return 0;
 }
\ No newline at end of file
@@ -1,17 +1,33 @@
 #include <glbinding/gl/enum.h>
 #include <glbinding/gl/functions.h>
+#include "oglc/app.hpp"
+#include "oglc/bench.hpp"
+#include "oglc/context.hpp"
 #include "oglc/handles.hpp"
+#include "oglc/linalg.hpp"
+#include "oglc/pacing.hpp"
+#include "oglc/recorder.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/snapshot.hpp"
+#include "oglc/startup.hpp"
 #define GLFW_INCLUDE_NONE
 #include <glbinding/gl/gl.h>
-#include <glbinding/glbinding.h>
 #include <GLFW/glfw3.h>
 
 #include <cmrc/cmrc.hpp>
 CMRC_DECLARE(rc);
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <optional>
 #include <iostream>
+#include <numbers>
+#include <thread>
 
 /*************************
 FLASHING LIGHT WARNING
@@ -34,16 +50,41 @@ gl::GLuint indices[] = {
 gl::GLuint vbo, vao, ebo;
 oglc::ShaderProgram shader;
 
-void setup(GLFWwindow* win) {
+// Events are handled on the main thread, simulation runs on its own thread
+// and the render thread owns the context. They only talk through these.
+struct input_state {
+  uint64_t sampled = 0;  // when the main thread last pumped events
+};
+// What the simulation produces every tick.
+struct sim_state {
+  float osc         = 0.5f;
+  oglc::vec3 offset = {};
+  oglc::quat spin   = oglc::quat::identity();
+};
+// The two latest ticks, so the renderer can interpolate between them.
+struct frame_state {
+  uint64_t sampled   = 0;  // input timestamp this frame was built from
+  uint64_t simulated = 0;
+  double time        = 0.0;  // of current, previous is a tick earlier
+  sim_state previous;
+  sim_state current;
+};
+oglc::TripleBuffer<input_state> inputs;
+oglc::TripleBuffer<frame_state> frames;
+std::atomic<bool> running {true};
+
+// simulation tick rate, independent from the display
+constexpr double sim_rate = 240.0;
+// ticks run back to back to catch up after a stall; beyond that the
+// backlog is dropped, so a spike can't snowball into a longer one
+constexpr uint64_t max_catch_up = 8;
+
+void setup(oglc::Context& ctx) {
   using namespace gl;
-  glfwMakeContextCurrent(win);
+  OGLC_STARTUP_PHASE("setup");
   
-  // Setup viewport and resize handler
-  glViewport(0, 0, 800, 600);
-  glfwSetFramebufferSizeCallback(win, [](GLFWwindow* win, int width, int height) {
-    glfwMakeContextCurrent(win);
-    glViewport(0, 0, width, height);
-  });
+  // Setup viewport, the render thread follows ctx's size from here on
+  glViewport(0, 0, ctx.width(), ctx.height());
   
   // Grab shaders from resource files
   // ================================
@@ -75,62 +116,208 @@ void setup(GLFWwindow* win) {
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
   
+  // names for GL debug output
+  shader.label("uniforms");
+  oglc::labelObject(GL_BUFFER, vbo, "quad vertices");
+  oglc::labelObject(GL_BUFFER, ebo, "quad indices");
+  oglc::labelObject(GL_VERTEX_ARRAY, vao, "quad");
+}
+
+sim_state simulateAt(double t) {
+  constexpr float pi = std::numbers::pi_v<float>;
+  float phase        = float(std::fmod(t, 2.0)) * pi;
+  sim_state state;
+  state.osc    = (std::sin(phase) / 2) + 0.5f;
+  state.offset = {0.0f, std::sin(phase) * 0.1f, 0.0f};
+  state.spin   = oglc::quat::fromAxisAngle({0.0f, 0.0f, 1.0f}, phase);
+  return state;
+}
+
+// Fixed timestep: ticks are counted, not timed, so the cost is the same
+// at any frame rate and a late wakeup runs the ticks it missed.
+void simulate(const oglc::Context& ctx) {
+  OGLC_THREAD_NAME("simulation");
+  using clock = std::chrono::steady_clock;
+  auto period = std::chrono::duration_cast<clock::duration>(
+    std::chrono::duration<double>(1.0 / sim_rate));
+  auto next   = clock::now();
+
+  uint64_t tick      = uint64_t(ctx.time() * sim_rate);
+  sim_state previous = simulateAt(tick / sim_rate);
+  sim_state current  = previous;
+  while (running) {
+    {
+      OGLC_ZONE("simulate");
+      inputs.update();
+      const input_state& in = inputs.front();
+
+      uint64_t due = uint64_t(ctx.time() * sim_rate);
+      if (due > tick + max_catch_up) {
+        // don't interpolate across the dropped time either
+        tick     = due;
+        current  = simulateAt(tick / sim_rate);
+        previous = current;
+      }
+      for (; tick < due; tick++) {
+        previous = current;
+        current  = simulateAt((tick + 1) / sim_rate);
+      }
+
+      frame_state& out = frames.back();
+      out.sampled      = in.sampled;
+      out.simulated    = oglc::monotonicNanos();
+      out.time         = tick / sim_rate;
+      out.previous     = previous;
+      out.current      = current;
+      frames.publish();
+    }
+
+    next += period;
+    std::this_thread::sleep_until(next);
+  }
 }
 
-void render(GLFWwindow* win) {
+void render(const frame_state& frame, double time) {
   using namespace gl;
-  
-  glfwMakeContextCurrent(win);
+  OGLC_ZONE("render");
+
+  // a tick behind the clock, between the two latest ticks
+  float alpha = float(std::clamp((time - frame.time) * sim_rate, 0.0, 1.0));
+  const sim_state &a = frame.previous, &b = frame.current;
+  float osc          = std::lerp(a.osc, b.osc, alpha);
+  oglc::mat4 model =
+    oglc::translation(oglc::lerp(a.offset, b.offset, alpha)) *
+    oglc::rotation(oglc::slerp(a.spin, b.spin, alpha));
+
   glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT);
   
   // do our actual rendering
   shader.use();
-  {
-    double t = glfwGetTime();
-    float osc = (sin(std::numbers::pi * t) / 2) + 0.5f;
-    glUniform4f(2, 0.0f, osc, 0.0f, 1.0f);
-  }
+  glUniform4f(2, 0.0f, osc, 0.0f, 1.0f);
+  glUniformMatrix4fv(4, 1, GL_FALSE, &model[0][0]);
   glBindVertexArray(vao);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 }
 
-void input(GLFWwindow* win) {
-  if (glfwGetKey(win, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-    glfwSetWindowShouldClose(win, true);
+void renderMain(oglc::Context& ctx, const oglc::AppOptions& opts) {
+  OGLC_THREAD_NAME("render");
+  ctx.makeCurrent();
+
+  oglc::FramePacer pacer(opts, ctx);
+  oglc::Bench bench(opts, ctx);
+  if (bench.active())
+    ctx.swapInterval(0);
+  oglc::Recording recording(opts, ctx);
+
+  oglc::LatencyStats input_latency, sim_latency;
+  std::optional<oglc::StartupPhase> first_frame;
+  first_frame.emplace("first frame");
+  int vp_width = ctx.width(), vp_height = ctx.height();
+  for (uint64_t n = 1; running; n++) {
+    if (ctx.width() != vp_width || ctx.height() != vp_height) {
+      vp_width  = ctx.width();
+      vp_height = ctx.height();
+      gl::glViewport(0, 0, vp_width, vp_height);
+    }
+    // with --jit this picks the simulation state as late as it can
+    pacer.beginFrame();
+    frames.update();
+    // a fixed clock is for reproducible runs, so draw the tick it is due
+    // rather than whichever the simulation thread got to
+    if (opts.fixedDt > 0) {
+      uint64_t due = uint64_t(ctx.time() * sim_rate);
+      // the frame's time is a whole tick, rounding undoes the division
+      auto tick = [&] {
+        return uint64_t(std::llround(frames.front().time * sim_rate));
+      };
+      while (running && tick() < due) {
+        std::this_thread::yield();
+        frames.update();
+      }
+    }
+    const frame_state& frame = frames.front();
+    render(frame, ctx.time());
+    recording.capture(ctx);
+    bool last = n == opts.frames;
+    if (last && !opts.capturePath.empty())
+      oglc::readFramebuffer(vp_width, vp_height).writePpm(opts.capturePath);
+    pacer.beforeSwap();
+    {
+      OGLC_ZONE("swap");
+      ctx.swap();
+    }
+    if (first_frame) {
+      first_frame.reset();
+      oglc::StartupTimeline::instance().firstFrame();
+      if (opts.startupReport)
+        oglc::StartupTimeline::instance().print();
+    }
+    if (oglc::DebugLog::enabled())
+      oglc::DebugLog::instance().endFrame();
+    if (oglc::GlTracer::active())
+      oglc::GlTracer::instance().endFrame();
+    OGLC_FRAME_MARK();
+
+    // how stale the presented frame was by the time swap returned
+    uint64_t now = oglc::monotonicNanos();
+    if (frame.sampled != 0) {
+      input_latency.record(now - frame.sampled);
+      sim_latency.record(now - frame.simulated);
+    }
+    // after the latency samples, a capped frame rate sleeps here
+    pacer.endFrame();
+    if (last || (bench.active() && !bench.frameDone())) {
+      ctx.requestClose();
+      break;
+    }
   }
+
+  recording.finish();
+  if (oglc::DebugLog::enabled())
+    oglc::DebugLog::instance().printSummary();
+  oglc::GlTracer::instance().stop();
+  if (bench.active())
+    bench.report();
+  input_latency.print("input to present");
+  sim_latency.print("simulation to present");
+  ctx.releaseCurrent();
 }
 
-int main() {
-  glfwInit();
-  // Setup an OpenGL 3.3 Core context
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_FLOATING, GLFW_TRUE);
-  // Create GLFW window
-  GLFWwindow* win = glfwCreateWindow(800, 600, "OpenGL Testing", nullptr, nullptr);
-  if (win == nullptr) {
-    glfwTerminate();
-    std::cerr << "GLFW failed to create window\n";
-    return 1;
+void input(oglc::Context& ctx) {
+  if (ctx.window() && glfwGetKey(ctx.window(), GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    ctx.requestClose();
   }
-  glbinding::initialize(glfwGetProcAddress, false);
+  inputs.back().sampled = oglc::monotonicNanos();
+  inputs.publish();
+}
+
+int main(int argc, char** argv) {
+  OGLC_THREAD_NAME("main");
+  auto opts     = oglc::AppOptions::fromArgs(argc, argv);
+  opts.floating = true;
+  oglc::Context ctx(opts, "OpenGL Testing");
   
-  setup(win);
+  setup(ctx);
+  // hand the context over to the render thread
+  ctx.releaseCurrent();
+  std::thread sim_thread(simulate, std::cref(ctx));
+  std::thread render_thread(renderMain, std::ref(ctx), std::cref(opts));
   
-  // event loop
-  while (!glfwWindowShouldClose(win)) {
-    input(win);
-    render(win);
-    
-    // swap buffers and poll
-    glfwSwapBuffers(win);
-    glfwPollEvents();
+  // event loop: GLFW needs this on the main thread, and it must never
+  // wait on the swap
+  while (!ctx.shouldClose()) {
+    ctx.waitEvents(1.0 / sim_rate);
+    input(ctx);
   }
   
+  running = false;
+  sim_thread.join();
+  render_thread.join();
+  
+  oglc::writeTraceFromEnv();
+  ctx.makeCurrent();
   shader.~ShaderProgram();
-  glfwTerminate();
   return 0;
-}
\ No newline at end of file
+}
@@ -1,6 +1,9 @@
 #version 330 core
+#extension GL_ARB_explicit_uniform_location : require
 layout (location = 0) in vec3 pos;
 
+layout(location = 4) uniform mat4 model;
+
 void main() {
-  gl_Position = vec4(pos.x, pos.y, pos.z, 1.0);
-}
\ No newline at end of file
+  gl_Position = model * vec4(pos.x, pos.y, pos.z, 1.0);
+}
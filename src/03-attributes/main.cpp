@@ -1,18 +1,22 @@
 #include <glbinding/gl/enum.h>
 #include <glbinding/gl/functions.h>
 #include <numbers>
+#include "oglc/app.hpp"
+#include "oglc/cmdbuf.hpp"
 #include "oglc/handles.hpp"
+#include "oglc/profiler.hpp"
 #include "oglc/linalg.hpp"
+#include "oglc/workers.hpp"
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glbinding/gl/gl.h>
-#include <glbinding/glbinding.h>
 
 #include <cmrc/cmrc.hpp>
 CMRC_DECLARE(rc);
 
 #include <array>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 
 struct vtx {
@@ -31,17 +35,17 @@ gl::GLuint indices[] = {0, 1, 2, 2, 3, 0};
 gl::GLuint vbo, vao, ebo;
 oglc::ShaderProgram shader;
 
-void setup(GLFWwindow* win) {
+// draw lists are built on the pool, one buffer per slot
+oglc::WorkerPool pool;
+oglc::CommandQueue queue(2);
+
+void setup(oglc::Context& ctx) {
   using namespace gl;
-  glfwMakeContextCurrent(win);
+  OGLC_STARTUP_PHASE("setup");
 
   // Setup viewport and resize handler
-  glViewport(0, 0, 800, 600);
-  glfwSetFramebufferSizeCallback(
-    win, [](GLFWwindow* win, int width, int height) {
-      glfwMakeContextCurrent(win);
-      glViewport(0, 0, width, height);
-    });
+  glViewport(0, 0, ctx.width(), ctx.height());
+  ctx.onResize([](int width, int height) { glViewport(0, 0, width, height); });
 
   // Grab shaders from resource files
   // ================================
@@ -77,59 +81,61 @@ void setup(GLFWwindow* win) {
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glBufferData(
     GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  // names for GL debug output
+  shader.label("attributes");
+  oglc::labelObject(GL_BUFFER, vbo, "quad vertices");
+  oglc::labelObject(GL_BUFFER, ebo, "quad indices");
+  oglc::labelObject(GL_VERTEX_ARRAY, vao, "quad");
 }
 
-void render(GLFWwindow* win) {
+// Runs on a worker thread, so no GL calls in here.
+void record(oglc::CommandBuffer& cmd, size_t slot) {
   using namespace gl;
 
-  glfwMakeContextCurrent(win);
-  glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  switch (slot) {
+    case 0: {
+      cmd.clearColor(0.2f, 0.3f, 0.3f, 1.0f);
+      cmd.clear(GL_COLOR_BUFFER_BIT);
+    } break;
+    case 1: {
+      // Load drawing buffers
+      cmd.useProgram(shader.handle());
+      cmd.bindVertexArray(vao);
+      cmd.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+      // draw our elements
+      cmd.drawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT);
+    } break;
+  }
+}
 
-  // Load drawing buffers
-  shader.use();
-  glBindVertexArray(vao);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+void render() {
+  OGLC_ZONE("render");
 
-  // draw our elements
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+  pool.parallelFor(queue.slots(), [](size_t i) { record(queue[i], i); });
+  queue.submit();
 }
 
-void input(GLFWwindow* win) {
-  if (glfwGetKey(win, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-    glfwSetWindowShouldClose(win, true);
+void input(oglc::Context& ctx) {
+  if (ctx.window() && glfwGetKey(ctx.window(), GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    ctx.requestClose();
   }
 }
 
-int main() {
-  glfwInit();
-  // Setup an OpenGL 3.3 Core context
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  // Create GLFW window
-  GLFWwindow* win =
-    glfwCreateWindow(800, 600, "OpenGL Testing", nullptr, nullptr);
-  if (win == nullptr) {
-    glfwTerminate();
-    std::cerr << "GLFW failed to create window\n";
-    return 1;
-  }
-  glbinding::initialize(glfwGetProcAddress, false);
+int main(int argc, char** argv) {
+  OGLC_THREAD_NAME("main");
+  auto opts = oglc::AppOptions::fromArgs(argc, argv);
+  oglc::Context ctx(opts, "OpenGL Testing");
 
-  setup(win);
+  setup(ctx);
 
   // event loop
-  while (!glfwWindowShouldClose(win)) {
-    input(win);
-    render(win);
-
-    // swap buffers and poll
-    glfwSwapBuffers(win);
-    glfwPollEvents();
-  }
+  oglc::runLoop(ctx, opts, [&] {
+    input(ctx);
+    render();
+  });
 
   shader.~ShaderProgram();
-  glfwTerminate();
   return 0;
 }
\ No newline at end of file
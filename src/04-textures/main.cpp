@@ -3,20 +3,31 @@
 #include <exception>
 #include <numbers>
 #include <stdexcept>
+#include "oglc/app.hpp"
+#include "oglc/decode.hpp"
+#include "oglc/gpuprof.hpp"
 #include "oglc/handles.hpp"
 #include "oglc/linalg.hpp"
+#include "oglc/png.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/qoi.hpp"
+#include "oglc/startup.hpp"
+#include "oglc/texloader.hpp"
 #include "stb_image.h"
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glbinding/gl/gl.h>
-#include <glbinding/glbinding.h>
 
 #include <cmrc/cmrc.hpp>
 CMRC_DECLARE(rc);
 
 #include <array>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
 
 struct vtx {
   oglc::vec3 pos;
@@ -45,53 +56,120 @@ vtx vertices[] = {
 };
 gl::GLuint indices[] = {0, 1, 2, 2, 3, 0};
 
-gl::GLuint vbo, vao, ebo, tex;
+gl::GLuint vbo, vao, ebo;
+oglc::TextureHandle skin;
 oglc::ShaderProgram shader;
+oglc::GpuProfiler gpu_profiler;
+
+// Startup work that doesn't need the context, so --overlap-startup can
+// run it while the context is being created.
+struct shader_sources {
+  std::string vertex;
+  std::string fragment;
+};
+
+shader_sources loadShaderSources() {
+  auto fs       = cmrc::rc::get_filesystem();
+  auto vertex   = fs.open("/vertex.glsl");
+  auto fragment = fs.open("/fragment.glsl");
+  return {
+    {vertex.begin(), vertex.end()},
+    {fragment.begin(), fragment.end()},
+  };
+}
+
+std::span<const uint8_t> bytes(const cmrc::file& file) {
+  return {reinterpret_cast<const uint8_t*>(file.begin()), file.size()};
+}
+
+// Both run on the texture loader's workers. Images keep the channels
+// they have, the loader picks a format to match: QOI is RGB or RGBA, as
+// its header says. A PNG's colour key counts as alpha.
+int imageChannels(std::span<const uint8_t> encoded) {
+  if (int channels = oglc::png::channelsOf(encoded); channels > 0)
+    return channels;
+  int width = 0, height = 0, channels = 0;
+  if (!stbi_info_from_memory(
+        encoded.data(), int(encoded.size()), &width, &height, &channels)) {
+    throw std::runtime_error("STB failed to read image header");
+  }
+  return channels;
+}
+
+oglc::TextureSize probeImage(std::span<const uint8_t> encoded) {
+  if (oglc::qoi::isQoi(encoded)) {
+    oglc::qoi::Header header = oglc::qoi::readHeader(encoded);
+    return {header.width, header.height, header.channels};
+  }
+  oglc::TextureSize size;
+  if (!stbi_info_from_memory(
+        encoded.data(), int(encoded.size()), &size.width, &size.height,
+        &size.channels)) {
+    throw std::runtime_error("STB failed to read image header");
+  }
+  if (int channels = oglc::png::channelsOf(encoded); channels > 0)
+    size.channels = channels;
+  return size;
+}
 
-void setup(GLFWwindow* win) {
+// Into the loader's staging buffer, which is only ever written. QOI and
+// plain 8-bit PNGs go through oglc's decoders, straight into it; the
+// rest are decoded by stb in scratch memory and copied in once.
+void decodeImage(std::span<const uint8_t> encoded, std::span<uint8_t> dst) {
+  if (oglc::qoi::isQoi(encoded)) {
+    int channels = oglc::qoi::readHeader(encoded).channels;
+    oglc::qoi::decode(encoded, dst, channels);
+    return;
+  }
+  int wanted = imageChannels(encoded);
+  if (oglc::png::decode(encoded, dst, wanted))
+    return;
+  int width = 0, height = 0, channels = 0;
+  bool ok = oglc::decodeInto(dst, [&] {
+    return stbi_load_from_memory(
+      encoded.data(), int(encoded.size()), &width, &height, &channels,
+      wanted);
+  });
+  if (!ok || size_t(width) * size_t(height) * size_t(wanted) != dst.size()) {
+    throw std::runtime_error("STB failed to load image");
+  }
+}
+
+// Uploaded in the background, drawn with a placeholder until then. With
+// --overlap-startup this runs before the context exists, so the workers
+// probe and decode while it is being made.
+void loadTextures(oglc::TextureLoader& loader) {
+  OGLC_STARTUP_PHASE("start texture loads");
+  auto fs = cmrc::rc::get_filesystem();
+  oglc::TextureOptions options;
+  options.minFilter = gl::GL_NEAREST;
+  options.magFilter = gl::GL_NEAREST;
+  options.label     = "mc_skin";
+  // baked at build time, to KTX2 or QOI, unless OGLC_BAKE_TEXTURES is off
+  // and it has to be decoded from PNG
+  if (fs.exists("/mc_skin.ktx2"))
+    skin = loader.loadBaked(bytes(fs.open("/mc_skin.ktx2")), options);
+  else if (fs.exists("/mc_skin.qoi"))
+    skin = loader.load(bytes(fs.open("/mc_skin.qoi")), options);
+  else
+    skin = loader.load(bytes(fs.open("/mc_skin.png")), options);
+}
+
+void setup(oglc::Context& ctx, const shader_sources& sources) {
   using namespace gl;
-  glfwMakeContextCurrent(win);
+  OGLC_STARTUP_PHASE("setup");
 
   // Setup viewport and resize handler
-  glViewport(0, 0, 800, 600);
-  glfwSetFramebufferSizeCallback(
-    win, [](GLFWwindow* win, int width, int height) {
-      glfwMakeContextCurrent(win);
-      glViewport(0, 0, width, height);
-    });
+  glViewport(0, 0, ctx.width(), ctx.height());
+  ctx.onResize([](int width, int height) { glViewport(0, 0, width, height); });
 
   // Import resources
   // ================================
   {
-    auto fs = cmrc::rc::get_filesystem();
-    shader  = oglc::ShaderProgram {
-      oglc::Shader::fromResource(GL_VERTEX_SHADER, fs.open("/vertex.glsl")),
-      oglc::Shader::fromResource(GL_FRAGMENT_SHADER, fs.open("/fragment.glsl")),
+    shader = oglc::ShaderProgram {
+      oglc::Shader::fromString(GL_VERTEX_SHADER, sources.vertex),
+      oglc::Shader::fromString(GL_FRAGMENT_SHADER, sources.fragment),
     };
-
-    // load a texture from STB
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    {
-      auto texture = fs.open("/mc_skin.png");
-      int w, h, nc;
-      stbi_uc* data = stbi_load_from_memory(
-        reinterpret_cast<const stbi_uc*>(texture.begin()), texture.size(), &w,
-        &h, &nc, 0);
-      if (!data) {
-        throw std::runtime_error("STB failed to load image");
-      }
-      glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_2D);
-      
-      stbi_image_free(data);
-    }
   }
 
   shader.use();
@@ -115,60 +193,88 @@ void setup(GLFWwindow* win) {
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glBufferData(
     GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  // names for GL debug output
+  shader.label("textures");
+  oglc::labelObject(GL_BUFFER, vbo, "quad vertices");
+  oglc::labelObject(GL_BUFFER, ebo, "quad indices");
+  oglc::labelObject(GL_VERTEX_ARRAY, vao, "quad");
 }
 
-void render(GLFWwindow* win) {
+void render() {
   using namespace gl;
 
-  glfwMakeContextCurrent(win);
-  glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  gpu_profiler.beginFrame();
+  OGLC_ZONE("render");
+  OGLC_GPU_ZONE("render");
+  {
+    OGLC_GPU_ZONE("glClear");
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
 
   // Load drawing buffers
   shader.use();
-  glBindTexture(GL_TEXTURE_2D, tex);
+  glBindTexture(GL_TEXTURE_2D, skin.id());
   glBindVertexArray(vao);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
   // draw our elements
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+  {
+    OGLC_GPU_ZONE("glDrawElements");
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+  }
 }
 
-void input(GLFWwindow* win) {
-  if (glfwGetKey(win, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-    glfwSetWindowShouldClose(win, true);
+void input(oglc::Context& ctx) {
+  if (ctx.window() && glfwGetKey(ctx.window(), GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    ctx.requestClose();
   }
 }
 
-int main() {
-  glfwInit();
-  // Setup an OpenGL 3.3 Core context
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  // Create GLFW window
-  GLFWwindow* win =
-    glfwCreateWindow(800, 600, "OpenGL Testing", nullptr, nullptr);
-  if (win == nullptr) {
-    glfwTerminate();
-    std::cerr << "GLFW failed to create window\n";
-    return 1;
-  }
-  glbinding::initialize(glfwGetProcAddress, false);
+int main(int argc, char** argv) {
+  OGLC_THREAD_NAME("main");
+  auto opts = oglc::AppOptions::fromArgs(argc, argv);
+  // with --overlap-startup these run while the context is being made
+  auto sources = oglc::startupTask(
+    opts.overlapStartup, "shader sources", loadShaderSources);
+  oglc::TextureLoader loader({probeImage, decodeImage});
+  if (opts.overlapStartup)
+    loadTextures(loader);
+  oglc::Context ctx(opts, "OpenGL Testing");
+  loader.useContext();
+  if (!opts.overlapStartup)
+    loadTextures(loader);
 
-  setup(win);
+  // setup's GPU work counts as the first frame
+  gpu_profiler.activate();
+  gpu_profiler.beginFrame();
+  shader_sources loaded_sources;
+  {
+    OGLC_STARTUP_PHASE("wait for assets");
+    loaded_sources = sources.get();
+  }
+  setup(ctx, loaded_sources);
+  // a fixed-length run (captures, golden tests) can't depend on how fast
+  // the workers were
+  if (opts.frames > 0)
+    loader.finish();
 
   // event loop
-  while (!glfwWindowShouldClose(win)) {
-    input(win);
-    render(win);
-
-    // swap buffers and poll
-    glfwSwapBuffers(win);
-    glfwPollEvents();
-  }
+  oglc::runLoop(ctx, opts, [&] {
+    loader.update();
+    if (skin.failed())
+      throw std::runtime_error(skin.error());
+    // keep --on-demand drawing until the textures are in
+    if (loader.pending() > 0)
+      ctx.requestRedraw();
+    input(ctx);
+    render();
+  });
 
+  gpu_profiler.print();
+  gpu_profiler.release();
+  loader.release();
   shader.~ShaderProgram();
-  glfwTerminate();
   return 0;
 }
\ No newline at end of file
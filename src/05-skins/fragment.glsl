@@ -0,0 +1,15 @@
+#version 330 core
+
+// Passed from vertex shader, the layer in z.
+in vec3 frag_tcs;
+// Output color for this fragment.
+out vec4 color;
+
+uniform sampler2DArray skins;
+
+void main() {
+  vec3 bg = vec3(0.2f, 0.3f, 0.3f);
+  vec4 sm = texture(skins, frag_tcs);
+
+  color = vec4(mix(bg, sm.xyz, sm.a), 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include "oglc/app.hpp"
+#include "oglc/handles.hpp"
+#include "oglc/linalg.hpp"
+#include "oglc/profiler.hpp"
+#include "oglc/texarray.hpp"
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <glbinding/gl/gl.h>
+
+#include <cmrc/cmrc.hpp>
+CMRC_DECLARE(rc);
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+struct vtx {
+  oglc::vec2 pos;
+  oglc::vec2 tcs;
+};
+
+// what changes from one quad of the crowd to the next
+struct instance {
+  oglc::vec2 offset;
+  int32_t layer;
+};
+
+vtx vertices[] = {
+  {{-0.1f, -0.2f}, {0.0f, 0.0f}},
+  {{0.1f, -0.2f},  {1.0f, 0.0f}},
+  {{0.1f, 0.2f},   {1.0f, 1.0f}},
+  {{-0.1f, 0.2f},  {0.0f, 1.0f}}
+};
+gl::GLuint indices[] = {0, 1, 2, 2, 3, 0};
+
+// An 8 by 4 crowd wearing 12 skins at a time, out of 40, in an array of
+// 16 layers. The 12 move on as time passes, so skins come and go and the
+// least recently worn get evicted.
+constexpr int columns      = 8;
+constexpr int rows         = 4;
+constexpr int worn         = 12;
+constexpr int skin_count   = 40;
+constexpr int skin_size    = 32;
+constexpr double skin_rate = 20.0;  // new skins a second
+
+gl::GLuint vbo, vao, ebo, instances;
+oglc::ShaderProgram shader;
+std::optional<oglc::TextureArrayPool> skins;
+std::array<instance, columns * rows> crowd;
+
+// Made up rather than loaded: a colour of its own, stripes, eyes, a dark
+// border and transparent corners.
+std::vector<uint8_t> skinPixels(int key) {
+  std::vector<uint8_t> rgba(size_t(skin_size) * skin_size * 4);
+  const uint8_t base[3] = {
+    uint8_t(60 + (key * 97) % 180), uint8_t(60 + (key * 57) % 180),
+    uint8_t(60 + (key * 29) % 180)};
+  for (int y = 0; y < skin_size; y++) {
+    for (int x = 0; x < skin_size; x++) {
+      uint8_t* px = &rgba[(size_t(y) * skin_size + x) * 4];
+      int edge    = std::min(
+        std::min(x, skin_size - 1 - x), std::min(y, skin_size - 1 - y));
+      bool corner =
+        (x < 3 || x >= skin_size - 3) && (y < 3 || y >= skin_size - 3);
+      bool eye =
+        y >= 18 && y < 22 && ((x >= 8 && x < 12) || (x >= 20 && x < 24));
+      bool stripe = ((x + y + key) / 4) % 2 == 0;
+      for (int c = 0; c < 3; c++) {
+        if (eye)
+          px[c] = 255;
+        else if (edge == 0)
+          px[c] = base[c] / 3;
+        else
+          px[c] = stripe ? base[c] : uint8_t(base[c] * 4 / 5);
+      }
+      px[3] = corner ? 0 : 255;
+    }
+  }
+  return rgba;
+}
+
+void setup(oglc::Context& ctx) {
+  using namespace gl;
+  OGLC_STARTUP_PHASE("setup");
+
+  // Setup viewport and resize handler
+  glViewport(0, 0, ctx.width(), ctx.height());
+  ctx.onResize([](int width, int height) { glViewport(0, 0, width, height); });
+
+  // Grab shaders from resource files
+  // ================================
+  {
+    auto fs = cmrc::rc::get_filesystem();
+    shader  = oglc::ShaderProgram {
+      oglc::Shader::fromResource(GL_VERTEX_SHADER, fs.open("/vertex.glsl")),
+      oglc::Shader::fromResource(GL_FRAGMENT_SHADER, fs.open("/fragment.glsl")),
+    };
+  }
+
+  oglc::TextureArrayOptions options;
+  options.width  = skin_size;
+  options.height = skin_size;
+  options.layers = 16;
+  options.label  = "skins";
+  skins.emplace(options);
+
+  for (int i = 0; i < columns * rows; i++) {
+    int column = i % columns, row = i / columns;
+    crowd[size_t(i)].offset = {
+      -1.0f + (float(column) + 0.5f) * 2.0f / columns,
+      -1.0f + (float(row) + 0.5f) * 2.0f / rows};
+  }
+
+  shader.use();
+  // Construct VBO/VAO/EBO, and a buffer of per-instance attributes
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ebo);
+  glGenBuffers(1, &instances);
+  glGenVertexArrays(1, &vao);
+
+  // Bind VAO
+  glBindVertexArray(vao);
+
+  // Setup VBO data
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  // Define vertex layout
+  glVertexAttribPointer(
+    0, 2, GL_FLOAT, GL_FALSE, sizeof(vtx), (void*) offsetof(vtx, pos));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(
+    1, 2, GL_FLOAT, GL_FALSE, sizeof(vtx), (void*) offsetof(vtx, tcs));
+  glEnableVertexAttribArray(1);
+
+  // One of these per quad rather than per vertex; the layer stays an
+  // integer all the way to the shader
+  glBindBuffer(GL_ARRAY_BUFFER, instances);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(crowd), nullptr, GL_STREAM_DRAW);
+  glVertexAttribPointer(
+    2, 2, GL_FLOAT, GL_FALSE, sizeof(instance),
+    (void*) offsetof(instance, offset));
+  glEnableVertexAttribArray(2);
+  glVertexAttribDivisor(2, 1);
+  glVertexAttribIPointer(
+    3, 1, GL_INT, sizeof(instance), (void*) offsetof(instance, layer));
+  glEnableVertexAttribArray(3);
+  glVertexAttribDivisor(3, 1);
+
+  // Setup EBO data
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glBufferData(
+    GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  // names for GL debug output
+  shader.label("skins");
+  oglc::labelObject(GL_BUFFER, vbo, "quad vertices");
+  oglc::labelObject(GL_BUFFER, ebo, "quad indices");
+  oglc::labelObject(GL_BUFFER, instances, "crowd");
+  oglc::labelObject(GL_VERTEX_ARRAY, vao, "quad");
+}
+
+// Gives every quad the layer of the skin it wears this frame, uploading
+// the skins that aren't in the array.
+void dress(double time) {
+  OGLC_ZONE("dress");
+  skins->beginFrame();
+  int shift = int(time * skin_rate);
+  for (int i = 0; i < columns * rows; i++) {
+    int key                  = (i % worn + shift) % skin_count;
+    std::optional<int> layer = skins->find(key);
+    if (!layer)
+      layer = skins->insert(key, skinPixels(key));
+    if (!layer)
+      throw std::runtime_error("more skins worn than there are layers");
+    crowd[size_t(i)].layer = *layer;
+  }
+  skins->flush();
+}
+
+void render(double time) {
+  using namespace gl;
+  OGLC_ZONE("render");
+
+  dress(time);
+  glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  // the whole crowd in one draw
+  shader.use();
+  glBindTexture(GL_TEXTURE_2D_ARRAY, skins->texture());
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, instances);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(crowd), nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(crowd), crowd.data());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glDrawElementsInstanced(
+    GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, GLsizei(crowd.size()));
+}
+
+void input(oglc::Context& ctx) {
+  if (ctx.window() && glfwGetKey(ctx.window(), GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    ctx.requestClose();
+  }
+}
+
+int main(int argc, char** argv) {
+  OGLC_THREAD_NAME("main");
+  auto opts = oglc::AppOptions::fromArgs(argc, argv);
+  oglc::Context ctx(opts, "OpenGL Testing");
+
+  setup(ctx);
+
+  // event loop
+  oglc::runLoop(ctx, opts, [&] {
+    input(ctx);
+    render(ctx.time());
+  });
+
+  skins->release();
+  shader.~ShaderProgram();
+  return 0;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec2 tcs;
+// Per instance: where the quad goes and which skin it wears.
+layout (location = 2) in vec2 offset;
+layout (location = 3) in int layer;
+
+out vec3 frag_tcs;
+
+void main() {
+  gl_Position = vec4(pos + offset, 0.0, 1.0);
+  frag_tcs = vec3(tcs, float(layer));
+}
\ No newline at end of file
@@ -0,0 +1,1150 @@
+// Checks of oglc's own headers, run by ctest. Each runs headless where it
+// needs GL and fails with the first thing that went wrong.
+//
+//   oglc-checks NAME
+//     loader: TextureLoader's placeholder, frame budget and failures.
+//     bcn: the block compressor's output, decoded by the spec and by GL.
+//     mipmap: the CPU mip filters at odd sizes, in sRGB and with alpha.
+//     pixels: premultiplying alpha, in sRGB too.
+//     atlas: RectPacker's placements and reuse, TextureAtlas's limits.
+//     gpuprof: GpuProfiler zones, one left open across beginFrame().
+//     texarray: TextureArrayPool's eviction order and batched uploads.
+//     trace: strings in trace and report JSON are escaped.
+//     workers: WorkerPool::parallelFor when fn throws, WorkerTeam.
+//     recorder: VideoRecorder's output, with no allocations per frame.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "oglc/atlas.hpp"
+#include "oglc/bcn.hpp"
+#include "oglc/context.hpp"
+#include "oglc/gpuprof.hpp"
+#include "oglc/mipmap.hpp"
+#include "oglc/pixels.hpp"
+#include "oglc/recorder.hpp"
+#include "oglc/texarray.hpp"
+#include "oglc/trace.hpp"
+#include "oglc/texloader.hpp"
+#include "oglc/workers.hpp"
+
+#include <glbinding/CallbackMask.h>
+#include <glbinding/FunctionCall.h>
+#include <glbinding/glbinding.h>
+
+// Heap allocations, counted while counting is on, on any thread.
+std::atomic<bool> counting_allocations {false};
+std::atomic<size_t> allocations {0};
+
+void* operator new(size_t size) {
+  if (counting_allocations)
+    allocations++;
+  if (void* p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+void expect(bool ok, const std::string& what) {
+  if (!ok)
+    throw std::runtime_error("check failed: " + what);
+}
+
+oglc::AppOptions headless() {
+  oglc::AppOptions opts;
+  opts.backend = oglc::Backend::headless;
+  opts.width   = 64;
+  opts.height  = 64;
+  return opts;
+}
+
+// loader
+// ================================
+
+// A made-up image format: width, height and channels in a byte each, then
+// the value every byte of the pixels has. Width 0 fails the probe, value
+// 0xff the decode.
+std::vector<uint8_t> fakeImage(int width, int height, uint8_t value) {
+  return {uint8_t(width), uint8_t(height), 4, value};
+}
+
+oglc::TextureDecoder fakeDecoder() {
+  return {
+    [](std::span<const uint8_t> encoded) {
+      if (encoded[0] == 0)
+        throw std::runtime_error("bad header");
+      return oglc::TextureSize {encoded[0], encoded[1], encoded[2]};
+    },
+    [](std::span<const uint8_t> encoded, std::span<uint8_t> dst) {
+      if (encoded[3] == 0xff)
+        throw std::runtime_error("bad pixels");
+      std::memset(dst.data(), encoded[3], dst.size());
+    },
+  };
+}
+
+// Calls update() until nothing is pending, returning the bytes each call
+// uploaded.
+std::vector<uint64_t> drain(oglc::TextureLoader& loader) {
+  std::vector<uint64_t> uploads;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+  while (loader.pending() > 0) {
+    expect(std::chrono::steady_clock::now() < deadline, "loads finish");
+    uint64_t before = loader.uploadedBytes();
+    loader.update();
+    if (loader.uploadedBytes() != before)
+      uploads.push_back(loader.uploadedBytes() - before);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  return uploads;
+}
+
+void checkLoader() {
+  using namespace gl;
+  constexpr size_t budget = 64 << 10;
+  oglc::TextureLoader loader(fakeDecoder(), budget);
+  oglc::TextureOptions flat;
+  flat.mipmaps   = false;
+  flat.minFilter = GL_NEAREST;
+
+  // before the context: decoded to worker memory, no placeholder yet
+  auto early = fakeImage(16, 16, 7);
+  auto first = loader.load(early, flat);
+  // one to compress waits for the context to say which blocks it takes
+  oglc::TextureOptions packed = flat;
+  packed.compress             = oglc::BlockFormat::bc7;
+  auto compressed             = loader.load(early, packed);
+  expect(first.id() == 0, "no placeholder before the context");
+  oglc::Context ctx(headless(), "checks");
+  loader.useContext();
+  // nothing is uploaded before update() or finish()
+  GLuint placeholder = first.id();
+  expect(glIsTexture(placeholder) == GL_TRUE, "placeholder exists");
+
+  // failures, in the probe and in the decode
+  auto bad_header = fakeImage(0, 16, 1), bad_pixels = fakeImage(16, 16, 0xff);
+  auto no_header = loader.load(bad_header, flat);
+  auto no_pixels = loader.load(bad_pixels, flat);
+  loader.finish();
+  expect(first.ready(), "early load is ready");
+  expect(compressed.ready(), "early compressed load is ready");
+  GLint is_compressed = 0;
+  glBindTexture(GL_TEXTURE_2D, compressed.id());
+  glGetTexLevelParameteriv(
+    GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &is_compressed);
+  expect(is_compressed != 0, "the driver takes BC7 here");
+  expect(no_header.failed() && no_header.error() == "bad header", "probe");
+  expect(no_pixels.failed() && no_pixels.error() == "bad pixels", "decode");
+  expect(no_pixels.id() == placeholder, "failed loads keep the placeholder");
+  expect(glGetError() == GL_NO_ERROR, "no GL errors after failures");
+
+  // the budget: 16 KiB textures go four to an update, one bigger than the
+  // budget on its own
+  std::vector<std::vector<uint8_t>> images;
+  std::vector<oglc::TextureHandle> handles;
+  for (int i = 0; i < 12; i++)
+    images.push_back(fakeImage(64, 64, uint8_t(i)));
+  images.push_back(fakeImage(255, 255, 200));
+  for (auto& image : images)
+    handles.push_back(loader.load(image, flat));
+  for (uint64_t bytes : drain(loader)) {
+    expect(
+      bytes <= budget || bytes == 255 * 255 * 4,
+      "an update uploads " + std::to_string(bytes) + " bytes");
+  }
+
+  // mips made on the GL thread count 8/3: one 16 KiB texture an update
+  images.clear();
+  handles.clear();
+  oglc::TextureOptions mipped = flat;
+  mipped.mipmaps              = true;
+  for (int i = 0; i < 6; i++)
+    images.push_back(fakeImage(64, 64, uint8_t(i)));
+  for (auto& image : images)
+    handles.push_back(loader.load(image, mipped));
+  for (uint64_t bytes : drain(loader))
+    expect(bytes == 64 * 64 * 4, "one mipped texture an update");
+
+  // and the pixels made it
+  std::vector<uint8_t> px(64 * 64 * 4);
+  glBindTexture(GL_TEXTURE_2D, handles[5].id());
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, px.data());
+  expect(px[0] == 5 && px.back() == 5, "uploaded pixels");
+  GLint max_level = 0;
+  glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+  expect(max_level > 0, "mips generated");
+  expect(glGetError() == GL_NO_ERROR, "no GL errors");
+
+  // mips filtered and blocks compressed by workers, each spreading its
+  // rows over the pool the others are decoding on
+  images.clear();
+  handles.clear();
+  oglc::TextureOptions cpu = mipped;
+  cpu.filterMips           = oglc::MipOptions {};
+  for (int i = 0; i < 8; i++) {
+    images.push_back(fakeImage(200, 120, uint8_t(i * 10)));
+    cpu.compress = i % 2 ? std::optional(oglc::BlockFormat::bc3) : std::nullopt;
+    handles.push_back(loader.load(images.back(), cpu));
+  }
+  loader.finish();
+  for (auto& handle : handles)
+    expect(handle.ready(), "CPU mipped texture is ready");
+  std::vector<uint8_t> level(100 * 60 * 4);
+  glBindTexture(GL_TEXTURE_2D, handles[6].id());
+  glGetTexImage(GL_TEXTURE_2D, 1, GL_RGBA, GL_UNSIGNED_BYTE, level.data());
+  expect(level[0] == 60 && level.back() == 60, "filtered mip");
+  expect(glGetError() == GL_NO_ERROR, "no GL errors with CPU mips");
+  loader.release();
+}
+
+// bcn
+// ================================
+
+// Reference decoders, written from the S3TC and BPTC specs rather than
+// the encoder, to RGBA texels in rows.
+void decode565(uint16_t c, uint8_t* out) {
+  int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+  out[0] = uint8_t(r << 3 | r >> 2);
+  out[1] = uint8_t(g << 2 | g >> 4);
+  out[2] = uint8_t(b << 3 | b >> 2);
+  out[3] = 255;
+}
+
+// BC3's colour block is always four colours
+void decodeBC1(const uint8_t* in, bool bc3, uint8_t* out) {
+  uint16_t c0 = uint16_t(in[0] | in[1] << 8), c1 = uint16_t(in[2] | in[3] << 8);
+  uint32_t bits = uint32_t(in[4] | in[5] << 8 | in[6] << 16) |
+    uint32_t(in[7]) << 24;
+  uint8_t pal[16];
+  decode565(c0, pal);
+  decode565(c1, pal + 4);
+  bool four = bc3 || c0 > c1;
+  for (int c = 0; c < 4; c++) {
+    if (four) {
+      pal[8 + c]  = uint8_t((2 * pal[c] + pal[4 + c]) / 3);
+      pal[12 + c] = uint8_t((pal[c] + 2 * pal[4 + c]) / 3);
+    }
+    else {
+      pal[8 + c]  = uint8_t((pal[c] + pal[4 + c]) / 2);
+      pal[12 + c] = 0;
+    }
+  }
+  for (int i = 0; i < 16; i++)
+    std::memcpy(out + i * 4, pal + (bits >> (i * 2) & 3) * 4, 4);
+}
+
+void decodeAlpha(const uint8_t* in, uint8_t* out) {
+  int a0 = in[0], a1 = in[1];
+  // six steps between the two, or four and then 0 and 255
+  int pal[8] = {a0, a1, 0, 0, 0, 0, 0, 255};
+  int steps  = a0 > a1 ? 7 : 5;
+  for (int i = 1; i < steps; i++)
+    pal[i + 1] = ((steps - i) * a0 + i * a1) / steps;
+  uint64_t bits = 0;
+  for (int i = 0; i < 6; i++)
+    bits |= uint64_t(in[2 + i]) << (i * 8);
+  for (int i = 0; i < 16; i++)
+    out[i * 4 + 3] = uint8_t(pal[bits >> (i * 3) & 7]);
+}
+
+// mode 6 only, which is all the encoder writes
+void decodeBC7(const uint8_t* in, uint8_t* out) {
+  int pos   = 0;
+  auto bits = [&](int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++, pos++)
+      v |= (in[pos / 8] >> (pos % 8) & 1) << i;
+    return v;
+  };
+  expect(bits(7) == 1 << 6, "BC7 blocks are mode 6");
+  int e[2][4];
+  for (int c = 0; c < 4; c++) {
+    e[0][c] = bits(7);
+    e[1][c] = bits(7);
+  }
+  int p0 = bits(1), p1 = bits(1);
+  for (int c = 0; c < 4; c++) {
+    e[0][c] = e[0][c] << 1 | p0;
+    e[1][c] = e[1][c] << 1 | p1;
+  }
+  static const int weights[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64,
+  };
+  for (int i = 0; i < 16; i++) {
+    int w = weights[bits(i == 0 ? 3 : 4)];
+    for (int c = 0; c < 4; c++)
+      out[i * 4 + c] = uint8_t(((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6);
+  }
+  expect(pos == 128, "BC7 mode 6 is 128 bits");
+}
+
+std::vector<uint8_t> decodeBlocks(
+  std::span<const uint8_t> blocks, int width, int height,
+  oglc::BlockFormat f) {
+  std::vector<uint8_t> rgba(size_t(width) * height * 4);
+  int blocks_x = (width + 3) / 4;
+  for (int by = 0; by < (height + 3) / 4; by++) {
+    for (int bx = 0; bx < blocks_x; bx++) {
+      const uint8_t* in =
+        &blocks[(size_t(by) * blocks_x + bx) * oglc::blockBytes(f)];
+      uint8_t texels[64];
+      if (f == oglc::BlockFormat::bc1)
+        decodeBC1(in, false, texels);
+      else if (f == oglc::BlockFormat::bc3) {
+        decodeBC1(in + 8, true, texels);
+        decodeAlpha(in, texels);
+      }
+      else
+        decodeBC7(in, texels);
+      // texels past the edge are dropped
+      for (int y = 0; y < 4 && by * 4 + y < height; y++) {
+        for (int x = 0; x < 4 && bx * 4 + x < width; x++) {
+          std::memcpy(
+            &rgba[(size_t(by * 4 + y) * width + bx * 4 + x) * 4],
+            &texels[(y * 4 + x) * 4], 4);
+        }
+      }
+    }
+  }
+  return rgba;
+}
+
+// What the driver makes of the same blocks.
+std::vector<uint8_t> decodeWithGL(
+  std::span<const uint8_t> blocks, int width, int height,
+  oglc::BlockFormat f) {
+  using namespace gl;
+  GLenum format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+  if (f == oglc::BlockFormat::bc1)
+    format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+  else if (f == oglc::BlockFormat::bc3)
+    format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glCompressedTexImage2D(
+    GL_TEXTURE_2D, 0, format, width, height, 0, GLsizei(blocks.size()),
+    blocks.data());
+  std::vector<uint8_t> rgba(size_t(width) * height * 4);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+  glDeleteTextures(1, &texture);
+  expect(glGetError() == GL_NO_ERROR, "no GL errors decoding blocks");
+  return rgba;
+}
+
+// Root mean square error of one channel, over the texels whose source
+// alpha is at least min_alpha.
+double rmse(
+  std::span<const uint8_t> src, std::span<const uint8_t> decoded,
+  int channel, uint8_t min_alpha = 0) {
+  double sum = 0;
+  size_t n   = 0;
+  for (size_t i = 0; i < src.size(); i += 4) {
+    if (src[i + 3] < min_alpha)
+      continue;
+    double d = double(src[i + channel]) - double(decoded[i + channel]);
+    sum += d * d;
+    n++;
+  }
+  return std::sqrt(sum / double(n));
+}
+
+void checkBcn() {
+  using oglc::BlockFormat;
+  using oglc::BlockQuality;
+  oglc::Context ctx(headless(), "checks");
+
+  // colour and alpha gradients, at an odd size so the edge blocks are
+  // partly outside; for BC1, the colours cut out by a hard-edged disc.
+  // Each mirrored too, so a block's first texel is at either end of its
+  // line, which changes how BC7 writes it.
+  const int w = 61, h = 37;
+  auto image = [&](bool cut, bool mirror) {
+    std::vector<uint8_t> rgba(size_t(w) * h * 4);
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        int u = mirror ? w - 1 - x : x, v = mirror ? h - 1 - y : y;
+        int dx = x - w / 2, dy = y - h / 2;
+        uint8_t* px = &rgba[(size_t(y) * w + x) * 4];
+        px[0]       = uint8_t(u * 4);
+        px[1]       = uint8_t(v * 6);
+        px[2]       = uint8_t(255 - u * 2 - v * 2);
+        px[3]       = uint8_t(255 - v * 5);
+        if (cut)
+          px[3] = dx * dx + dy * dy < 15 * 15 ? 255 : 0;
+      }
+    }
+    return rgba;
+  };
+
+  // Bounds on the RMSE of R, G, B and A added up, at the fast quality
+  // and the others. The colours vary along both axes, which one line
+  // through RGBA can't follow exactly, so even BC7 is a few steps off.
+  struct bound {
+    BlockFormat format;
+    const char* name;
+    double fast;
+    double better;
+  };
+  const bound bounds[] = {
+    {BlockFormat::bc1, "BC1", 17.0, 11.5},
+    {BlockFormat::bc3, "BC3", 17.0, 11.5},
+    {BlockFormat::bc7, "BC7", 23.0, 9.5},
+  };
+  for (const bound& b : bounds) {
+    for (bool mirror : {false, true}) {
+      bool bc1 = b.format == BlockFormat::bc1;
+      auto src = image(bc1, mirror);
+      for (auto q :
+           {BlockQuality::fast, BlockQuality::normal, BlockQuality::high}) {
+        std::string name = b.name + std::string(mirror ? " mirrored" : "") +
+          " quality " + std::to_string(int(q));
+        std::vector<uint8_t> blocks(oglc::compressedBytes(b.format, w, h));
+        oglc::compressImage(src, w, h, b.format, q, blocks);
+        auto decoded = decodeBlocks(blocks, w, h, b.format);
+
+        // S3TC leaves the rounding of its in-between colours to the driver
+        auto by_gl = decodeWithGL(blocks, w, h, b.format);
+        int slack  = b.format == BlockFormat::bc7 ? 0 : 1;
+        for (size_t i = 0; i < decoded.size(); i++) {
+          if (std::abs(int(by_gl[i]) - int(decoded[i])) > slack)
+            throw std::runtime_error(name + ": GL decodes it otherwise");
+        }
+
+        // transparent BC1 texels are black, their colour doesn't count
+        double error = rmse(src, decoded, 3);
+        expect(!bc1 || error == 0, name + " keeps the cut-out");
+        for (int c = 0; c < 3; c++)
+          error += rmse(src, decoded, c, bc1 ? 128 : 0);
+        double limit = q == BlockQuality::fast ? b.fast : b.better;
+        expect(error <= limit, name + " error " + std::to_string(error));
+      }
+    }
+  }
+
+  // two colours BC7 can hit exactly, one odd in every channel and one
+  // even, so the endpoints' shared low bits differ; the first texel is
+  // the odd one, at the far end of the line, so its index is flipped
+  std::vector<uint8_t> two(16 * 4);
+  for (int i = 0; i < 16; i++) {
+    const uint8_t odd[] = {201, 151, 101, 255}, even[] = {40, 20, 10, 254};
+    std::memcpy(&two[i * 4], i % 3 == 0 ? odd : even, 4);
+  }
+  std::vector<uint8_t> block(16);
+  oglc::compressImage(two, 4, 4, BlockFormat::bc7, BlockQuality::fast, block);
+  expect(decodeBlocks(block, 4, 4, BlockFormat::bc7) == two, "exact BC7");
+}
+
+// mipmap
+// ================================
+
+// Every texel of a chain, level by level: fn(level, texel).
+template <class F>
+void eachTexel(std::span<const uint8_t> chain, int w, int h, F&& fn) {
+  const uint8_t* px = chain.data();
+  for (int i = 0; i < oglc::mipLevels(w, h); i++) {
+    size_t n = size_t(oglc::mipSize(w, i)) * size_t(oglc::mipSize(h, i));
+    for (size_t t = 0; t < n; t++, px += 4)
+      fn(i, px);
+  }
+}
+
+void checkMipmap() {
+  using oglc::MipFilter;
+  using oglc::MipOptions;
+  oglc::WorkerPool pool(3);
+  const MipFilter filters[] = {
+    MipFilter::box, MipFilter::kaiser, MipFilter::lanczos};
+
+  // odd sizes, one side down to 1 well before the other
+  const int w = 37, h = 5;
+  const int levels = oglc::mipLevels(w, h);
+  expect(levels == 6, "37x5 has 6 levels");
+  expect(oglc::mipSize(h, 3) == 1, "sizes stop at 1");
+  auto chainOf = [&](auto texel) {
+    std::vector<uint8_t> chain(oglc::mipChainBytes(w, h, levels));
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++)
+        texel(x, y, &chain[(size_t(y) * w + x) * 4]);
+    }
+    return chain;
+  };
+
+  // a flat colour stays exactly that at every level with every filter, so
+  // the weights add up to one at the edges too
+  for (MipFilter filter : filters) {
+    for (bool srgb : {false, true}) {
+      const uint8_t colour[] = {90, 160, 220, 255};
+      auto chain             = chainOf([&](int, int, uint8_t* px) {
+        std::memcpy(px, colour, 4);
+      });
+      oglc::generateMips(chain, w, h, levels, {filter, srgb}, &pool);
+      eachTexel(chain, w, h, [&](int level, const uint8_t* px) {
+        expect(
+          std::memcmp(px, colour, 4) == 0,
+          "flat colour at level " + std::to_string(level));
+      });
+    }
+  }
+
+  // black and white average to half the light, which sRGB encodes as 188
+  for (bool srgb : {false, true}) {
+    std::vector<uint8_t> chain(oglc::mipChainBytes(2, 2, 2));
+    for (int i = 0; i < 4; i++) {
+      uint8_t v = (i == 0 || i == 3) ? 255 : 0;
+      std::memset(&chain[size_t(i) * 4], v, 3);
+      chain[size_t(i) * 4 + 3] = 255;
+    }
+    oglc::generateMips(chain, 2, 2, 2, {MipFilter::box, srgb});
+    expect(chain[16] == (srgb ? 188 : 128), "sRGB average");
+  }
+
+  // opaque red beside transparent green: the green must not bleed in,
+  // even through the sharper filters' lobes, so what has any alpha is
+  // still pure red. Premultiplied, colour never exceeds alpha.
+  for (MipFilter filter : filters) {
+    for (bool srgb : {false, true}) {
+      for (bool premultiplied : {false, true}) {
+        auto chain = chainOf([&](int x, int, uint8_t* px) {
+          const uint8_t red[]   = {255, 0, 0, 255};
+          const uint8_t green[] = {0, uint8_t(premultiplied ? 0 : 255), 0, 0};
+          std::memcpy(px, x < w / 2 ? red : green, 4);
+        });
+        MipOptions o {filter, srgb, premultiplied};
+        oglc::generateMips(chain, w, h, levels, o, &pool);
+        eachTexel(chain, w, h, [&](int level, const uint8_t* px) {
+          std::string where = " at level " + std::to_string(level);
+          if (level == 0)
+            return;
+          expect(px[1] == 0 && px[2] == 0, "no bleeding" + where);
+          if (premultiplied) {
+            // in linear light, allowing for the rounding of both
+            const auto& linear = oglc::details::srgbTable();
+            float red          = srgb ? linear[px[0]] : px[0] / 255.0f;
+            expect(red <= (px[3] + 1) / 255.0f, "premultiplied" + where);
+          }
+          else if (px[3] > 0)
+            expect(px[0] == 255, "pure red" + where);
+        });
+      }
+    }
+  }
+
+  // noise, linear and opaque: a box filter halving an even size is the
+  // mean of each 2x2
+  uint32_t seed = 1;
+  auto random   = [&] {
+    seed = seed * 1664525 + 1013904223;
+    return uint8_t(seed >> 24);
+  };
+  std::vector<uint8_t> noise(16 * 16 * 4), half(8 * 8 * 4);
+  for (size_t i = 0; i < noise.size(); i++)
+    noise[i] = i % 4 == 3 ? 255 : random();
+  oglc::downsample(noise, 16, 16, half);
+  for (int y = 0; y < 8; y++) {
+    for (int x = 0; x < 8; x++) {
+      for (int c = 0; c < 4; c++) {
+        int sum = 0;
+        for (int k = 0; k < 4; k++)
+          sum += noise[((size_t(y * 2 + k / 2) * 16) + x * 2 + k % 2) * 4 + c];
+        int got = half[(size_t(y) * 8 + x) * 4 + c];
+        expect(std::abs(got * 4 - sum) <= 4, "box filter is the mean");
+      }
+    }
+  }
+
+  // the pool only shares out the work: the same bytes as without, and
+  // the same as downsampling each level on its own
+  auto noisy = chainOf([&](int, int, uint8_t* px) {
+    for (int c = 0; c < 4; c++)
+      px[c] = random();
+  });
+  for (MipFilter filter : filters) {
+    MipOptions o {filter, true, false};
+    auto alone = noisy, shared = noisy;
+    oglc::generateMips(alone, w, h, levels, o);
+    oglc::generateMips(shared, w, h, levels, o, &pool);
+    expect(alone == shared, "the pool doesn't change the result");
+    std::vector<uint8_t> first(
+      size_t(oglc::mipSize(w, 1)) * size_t(oglc::mipSize(h, 1)) * 4);
+    oglc::downsample({alone.data(), size_t(w) * h * 4}, w, h, first, o);
+    expect(
+      std::equal(first.begin(), first.end(), alone.begin() + w * h * 4),
+      "downsample is the first level");
+  }
+}
+
+// pixels
+// ================================
+
+void checkPixels() {
+  // half covered white is half the light: 128 linear, 188 in sRGB
+  for (bool srgb : {false, true}) {
+    std::vector<uint8_t> px = {255, 255, 255, 128, 200, 100, 50, 0};
+    oglc::premultiplyAlpha(px, 4, srgb);
+    uint8_t half = srgb ? 188 : 128;
+    expect(px[0] == half && px[2] == half && px[3] == 128, "half covered");
+    expect(px[4] == 0 && px[6] == 0 && px[7] == 0, "transparent is black");
+  }
+
+  // opaque stays exactly as it was, every value, grey or RGBA, in and
+  // past the SIMD blocks
+  for (bool srgb : {false, true}) {
+    for (int channels : {2, 4}) {
+      std::vector<uint8_t> px(256 * size_t(channels));
+      for (size_t i = 0; i < 256; i++) {
+        std::memset(&px[i * channels], int(i), size_t(channels) - 1);
+        px[i * channels + channels - 1] = 255;
+      }
+      auto before = px;
+      oglc::premultiplyAlpha(px, channels, srgb);
+      expect(px == before, "opaque pixels are unchanged");
+    }
+  }
+}
+
+// atlas
+// ================================
+
+using Rect = oglc::RectPacker::Rect;
+
+// Everything placed is on the page and clear of everything else.
+void expectDisjoint(
+  const oglc::RectPacker& packer, std::span<const Rect> live) {
+  int64_t area = 0;
+  for (size_t i = 0; i < live.size(); i++) {
+    const Rect& r = live[i];
+    expect(
+      r.x >= 0 && r.y >= 0 && r.right() <= packer.width() &&
+        r.bottom() <= packer.height(),
+      "placed on the page");
+    for (size_t j = i + 1; j < live.size(); j++)
+      expect(!r.overlaps(live[j]), "placements don't overlap");
+    area += int64_t(r.width) * r.height;
+  }
+  double share = double(area) / (double(packer.width()) * packer.height());
+  expect(std::abs(packer.occupancy() - share) < 1e-9, "occupancy adds up");
+}
+
+// Whether a width x height rectangle fits anywhere clear of live, on a
+// grid of step texels.
+bool fitsSomewhere(
+  const oglc::RectPacker& packer, std::span<const Rect> live, int width,
+  int height, int step) {
+  for (int y = 0; y + height <= packer.height(); y += step) {
+    for (int x = 0; x + width <= packer.width(); x += step) {
+      Rect r {x, y, width, height};
+      if (std::none_of(live.begin(), live.end(), [&](const Rect& l) {
+            return l.overlaps(r);
+          }))
+        return true;
+    }
+  }
+  return false;
+}
+
+void checkAtlas() {
+  std::mt19937 rng(49);
+  auto pick = [&](int lo, int hi) {
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+  };
+
+  // random sizes until full, then churn: half out, refill, and again
+  {
+    oglc::RectPacker packer(256, 192);
+    std::vector<Rect> live;
+    for (int round = 0; round < 6; round++) {
+      for (int misses = 0; misses < 40;) {
+        if (auto r = packer.insert(pick(1, 48), pick(1, 48)))
+          live.push_back(*r);
+        else
+          misses++;
+      }
+      expectDisjoint(packer, live);
+      expect(packer.occupancy() > 0.7, "a full page is mostly used");
+      std::shuffle(live.begin(), live.end(), rng);
+      for (size_t n = live.size() / 2; n > 0; n--) {
+        packer.remove(live.back());
+        live.pop_back();
+      }
+      expectDisjoint(packer, live);
+    }
+  }
+
+  // After any removal, whatever fits in the space left is placed. With
+  // sizes on an 8 texel grid every placement is on it too, so trying
+  // each grid position finds all the room there is.
+  {
+    oglc::RectPacker packer(64, 64);
+    std::vector<Rect> live;
+    for (int step = 0; step < 400; step++) {
+      if (live.empty() || pick(0, 2) != 0) {
+        int w = pick(1, 3) * 8, h = pick(1, 3) * 8;
+        bool room = fitsSomewhere(packer, live, w, h, 8);
+        auto r    = packer.insert(w, h);
+        // best fit may place it where a later one fits worse, so only
+        // the packer saying no when there is room is wrong
+        expect(r.has_value() || !room, "placed when there is room");
+        if (r)
+          live.push_back(*r);
+      }
+      else {
+        size_t i = size_t(pick(0, int(live.size()) - 1));
+        packer.remove(live[i]);
+        live[i] = live.back();
+        live.pop_back();
+        for (int w = 8; w <= 64; w += 8) {
+          for (int h = 8; h <= 64; h += 8) {
+            if (!fitsSomewhere(packer, live, w, h, 8))
+              continue;
+            auto r = packer.insert(w, h);
+            expect(r.has_value(), "free space stays maximal on removal");
+            packer.remove(*r);
+          }
+        }
+      }
+      expectDisjoint(packer, live);
+    }
+  }
+
+  // a full page takes nothing more until something goes, then reuses
+  // exactly that space
+  {
+    oglc::RectPacker packer(64, 64);
+    std::vector<Rect> tiles;
+    while (auto r = packer.insert(16, 16))
+      tiles.push_back(*r);
+    expect(tiles.size() == 16 && packer.occupancy() == 1.0, "tiles fill");
+    for (size_t i : {5, 6}) {
+      packer.remove(tiles[i]);
+      auto r = packer.insert(16, 16);
+      expect(r && *r == tiles[i], "a removed tile's space is reused");
+    }
+    // two side by side take one twice the size
+    auto left = std::find_if(tiles.begin(), tiles.end(), [](const Rect& t) {
+      return t.x == 16 && t.y == 32;
+    });
+    auto right = std::find_if(tiles.begin(), tiles.end(), [](const Rect& t) {
+      return t.x == 32 && t.y == 32;
+    });
+    expect(left != tiles.end() && right != tiles.end(), "tiles on a grid");
+    packer.remove(*left);
+    packer.remove(*right);
+    auto r = packer.insert(32, 16);
+    expect(r && *r == Rect {16, 32, 32, 16}, "neighbours' space is one");
+    for (const Rect& t : tiles)
+      packer.remove(t);
+    packer.remove(*r);
+    expect(packer.empty(), "all removed");
+  }
+
+  // TextureAtlas: an image too big for a page, gutter and all, is
+  // refused before a page is made for it
+  {
+    oglc::Context ctx(headless(), "checks");
+    oglc::AtlasOptions options;
+    options.pageSize = 64;
+    options.gutter   = 2;
+    options.maxPages = 2;
+    oglc::TextureAtlas atlas(options);
+    std::vector<uint8_t> big(61 * 10 * 4, 200);
+    bool threw = false;
+    try {
+      atlas.add(big, 61, 10);
+    }
+    catch (const std::invalid_argument&) {
+      threw = true;
+    }
+    expect(threw && atlas.pageCount() == 0, "oversize images are refused");
+
+    std::vector<uint8_t> fits(60 * 60 * 4, 200);
+    auto a = atlas.add(fits, 60, 60);
+    expect(a && atlas.region(*a).x == 2, "the largest image fits");
+    auto b = atlas.add(fits, 60, 60);
+    expect(b && atlas.region(*b).page == 1, "a second page");
+    expect(!atlas.add(fits, 60, 60), "no third page");
+    atlas.remove(*a);
+    auto c = atlas.add(fits, 60, 60);
+    expect(c && atlas.region(*c).page == 0, "a removed image's page");
+    expect(atlas.pageCount() == 2, "no page added for it");
+    atlas.release();
+  }
+}
+
+// gpuprof
+// ================================
+
+void checkGpuprof() {
+  using namespace gl;
+  oglc::Context ctx(headless(), "checks");
+  oglc::GpuProfiler profiler(2, 8);
+  profiler.activate();
+
+  // frame 1: one zone closed in it, one still open when frame 2 starts
+  profiler.beginFrame();
+  { OGLC_GPU_ZONE("closed"); }
+  std::optional<oglc::GpuZone> across;
+  across.emplace("across");
+  profiler.beginFrame();
+  { OGLC_GPU_ZONE("inner"); }
+
+  // frame 1 is over, so closing it now issues nothing
+  int queries = 0;
+  glbinding::setAfterCallback([&](const glbinding::FunctionCall& call) {
+    if (std::string(call.function->name()) == "glQueryCounter")
+      queries++;
+  });
+  glbinding::setCallbackMask(glbinding::CallbackMask::After);
+  across.reset();
+  glbinding::setCallbackMask(glbinding::CallbackMask::None);
+  glbinding::setAfterCallback(nullptr);
+  expect(queries == 0, "no end query for a zone of a finished frame");
+
+  // the frames after are timed as usual, and read back two frames on
+  for (int frame = 0; frame < 4; frame++) {
+    glFinish();
+    profiler.beginFrame();
+    { OGLC_GPU_ZONE("inner"); }
+  }
+  std::ostringstream totals;
+  profiler.print(totals);
+  std::string text = totals.str();
+  size_t closed = text.find("closed");
+  expect(
+    closed != std::string::npos &&
+      text.substr(closed, text.find('\n', closed) - closed).ends_with("over 1"),
+    "closed is counted once");
+  expect(text.find("across") == std::string::npos, "across is dropped");
+  expect(text.find("inner") != std::string::npos, "inner is counted");
+  expect(profiler.droppedFrames() == 0, "every frame read back");
+  profiler.release();
+}
+
+// texarray
+// ================================
+
+// Every layer of the pool's texture, read back.
+std::vector<uint8_t> readLayers(const oglc::TextureArrayPool& pool) {
+  using namespace gl;
+  std::vector<uint8_t> texels(pool.layerBytes() * size_t(pool.capacity()));
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pool.texture());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTexImage(
+    GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  return texels;
+}
+
+// Whether every byte of the layer is value.
+bool layerIs(
+  const oglc::TextureArrayPool& pool, const std::vector<uint8_t>& texels,
+  int layer, uint8_t value) {
+  const uint8_t* at = texels.data() + pool.layerBytes() * size_t(layer);
+  return std::all_of(
+    at, at + pool.layerBytes(), [&](uint8_t b) { return b == value; });
+}
+
+void checkTexarray() {
+  oglc::Context ctx(headless(), "checks");
+  oglc::TextureArrayOptions options;
+  options.width  = 4;
+  options.height = 4;
+  options.layers = 4;
+  auto flat      = [](uint8_t value) {
+    return std::vector<uint8_t>(4 * 4 * 4, value);
+  };
+
+  // the least recently used goes first, counting find() as a use
+  {
+    oglc::TextureArrayPool pool(options);
+    for (uint64_t key = 1; key <= 4; key++)
+      expect(pool.insert(key, flat(uint8_t(key))) == int(key - 1), "free");
+    pool.beginFrame();
+    pool.find(3);
+    pool.find(1);
+    pool.beginFrame();
+    expect(pool.insert(5, flat(5)) == 1, "2 is the least recently used");
+    expect(pool.insert(6, flat(6)) == 3, "then 4");
+    expect(pool.insert(7, flat(7)) == 2, "then 3, found before 1");
+    expect(!pool.find(2) && !pool.find(4) && !pool.find(3), "evicted");
+    expect(pool.evictions() == 3 && pool.size() == 4, "three evictions");
+
+    // 1 was used last frame, the rest this one; 1 goes, then none can
+    expect(pool.insert(8, flat(8)) == 0, "last frame's can go");
+    expect(!pool.insert(9, flat(9)), "this frame's are never evicted");
+    for (uint64_t key : {5, 6, 7, 8})
+      expect(pool.find(key).has_value(), "this frame's keep their layers");
+
+    // freed layers are taken before anything is evicted
+    pool.beginFrame();
+    pool.evict(7);
+    expect(pool.insert(9, flat(9)) == 2, "an evicted key's layer");
+    expect(pool.evictions() == 4, "evict() doesn't count");
+    expect(pool.insert(10, flat(10)) == 1, "then the least recently used");
+
+    pool.flush();
+    auto texels = readLayers(pool);
+    expect(
+      layerIs(pool, texels, 0, 8) && layerIs(pool, texels, 1, 10) &&
+        layerIs(pool, texels, 2, 9) && layerIs(pool, texels, 3, 6),
+      "each layer holds its last image");
+    pool.release();
+  }
+
+  // consecutive layers staged back to back go in one upload, the same
+  // layer twice in one, with the later pixels
+  {
+    options.layers = 8;
+    oglc::TextureArrayPool pool(options);
+    for (uint64_t key = 0; key < 8; key++)
+      pool.insert(key, flat(uint8_t(key + 1)));
+    expect(pool.flush() == 1, "eight layers in order are one run");
+    expect(pool.flush() == 0, "nothing left");
+
+    // 5 alone, then 2 and 3 together, 2 queued again in between
+    pool.insert(5, flat(50));
+    pool.insert(2, flat(20));
+    pool.insert(2, flat(22));
+    pool.insert(3, flat(30));
+    pool.insert(5, flat(55));
+    expect(pool.flush() == 2, "runs of consecutive layers");
+    // adjacent layers staged the other way round can't be one call
+    pool.insert(1, flat(11));
+    pool.insert(0, flat(10));
+    expect(pool.flush() == 2, "runs follow the staging order");
+    auto texels = readLayers(pool);
+    const uint8_t want[] = {10, 11, 22, 30, 5, 55, 7, 8};
+    for (int layer = 0; layer < 8; layer++)
+      expect(layerIs(pool, texels, layer, want[layer]), "uploaded pixels");
+    pool.release();
+  }
+
+  // layers too many for one staging buffer go in one run per buffer
+  {
+    options.width  = 512;
+    options.height = 512;
+    options.layers = 10;
+    oglc::TextureArrayPool pool(options);
+    for (int round = 0; round < 2; round++) {
+      for (uint64_t key = 0; key < 10; key++)
+        pool.insert(key, std::vector<uint8_t>(pool.layerBytes(), key + 9));
+      expect(pool.flush() == 3, "4 MiB of layers a buffer, 1 MiB each");
+    }
+    auto texels = readLayers(pool);
+    for (int layer = 0; layer < 10; layer++)
+      expect(layerIs(pool, texels, layer, uint8_t(layer + 9)), "big layers");
+    pool.release();
+  }
+}
+
+// trace
+// ================================
+
+std::string jsonString(std::string_view str) {
+  std::ostringstream out;
+  oglc::writeJsonString(out, str);
+  return out.str();
+}
+
+void checkTrace() {
+  expect(jsonString("Mesa Intel(R) UHD") == "\"Mesa Intel(R) UHD\"", "plain");
+  expect(
+    jsonString("say \"hi\" C:\\gl") == R"("say \"hi\" C:\\gl")",
+    "quotes and backslashes");
+  // the NUL ending the literal too
+  expect(
+    jsonString(std::string("a\tb\nc\x01\x1f", 8)) ==
+      R"("a\tb\nc\u0001\u001f\u0000")",
+    "control characters");
+  expect(
+    jsonString("d\xc3\xa9j\xc3\xa0") == "\"d\xc3\xa9j\xc3\xa0\"",
+    "UTF-8 as is");
+
+  // thread and event names go through the same
+  oglc::TraceWriter trace;
+  trace.threadName(1, "ren\"der");
+  trace.complete("a\\b\tc", 1, 0, 1000);
+  std::ostringstream out;
+  trace.write(out);
+  std::string text = out.str();
+  expect(text.find(R"("name":"ren\"der")") != std::string::npos, "thread");
+  expect(text.find(R"("name":"a\\b\tc")") != std::string::npos, "event");
+}
+
+// workers
+// ================================
+
+// fn throws on the threads throws_on picks, after a few indices. Once
+// parallelFor is out, nothing may call fn again: it's gone by then.
+void expectRethrown(
+  oglc::WorkerPool& pool, std::function<bool(bool caller)> throws_on) {
+  const auto caller = std::this_thread::get_id();
+  std::atomic<bool> returned {false};
+  std::atomic<int> calls {0}, late {0};
+  bool threw = false;
+  try {
+    pool.parallelFor(400, [&](size_t i) {
+      if (returned)
+        late++;
+      calls++;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      if (i >= 8 && throws_on(std::this_thread::get_id() == caller))
+        throw std::runtime_error("fn failed");
+    });
+  }
+  catch (const std::runtime_error& e) {
+    threw = std::string(e.what()) == "fn failed";
+  }
+  returned = true;
+  expect(threw, "fn's exception comes out of parallelFor");
+  expect(calls < 400, "indices after the throw are skipped");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  expect(late == 0, "fn isn't called once parallelFor is out");
+}
+
+void checkWorkers() {
+  oglc::WorkerPool pool(3);
+  expectRethrown(pool, [](bool caller) { return caller; });
+  expectRethrown(pool, [](bool caller) { return !caller; });
+  expectRethrown(pool, [](bool) { return true; });
+
+  // from a job on the pool, as the mip filters are, and still usable
+  std::atomic<bool> nested {false};
+  pool.submit([&] {
+    try {
+      pool.parallelFor(8, [](size_t i) {
+        if (i == 5)
+          throw std::runtime_error("nested");
+      });
+    }
+    catch (const std::runtime_error&) {
+      nested = true;
+    }
+  });
+  pool.waitIdle();
+  expect(nested, "rethrown inside a job");
+  std::atomic<int> sum {0};
+  pool.parallelFor(100, [&](size_t i) { sum += int(i); });
+  expect(sum == 4950, "the pool works after");
+
+  // the team: every index once, the same on every round, and without
+  // touching the heap once started
+  oglc::WorkerTeam team(3);
+  std::vector<std::atomic<int>> seen(1000);
+  allocations          = 0;
+  counting_allocations = true;
+  for (int round = 0; round < 50; round++)
+    team.run(seen.size(), [&](size_t i) { seen[i]++; });
+  counting_allocations = false;
+  expect(allocations == 0, "team runs don't allocate");
+  for (auto& n : seen)
+    expect(n == 50, "every index once a round");
+  bool threw = false;
+  try {
+    team.run(400, [&](size_t i) {
+      if (i == 17)
+        throw std::runtime_error("fn failed");
+    });
+  }
+  catch (const std::runtime_error&) {
+    threw = true;
+  }
+  expect(threw, "the team rethrows");
+  sum = 0;
+  team.run(100, [&](size_t i) { sum += int(i); });
+  expect(sum == 4950, "the team works after");
+}
+
+// recorder
+// ================================
+
+void checkRecorder() {
+  namespace fs = std::filesystem;
+  constexpr int w = 64, h = 37;
+  // bottom-up rows, as GL reads them: row y is all y
+  std::vector<uint8_t> pixels(size_t(w) * h * 4);
+  for (int y = 0; y < h; y++)
+    std::memset(&pixels[size_t(y) * w * 4], y, size_t(w) * 4);
+  oglc::FrameView frame {pixels.data(), w, h, size_t(w) * 4, 0};
+
+  auto record = [&](const fs::path& path, oglc::VideoRecorder::Format f) {
+    oglc::VideoRecorder recorder(path.string(), f, w, h);
+    recorder.consume(frame);  // first use of the threads' profiler rings
+    allocations          = 0;
+    counting_allocations = true;
+    for (int i = 1; i < 40; i++)
+      recorder.consume(frame);
+    counting_allocations = false;
+    expect(allocations == 0, "frames are recorded without allocating");
+    recorder.finish();
+    expect(recorder.frames() == 40, "every frame recorded");
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+  };
+
+  using Format  = oglc::VideoRecorder::Format;
+  fs::path dir  = fs::temp_directory_path();
+  auto rgba     = record(dir / "oglc-check.rgba", Format::rgba);
+  expect(rgba.size() == pixels.size() * 40, "raw RGBA size");
+  for (int frame_index : {0, 39}) {
+    const uint8_t* f = rgba.data() + pixels.size() * size_t(frame_index);
+    expect(f[0] == h - 1 && f[pixels.size() - 1] == 0, "rows top-down");
+  }
+
+  auto y4m = record(dir / "oglc-check.y4m", Format::y4m);
+  std::string header(y4m.begin(), std::find(y4m.begin(), y4m.end(), '\n'));
+  expect(header.starts_with("YUV4MPEG2 W64 H37 "), "Y4M header");
+  size_t chroma = size_t(w / 2) * ((h + 1) / 2);
+  size_t bytes  = size_t(w) * h + chroma * 2 + 6;
+  expect(y4m.size() == header.size() + 1 + bytes * 40, "Y4M size");
+  fs::remove(dir / "oglc-check.rgba");
+  fs::remove(dir / "oglc-check.y4m");
+}
+
+int main(int argc, char** argv) {
+  const std::map<std::string, std::function<void()>> checks = {
+    {"atlas", checkAtlas},
+    {"bcn", checkBcn},
+    {"gpuprof", checkGpuprof},
+    {"loader", checkLoader},
+    {"mipmap", checkMipmap},
+    {"pixels", checkPixels},
+    {"recorder", checkRecorder},
+    {"texarray", checkTexarray},
+    {"trace", checkTrace},
+    {"workers", checkWorkers},
+  };
+  if (argc != 2 || !checks.count(argv[1])) {
+    std::cerr << "usage: " << argv[0] << " NAME, one of:";
+    for (auto& [name, fn] : checks)
+      std::cerr << " " << name;
+    std::cerr << "\n";
+    return 2;
+  }
+  try {
+    checks.at(argv[1])();
+    return 0;
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+}
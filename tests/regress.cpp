@@ -0,0 +1,245 @@
+// Regression checks for the examples, run by ctest.
+//
+//   oglc-regress golden EXE GOLDEN OUT_DIR [example args...]
+//     Runs EXE headless with --capture and compares the result against
+//     GOLDEN. Missing goldens are written from the capture and the test
+//     is skipped, commit the new file to start checking against it.
+//
+//   oglc-regress perf EXE BASELINE OUT_DIR [example args...]
+//     Runs EXE headless with --bench-out and compares the mean frame time
+//     against BASELINE. Missing baselines are recorded the same way.
+//
+//   oglc-regress replay EXE GOLDEN OUT_DIR [example args...]
+//     Records a --gl-trace of EXE, replays it with the oglc-replay named
+//     by OGLC_REPLAY and compares the replay's last frame against GOLDEN.
+//
+// Thresholds come from the environment so CI can loosen them without a
+// reconfigure: OGLC_IMAGE_TOLERANCE (per channel, default 8),
+// OGLC_IMAGE_MAX_BAD (fraction of pixels, default 0.001) and
+// OGLC_PERF_THRESHOLD (allowed slowdown, default 0.25 = 25%).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "oglc/image.hpp"
+
+namespace fs = std::filesystem;
+
+// ctest's SKIP_RETURN_CODE
+constexpr int skip_code = 77;
+
+double envOr(const char* name, double fallback) {
+  const char* str = std::getenv(name);
+  return str ? std::atof(str) : fallback;
+}
+
+std::string quote(const std::string& str) {
+  std::string res = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      res += '\\';
+    res += c;
+  }
+  return res + '"';
+}
+
+int runExample(const std::string& exe, const std::vector<std::string>& args) {
+  std::string cmd = quote(exe) + " --headless";
+  for (auto& arg : args)
+    cmd += " " + quote(arg);
+  std::cout << "running: " << cmd << std::endl;
+  return std::system(cmd.c_str());
+}
+
+// Copies a fresh result into place when there is nothing to compare with.
+bool bootstrap(const fs::path& result, const fs::path& stored) {
+  if (fs::exists(stored))
+    return false;
+  fs::create_directories(stored.parent_path());
+  fs::copy_file(result, stored);
+  std::cout << "no reference yet, recorded " << stored << "\n";
+  return true;
+}
+
+// Compares a capture against the golden, writing a diff image on failure.
+int compareImages(const fs::path& golden, const fs::path& actual) {
+  auto want = oglc::Image::readPpm(golden.string());
+  auto got  = oglc::Image::readPpm(actual.string());
+  if (want.width != got.width || want.height != got.height) {
+    std::cerr << "size mismatch: golden " << want.width << "x" << want.height
+              << ", got " << got.width << "x" << got.height << "\n";
+    return 1;
+  }
+
+  int tolerance  = int(envOr("OGLC_IMAGE_TOLERANCE", 8));
+  double max_bad = envOr("OGLC_IMAGE_MAX_BAD", 0.001);
+
+  // differing pixels in red over a dimmed copy of the golden
+  oglc::Image diff(want.width, want.height);
+  size_t bad = 0;
+  int worst  = 0;
+  for (size_t i = 0; i < want.pixels.size(); i += 3) {
+    int d = 0;
+    for (size_t c = 0; c < 3; c++)
+      d = std::max(d, std::abs(int(want.pixels[i + c]) - got.pixels[i + c]));
+    worst = std::max(worst, d);
+    if (d > tolerance) {
+      bad++;
+      diff.pixels[i] = 255;
+    }
+    else {
+      for (size_t c = 0; c < 3; c++)
+        diff.pixels[i + c] = want.pixels[i + c] / 4;
+    }
+  }
+
+  double fraction = double(bad) / (want.pixels.size() / 3);
+  std::cout << bad << " pixels differ by more than " << tolerance
+            << " (fraction " << fraction << ", worst " << worst << ")\n";
+  if (fraction > max_bad) {
+    fs::path diff_path = actual;
+    diff_path.replace_extension(".diff.ppm");
+    diff.writePpm(diff_path.string());
+    std::cerr << "image differs from " << golden << ", see " << diff_path
+              << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+int checkGolden(
+  const std::string& exe, const fs::path& golden, const fs::path& out_dir,
+  std::vector<std::string> args) {
+  fs::path actual = out_dir / golden.filename();
+  args.push_back("--capture");
+  args.push_back(actual.string());
+  if (runExample(exe, args) != 0) {
+    std::cerr << "example failed\n";
+    return 1;
+  }
+  if (bootstrap(actual, golden))
+    return skip_code;
+  return compareImages(golden, actual);
+}
+
+// Records a GL trace of the example, replays it and checks the replay's
+// last frame against the golden.
+int checkReplay(
+  const std::string& exe, const fs::path& golden, const fs::path& out_dir,
+  std::vector<std::string> args) {
+  const char* replay = std::getenv("OGLC_REPLAY");
+  if (replay == nullptr) {
+    std::cerr << "OGLC_REPLAY should point at oglc-replay\n";
+    return 1;
+  }
+  if (!fs::exists(golden)) {
+    std::cout << "no golden yet, run the golden test first\n";
+    return skip_code;
+  }
+
+  std::string name = golden.stem().string();
+  fs::path trace   = out_dir / (name + ".trace");
+  fs::path report  = out_dir / (name + ".replay.json");
+  fs::path actual  = out_dir / (name + ".replay.ppm");
+  std::string size;
+  for (size_t i = 0; i + 1 < args.size(); i++)
+    if (args[i] == "--size")
+      size = args[i + 1];
+
+  args.push_back("--gl-trace");
+  args.push_back(trace.string());
+  if (runExample(exe, args) != 0) {
+    std::cerr << "example failed\n";
+    return 1;
+  }
+
+  std::string cmd = quote(replay) + " " + quote(trace.string()) +
+    " --strict --loops 2 --out " + quote(report.string()) +
+    " --capture " + quote(actual.string());
+  if (!size.empty())
+    cmd += " --size " + size;
+  std::cout << "running: " << cmd << std::endl;
+  if (std::system(cmd.c_str()) != 0) {
+    std::cerr << "replay failed\n";
+    return 1;
+  }
+  return compareImages(golden, actual);
+}
+
+// Pulls a number out of the bench report. The report is ours and flat,
+// so a full JSON parser would be overkill.
+double jsonNumber(const fs::path& path, const std::string& key) {
+  std::ifstream in(path);
+  std::stringstream buf;
+  buf << in.rdbuf();
+  std::string text = buf.str();
+  auto pos         = text.find("\"" + key + "\":");
+  if (pos == std::string::npos)
+    throw std::runtime_error(key + " missing from " + path.string());
+  return std::atof(text.c_str() + pos + key.size() + 3);
+}
+
+int checkPerf(
+  const std::string& exe, const fs::path& baseline, const fs::path& out_dir,
+  std::vector<std::string> args) {
+  fs::path report = out_dir / baseline.filename();
+  args.push_back("--bench-out");
+  args.push_back(report.string());
+  if (runExample(exe, args) != 0) {
+    std::cerr << "example failed\n";
+    return 1;
+  }
+  if (bootstrap(report, baseline))
+    return skip_code;
+
+  double threshold = envOr("OGLC_PERF_THRESHOLD", 0.25);
+  double base      = jsonNumber(baseline, "mean_ms");
+  double mean      = jsonNumber(report, "mean_ms");
+  std::cout << "mean " << mean << " ms (baseline " << base << " ms), p99 "
+            << jsonNumber(report, "p99_ms") << " ms (baseline "
+            << jsonNumber(baseline, "p99_ms") << " ms)\n";
+  if (mean > base * (1.0 + threshold)) {
+    std::cerr << "mean frame time regressed by "
+              << (mean / base - 1.0) * 100.0 << "%, more than "
+              << threshold * 100.0 << "%\n";
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 5) {
+    std::cerr << "usage: " << argv[0]
+              << " golden|perf|replay EXE REFERENCE OUT_DIR [args...]\n";
+    return 2;
+  }
+  std::string mode = argv[1];
+  std::string exe  = argv[2];
+  fs::path ref     = argv[3];
+  fs::path out_dir = argv[4];
+  std::vector<std::string> args(argv + 5, argv + argc);
+  fs::create_directories(out_dir);
+
+  try {
+    if (mode == "golden")
+      return checkGolden(exe, ref, out_dir, args);
+    if (mode == "perf")
+      return checkPerf(exe, ref, out_dir, args);
+    if (mode == "replay")
+      return checkReplay(exe, ref, out_dir, args);
+    std::cerr << "unknown mode " << mode << "\n";
+    return 2;
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,9 @@
+// stb_image's allocations go through oglc's decode hooks, so
+// oglc::decodeInto() can give it a scratch arena.
+#include "oglc/decode.hpp"
+#define STBI_MALLOC(size) ::oglc::details::decodeMalloc(size)
+#define STBI_REALLOC_SIZED(p, old_size, new_size) \
+  ::oglc::details::decodeRealloc(p, old_size, new_size)
+#define STBI_FREE(p) ::oglc::details::decodeFree(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
@@ -0,0 +1,203 @@
+// Measures PNG decode throughput, oglc's fast path against stb_image,
+// and checks that the two agree byte for byte, as RGBA and as the
+// channels the file holds. Each image is also transcoded to QOI, whose
+// decode is timed and checked the same way.
+//
+//   oglc-pngbench [--check] [--expect-fast] [--repeat N] PATH...
+//
+// PATHs are PNG files, or directories searched for them. Each file is
+// decoded N times (default 5) both ways to RGBA8, keeping the fastest
+// run; oglc falls back to stb for files its fast path doesn't take, as
+// the texture loader does. Throughput is in decoded megapixels and
+// encoded megabytes a second. With --check only agreement is reported.
+// With --expect-fast, every file has to take the fast path, as RGBA and
+// as its own channels, except those named *.stb.png, which must not:
+// a fallback would otherwise pass the comparison without testing it.
+// Exits 1 if any file decodes differently or goes the wrong way.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "oglc/png.hpp"
+#include "oglc/qoi.hpp"
+#include "stb_image.h"
+
+namespace {
+  std::vector<uint8_t> readFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return {
+      std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+  }
+
+  // Fastest of repeat runs, in seconds.
+  template <class F>
+  double fastest(int repeat, F&& fn) {
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < repeat; i++) {
+      auto start = std::chrono::steady_clock::now();
+      fn();
+      std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - start;
+      best = std::min(best, took.count());
+    }
+    return best;
+  }
+
+  struct totals {
+    int files      = 0;
+    int fast       = 0;  // taken by the fast path
+    int mismatches = 0;
+    int misrouted  = 0;  // not on the path --expect-fast expects
+    double pixels  = 0;
+    double encoded = 0;
+    double qoiSize = 0;
+    double stb     = 0;  // seconds
+    double oglc    = 0;
+    double qoi     = 0;
+  };
+
+  void bench(
+    const std::filesystem::path& path, int repeat, bool check,
+    bool expect_fast, totals& t) {
+    std::vector<uint8_t> file = readFile(path);
+    int w = 0, h = 0, channels = 0;
+    stbi_uc* expected = stbi_load_from_memory(
+      file.data(), int(file.size()), &w, &h, &channels, 4);
+    if (!expected)
+      return;  // not something either decodes
+    std::vector<uint8_t> pixels(size_t(w) * size_t(h) * 4);
+    bool fast = oglc::png::decode(file, pixels);
+    bool same = !fast ||
+      std::equal(pixels.begin(), pixels.end(), expected);
+    std::vector<uint8_t> qoi =
+      oglc::qoi::encode({expected, pixels.size()}, w, h, false);
+    oglc::qoi::decode(qoi, pixels);
+    same = same && std::equal(pixels.begin(), pixels.end(), expected);
+    // opaque images say RGB, and decode to it too
+    if (oglc::qoi::readHeader(qoi).channels == 3) {
+      std::vector<uint8_t> rgb(size_t(w) * size_t(h) * 3);
+      oglc::qoi::decode(qoi, rgb, 3);
+      for (size_t i = 0; same && i < rgb.size() / 3; i++)
+        same = std::memcmp(&rgb[i * 3], &expected[i * 4], 3) == 0;
+    }
+    stbi_image_free(expected);
+
+    // and to the channels the file holds, as the texture loader asks
+    bool native_fast = false;
+    if (int native = oglc::png::channelsOf(file); native > 0) {
+      expected = stbi_load_from_memory(
+        file.data(), int(file.size()), &w, &h, &channels, native);
+      std::vector<uint8_t> packed(size_t(w) * size_t(h) * size_t(native));
+      native_fast = expected && oglc::png::decode(file, packed, native);
+      if (native_fast)
+        same = same && std::equal(packed.begin(), packed.end(), expected);
+      stbi_image_free(expected);
+    }
+
+    t.files++;
+    t.fast += fast;
+    if (!same) {
+      t.mismatches++;
+      std::printf("MISMATCH %s\n", path.string().c_str());
+    }
+    if (expect_fast) {
+      bool stb = path.filename().string().ends_with(".stb.png");
+      if (stb ? fast || native_fast : !fast || !native_fast) {
+        t.misrouted++;
+        std::printf(
+          "%s %s\n", stb ? "TOOK THE FAST PATH" : "FELL BACK",
+          path.string().c_str());
+      }
+    }
+    if (check)
+      return;
+
+    t.stb += fastest(repeat, [&] {
+      stbi_image_free(stbi_load_from_memory(
+        file.data(), int(file.size()), &w, &h, &channels, 4));
+    });
+    t.oglc += fastest(repeat, [&] {
+      if (!oglc::png::decode(file, pixels)) {
+        stbi_image_free(stbi_load_from_memory(
+          file.data(), int(file.size()), &w, &h, &channels, 4));
+      }
+    });
+    t.qoi += fastest(repeat, [&] { oglc::qoi::decode(qoi, pixels); });
+    t.pixels += double(w) * h;
+    t.encoded += double(file.size());
+    t.qoiSize += double(qoi.size());
+  }
+}  // namespace
+
+int main(int argc, char** argv) try {
+  bool check       = false;
+  bool expect_fast = false;
+  int repeat       = 5;
+  std::vector<std::filesystem::path> files;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--check") {
+      check = true;
+    }
+    else if (arg == "--expect-fast") {
+      expect_fast = true;
+    }
+    else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(std::stoi(argv[++i]), 1);
+    }
+    else if (std::filesystem::is_directory(arg)) {
+      for (auto& e : std::filesystem::recursive_directory_iterator(arg)) {
+        if (e.is_regular_file() && e.path().extension() == ".png")
+          files.push_back(e.path());
+      }
+    }
+    else {
+      files.emplace_back(arg);
+    }
+  }
+  if (files.empty()) {
+    std::fprintf(
+      stderr,
+      "usage: oglc-pngbench [--check] [--expect-fast] [--repeat N] "
+      "PATH...\n");
+    return 2;
+  }
+  std::sort(files.begin(), files.end());
+
+  totals t;
+  for (auto& f : files)
+    bench(f, repeat, check, expect_fast, t);
+  std::printf(
+    "%d files, %d on the fast path, %d mismatched\n", t.files, t.fast,
+    t.mismatches);
+  if (expect_fast)
+    std::printf("%d not on the path expected\n", t.misrouted);
+  if (!check && t.files > 0) {
+    std::printf(
+      "stb:  %8.1f MP/s %8.1f MB/s\n", t.pixels / t.stb / 1e6,
+      t.encoded / t.stb / 1e6);
+    std::printf(
+      "oglc: %8.1f MP/s %8.1f MB/s, %.2fx\n", t.pixels / t.oglc / 1e6,
+      t.encoded / t.oglc / 1e6, t.stb / t.oglc);
+    std::printf(
+      "qoi:  %8.1f MP/s %8.1f MB/s, %.2fx, %.2fx oglc's\n",
+      t.pixels / t.qoi / 1e6, t.qoiSize / t.qoi / 1e6, t.stb / t.qoi,
+      t.oglc / t.qoi);
+  }
+  return t.mismatches > 0 || t.misrouted > 0 ? 1 : 0;
+}
+catch (const std::exception& e) {
+  std::fprintf(stderr, "oglc-pngbench: %s\n", e.what());
+  return 1;
+}
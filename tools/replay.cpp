@@ -0,0 +1,875 @@
+// Replays a GL trace written with --gl-trace against a headless context,
+// as fast as the driver allows, and reports per-frame times.
+//
+//   oglc-replay TRACE [options]
+//
+// The first frame of a trace also holds the example's setup, so it is
+// replayed once, untimed. The remaining frames are then replayed --loops
+// times and timed one by one, each followed by the usual headless swap.
+// The workload is fixed and there is no window or input in the way, so
+// this measures the driver's CPU overhead, and changes such as state
+// caching or batching show up directly.
+//
+// Only functions in the dispatch table below can be replayed; calls to
+// anything else are skipped (or rejected up front with --strict).
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/gl.h>
+#include <glbinding/gl/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "oglc/bench.hpp"
+#include "oglc/context.hpp"
+#include "oglc/gltrace.hpp"
+#include "oglc/readback.hpp"
+#include "oglc/trace.hpp"
+
+using namespace gl;
+namespace trace = oglc::trace;
+
+// The arguments of one traced call, converted back to the types the GL
+// functions take.
+class Args {
+public:
+  Args(const trace::Reader& reader, const trace::call& call) :
+    m_call(call), m_args(reader.args(call)), m_blobs(reader.blobs(call)) {}
+
+  template <class T>
+  T get(size_t i) const {
+    const trace::value& v = m_args[i];
+    if constexpr (std::is_same_v<T, gl::GLboolean>)
+      return v.bits != 0 ? GL_TRUE : GL_FALSE;
+    else if constexpr (std::is_floating_point_v<T>)
+      return T(v.asReal());
+    else if constexpr (std::is_pointer_v<T>)
+      return reinterpret_cast<T>(uintptr_t(v.bits));
+    else
+      return static_cast<T>(v.bits);
+  }
+  gl::GLenum e(size_t k) const { return get<gl::GLenum>(k); }
+  gl::GLint i(size_t k) const { return get<gl::GLint>(k); }
+  gl::GLuint u(size_t k) const { return get<gl::GLuint>(k); }
+  gl::GLsizei n(size_t k) const { return get<gl::GLsizei>(k); }
+  gl::GLfloat f(size_t k) const { return get<gl::GLfloat>(k); }
+  gl::GLboolean b(size_t k) const { return get<gl::GLboolean>(k); }
+  const trace::value& raw(size_t k) const { return m_args[k]; }
+
+  // The memory recorded with argument i, or the raw pointer value when
+  // nothing was, which is what buffer offsets look like.
+  template <class T = void>
+  const T* data(size_t i) const {
+    for (auto& b : m_blobs)
+      if (b.arg == i)
+        return reinterpret_cast<const T*>(b.data);
+    return get<const T*>(i);
+  }
+  std::span<const trace::blob> blobs() const { return m_blobs; }
+
+  const trace::value& ret() const { return m_call.ret; }
+
+private:
+  const trace::call& m_call;
+  std::span<const trace::value> m_args;
+  std::span<const trace::blob> m_blobs;
+};
+
+// Traced object names mapped to the ones the replay got. Names that were
+// never created in the trace pass through unchanged.
+class NameMap {
+public:
+  gl::GLuint operator()(gl::GLuint traced) const {
+    auto it = m_names.find(traced);
+    return it == m_names.end() ? traced : it->second;
+  }
+  void add(gl::GLuint traced, gl::GLuint actual) { m_names[traced] = actual; }
+  void remove(gl::GLuint traced) { m_names.erase(traced); }
+
+private:
+  std::unordered_map<gl::GLuint, gl::GLuint> m_names;
+};
+
+class Replayer {
+public:
+  explicit Replayer(const trace::Reader& reader) : m_reader(reader) {
+    for (auto& name : reader.functions()) {
+      auto fn = handlerFor(name);
+      if (fn == nullptr && !name.empty())
+        m_unsupported.push_back(name);
+      m_handlers.push_back(fn);
+    }
+    // whatever the context presents from stands in for framebuffer 0
+    gl::GLint fbo = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+    m_framebuffers.add(0, gl::GLuint(fbo));
+  }
+
+  const std::vector<std::string>& unsupported() const { return m_unsupported; }
+  uint64_t skipped() const { return m_skipped; }
+
+  // Replays calls [begin, end).
+  void run(size_t begin, size_t end) {
+    auto& calls = m_reader.calls();
+    for (size_t i = begin; i < end; i++) {
+      const trace::call& c = calls[i];
+      if (auto fn = m_handlers[c.function])
+        fn(*this, Args(m_reader, c));
+      else
+        m_skipped++;
+    }
+  }
+
+private:
+  using handler = void (*)(Replayer&, const Args&);
+
+  enum class object {
+    buffer,
+    texture,
+    vertex_array,
+    framebuffer,
+    renderbuffer,
+    query,
+    sampler,
+  };
+
+  static handler handlerFor(std::string_view name);
+
+  NameMap& names(object type) {
+    switch (type) {
+      case object::buffer:
+        return m_buffers;
+      case object::texture:
+        return m_textures;
+      case object::vertex_array:
+        return m_vertexArrays;
+      case object::framebuffer:
+        return m_framebuffers;
+      case object::renderbuffer:
+        return m_renderbuffers;
+      case object::query:
+        return m_queries;
+      default:
+        return m_samplers;
+    }
+  }
+
+  // Names for glObjectLabel's identifiers.
+  gl::GLuint labelled(gl::GLenum identifier, gl::GLuint name) {
+    switch (identifier) {
+      case GL_BUFFER:
+        return m_buffers(name);
+      case GL_TEXTURE:
+        return m_textures(name);
+      case GL_VERTEX_ARRAY:
+        return m_vertexArrays(name);
+      case GL_FRAMEBUFFER:
+        return m_framebuffers(name);
+      case GL_RENDERBUFFER:
+        return m_renderbuffers(name);
+      case GL_QUERY:
+        return m_queries(name);
+      case GL_SAMPLER:
+        return m_samplers(name);
+      case GL_SHADER:
+      case GL_PROGRAM:
+        return m_programs(name);
+      default:
+        return name;
+    }
+  }
+
+  void gen(object type, const Args& a) {
+    gl::GLsizei count = a.n(0);
+    auto traced   = a.data<gl::GLuint>(1);
+    m_names.resize(size_t(count));
+    switch (type) {
+      case object::buffer:
+        glGenBuffers(count, m_names.data());
+        break;
+      case object::texture:
+        glGenTextures(count, m_names.data());
+        break;
+      case object::vertex_array:
+        glGenVertexArrays(count, m_names.data());
+        break;
+      case object::framebuffer:
+        glGenFramebuffers(count, m_names.data());
+        break;
+      case object::renderbuffer:
+        glGenRenderbuffers(count, m_names.data());
+        break;
+      case object::query:
+        glGenQueries(count, m_names.data());
+        break;
+      case object::sampler:
+        glGenSamplers(count, m_names.data());
+        break;
+    }
+    for (gl::GLsizei i = 0; traced && i < count; i++)
+      names(type).add(traced[i], m_names[i]);
+  }
+
+  void remove(object type, const Args& a) {
+    gl::GLsizei count = a.n(0);
+    auto traced   = a.data<gl::GLuint>(1);
+    if (traced == nullptr)
+      return;
+    m_names.resize(size_t(count));
+    for (gl::GLsizei i = 0; i < count; i++) {
+      m_names[i] = names(type)(traced[i]);
+      names(type).remove(traced[i]);
+    }
+    switch (type) {
+      case object::buffer:
+        glDeleteBuffers(count, m_names.data());
+        break;
+      case object::texture:
+        glDeleteTextures(count, m_names.data());
+        break;
+      case object::vertex_array:
+        glDeleteVertexArrays(count, m_names.data());
+        break;
+      case object::framebuffer:
+        glDeleteFramebuffers(count, m_names.data());
+        break;
+      case object::renderbuffer:
+        glDeleteRenderbuffers(count, m_names.data());
+        break;
+      case object::query:
+        glDeleteQueries(count, m_names.data());
+        break;
+      case object::sampler:
+        glDeleteSamplers(count, m_names.data());
+        break;
+    }
+  }
+
+  // Uniform locations are per program; explicit ones pass through.
+  gl::GLint location(gl::GLint traced) const {
+    auto it = m_locations.find(locationKey(m_program, traced));
+    return it == m_locations.end() ? traced : it->second;
+  }
+  static uint64_t locationKey(gl::GLuint program, gl::GLint loc) {
+    return uint64_t(program) << 32 | uint32_t(loc);
+  }
+
+  gl::GLsync sync(const trace::value& traced) const {
+    auto it = m_syncs.find(traced.bits);
+    return it == m_syncs.end() ? nullptr : it->second;
+  }
+
+  // Somewhere for glGet* and client-side glReadPixels to write to.
+  template <class T = char>
+  T* scratch(size_t bytes = 256) {
+    size_t count = bytes / sizeof(std::max_align_t) + 1;
+    if (m_scratch.size() < count)
+      m_scratch.resize(count);
+    return reinterpret_cast<T*>(m_scratch.data());
+  }
+
+  const trace::Reader& m_reader;
+  std::vector<handler> m_handlers;
+  std::vector<std::string> m_unsupported;
+  uint64_t m_skipped = 0;
+
+  NameMap m_buffers, m_textures, m_vertexArrays, m_framebuffers,
+    m_renderbuffers, m_queries, m_samplers;
+  NameMap m_programs;  // shaders and programs share a namespace
+  std::unordered_map<uint64_t, gl::GLint> m_locations;
+  std::unordered_map<uint64_t, gl::GLsync> m_syncs;
+  gl::GLuint m_program   = 0;  // traced name of the program in use
+  bool m_packBuffer  = false;
+  std::vector<gl::GLuint> m_names;
+  std::vector<const gl::GLchar*> m_strings;
+  std::vector<gl::GLint> m_lengths;
+  std::vector<std::max_align_t> m_scratch;
+};
+
+// The dispatch table: every function the examples and oglc's own helpers
+// call, plus the common neighbours. Add to it as traces need.
+Replayer::handler Replayer::handlerFor(std::string_view name) {
+  using R = Replayer;
+  using A = Args;
+  static const std::unordered_map<std::string_view, handler> table = {
+    // state
+    {"glViewport",
+     [](R&, const A& a) { glViewport(a.i(0), a.i(1), a.n(2), a.n(3)); }},
+    {"glScissor",
+     [](R&, const A& a) { glScissor(a.i(0), a.i(1), a.n(2), a.n(3)); }},
+    {"glClearColor",
+     [](R&, const A& a) { glClearColor(a.f(0), a.f(1), a.f(2), a.f(3)); }},
+    {"glClearDepth",
+     [](R&, const A& a) { glClearDepth(a.get<gl::GLdouble>(0)); }},
+    {"glClear", [](R&, const A& a) { glClear(a.get<ClearBufferMask>(0)); }},
+    {"glEnable", [](R&, const A& a) { glEnable(a.e(0)); }},
+    {"glDisable", [](R&, const A& a) { glDisable(a.e(0)); }},
+    {"glBlendFunc", [](R&, const A& a) { glBlendFunc(a.e(0), a.e(1)); }},
+    {"glDepthFunc", [](R&, const A& a) { glDepthFunc(a.e(0)); }},
+    {"glDepthMask", [](R&, const A& a) { glDepthMask(a.b(0)); }},
+    {"glColorMask",
+     [](R&, const A& a) { glColorMask(a.b(0), a.b(1), a.b(2), a.b(3)); }},
+    {"glCullFace", [](R&, const A& a) { glCullFace(a.e(0)); }},
+    {"glFrontFace", [](R&, const A& a) { glFrontFace(a.e(0)); }},
+    {"glPixelStorei", [](R&, const A& a) { glPixelStorei(a.e(0), a.i(1)); }},
+
+    // buffers and vertex arrays
+    {"glGenBuffers", [](R& r, const A& a) { r.gen(object::buffer, a); }},
+    {"glDeleteBuffers",
+     [](R& r, const A& a) { r.remove(object::buffer, a); }},
+    {"glBindBuffer",
+     [](R& r, const A& a) {
+       if (a.e(0) == GL_PIXEL_PACK_BUFFER)
+         r.m_packBuffer = a.u(1) != 0;
+       glBindBuffer(a.e(0), r.m_buffers(a.u(1)));
+     }},
+    {"glBufferData",
+     [](R&, const A& a) {
+       glBufferData(
+         a.e(0), a.get<gl::GLsizeiptr>(1), a.data(2), a.e(3));
+     }},
+    {"glBufferSubData",
+     [](R&, const A& a) {
+       glBufferSubData(
+         a.e(0), a.get<gl::GLintptr>(1), a.get<gl::GLsizeiptr>(2), a.data(3));
+     }},
+    // what was written through a mapping comes with the unmap
+    {"glMapBufferRange",
+     [](R&, const A& a) {
+       glMapBufferRange(
+         a.e(0), a.get<gl::GLintptr>(1), a.get<gl::GLsizeiptr>(2),
+         a.get<MapBufferAccessMask>(3));
+     }},
+    {"glUnmapBuffer",
+     [](R&, const A& a) {
+       void* mapped = nullptr;
+       if (!a.blobs().empty())
+         glGetBufferPointerv(a.e(0), GL_BUFFER_MAP_POINTER, &mapped);
+       if (mapped) {
+         auto& written = a.blobs().front();
+         std::memcpy(mapped, written.data, written.size);
+       }
+       glUnmapBuffer(a.e(0));
+     }},
+    {"glGenVertexArrays",
+     [](R& r, const A& a) { r.gen(object::vertex_array, a); }},
+    {"glDeleteVertexArrays",
+     [](R& r, const A& a) { r.remove(object::vertex_array, a); }},
+    {"glBindVertexArray",
+     [](R& r, const A& a) { glBindVertexArray(r.m_vertexArrays(a.u(0))); }},
+    {"glVertexAttribPointer",
+     [](R&, const A& a) {
+       glVertexAttribPointer(
+         a.u(0), a.i(1), a.e(2), a.b(3), a.n(4), a.data(5));
+     }},
+    {"glVertexAttribIPointer",
+     [](R&, const A& a) {
+       glVertexAttribIPointer(a.u(0), a.i(1), a.e(2), a.n(3), a.data(4));
+     }},
+    {"glEnableVertexAttribArray",
+     [](R&, const A& a) { glEnableVertexAttribArray(a.u(0)); }},
+    {"glDisableVertexAttribArray",
+     [](R&, const A& a) { glDisableVertexAttribArray(a.u(0)); }},
+    {"glVertexAttribDivisor",
+     [](R&, const A& a) { glVertexAttribDivisor(a.u(0), a.u(1)); }},
+
+    // textures
+    {"glGenTextures", [](R& r, const A& a) { r.gen(object::texture, a); }},
+    {"glDeleteTextures",
+     [](R& r, const A& a) { r.remove(object::texture, a); }},
+    {"glActiveTexture", [](R&, const A& a) { glActiveTexture(a.e(0)); }},
+    {"glBindTexture",
+     [](R& r, const A& a) { glBindTexture(a.e(0), r.m_textures(a.u(1))); }},
+    {"glTexParameteri",
+     [](R&, const A& a) { glTexParameteri(a.e(0), a.e(1), a.i(2)); }},
+    {"glTexParameterf",
+     [](R&, const A& a) { glTexParameterf(a.e(0), a.e(1), a.f(2)); }},
+    {"glTexImage2D",
+     [](R&, const A& a) {
+       glTexImage2D(
+         a.e(0), a.i(1), a.i(2), a.n(3), a.n(4), a.i(5), a.e(6), a.e(7),
+         a.data(8));
+     }},
+    {"glTexSubImage2D",
+     [](R&, const A& a) {
+       glTexSubImage2D(
+         a.e(0), a.i(1), a.i(2), a.i(3), a.n(4), a.n(5), a.e(6), a.e(7),
+         a.data(8));
+     }},
+    {"glCompressedTexImage2D",
+     [](R&, const A& a) {
+       glCompressedTexImage2D(
+         a.e(0), a.i(1), a.e(2), a.n(3), a.n(4), a.i(5), a.n(6), a.data(7));
+     }},
+    {"glCompressedTexSubImage2D",
+     [](R&, const A& a) {
+       glCompressedTexSubImage2D(
+         a.e(0), a.i(1), a.i(2), a.i(3), a.n(4), a.n(5), a.e(6), a.n(7),
+         a.data(8));
+     }},
+    {"glTexImage3D",
+     [](R&, const A& a) {
+       glTexImage3D(
+         a.e(0), a.i(1), a.i(2), a.n(3), a.n(4), a.n(5), a.i(6), a.e(7),
+         a.e(8), a.data(9));
+     }},
+    {"glTexSubImage3D",
+     [](R&, const A& a) {
+       glTexSubImage3D(
+         a.e(0), a.i(1), a.i(2), a.i(3), a.i(4), a.n(5), a.n(6), a.n(7),
+         a.e(8), a.e(9), a.data(10));
+     }},
+    {"glTexStorage2D",
+     [](R&, const A& a) {
+       glTexStorage2D(a.e(0), a.n(1), a.e(2), a.n(3), a.n(4));
+     }},
+    {"glTexStorage3D",
+     [](R&, const A& a) {
+       glTexStorage3D(a.e(0), a.n(1), a.e(2), a.n(3), a.n(4), a.n(5));
+     }},
+    {"glGenerateMipmap", [](R&, const A& a) { glGenerateMipmap(a.e(0)); }},
+    {"glGenSamplers", [](R& r, const A& a) { r.gen(object::sampler, a); }},
+    {"glDeleteSamplers",
+     [](R& r, const A& a) { r.remove(object::sampler, a); }},
+    {"glBindSampler",
+     [](R& r, const A& a) { glBindSampler(a.u(0), r.m_samplers(a.u(1))); }},
+
+    // framebuffers
+    {"glGenFramebuffers",
+     [](R& r, const A& a) { r.gen(object::framebuffer, a); }},
+    {"glDeleteFramebuffers",
+     [](R& r, const A& a) { r.remove(object::framebuffer, a); }},
+    {"glBindFramebuffer",
+     [](R& r, const A& a) {
+       glBindFramebuffer(a.e(0), r.m_framebuffers(a.u(1)));
+     }},
+    {"glGenRenderbuffers",
+     [](R& r, const A& a) { r.gen(object::renderbuffer, a); }},
+    {"glDeleteRenderbuffers",
+     [](R& r, const A& a) { r.remove(object::renderbuffer, a); }},
+    {"glBindRenderbuffer",
+     [](R& r, const A& a) {
+       glBindRenderbuffer(a.e(0), r.m_renderbuffers(a.u(1)));
+     }},
+    {"glRenderbufferStorage",
+     [](R&, const A& a) {
+       glRenderbufferStorage(a.e(0), a.e(1), a.n(2), a.n(3));
+     }},
+    {"glFramebufferRenderbuffer",
+     [](R& r, const A& a) {
+       glFramebufferRenderbuffer(
+         a.e(0), a.e(1), a.e(2), r.m_renderbuffers(a.u(3)));
+     }},
+    {"glFramebufferTexture2D",
+     [](R& r, const A& a) {
+       glFramebufferTexture2D(
+         a.e(0), a.e(1), a.e(2), r.m_textures(a.u(3)), a.i(4));
+     }},
+    {"glCheckFramebufferStatus",
+     [](R&, const A& a) { glCheckFramebufferStatus(a.e(0)); }},
+    {"glReadPixels",
+     [](R& r, const A& a) {
+       // client memory is gone, read into scratch instead
+       const void* dst = a.data(6);
+       if (!r.m_packBuffer)
+         dst = r.scratch(size_t(a.n(2)) * size_t(a.n(3)) * 16);
+       glReadPixels(
+         a.i(0), a.i(1), a.n(2), a.n(3), a.e(4), a.e(5),
+         const_cast<void*>(dst));
+     }},
+
+    // shaders and programs
+    {"glCreateShader",
+     [](R& r, const A& a) {
+       r.m_programs.add(gl::GLuint(a.ret().bits), glCreateShader(a.e(0)));
+     }},
+    {"glShaderSource",
+     [](R& r, const A& a) {
+       r.m_strings.clear();
+       r.m_lengths.clear();
+       for (auto& b : a.blobs()) {
+         r.m_strings.push_back(b.data);
+         r.m_lengths.push_back(gl::GLint(b.size));
+       }
+       glShaderSource(
+         r.m_programs(a.u(0)), gl::GLsizei(r.m_strings.size()),
+         r.m_strings.data(), r.m_lengths.data());
+     }},
+    {"glCompileShader",
+     [](R& r, const A& a) { glCompileShader(r.m_programs(a.u(0))); }},
+    {"glGetShaderiv",
+     [](R& r, const A& a) {
+       glGetShaderiv(r.m_programs(a.u(0)), a.e(1), r.scratch<gl::GLint>());
+     }},
+    {"glGetShaderInfoLog",
+     [](R& r, const A& a) {
+       gl::GLsizei size = a.n(1);
+       glGetShaderInfoLog(
+         r.m_programs(a.u(0)), size, nullptr, r.scratch(size_t(size)));
+     }},
+    {"glDeleteShader",
+     [](R& r, const A& a) {
+       glDeleteShader(r.m_programs(a.u(0)));
+       r.m_programs.remove(a.u(0));
+     }},
+    {"glCreateProgram",
+     [](R& r, const A& a) {
+       r.m_programs.add(gl::GLuint(a.ret().bits), glCreateProgram());
+     }},
+    {"glAttachShader",
+     [](R& r, const A& a) {
+       glAttachShader(r.m_programs(a.u(0)), r.m_programs(a.u(1)));
+     }},
+    {"glDetachShader",
+     [](R& r, const A& a) {
+       glDetachShader(r.m_programs(a.u(0)), r.m_programs(a.u(1)));
+     }},
+    {"glBindAttribLocation",
+     [](R& r, const A& a) {
+       glBindAttribLocation(
+         r.m_programs(a.u(0)), a.u(1), a.data<gl::GLchar>(2));
+     }},
+    {"glLinkProgram",
+     [](R& r, const A& a) { glLinkProgram(r.m_programs(a.u(0))); }},
+    {"glGetProgramiv",
+     [](R& r, const A& a) {
+       glGetProgramiv(r.m_programs(a.u(0)), a.e(1), r.scratch<gl::GLint>());
+     }},
+    {"glGetProgramInfoLog",
+     [](R& r, const A& a) {
+       gl::GLsizei size = a.n(1);
+       glGetProgramInfoLog(
+         r.m_programs(a.u(0)), size, nullptr, r.scratch(size_t(size)));
+     }},
+    {"glUseProgram",
+     [](R& r, const A& a) {
+       r.m_program = a.u(0);
+       glUseProgram(r.m_programs(a.u(0)));
+     }},
+    {"glDeleteProgram",
+     [](R& r, const A& a) {
+       glDeleteProgram(r.m_programs(a.u(0)));
+       r.m_programs.remove(a.u(0));
+     }},
+    {"glGetUniformLocation",
+     [](R& r, const A& a) {
+       gl::GLint loc =
+         glGetUniformLocation(r.m_programs(a.u(0)), a.data<gl::GLchar>(1));
+       r.m_locations[locationKey(a.u(0), gl::GLint(a.ret().bits))] = loc;
+     }},
+    {"glGetAttribLocation",
+     [](R& r, const A& a) {
+       glGetAttribLocation(r.m_programs(a.u(0)), a.data<gl::GLchar>(1));
+     }},
+
+    // uniforms
+    {"glUniform1i",
+     [](R& r, const A& a) { glUniform1i(r.location(a.i(0)), a.i(1)); }},
+    {"glUniform1ui",
+     [](R& r, const A& a) { glUniform1ui(r.location(a.i(0)), a.u(1)); }},
+    {"glUniform1f",
+     [](R& r, const A& a) { glUniform1f(r.location(a.i(0)), a.f(1)); }},
+    {"glUniform2f",
+     [](R& r, const A& a) {
+       glUniform2f(r.location(a.i(0)), a.f(1), a.f(2));
+     }},
+    {"glUniform3f",
+     [](R& r, const A& a) {
+       glUniform3f(r.location(a.i(0)), a.f(1), a.f(2), a.f(3));
+     }},
+    {"glUniform4f",
+     [](R& r, const A& a) {
+       glUniform4f(r.location(a.i(0)), a.f(1), a.f(2), a.f(3), a.f(4));
+     }},
+    {"glUniform1fv",
+     [](R& r, const A& a) {
+       glUniform1fv(r.location(a.i(0)), a.n(1), a.data<gl::GLfloat>(2));
+     }},
+    {"glUniform2fv",
+     [](R& r, const A& a) {
+       glUniform2fv(r.location(a.i(0)), a.n(1), a.data<gl::GLfloat>(2));
+     }},
+    {"glUniform3fv",
+     [](R& r, const A& a) {
+       glUniform3fv(r.location(a.i(0)), a.n(1), a.data<gl::GLfloat>(2));
+     }},
+    {"glUniform4fv",
+     [](R& r, const A& a) {
+       glUniform4fv(r.location(a.i(0)), a.n(1), a.data<gl::GLfloat>(2));
+     }},
+    {"glUniform1iv",
+     [](R& r, const A& a) {
+       glUniform1iv(r.location(a.i(0)), a.n(1), a.data<gl::GLint>(2));
+     }},
+    {"glUniformMatrix3fv",
+     [](R& r, const A& a) {
+       glUniformMatrix3fv(
+         r.location(a.i(0)), a.n(1), a.b(2), a.data<gl::GLfloat>(3));
+     }},
+    {"glUniformMatrix4fv",
+     [](R& r, const A& a) {
+       glUniformMatrix4fv(
+         r.location(a.i(0)), a.n(1), a.b(2), a.data<gl::GLfloat>(3));
+     }},
+
+    // draws
+    {"glDrawArrays",
+     [](R&, const A& a) { glDrawArrays(a.e(0), a.i(1), a.n(2)); }},
+    {"glDrawArraysInstanced",
+     [](R&, const A& a) {
+       glDrawArraysInstanced(a.e(0), a.i(1), a.n(2), a.n(3));
+     }},
+    {"glDrawElements",
+     [](R&, const A& a) {
+       glDrawElements(a.e(0), a.n(1), a.e(2), a.data(3));
+     }},
+    {"glDrawElementsInstanced",
+     [](R&, const A& a) {
+       glDrawElementsInstanced(a.e(0), a.n(1), a.e(2), a.data(3), a.n(4));
+     }},
+
+    // queries and sync
+    {"glGenQueries", [](R& r, const A& a) { r.gen(object::query, a); }},
+    {"glDeleteQueries",
+     [](R& r, const A& a) { r.remove(object::query, a); }},
+    {"glQueryCounter",
+     [](R& r, const A& a) { glQueryCounter(r.m_queries(a.u(0)), a.e(1)); }},
+    {"glBeginQuery",
+     [](R& r, const A& a) { glBeginQuery(a.e(0), r.m_queries(a.u(1))); }},
+    {"glEndQuery", [](R&, const A& a) { glEndQuery(a.e(0)); }},
+    {"glGetQueryObjectiv",
+     [](R& r, const A& a) {
+       glGetQueryObjectiv(r.m_queries(a.u(0)), a.e(1), r.scratch<gl::GLint>());
+     }},
+    {"glGetQueryObjectui64v",
+     [](R& r, const A& a) {
+       glGetQueryObjectui64v(
+         r.m_queries(a.u(0)), a.e(1), r.scratch<gl::GLuint64>());
+     }},
+    {"glFenceSync",
+     [](R& r, const A& a) {
+       r.m_syncs[a.ret().bits] =
+         glFenceSync(a.e(0), a.get<UnusedMask>(1));
+     }},
+    {"glClientWaitSync",
+     [](R& r, const A& a) {
+       if (gl::GLsync s = r.sync(a.raw(0)))
+         glClientWaitSync(s, a.get<SyncObjectMask>(1), a.get<gl::GLuint64>(2));
+     }},
+    {"glWaitSync",
+     [](R& r, const A& a) {
+       if (gl::GLsync s = r.sync(a.raw(0)))
+         glWaitSync(s, a.get<UnusedMask>(1), a.get<gl::GLuint64>(2));
+     }},
+    {"glDeleteSync",
+     [](R& r, const A& a) {
+       auto traced = a.raw(0);
+       if (gl::GLsync s = r.sync(traced)) {
+         glDeleteSync(s);
+         r.m_syncs.erase(traced.bits);
+       }
+     }},
+    {"glFlush", [](R&, const A&) { glFlush(); }},
+    {"glFinish", [](R&, const A&) { glFinish(); }},
+
+    // queries of state, replayed for their cost
+    {"glGetError", [](R&, const A&) { glGetError(); }},
+    {"glGetIntegerv",
+     [](R& r, const A& a) { glGetIntegerv(a.e(0), r.scratch<gl::GLint>()); }},
+    {"glGetInteger64v",
+     [](R& r, const A& a) {
+       glGetInteger64v(a.e(0), r.scratch<gl::GLint64>());
+     }},
+    {"glGetFloatv",
+     [](R& r, const A& a) { glGetFloatv(a.e(0), r.scratch<gl::GLfloat>()); }},
+    {"glGetString", [](R&, const A& a) { glGetString(a.e(0)); }},
+    {"glGetStringi", [](R&, const A& a) { glGetStringi(a.e(0), a.u(1)); }},
+
+    // debug annotations
+    {"glPushDebugGroup",
+     [](R&, const A& a) {
+       glPushDebugGroup(a.e(0), a.u(1), a.n(2), a.data<gl::GLchar>(3));
+     }},
+    {"glPopDebugGroup", [](R&, const A&) { glPopDebugGroup(); }},
+    {"glObjectLabel",
+     [](R& r, const A& a) {
+       glObjectLabel(
+         a.e(0), r.labelled(a.e(0), a.u(1)), a.n(2), a.data<gl::GLchar>(3));
+     }},
+    // the callback pointed into the traced process
+    {"glDebugMessageCallback", [](R&, const A&) {}},
+    {"glDebugMessageControl", [](R&, const A&) {}},
+  };
+  auto it = table.find(name);
+  return it == table.end() ? nullptr : it->second;
+}
+
+struct ReplayOptions {
+  std::string tracePath;
+  uint64_t loops = 1;
+  int width      = 800;
+  int height     = 600;
+  bool strict    = false;
+  std::string out;        // JSON report, empty = stdout
+  std::string framesOut;  // per-frame times as CSV
+  std::string capture;    // last frame as PPM
+
+  static void usage(std::ostream& out, const char* argv0) {
+    out << "usage: " << argv0 << " TRACE [options]\n"
+        << "  --loops N          replay the frames N times (default 1)\n"
+        << "  --size WxH         framebuffer size, use the recorded one\n"
+        << "  --out FILE         write the JSON report to FILE\n"
+        << "  --frames-out FILE  write per-frame times to FILE as CSV\n"
+        << "  --capture FILE     save the last frame (PPM)\n"
+        << "  --strict           fail if the trace has calls we can't "
+           "replay\n";
+  }
+
+  static ReplayOptions fromArgs(int argc, char** argv) {
+    ReplayOptions opts;
+    for (int i = 1; i < argc; i++) {
+      std::string_view arg = argv[i];
+      auto value           = [&]() -> std::string {
+        if (i + 1 >= argc)
+          throw std::invalid_argument(std::string(arg) + " needs a value");
+        return argv[++i];
+      };
+
+      if (arg == "--loops") {
+        opts.loops = std::stoull(value());
+      }
+      else if (arg == "--size") {
+        std::string v = value();
+        if (std::sscanf(v.c_str(), "%dx%d", &opts.width, &opts.height) != 2)
+          throw std::invalid_argument("--size expects WxH");
+      }
+      else if (arg == "--out") {
+        opts.out = value();
+      }
+      else if (arg == "--frames-out") {
+        opts.framesOut = value();
+      }
+      else if (arg == "--capture") {
+        opts.capture = value();
+      }
+      else if (arg == "--strict") {
+        opts.strict = true;
+      }
+      else if (arg == "--help" || arg == "-h") {
+        usage(std::cout, argv[0]);
+        std::exit(0);
+      }
+      else if (opts.tracePath.empty() && !arg.starts_with("--")) {
+        opts.tracePath = arg;
+      }
+      else {
+        usage(std::cerr, argv[0]);
+        throw std::invalid_argument("Unknown option " + std::string(arg));
+      }
+    }
+    if (opts.tracePath.empty()) {
+      usage(std::cerr, argv[0]);
+      throw std::invalid_argument("No trace given");
+    }
+    return opts;
+  }
+};
+
+int main(int argc, char** argv) try {
+  auto opts = ReplayOptions::fromArgs(argc, argv);
+  trace::Reader reader(opts.tracePath);
+  auto& ends = reader.frameEnds();
+  if (ends.size() < 2)
+    throw std::runtime_error("Trace needs at least two frames to time");
+
+  oglc::AppOptions app;
+  app.backend = oglc::Backend::headless;
+  app.width   = opts.width;
+  app.height  = opts.height;
+  oglc::Context ctx(app, "oglc-replay");
+
+  Replayer replayer(reader);
+  for (auto& name : replayer.unsupported())
+    std::cerr << "can't replay " << name << ", skipping it\n";
+  if (opts.strict && !replayer.unsupported().empty())
+    return 1;
+
+  // setup and the first frame
+  replayer.run(0, ends[0]);
+  ctx.swap();
+
+  std::ofstream frames_out;
+  if (!opts.framesOut.empty()) {
+    frames_out.open(opts.framesOut);
+    if (!frames_out)
+      throw std::runtime_error("Failed to open " + opts.framesOut);
+    frames_out << "loop,frame,ms\n";
+  }
+
+  oglc::FrameStats times;
+  times.reserve(opts.loops * (ends.size() - 1));
+  for (uint64_t loop = 0; loop < opts.loops; loop++) {
+    for (size_t f = 1; f < ends.size(); f++) {
+      uint64_t start = oglc::monotonicNanos();
+      replayer.run(ends[f - 1], ends[f]);
+      ctx.swap();
+      uint64_t ns = oglc::monotonicNanos() - start;
+      times.record(ns);
+      if (frames_out)
+        frames_out << loop << "," << f << "," << ns / 1e6 << "\n";
+    }
+  }
+  gl::glFinish();
+  if (!opts.capture.empty())
+    oglc::readFramebuffer(ctx.width(), ctx.height()).writePpm(opts.capture);
+  // whatever the example cleaned up after its last frame
+  replayer.run(ends.back(), reader.calls().size());
+
+  std::ofstream file;
+  if (!opts.out.empty()) {
+    file.open(opts.out);
+    if (!file)
+      throw std::runtime_error("Failed to open " + opts.out);
+  }
+  std::ostream& out = opts.out.empty() ? std::cout : file;
+  double frame_calls =
+    double(ends.back() - ends[0]) / double(ends.size() - 1);
+  double mean = times.meanMs();
+  out << "{\n"
+      << "  \"trace\": ";
+  oglc::writeJsonString(out, opts.tracePath);
+  out << ",\n"
+      << "  \"renderer\": ";
+  oglc::writeJsonString(out, ctx.renderer());
+  out << ",\n"
+      << "  \"width\": " << ctx.width() << ",\n"
+      << "  \"height\": " << ctx.height() << ",\n"
+      << "  \"loops\": " << opts.loops << ",\n"
+      << "  \"frames\": " << times.count() << ",\n"
+      << "  \"mean_ms\": " << mean << ",\n"
+      << "  \"p50_ms\": " << times.percentileMs(50) << ",\n"
+      << "  \"p99_ms\": " << times.percentileMs(99) << ",\n"
+      << "  \"p999_ms\": " << times.percentileMs(99.9) << ",\n"
+      << "  \"max_ms\": " << times.percentileMs(100) << ",\n"
+      << "  \"fps\": " << (mean > 0 ? 1000.0 / mean : 0.0) << ",\n"
+      << "  \"gl_calls_per_frame\": " << frame_calls << ",\n"
+      << "  \"skipped_calls\": " << replayer.skipped() << "\n}\n";
+  return 0;
+}
+catch (const std::exception& e) {
+  std::cerr << e.what() << "\n";
+  return 1;
+}
@@ -0,0 +1,188 @@
+// Bakes an image into a KTX2 texture with its mip chain precomputed, so
+// loading it at runtime is a straight upload: no decoding, and no
+// glGenerateMipmap. oglc_bake_textures() in CMake runs this at build time.
+//
+//   oglc-texbake INPUT OUTPUT [options]
+//
+//   --format F    rgba8 (default), bc1, bc3 or bc7
+//   --quality Q   fast, normal (default) or high, for block compression
+//   --filter F    box (default), kaiser or lanczos, for the mips
+//   --srgb        the colours are sRGB encoded, and sampled as such
+//   --premultiplied  the colours are already multiplied by alpha
+//   --no-mips     only the full size level
+//
+// INPUT is anything stb_image reads. Mips are filtered in linear space
+// with --srgb, and weighted by alpha unless it is premultiplied.
+//
+// An OUTPUT ending in .qoi is written as a QOI image instead: lossless
+// RGBA8 at full size only, to be decoded at load time, so only --srgb
+// applies.
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "oglc/bcn.hpp"
+#include "oglc/ktx.hpp"
+#include "oglc/mipmap.hpp"
+#include "oglc/qoi.hpp"
+#include "oglc/workers.hpp"
+#include "stb_image.h"
+
+namespace {
+  struct image {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;  // RGBA8
+  };
+
+  image load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      throw std::runtime_error("Failed to open " + path);
+    std::vector<uint8_t> encoded(
+      (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    image img {};
+    int channels    = 0;
+    stbi_uc* pixels = stbi_load_from_memory(
+      encoded.data(), int(encoded.size()), &img.width, &img.height, &channels,
+      4);
+    if (!pixels)
+      throw std::runtime_error(path + ": " + stbi_failure_reason());
+    img.pixels.assign(pixels, pixels + size_t(img.width) * img.height * 4);
+    stbi_image_free(pixels);
+    return img;
+  }
+
+  void write(const std::string& path, std::span<const uint8_t> blob) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(
+      reinterpret_cast<const char*>(blob.data()), std::streamsize(blob.size()));
+    if (!out)
+      throw std::runtime_error("Failed to write " + path);
+  }
+
+  using oglc::ktx::format;
+
+  struct format_choice {
+    std::string_view name;
+    format linear;
+    format srgb;
+    oglc::BlockFormat block;  // if compressed
+  };
+
+  const format_choice formats[] = {
+    {"rgba8", format::rgba8, format::srgb8_alpha8, {}},
+    {"bc1", format::bc1, format::bc1_srgb, oglc::BlockFormat::bc1},
+    {"bc3", format::bc3, format::bc3_srgb, oglc::BlockFormat::bc3},
+    {"bc7", format::bc7, format::bc7_srgb, oglc::BlockFormat::bc7},
+  };
+}  // namespace
+
+int main(int argc, char** argv) try {
+  std::vector<std::string> paths;
+  const format_choice* choice = &formats[0];
+  oglc::BlockQuality effort   = oglc::BlockQuality::normal;
+  oglc::MipOptions filter;
+  bool mips = true, usage = false;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg   = argv[i];
+    std::string_view value = i + 1 < argc ? argv[i + 1] : "";
+    if (arg == "--format") {
+      auto it = std::find_if(
+        std::begin(formats), std::end(formats),
+        [&](auto& f) { return f.name == value; });
+      usage |= it == std::end(formats);
+      choice = it == std::end(formats) ? choice : it;
+      i++;
+    }
+    else if (arg == "--quality") {
+      if (value == "fast")
+        effort = oglc::BlockQuality::fast;
+      else if (value == "normal")
+        effort = oglc::BlockQuality::normal;
+      else if (value == "high")
+        effort = oglc::BlockQuality::high;
+      else
+        usage = true;
+      i++;
+    }
+    else if (arg == "--filter") {
+      if (value == "box")
+        filter.filter = oglc::MipFilter::box;
+      else if (value == "kaiser")
+        filter.filter = oglc::MipFilter::kaiser;
+      else if (value == "lanczos")
+        filter.filter = oglc::MipFilter::lanczos;
+      else
+        usage = true;
+      i++;
+    }
+    else if (arg == "--srgb") {
+      filter.srgb = true;
+    }
+    else if (arg == "--premultiplied") {
+      filter.premultiplied = true;
+    }
+    else if (arg == "--no-mips") {
+      mips = false;
+    }
+    else {
+      paths.emplace_back(arg);
+    }
+  }
+  if (usage || paths.size() != 2) {
+    std::cerr << "usage: oglc-texbake INPUT OUTPUT [--format rgba8|bc1|bc3|"
+                 "bc7] [--quality fast|normal|high] [--filter box|kaiser|"
+                 "lanczos] [--srgb] [--premultiplied] [--no-mips]\n";
+    return 2;
+  }
+  format fmt = filter.srgb ? choice->srgb : choice->linear;
+
+  image base = load(paths[0]);
+  std::vector<uint8_t> blob;
+  if (paths[1].ends_with(".qoi")) {
+    blob = oglc::qoi::encode(base.pixels, base.width, base.height, filter.srgb);
+    write(paths[1], blob);
+    return 0;
+  }
+
+  int count  = mips ? oglc::mipLevels(base.width, base.height) : 1;
+  std::vector<uint8_t> chain(
+    oglc::mipChainBytes(base.width, base.height, count));
+  std::copy(base.pixels.begin(), base.pixels.end(), chain.begin());
+  oglc::WorkerPool pool;
+  oglc::generateMips(chain, base.width, base.height, count, filter, &pool);
+
+  // block compression works on the texels as stored, sRGB or not
+  std::vector<std::vector<uint8_t>> compressed(count);
+  std::vector<oglc::ktx::level> levels;
+  size_t offset = 0;
+  for (int i = 0; i < count; i++) {
+    int w = oglc::mipSize(base.width, i), h = oglc::mipSize(base.height, i);
+    std::span<const uint8_t> pixels(&chain[offset], size_t(w) * h * 4);
+    offset += pixels.size();
+    if (oglc::ktx::isCompressed(fmt)) {
+      compressed[i].resize(oglc::compressedBytes(choice->block, w, h));
+      oglc::compressImage(
+        pixels, w, h, choice->block, effort, compressed[i], &pool);
+      pixels = compressed[i];
+    }
+    levels.push_back({w, h, pixels});
+  }
+  blob = oglc::ktx::write(fmt, levels);
+  write(paths[1], blob);
+  return 0;
+}
+catch (const std::exception& e) {
+  std::cerr << "oglc-texbake: " << e.what() << "\n";
+  return 1;
+}